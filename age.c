@@ -0,0 +1,340 @@
+/*
+    Envelhecimento de imagens Ext2 (aging).
+
+    Cria uma imagem (mkfs embutido) e aplica uma sequência determinística de criações,
+    acréscimos, remoções e cópias de arquivos com tamanhos em distribuição log-normal,
+    usando os próprios caminhos do shell (comando_touch, comando_rm, comando_cp e
+    anexar_ao_arquivo). A ocupação é mantida perto de um alvo, o que provoca a rotatividade
+    que fragmenta arquivos, espaço livre e diretórios. Ao final grava uma cópia da imagem
+    (snapshot) e as métricas de fragmentação em JSON.
+
+    Uso: ext2age [-s MiB] [-n operações] [-r semente] [-u ocupação_%] [-m mediana_bytes]
+                 [-x máximo_bytes] [-k intervalo] [-o snapshot.img] [-j metricas.json] <imagem>
+*/
+
+#include "motor.h"
+
+#include <math.h>
+
+#define AGING_ARQUIVOS_POR_DIR 48 // Entradas por diretório (cada diretório ocupa um bloco)
+
+// Parâmetros do envelhecimento.
+struct configuracao_aging {
+    unsigned long tamanho_mib;
+    unsigned long operacoes;
+    uint64_t semente;
+    unsigned int ocupacao_alvo;     // Porcentagem de blocos em uso a ser mantida
+    unsigned long mediana_bytes;    // Mediana do tamanho dos arquivos criados
+    unsigned long maximo_bytes;     // Tamanho máximo de um arquivo
+    unsigned long intervalo_metricas; // A cada quantas operações registrar métricas (0 = só no fim)
+    const char *snapshot;
+    const char *saida_json;
+};
+
+// Arquivo vivo criado pelo envelhecimento.
+struct arquivo_vivo {
+    char caminho[32];
+    uint32_t tamanho;
+};
+
+// Estado do envelhecimento.
+struct estado_aging {
+    int fd;
+    struct ext2_super_block sb;
+    struct ext2_group_desc *bgdt;
+    struct arquivo_vivo *arquivos;
+    uint32_t num_arquivos;
+    uint32_t capacidade;
+    uint32_t proximo_nome;          // Contador para nomes únicos
+    uint32_t diretorio_atual;       // Índice do diretório onde os arquivos novos são criados
+    uint32_t arquivos_no_diretorio;
+    uint64_t contagem[4];           // Operações feitas por tipo
+    uint64_t falhas;
+    char *dados;                    // Conteúdo usado nas escritas
+};
+
+enum { OP_CRIAR, OP_ACRESCENTAR, OP_REMOVER, OP_COPIAR };
+static const char *nomes_operacoes[] = { "criar", "acrescentar", "remover", "copiar" };
+static const unsigned int pesos_operacoes[] = { 40, 20, 30, 10 }; // Mistura padrão (%)
+
+static uint64_t estado_aleatorio;
+
+static uint64_t aleatorio(void) { // xorshift64*
+    estado_aleatorio ^= estado_aleatorio >> 12;
+    estado_aleatorio ^= estado_aleatorio << 25;
+    estado_aleatorio ^= estado_aleatorio >> 27;
+    return estado_aleatorio * 2685821657736338717ull;
+}
+
+static double aleatorio_unitario(void) {
+    return ((aleatorio() >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+// Tamanho log-normal (sigma 1,5) com a mediana dada, limitado a 'maximo'.
+static uint32_t tamanho_lognormal(unsigned long mediana, unsigned long maximo) {
+    double normal = sqrt(-2.0 * log(aleatorio_unitario())) * cos(2.0 * M_PI * aleatorio_unitario());
+    double tamanho = (double)mediana * exp(1.5 * normal);
+    if (tamanho > (double)maximo) tamanho = (double)maximo;
+    return (uint32_t)tamanho;
+}
+
+static unsigned int ocupacao_atual(const struct estado_aging *e) {
+    uint64_t usados = e->sb.s_blocks_count - e->sb.s_free_blocks_count;
+    return (unsigned int)(usados * 100 / e->sb.s_blocks_count);
+}
+
+// Cada operação roda dentro de uma transação, como no shell: transacao_iniciar() antes
+// do comando e concluir() com o resultado dele. Retorna 0 se o comando e a gravação
+// tiveram sucesso.
+static int concluir(struct estado_aging *e, int resultado_comando) {
+    if (transacao_confirmar(e->fd) != 0) return 1;
+    return resultado_comando != 0;
+}
+
+// Cria os diretórios /age/aX/dY onde os próximos arquivos serão criados.
+static int preparar_diretorio(struct estado_aging *e) {
+    char caminho[32];
+    uint32_t indice = e->diretorio_atual;
+    if (indice % AGING_ARQUIVOS_POR_DIR == 0) {
+        snprintf(caminho, sizeof(caminho), "/age/a%u", indice / AGING_ARQUIVOS_POR_DIR);
+        transacao_iniciar();
+        if (concluir(e, comando_mkdir(e->fd, &e->sb, e->bgdt, EXT2_ROOT_INO, "/", caminho)) != 0) return -1;
+    }
+    snprintf(caminho, sizeof(caminho), "/age/a%u/d%u", indice / AGING_ARQUIVOS_POR_DIR, indice % AGING_ARQUIVOS_POR_DIR);
+    transacao_iniciar();
+    if (concluir(e, comando_mkdir(e->fd, &e->sb, e->bgdt, EXT2_ROOT_INO, "/", caminho)) != 0) return -1;
+    e->arquivos_no_diretorio = 0;
+    return 0;
+}
+
+static struct arquivo_vivo* novo_arquivo(struct estado_aging *e) {
+    if (e->num_arquivos == e->capacidade) {
+        uint32_t nova = e->capacidade ? e->capacidade * 2 : 1024;
+        struct arquivo_vivo *novos = (struct arquivo_vivo *)realloc(e->arquivos, nova * sizeof(struct arquivo_vivo));
+        if (!novos) return NULL;
+        e->arquivos = novos;
+        e->capacidade = nova;
+    }
+    if (e->arquivos_no_diretorio == AGING_ARQUIVOS_POR_DIR) {
+        e->diretorio_atual++;
+        if (preparar_diretorio(e) != 0) return NULL;
+    }
+    struct arquivo_vivo *a = &e->arquivos[e->num_arquivos];
+    snprintf(a->caminho, sizeof(a->caminho), "/age/a%u/d%u/f%u", e->diretorio_atual / AGING_ARQUIVOS_POR_DIR,
+             e->diretorio_atual % AGING_ARQUIVOS_POR_DIR, e->proximo_nome++);
+    a->tamanho = 0;
+    e->arquivos_no_diretorio++;
+    return a;
+}
+
+// Acrescenta 'tamanho' bytes ao arquivo pelo mesmo caminho de escrita do shell.
+static int acrescentar(struct estado_aging *e, struct arquivo_vivo *a, uint32_t tamanho) {
+    if (tamanho == 0) return 0;
+    uint32_t inode_num = path_to_inode_number(e->fd, &e->sb, e->bgdt, EXT2_ROOT_INO, a->caminho, NULL);
+    struct ext2_inode inode;
+    if (inode_num == 0 || read_inode(e->fd, &e->sb, e->bgdt, inode_num, &inode) != 0) return -1;
+    transacao_iniciar();
+    int resultado = concluir(e, anexar_ao_arquivo(e->fd, &e->sb, e->bgdt, inode_num, &inode, e->dados, tamanho));
+    a->tamanho = inode.i_size;
+    return resultado;
+}
+
+static int operacao_criar(struct estado_aging *e, const struct configuracao_aging *cfg) {
+    struct arquivo_vivo *a = novo_arquivo(e);
+    if (!a) return -1;
+    char caminho[32];
+    snprintf(caminho, sizeof(caminho), "%s", a->caminho);
+    transacao_iniciar();
+    if (concluir(e, comando_touch(e->fd, &e->sb, e->bgdt, EXT2_ROOT_INO, "/", caminho)) != 0) return -1;
+    e->num_arquivos++;
+    return acrescentar(e, a, tamanho_lognormal(cfg->mediana_bytes, cfg->maximo_bytes));
+}
+
+static int operacao_acrescentar(struct estado_aging *e, const struct configuracao_aging *cfg) {
+    struct arquivo_vivo *a = &e->arquivos[aleatorio() % e->num_arquivos];
+    uint32_t tamanho = tamanho_lognormal(cfg->mediana_bytes / 4 + 1, cfg->maximo_bytes);
+    if (a->tamanho + (uint64_t)tamanho > cfg->maximo_bytes) tamanho = (uint32_t)(cfg->maximo_bytes - a->tamanho);
+    return acrescentar(e, a, tamanho);
+}
+
+static int operacao_remover(struct estado_aging *e) {
+    uint32_t indice = aleatorio() % e->num_arquivos;
+    transacao_iniciar();
+    int resultado = concluir(e, comando_rm(e->fd, &e->sb, e->bgdt, EXT2_ROOT_INO, e->arquivos[indice].caminho));
+    e->arquivos[indice] = e->arquivos[--e->num_arquivos];
+    return resultado;
+}
+
+static int operacao_copiar(struct estado_aging *e) {
+    struct arquivo_vivo origem = e->arquivos[aleatorio() % e->num_arquivos];
+    struct arquivo_vivo *a = novo_arquivo(e);
+    if (!a) return -1;
+    transacao_iniciar();
+    if (concluir(e, comando_cp(e->fd, &e->sb, e->bgdt, EXT2_ROOT_INO, origem.caminho, a->caminho)) != 0) return -1;
+    a->tamanho = origem.tamanho;
+    e->num_arquivos++;
+    return 0;
+}
+
+// Escolhe a próxima operação pela mistura padrão, puxando a ocupação para o alvo.
+static int escolher_operacao(const struct estado_aging *e, const struct configuracao_aging *cfg) {
+    if (e->num_arquivos == 0) return OP_CRIAR;
+    unsigned int ocupacao = ocupacao_atual(e);
+    if (ocupacao >= cfg->ocupacao_alvo) return OP_REMOVER;
+    unsigned int sorteio = (unsigned int)(aleatorio() % 100);
+    unsigned int acumulado = 0;
+    for (int op = 0; op < 4; ++op) {
+        acumulado += pesos_operacoes[op];
+        if (sorteio < acumulado) {
+            // Longe do alvo, remoções viram criações para encher a imagem.
+            if (op == OP_REMOVER && ocupacao + 10 < cfg->ocupacao_alvo) return OP_CRIAR;
+            return op;
+        }
+    }
+    return OP_CRIAR;
+}
+
+static void imprimir_metricas_json(FILE *saida, const struct metricas_fragmentacao *m,
+                                   unsigned long operacao, unsigned int ocupacao) {
+    fprintf(saida, "{\"operacao\": %lu, \"ocupacao_pct\": %u, \"arquivos\": %llu, \"arquivos_vazios\": %llu, "
+                   "\"arquivos_fragmentados\": %llu, \"extensoes_por_arquivo\": %.3f, \"max_extensoes\": %llu, "
+                   "\"layout_score\": %.4f, \"diretorios\": %llu, \"entradas_mortas\": %llu, "
+                   "\"bytes_diretorio_ocupados_pct\": %.2f, \"bytes_entradas_mortas_pct\": %.2f, "
+                   "\"extensoes_livres\": %llu, \"extensao_livre_media\": %.1f, \"maior_extensao_livre\": %llu}",
+            operacao, ocupacao, (unsigned long long)m->arquivos, (unsigned long long)m->arquivos_vazios,
+            (unsigned long long)m->arquivos_fragmentados,
+            m->arquivos ? (double)m->extensoes / m->arquivos : 0.0, (unsigned long long)m->max_extensoes,
+            m->pares_total ? (double)m->pares_contiguos / m->pares_total : 1.0,
+            (unsigned long long)m->diretorios, (unsigned long long)m->entradas_mortas,
+            m->bytes_diretorios ? 100.0 * m->bytes_entradas_vivas / m->bytes_diretorios : 0.0,
+            m->bytes_diretorios ? 100.0 * m->bytes_entradas_mortas / m->bytes_diretorios : 0.0,
+            (unsigned long long)m->extensoes_livres,
+            m->extensoes_livres ? (double)m->blocos_livres / m->extensoes_livres : 0.0,
+            (unsigned long long)m->maior_extensao_livre);
+}
+
+int main(int argc, char *argv[]) {
+    struct configuracao_aging cfg = { 256, 20000, 1, 80, 16384, 4u << 20, 0, NULL, NULL };
+    int opcao;
+
+    while ((opcao = getopt(argc, argv, "s:n:r:u:m:x:k:o:j:h")) != -1) {
+        switch (opcao) {
+            case 's': cfg.tamanho_mib = strtoul(optarg, NULL, 10); break;
+            case 'n': cfg.operacoes = strtoul(optarg, NULL, 10); break;
+            case 'r': cfg.semente = strtoull(optarg, NULL, 10); break;
+            case 'u': cfg.ocupacao_alvo = (unsigned int)strtoul(optarg, NULL, 10); break;
+            case 'm': cfg.mediana_bytes = strtoul(optarg, NULL, 10); break;
+            case 'x': cfg.maximo_bytes = strtoul(optarg, NULL, 10); break;
+            case 'k': cfg.intervalo_metricas = strtoul(optarg, NULL, 10); break;
+            case 'o': cfg.snapshot = optarg; break;
+            case 'j': cfg.saida_json = optarg; break;
+            default:
+                fprintf(stderr, "Uso: %s [-s MiB] [-n operações] [-r semente] [-u ocupação_%%] [-m mediana_bytes] "
+                                "[-x máximo_bytes] [-k intervalo] [-o snapshot.img] [-j metricas.json] <imagem>\n", argv[0]);
+                return opcao == 'h' ? 0 : 2;
+        }
+    }
+    if (optind >= argc || cfg.ocupacao_alvo == 0 || cfg.ocupacao_alvo > 95 || cfg.mediana_bytes == 0 ||
+        cfg.maximo_bytes == 0 || cfg.maximo_bytes > (64u << 20)) {
+        fprintf(stderr, "ext2age: parâmetros inválidos (ocupação 1-95%%, tamanhos entre 1 byte e 64 MiB)\n");
+        return 2;
+    }
+    const char *caminho_imagem = argv[optind];
+    estado_aleatorio = cfg.semente * 0x9E3779B97F4A7C15ull + 1;
+
+    modo_verboso = 0;
+    struct parametros_mkfs parametros = { (uint64_t)cfg.tamanho_mib << 20, 0, 0, 0, 0 };
+    if (criar_sistema_de_arquivos(caminho_imagem, &parametros) != 0) return 1;
+
+    struct estado_aging e;
+    unsigned int num_grupos = 0;
+    memset(&e, 0, sizeof(e));
+    e.fd = read_superblock(caminho_imagem, &e.sb);
+    if (e.fd < 0) return 1;
+    e.bgdt = read_block_group_descriptor_table(e.fd, &e.sb, &num_grupos);
+    e.dados = (char *)malloc(cfg.maximo_bytes);
+    if (!e.bgdt || !e.dados) return 1;
+    for (unsigned long i = 0; i < cfg.maximo_bytes; ++i) e.dados[i] = (char)('a' + i % 26);
+    construir_indice_livre(e.fd, &e.sb, e.bgdt);
+    motor_atual->metadados_adiados = 1; // Superbloco e descritores gravados ao final
+
+    FILE *saida = cfg.saida_json ? fopen(cfg.saida_json, "w") : stdout;
+    if (!saida) {
+        perror("ext2age: Erro ao abrir o arquivo de métricas");
+        return 1;
+    }
+
+    // Os comandos do shell imprimem mensagens de progresso: descarta durante a execução.
+    fflush(stdout);
+    int stdout_original = dup(STDOUT_FILENO);
+    int nulo = open("/dev/null", O_WRONLY);
+    if (saida == stdout) saida = fdopen(dup(STDOUT_FILENO), "w");
+    dup2(nulo, STDOUT_FILENO);
+    close(nulo);
+
+    fprintf(saida, "{\n  \"parametros\": {\"tamanho_mib\": %lu, \"operacoes\": %lu, \"semente\": %llu, "
+                   "\"ocupacao_alvo_pct\": %u, \"mediana_bytes\": %lu, \"maximo_bytes\": %lu},\n  \"progresso\": [",
+            cfg.tamanho_mib, cfg.operacoes, (unsigned long long)cfg.semente, cfg.ocupacao_alvo,
+            cfg.mediana_bytes, cfg.maximo_bytes);
+
+    uint64_t inicio = relogio_ns();
+    transacao_iniciar();
+    int resultado = concluir(&e, comando_mkdir(e.fd, &e.sb, e.bgdt, EXT2_ROOT_INO, "/", "/age"));
+    if (resultado == 0) resultado = preparar_diretorio(&e);
+    int primeira_linha = 1;
+    for (unsigned long i = 0; i < cfg.operacoes && resultado == 0; ++i) {
+        int op = escolher_operacao(&e, &cfg);
+        int falhou;
+        switch (op) {
+            case OP_CRIAR: falhou = operacao_criar(&e, &cfg); break;
+            case OP_ACRESCENTAR: falhou = operacao_acrescentar(&e, &cfg); break;
+            case OP_REMOVER: falhou = operacao_remover(&e); break;
+            default: falhou = operacao_copiar(&e); break;
+        }
+        e.contagem[op]++;
+        if (falhou) e.falhas++;
+
+        if (cfg.intervalo_metricas && (i + 1) % cfg.intervalo_metricas == 0) {
+            struct metricas_fragmentacao m;
+            if (medir_fragmentacao(e.fd, &e.sb, e.bgdt, &m) == 0) {
+                fprintf(saida, "%s\n    ", primeira_linha ? "" : ",");
+                imprimir_metricas_json(saida, &m, i + 1, ocupacao_atual(&e));
+                primeira_linha = 0;
+            }
+        }
+    }
+    double segundos = (relogio_ns() - inicio) / 1e9;
+    if (gravar_metadados_adiados(e.fd, &e.sb, e.bgdt) != 0) resultado = -1;
+    if (descritores_gravar_copias(e.fd) != 0) resultado = -1;
+
+    fflush(stdout);
+    dup2(stdout_original, STDOUT_FILENO);
+    close(stdout_original);
+
+    struct metricas_fragmentacao final;
+    if (resultado == 0 && medir_fragmentacao(e.fd, &e.sb, e.bgdt, &final) == 0) {
+        fprintf(saida, "\n  ],\n  \"operacoes_por_tipo\": {");
+        for (int op = 0; op < 4; ++op) {
+            fprintf(saida, "%s\"%s\": %llu", op ? ", " : "", nomes_operacoes[op], (unsigned long long)e.contagem[op]);
+        }
+        fprintf(saida, "},\n  \"falhas\": %llu,\n  \"segundos\": %.3f,\n  \"final\": ",
+                (unsigned long long)e.falhas, segundos);
+        imprimir_metricas_json(saida, &final, cfg.operacoes, ocupacao_atual(&e));
+        fprintf(saida, "\n}\n");
+    } else {
+        fprintf(stderr, "ext2age: envelhecimento interrompido por erro\n");
+        resultado = -1;
+    }
+    fclose(saida);
+
+    liberar_indice_livre();
+    liberar_mapas_diretorios();
+    liberar_transacoes();
+    free(e.arquivos);
+    free(e.dados);
+    liberar_descritores();
+    close(e.fd);
+
+    if (resultado == 0 && cfg.snapshot && copiar_imagem(caminho_imagem, cfg.snapshot) != 0) resultado = -1;
+    return resultado == 0 ? 0 : 1;
+}
@@ -0,0 +1,478 @@
+/*
+    Micro-benchmarks das primitivas do ext2shell.
+
+    Gera uma imagem Ext2 populada (diretórios e arquivos com conteúdo), mede cada
+    primitiva e cada comando do shell individualmente e grava os resultados em JSON
+    (ns/op, ops/s e percentis), para comparar execuções.
+
+    Uso: ext2bench [-s MiB] [-b bytes_por_bloco] [-d diretórios] [-a arquivos_por_diretório]
+                   [-z bytes_por_arquivo] [-n iterações] [-w diretório_de_trabalho] [-o saida.json]
+*/
+
+#include "motor.h"
+
+#include <dirent.h>
+
+// Amostras de uma medição (uma por operação, em nanossegundos).
+struct medicao {
+    const char *nome;
+    uint64_t *amostras;
+    uint32_t num_amostras;
+    uint32_t capacidade;
+    uint32_t falhas;      // Operações que retornaram erro
+};
+
+// Parâmetros da execução.
+struct configuracao_bench {
+    unsigned long tamanho_mib;
+    unsigned int tamanho_bloco;     // 1024, 2048 ou 4096
+    unsigned int num_diretorios;
+    unsigned int arquivos_por_diretorio;
+    unsigned long bytes_por_arquivo;
+    unsigned int iteracoes;
+    const char *diretorio_trabalho;
+    const char *saida_json;
+};
+
+// Contexto da imagem em teste.
+struct contexto_bench {
+    int fd;
+    struct ext2_super_block sb;
+    struct ext2_group_desc *bgdt;
+    struct sessao_shell sessao;
+    uint32_t *inodes_arquivos;   // Inodes dos arquivos gerados
+    uint32_t num_inodes_arquivos;
+};
+
+#define BENCH_MAX_MEDICOES 64
+#define BENCH_LOTE 32 // Operações por rodada nos comandos que criam entradas (diretórios usam um bloco)
+
+static struct medicao medicoes[BENCH_MAX_MEDICOES];
+static int num_medicoes = 0;
+static int stdout_original = -1;
+static int stderr_original = -1;
+
+static struct medicao* nova_medicao(const char *nome, uint32_t capacidade) {
+    if (num_medicoes == BENCH_MAX_MEDICOES) {
+        fprintf(stderr, "ext2bench: medições demais\n");
+        exit(1);
+    }
+    struct medicao *m = &medicoes[num_medicoes++];
+    m->nome = nome;
+    m->amostras = (uint64_t *)malloc(capacidade * sizeof(uint64_t));
+    if (!m->amostras) {
+        perror("ext2bench: Erro ao alocar amostras");
+        exit(1);
+    }
+    m->num_amostras = 0;
+    m->capacidade = capacidade;
+    m->falhas = 0;
+    return m;
+}
+
+static void registrar_amostra(struct medicao *m, uint64_t inicio, int falhou) {
+    uint64_t duracao = relogio_ns() - inicio;
+    if (m->num_amostras < m->capacidade) m->amostras[m->num_amostras++] = duracao;
+    if (falhou) m->falhas++;
+}
+
+// Redireciona stdout/stderr para /dev/null enquanto os comandos do shell são medidos.
+static void silenciar_saida(int silenciar) {
+    fflush(stdout);
+    fflush(stderr);
+    if (silenciar) {
+        int nulo = open("/dev/null", O_WRONLY);
+        if (nulo < 0) return;
+        stdout_original = dup(STDOUT_FILENO);
+        stderr_original = dup(STDERR_FILENO);
+        dup2(nulo, STDOUT_FILENO);
+        dup2(nulo, STDERR_FILENO);
+        close(nulo);
+    } else if (stdout_original >= 0) {
+        dup2(stdout_original, STDOUT_FILENO);
+        dup2(stderr_original, STDERR_FILENO);
+        close(stdout_original);
+        close(stderr_original);
+        stdout_original = stderr_original = -1;
+    }
+}
+
+// Gerador pseudoaleatório determinístico (xorshift32), para execuções repetíveis.
+static uint32_t estado_aleatorio = 2463534242u;
+
+static uint32_t aleatorio(void) {
+    estado_aleatorio ^= estado_aleatorio << 13;
+    estado_aleatorio ^= estado_aleatorio >> 17;
+    estado_aleatorio ^= estado_aleatorio << 5;
+    return estado_aleatorio;
+}
+
+// Remove recursivamente a árvore de arquivos gerada no host.
+static void remover_arvore(const char *caminho) {
+    DIR *dir = opendir(caminho);
+    if (dir) {
+        struct dirent *entrada;
+        while ((entrada = readdir(dir)) != NULL) {
+            if (strcmp(entrada->d_name, ".") == 0 || strcmp(entrada->d_name, "..") == 0) continue;
+            char filho[4096];
+            snprintf(filho, sizeof(filho), "%s/%s", caminho, entrada->d_name);
+            remover_arvore(filho);
+        }
+        closedir(dir);
+        rmdir(caminho);
+    } else {
+        unlink(caminho);
+    }
+}
+
+// Gera a imagem: cria a árvore de origem no host e formata a imagem a partir dela.
+// Retorna 0 em sucesso, -1 em erro.
+static int gerar_imagem(const struct configuracao_bench *cfg, const char *caminho_imagem) {
+    char origem[1024];
+    snprintf(origem, sizeof(origem), "%s/arvore", cfg->diretorio_trabalho);
+    remover_arvore(origem);
+    if (mkdir(origem, 0755) != 0) {
+        perror("ext2bench: Erro ao criar a árvore de origem");
+        return -1;
+    }
+
+    char *conteudo = (char *)malloc(cfg->bytes_por_arquivo + 1);
+    if (!conteudo) {
+        perror("ext2bench: Erro ao alocar conteúdo");
+        return -1;
+    }
+    for (unsigned long i = 0; i < cfg->bytes_por_arquivo; ++i) conteudo[i] = (char)('a' + i % 26);
+
+    for (unsigned int d = 0; d < cfg->num_diretorios; ++d) {
+        char caminho[2048];
+        snprintf(caminho, sizeof(caminho), "%s/d%u", origem, d);
+        if (mkdir(caminho, 0755) != 0) {
+            perror("ext2bench: Erro ao criar diretório de origem");
+            free(conteudo);
+            return -1;
+        }
+        for (unsigned int a = 0; a < cfg->arquivos_por_diretorio; ++a) {
+            snprintf(caminho, sizeof(caminho), "%s/d%u/f%u", origem, d, a);
+            int arquivo = open(caminho, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (arquivo < 0 || write(arquivo, conteudo, cfg->bytes_por_arquivo) != (ssize_t)cfg->bytes_por_arquivo) {
+                perror("ext2bench: Erro ao criar arquivo de origem");
+                if (arquivo >= 0) close(arquivo);
+                free(conteudo);
+                return -1;
+            }
+            close(arquivo);
+        }
+    }
+    free(conteudo);
+
+    char comando[4096];
+    snprintf(comando, sizeof(comando),
+             "rm -f '%s' && mke2fs -q -F -t ext2 -b %u -d '%s' '%s' %luM >/dev/null",
+             caminho_imagem, cfg->tamanho_bloco, origem, caminho_imagem, cfg->tamanho_mib);
+    int status = system(comando);
+    remover_arvore(origem);
+    if (status != 0) {
+        fprintf(stderr, "ext2bench: Erro ao formatar a imagem (mke2fs retornou %d)\n", status);
+        return -1;
+    }
+    return 0;
+}
+
+// Abre a imagem e resolve os inodes dos arquivos gerados. Retorna 0 em sucesso, -1 em erro.
+static int abrir_contexto(struct contexto_bench *ctx, const struct configuracao_bench *cfg, const char *caminho_imagem) {
+    unsigned int num_grupos = 0;
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->fd = read_superblock(caminho_imagem, &ctx->sb);
+    if (ctx->fd < 0) return -1;
+    ctx->bgdt = read_block_group_descriptor_table(ctx->fd, &ctx->sb, &num_grupos);
+    if (!ctx->bgdt) return -1;
+    construir_indice_livre(ctx->fd, &ctx->sb, ctx->bgdt);
+
+    ctx->sessao.diretorio_atual_inode = EXT2_ROOT_INO;
+    strcpy(ctx->sessao.diretorio_atual, "/");
+
+    uint32_t total = cfg->num_diretorios * cfg->arquivos_por_diretorio;
+    ctx->inodes_arquivos = (uint32_t *)malloc((total ? total : 1) * sizeof(uint32_t));
+    if (!ctx->inodes_arquivos) return -1;
+    for (unsigned int d = 0; d < cfg->num_diretorios; ++d) {
+        for (unsigned int a = 0; a < cfg->arquivos_por_diretorio; ++a) {
+            char caminho[64];
+            snprintf(caminho, sizeof(caminho), "/d%u/f%u", d, a);
+            uint32_t inode = path_to_inode_number(ctx->fd, &ctx->sb, ctx->bgdt, EXT2_ROOT_INO, caminho, NULL);
+            if (inode == 0) {
+                fprintf(stderr, "ext2bench: arquivo gerado não encontrado: %s\n", caminho);
+                return -1;
+            }
+            ctx->inodes_arquivos[ctx->num_inodes_arquivos++] = inode;
+        }
+    }
+    return 0;
+}
+
+static void fechar_contexto(struct contexto_bench *ctx) {
+    liberar_indice_livre();
+    liberar_mapas_diretorios();
+    liberar_transacoes();
+    free(ctx->inodes_arquivos);
+    liberar_descritores();
+    if (ctx->fd >= 0) close(ctx->fd);
+}
+
+// Executa uma linha de comando do shell. Retorna o status do comando.
+static int executar_linha(struct contexto_bench *ctx, const char *linha) {
+    char copia[512];
+    int sair = 0;
+    snprintf(copia, sizeof(copia), "%s", linha);
+    return executar_comando(ctx->fd, &ctx->sb, ctx->bgdt, &ctx->sessao, copia, &sair);
+}
+
+// Executa uma linha de comando do shell e registra a duração.
+static void medir_comando(struct contexto_bench *ctx, struct medicao *m, const char *linha) {
+    uint64_t inicio = relogio_ns();
+    int status = executar_linha(ctx, linha);
+    registrar_amostra(m, inicio, status != STATUS_OK);
+}
+
+static void bench_primitivas(struct contexto_bench *ctx, const struct configuracao_bench *cfg) {
+    unsigned int n = cfg->iteracoes;
+    struct medicao *m;
+
+    m = nova_medicao("read_inode", n);
+    for (unsigned int i = 0; i < n; ++i) {
+        struct ext2_inode inode;
+        uint32_t numero = ctx->inodes_arquivos[aleatorio() % ctx->num_inodes_arquivos];
+        uint64_t inicio = relogio_ns();
+        int resultado = read_inode(ctx->fd, &ctx->sb, ctx->bgdt, numero, &inode);
+        registrar_amostra(m, inicio, resultado != 0);
+    }
+
+    m = nova_medicao("dir_lookup", n);
+    for (unsigned int i = 0; i < n; ++i) {
+        char nome[32];
+        char caminho_dir[32];
+        unsigned int d = aleatorio() % cfg->num_diretorios;
+        snprintf(caminho_dir, sizeof(caminho_dir), "/d%u", d);
+        snprintf(nome, sizeof(nome), "f%u", aleatorio() % cfg->arquivos_por_diretorio);
+        uint32_t dir = path_to_inode_number(ctx->fd, &ctx->sb, ctx->bgdt, EXT2_ROOT_INO, caminho_dir, NULL);
+        uint64_t inicio = relogio_ns();
+        uint32_t resultado = dir_lookup(ctx->fd, &ctx->sb, ctx->bgdt, dir, nome, NULL);
+        registrar_amostra(m, inicio, resultado == 0);
+    }
+
+    m = nova_medicao("path_to_inode_number", n);
+    for (unsigned int i = 0; i < n; ++i) {
+        char caminho[64];
+        snprintf(caminho, sizeof(caminho), "/d%u/f%u", aleatorio() % cfg->num_diretorios,
+                 aleatorio() % cfg->arquivos_por_diretorio);
+        uint64_t inicio = relogio_ns();
+        uint32_t resultado = path_to_inode_number(ctx->fd, &ctx->sb, ctx->bgdt, EXT2_ROOT_INO, caminho, NULL);
+        registrar_amostra(m, inicio, resultado == 0);
+    }
+
+    struct medicao *alocar = nova_medicao("allocate_data_block", n);
+    struct medicao *liberar = nova_medicao("deallocate_data_block", n);
+    uint32_t blocos[BENCH_LOTE];
+    for (unsigned int feitos = 0; feitos < n; ) {
+        unsigned int lote = (n - feitos < BENCH_LOTE) ? n - feitos : BENCH_LOTE;
+        for (unsigned int i = 0; i < lote; ++i) {
+            uint64_t inicio = relogio_ns();
+            blocos[i] = allocate_data_block(ctx->fd, &ctx->sb, ctx->bgdt);
+            registrar_amostra(alocar, inicio, blocos[i] == 0);
+        }
+        for (unsigned int i = 0; i < lote; ++i) {
+            if (blocos[i] == 0) continue;
+            uint64_t inicio = relogio_ns();
+            deallocate_data_block(ctx->fd, &ctx->sb, ctx->bgdt, blocos[i]);
+            registrar_amostra(liberar, inicio, 0);
+        }
+        feitos += lote;
+    }
+
+    m = nova_medicao("read_file_data", n);
+    for (unsigned int i = 0; i < n; ++i) {
+        struct ext2_inode inode;
+        uint32_t tamanho = 0;
+        uint32_t numero = ctx->inodes_arquivos[aleatorio() % ctx->num_inodes_arquivos];
+        if (read_inode(ctx->fd, &ctx->sb, ctx->bgdt, numero, &inode) != 0) continue;
+        uint64_t inicio = relogio_ns();
+        char *dados = read_file_data(ctx->fd, &ctx->sb, ctx->bgdt, &inode, &tamanho);
+        registrar_amostra(m, inicio, dados == NULL);
+        free(dados);
+    }
+}
+
+static void bench_comandos(struct contexto_bench *ctx, const struct configuracao_bench *cfg) {
+    unsigned int n = cfg->iteracoes;
+    char linha[256];
+    struct medicao *m;
+
+    // Comandos que só leem.
+    static const char *somente_leitura[] = { "info", "ls /d0", "cat /d0/f0", "attr /d0/f0", "pwd" };
+    static const char *nomes_leitura[] = { "cmd_info", "cmd_ls", "cmd_cat", "cmd_attr", "cmd_pwd" };
+    for (int c = 0; c < 5; ++c) {
+        m = nova_medicao(nomes_leitura[c], n);
+        for (unsigned int i = 0; i < n; ++i) medir_comando(ctx, m, somente_leitura[c]);
+    }
+
+    m = nova_medicao("cmd_cd", n);
+    for (unsigned int i = 0; i < n; ++i) {
+        snprintf(linha, sizeof(linha), "cd /d%u", aleatorio() % cfg->num_diretorios);
+        medir_comando(ctx, m, linha);
+    }
+    executar_linha(ctx, "cd /");
+
+    // Comandos que alteram a imagem, em rodadas de BENCH_LOTE operações. Cada rodada usa
+    // diretórios novos (/bench/rN/a e /bench/rN/b): um diretório ocupa um único bloco e as
+    // entradas removidas não são reaproveitadas.
+    struct medicao *touch = nova_medicao("cmd_touch", n);
+    struct medicao *rename_m = nova_medicao("cmd_rename", n);
+    struct medicao *cp = nova_medicao("cmd_cp", n);
+    struct medicao *mv = nova_medicao("cmd_mv", n);
+    struct medicao *rm = nova_medicao("cmd_rm", n);
+    struct medicao *mkdir_m = nova_medicao("cmd_mkdir", n);
+    struct medicao *rmdir_m = nova_medicao("cmd_rmdir", n);
+    executar_linha(ctx, "mkdir /bench");
+
+    for (unsigned int feitos = 0, rodada = 0; feitos < n; ++rodada) {
+        unsigned int lote = (n - feitos < BENCH_LOTE) ? n - feitos : BENCH_LOTE;
+        char dir_a[64];
+        char dir_b[64];
+        snprintf(linha, sizeof(linha), "mkdir /bench/r%u", rodada);
+        executar_linha(ctx, linha);
+        snprintf(dir_a, sizeof(dir_a), "/bench/r%u/a", rodada);
+        snprintf(dir_b, sizeof(dir_b), "/bench/r%u/b", rodada);
+        snprintf(linha, sizeof(linha), "mkdir %s", dir_a);
+        executar_linha(ctx, linha);
+        snprintf(linha, sizeof(linha), "mkdir %s", dir_b);
+        executar_linha(ctx, linha);
+
+        for (unsigned int i = 0; i < lote; ++i) {
+            snprintf(linha, sizeof(linha), "touch %s/t%u", dir_a, i);
+            medir_comando(ctx, touch, linha);
+        }
+        for (unsigned int i = 0; i < lote; ++i) {
+            snprintf(linha, sizeof(linha), "rename %s/t%u %s/r%u", dir_a, i, dir_a, i);
+            medir_comando(ctx, rename_m, linha);
+        }
+        for (unsigned int i = 0; i < lote; ++i) {
+            snprintf(linha, sizeof(linha), "cp /d0/f%u %s/c%u", i % cfg->arquivos_por_diretorio, dir_a, i);
+            medir_comando(ctx, cp, linha);
+        }
+        for (unsigned int i = 0; i < lote; ++i) {
+            snprintf(linha, sizeof(linha), "mv %s/r%u %s", dir_a, i, dir_b);
+            medir_comando(ctx, mv, linha);
+        }
+        for (unsigned int i = 0; i < lote; ++i) {
+            snprintf(linha, sizeof(linha), "rm %s/r%u", dir_b, i);
+            medir_comando(ctx, rm, linha);
+            snprintf(linha, sizeof(linha), "rm %s/c%u", dir_a, i);
+            executar_linha(ctx, linha); // Limpeza, não medida
+        }
+        for (unsigned int i = 0; i < lote; ++i) {
+            snprintf(linha, sizeof(linha), "mkdir %s/m%u", dir_b, i);
+            medir_comando(ctx, mkdir_m, linha);
+        }
+        for (unsigned int i = 0; i < lote; ++i) {
+            snprintf(linha, sizeof(linha), "rmdir %s/m%u", dir_b, i);
+            medir_comando(ctx, rmdir_m, linha);
+        }
+        feitos += lote;
+    }
+}
+
+static int comparar_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t percentil(const struct medicao *m, double p) {
+    if (m->num_amostras == 0) return 0;
+    uint32_t indice = (uint32_t)(p * (m->num_amostras - 1) + 0.5);
+    return m->amostras[indice];
+}
+
+// Grava os resultados em JSON. Retorna 0 em sucesso, -1 em erro.
+static int gravar_json(const struct configuracao_bench *cfg, const char *caminho_imagem) {
+    FILE *saida = cfg->saida_json ? fopen(cfg->saida_json, "w") : stdout;
+    if (!saida) {
+        perror("ext2bench: Erro ao abrir o arquivo de saída");
+        return -1;
+    }
+
+    fprintf(saida, "{\n");
+    fprintf(saida, "  \"imagem\": {\"caminho\": \"%s\", \"tamanho_mib\": %lu, \"tamanho_bloco\": %u, "
+                   "\"diretorios\": %u, \"arquivos_por_diretorio\": %u, \"bytes_por_arquivo\": %lu},\n",
+            caminho_imagem, cfg->tamanho_mib, cfg->tamanho_bloco, cfg->num_diretorios,
+            cfg->arquivos_por_diretorio, cfg->bytes_por_arquivo);
+    fprintf(saida, "  \"iteracoes\": %u,\n", cfg->iteracoes);
+    fprintf(saida, "  \"resultados\": [\n");
+    for (int i = 0; i < num_medicoes; ++i) {
+        struct medicao *m = &medicoes[i];
+        uint64_t total = 0;
+        for (uint32_t k = 0; k < m->num_amostras; ++k) total += m->amostras[k];
+        qsort(m->amostras, m->num_amostras, sizeof(uint64_t), comparar_u64);
+        double media = m->num_amostras ? (double)total / m->num_amostras : 0.0;
+        fprintf(saida, "    {\"nome\": \"%s\", \"operacoes\": %u, \"falhas\": %u, \"ns_por_op\": %.1f, "
+                       "\"ops_por_s\": %.1f, \"min_ns\": %llu, \"p50_ns\": %llu, \"p90_ns\": %llu, "
+                       "\"p99_ns\": %llu, \"max_ns\": %llu}%s\n",
+                m->nome, m->num_amostras, m->falhas, media, media > 0 ? 1e9 / media : 0.0,
+                (unsigned long long)percentil(m, 0.0), (unsigned long long)percentil(m, 0.50),
+                (unsigned long long)percentil(m, 0.90), (unsigned long long)percentil(m, 0.99),
+                (unsigned long long)percentil(m, 1.0), i + 1 < num_medicoes ? "," : "");
+    }
+    fprintf(saida, "  ]\n}\n");
+    if (saida != stdout) fclose(saida);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    struct configuracao_bench cfg = { 64, 1024, 16, 32, 4096, 1000, "/tmp", NULL };
+    int opcao;
+
+    while ((opcao = getopt(argc, argv, "s:b:d:a:z:n:w:o:h")) != -1) {
+        switch (opcao) {
+            case 's': cfg.tamanho_mib = strtoul(optarg, NULL, 10); break;
+            case 'b': cfg.tamanho_bloco = (unsigned int)strtoul(optarg, NULL, 10); break;
+            case 'd': cfg.num_diretorios = (unsigned int)strtoul(optarg, NULL, 10); break;
+            case 'a': cfg.arquivos_por_diretorio = (unsigned int)strtoul(optarg, NULL, 10); break;
+            case 'z': cfg.bytes_por_arquivo = strtoul(optarg, NULL, 10); break;
+            case 'n': cfg.iteracoes = (unsigned int)strtoul(optarg, NULL, 10); break;
+            case 'w': cfg.diretorio_trabalho = optarg; break;
+            case 'o': cfg.saida_json = optarg; break;
+            default:
+                fprintf(stderr, "Uso: %s [-s MiB] [-b bytes_por_bloco] [-d diretórios] [-a arquivos_por_diretório] "
+                                "[-z bytes_por_arquivo] [-n iterações] [-w diretório_de_trabalho] [-o saida.json]\n", argv[0]);
+                return opcao == 'h' ? 0 : 2;
+        }
+    }
+    if (cfg.tamanho_mib == 0 || cfg.num_diretorios == 0 || cfg.arquivos_por_diretorio == 0 || cfg.iteracoes == 0) {
+        fprintf(stderr, "ext2bench: parâmetros devem ser maiores que zero\n");
+        return 2;
+    }
+    if (cfg.tamanho_bloco != 1024 && cfg.tamanho_bloco != 2048 && cfg.tamanho_bloco != 4096) {
+        fprintf(stderr, "ext2bench: tamanho de bloco inválido: %u (use 1024, 2048 ou 4096)\n", cfg.tamanho_bloco);
+        return 2;
+    }
+
+    char caminho_imagem[1024];
+    snprintf(caminho_imagem, sizeof(caminho_imagem), "%s/ext2bench.img", cfg.diretorio_trabalho);
+    if (gerar_imagem(&cfg, caminho_imagem) != 0) return 1;
+
+    modo_verboso = 0;
+    struct contexto_bench ctx;
+    if (abrir_contexto(&ctx, &cfg, caminho_imagem) != 0) {
+        fprintf(stderr, "ext2bench: Erro ao abrir a imagem gerada\n");
+        return 1;
+    }
+
+    bench_primitivas(&ctx, &cfg);
+    silenciar_saida(1);
+    bench_comandos(&ctx, &cfg);
+    silenciar_saida(0);
+
+    fechar_contexto(&ctx);
+    int resultado = gravar_json(&cfg, caminho_imagem);
+    for (int i = 0; i < num_medicoes; ++i) free(medicoes[i].amostras);
+    return resultado == 0 ? 0 : 1;
+}
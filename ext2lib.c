@@ -0,0 +1,561 @@
+/*
+    Biblioteca Ext2 (ver ext2lib.h).
+
+    Cada ext2_fs tem o seu próprio motor (struct motor: geometria, descritores,
+    transações, journal, índices e threads), então várias imagens podem estar abertas ao
+    mesmo tempo. Cada função pública põe o motor do 'fs' em motor_atual, trava o sistema
+    de arquivos como executar_comando faz com as linhas do shell (trava compartilhada
+    para leitura, exclusiva e dentro de uma transação para alterações), desvia a saída
+    do motor para o destino das mensagens e traduz o resultado para um código
+    EXT2_FS_*. As alterações reaproveitam os comandos do shell (comando_touch,
+    comando_mkdir, ...); as condições de erro que o chamador precisa distinguir são
+    verificadas antes, já que os comandos só retornam 0 ou 1.
+
+    A leitura sem cópia (ext2_fs_spans) usa a imagem mapeada com mmap. Blocos que ainda
+    estão só em memória (journal_pendentes, à espera do commit de grupo) são entregues
+    a partir do próprio buffer do journal.
+*/
+
+#include "motor.h"
+
+#include "ext2lib.h"
+
+#include <sys/mman.h>
+
+struct ext2_fs {
+    struct motor *motor;         // Estado da imagem no motor (ver motor.h)
+    int fd;
+    struct ext2_super_block sb;
+    struct ext2_group_desc *bgdt;
+    const unsigned char *mapa;   // Imagem mapeada (PROT_READ, MAP_SHARED), NULL se indisponível
+    size_t tamanho_mapa;
+    FILE *mensagens;             // Destino dos diagnósticos escolhido pelo chamador
+    FILE *descarte;              // /dev/null, usado quando 'mensagens' é NULL
+};
+
+// Motor e destino das mensagens da thread antes de uma chamada, restaurados ao final
+// (um visitante de ext2_fs_listar pode chamar funções de outro 'fs').
+struct chamada {
+    struct motor *motor;
+    FILE *saida;
+};
+
+const char *ext2_fs_erro_texto(int codigo) {
+    switch (codigo) {
+        case EXT2_FS_OK:             return "sucesso";
+        case EXT2_FS_ERRO_ES:        return "erro de entrada/saída";
+        case EXT2_FS_NAO_ENCONTRADO: return "arquivo ou diretório não encontrado";
+        case EXT2_FS_NAO_DIRETORIO:  return "não é um diretório";
+        case EXT2_FS_E_DIRETORIO:    return "é um diretório";
+        case EXT2_FS_JA_EXISTE:      return "o arquivo já existe";
+        case EXT2_FS_SEM_ESPACO:     return "não há espaço livre";
+        case EXT2_FS_INVALIDO:       return "argumento inválido";
+        case EXT2_FS_SEM_MEMORIA:    return "memória insuficiente";
+        case EXT2_FS_NAO_VAZIO:      return "diretório não vazio";
+        case EXT2_FS_NAO_EXT2:       return "a imagem não é um Ext2 suportado";
+        default:                     return "erro desconhecido";
+    }
+}
+
+// Põe o motor do 'fs' em uso na thread. Retorna o estado anterior da thread,
+// restaurado por restaurar().
+static struct chamada usar(ext2_fs *fs) {
+    struct chamada anterior = { motor_atual, saida_cliente };
+    motor_atual = fs->motor;
+    return anterior;
+}
+
+static void restaurar(struct chamada anterior) {
+    motor_atual = anterior.motor;
+    saida_cliente = anterior.saida;
+}
+
+void ext2_fs_mensagens(ext2_fs *fs, FILE *destino) {
+    struct chamada anterior = usar(fs);
+    durabilidade_bloquear();
+    fs->mensagens = destino;
+    durabilidade_desbloquear();
+    restaurar(anterior);
+}
+
+// Início de uma chamada: põe o motor do 'fs' em uso, trava o sistema de arquivos (com
+// exclusividade e abrindo uma transação se 'alteracao') e desvia as mensagens do motor.
+// Retorna o estado anterior da thread, restaurado por sair().
+static struct chamada entrar(ext2_fs *fs, int alteracao) {
+    struct chamada anterior = usar(fs);
+    if (alteracao) {
+        durabilidade_bloquear();
+        transacao_iniciar();
+    } else {
+        durabilidade_bloquear_leitura();
+    }
+    saida_cliente = fs->mensagens ? fs->mensagens : fs->descarte;
+    return anterior;
+}
+
+// Fim de uma chamada: confirma a transação e aplica a política de durabilidade (se
+// 'alteracao') e solta a trava. Retorna 'resultado', ou EXT2_FS_ERRO_ES se a gravação falhar.
+static int sair(ext2_fs *fs, int alteracao, struct chamada anterior, int resultado) {
+    if (alteracao) {
+        if (transacao_confirmar(fs->fd) != 0 && resultado == EXT2_FS_OK) resultado = EXT2_FS_ERRO_ES;
+        if (durabilidade_apos_comando(fs->fd) != 0 && resultado == EXT2_FS_OK) resultado = EXT2_FS_ERRO_ES;
+    }
+    durabilidade_desbloquear();
+    restaurar(anterior);
+    return resultado;
+}
+
+// Código de uma alteração que falhou depois das verificações: falta de espaço, se os
+// blocos ou os inodes acabaram, senão erro de E/S.
+static int falha_da_alteracao(const ext2_fs *fs) {
+    if (fs->sb.s_free_blocks_count == 0 || fs->sb.s_free_inodes_count == 0) return EXT2_FS_SEM_ESPACO;
+    return EXT2_FS_ERRO_ES;
+}
+
+// Resolve 'caminho' a partir da raiz e lê o inode. Retorna EXT2_FS_OK ou o erro.
+static int resolver(ext2_fs *fs, const char *caminho, uint32_t *inode_num, struct ext2_inode *inode) {
+    if (caminho == NULL || strlen(caminho) >= 1024) return EXT2_FS_INVALIDO; // Limite de path_to_inode_number
+    *inode_num = path_to_inode_number(fs->fd, &fs->sb, fs->bgdt, EXT2_ROOT_INO, caminho, NULL);
+    if (*inode_num == 0) return EXT2_FS_NAO_ENCONTRADO;
+    if (read_inode(fs->fd, &fs->sb, fs->bgdt, *inode_num, inode) != 0) return EXT2_FS_ERRO_ES;
+    return EXT2_FS_OK;
+}
+
+// Último componente de 'caminho', ou NULL se não for um nome válido (vazio, ".", ".."
+// ou longo demais).
+static const char *nome_final(const char *caminho) {
+    const char *barra = strrchr(caminho, '/');
+    const char *nome = barra ? barra + 1 : caminho;
+    size_t tamanho_nome = strlen(nome);
+    if (tamanho_nome == 0 || tamanho_nome > EXT2_NAME_LEN || strcmp(nome, ".") == 0 || strcmp(nome, "..") == 0) {
+        return NULL;
+    }
+    return nome;
+}
+
+// Separa 'caminho' em diretório pai (resolvido em 'pai_num') e nome, que precisa ser
+// válido e ainda não existir. Retorna EXT2_FS_OK ou o erro.
+static int verificar_novo(ext2_fs *fs, const char *caminho, uint32_t *pai_num) {
+    if (caminho == NULL || strlen(caminho) >= 1024) return EXT2_FS_INVALIDO;
+    const char *nome = nome_final(caminho);
+    if (nome == NULL) return EXT2_FS_INVALIDO;
+
+    char pai[1024];
+    snprintf(pai, sizeof(pai), "%.*s", nome > caminho ? (int)(nome - caminho - 1) : 0, caminho);
+    struct ext2_inode inode_pai;
+    int erro = resolver(fs, pai, pai_num, &inode_pai);
+    if (erro != EXT2_FS_OK) return erro;
+    if (!S_ISDIR(inode_pai.i_mode)) return EXT2_FS_NAO_DIRETORIO;
+    if (dir_lookup(fs->fd, &fs->sb, fs->bgdt, *pai_num, nome, NULL) != 0) return EXT2_FS_JA_EXISTE;
+    return EXT2_FS_OK;
+}
+
+// Verifica o destino de mv/cp: um diretório existente recebe o nome da origem; senão o
+// destino é o caminho novo. Retorna EXT2_FS_OK ou o erro.
+static int verificar_destino(ext2_fs *fs, const char *origem, const char *destino) {
+    uint32_t destino_num;
+    struct ext2_inode inode_destino;
+    int erro = resolver(fs, destino, &destino_num, &inode_destino);
+    if (erro == EXT2_FS_NAO_ENCONTRADO) {
+        uint32_t pai_num;
+        return verificar_novo(fs, destino, &pai_num);
+    }
+    if (erro != EXT2_FS_OK) return erro;
+    if (!S_ISDIR(inode_destino.i_mode)) return EXT2_FS_JA_EXISTE;
+
+    const char *nome = strrchr(origem, '/');
+    nome = nome ? nome + 1 : origem;
+    if (dir_lookup(fs->fd, &fs->sb, fs->bgdt, destino_num, nome, NULL) != 0) return EXT2_FS_JA_EXISTE;
+    return EXT2_FS_OK;
+}
+
+int ext2_fs_abrir(const char *caminho_imagem, unsigned int opcoes, ext2_fs **fs_out) {
+    *fs_out = NULL;
+    ext2_fs *fs = (ext2_fs *)calloc(1, sizeof(ext2_fs));
+    struct motor *motor = motor_criar();
+    FILE *descarte = fopen("/dev/null", "w");
+    if (!fs || !motor || !descarte) {
+        free(fs);
+        motor_destruir(motor);
+        if (descarte) fclose(descarte);
+        return EXT2_FS_SEM_MEMORIA;
+    }
+    fs->motor = motor;
+    fs->descarte = descarte;
+    modo_verboso = 0;
+
+    // Mesma sequência de abertura do shell (ver main).
+    struct chamada anterior = usar(fs);
+    saida_cliente = descarte;
+    int resultado = EXT2_FS_OK;
+    fs->fd = read_superblock(caminho_imagem, &fs->sb);
+    if (fs->fd < 0) {
+        resultado = EXT2_FS_ERRO_ES;
+    } else if (fs->sb.s_magic != EXT2_SUPER_MAGIC) {
+        resultado = EXT2_FS_NAO_EXT2;
+    } else {
+        int reaplicadas = journal_recuperar(fs->fd, caminho_imagem, &fs->sb);
+        if (reaplicadas < 0 ||
+            (reaplicadas > 0 && dev_pread(fs->fd, &fs->sb, sizeof(fs->sb), SUPERBLOCK_OFFSET) != sizeof(fs->sb))) {
+            resultado = EXT2_FS_ERRO_ES;
+        } else if ((opcoes & EXT2_FS_JOURNAL) && journal_abrir(caminho_imagem, 32, &fs->sb) != 0) {
+            resultado = EXT2_FS_ERRO_ES;
+        } else if (somas_abrir(fs->fd, caminho_imagem, &fs->sb) != 0) {
+            resultado = EXT2_FS_ERRO_ES;
+        } else if ((fs->bgdt = read_block_group_descriptor_table(fs->fd, &fs->sb, NULL)) == NULL) {
+            resultado = EXT2_FS_SEM_MEMORIA;
+        }
+    }
+
+    if (resultado != EXT2_FS_OK) {
+        if (fs->fd >= 0) {
+            journal_fechar(fs->fd);
+            somas_fechar(fs->fd);
+            close(fs->fd);
+        }
+        liberar_transacoes();
+        liberar_descritores();
+        restaurar(anterior);
+        motor_destruir(motor);
+        fclose(descarte);
+        free(fs);
+        return resultado;
+    }
+
+    // A imagem mapeada só serve à leitura sem cópia; sem ela, ext2_fs_spans falha.
+    struct stat informacoes;
+    if (fstat(fs->fd, &informacoes) == 0 && informacoes.st_size > 0) {
+        void *mapa = mmap(NULL, (size_t)informacoes.st_size, PROT_READ, MAP_SHARED, fs->fd, 0);
+        if (mapa != MAP_FAILED) {
+            fs->mapa = (const unsigned char *)mapa;
+            fs->tamanho_mapa = (size_t)informacoes.st_size;
+        }
+    }
+
+    durabilidade_iniciar(fs->fd, (opcoes & EXT2_FS_SINCRONIZAR) ? DURABILIDADE_COMANDO : DURABILIDADE_NENHUMA, 0);
+
+    // Órfãos da sessão anterior e recolhimento em segundo plano, como no shell.
+    if (fs->sb.s_last_orphan != 0) orfaos_concluir(fs->fd, &fs->sb, fs->bgdt);
+    recolhedor_iniciar(fs->fd, &fs->sb, fs->bgdt);
+    restaurar(anterior);
+    *fs_out = fs;
+    return EXT2_FS_OK;
+}
+
+int ext2_fs_fechar(ext2_fs *fs) {
+    if (fs == NULL) return EXT2_FS_OK;
+    struct chamada anterior = usar(fs);
+    saida_cliente = fs->mensagens ? fs->mensagens : fs->descarte;
+
+    int resultado = EXT2_FS_OK;
+    recolhedor_encerrar();
+    if (gravar_metadados_adiados(fs->fd, &fs->sb, fs->bgdt) != 0) resultado = EXT2_FS_ERRO_ES;
+    if (descritores_gravar_copias(fs->fd) != 0) resultado = EXT2_FS_ERRO_ES;
+    if (durabilidade_encerrar(fs->fd) != 0) resultado = EXT2_FS_ERRO_ES;
+    if (journal_fechar(fs->fd) != 0) resultado = EXT2_FS_ERRO_ES;
+    if (somas_fechar(fs->fd) != 0) resultado = EXT2_FS_ERRO_ES;
+
+    if (fs->mapa) munmap((void *)fs->mapa, fs->tamanho_mapa);
+    liberar_indice_livre();
+    liberar_mapas_diretorios();
+    liberar_transacoes();
+    liberar_descritores();
+    restaurar(anterior);
+    motor_destruir(fs->motor);
+    close(fs->fd);
+    fclose(fs->descarte);
+    free(fs);
+    return resultado;
+}
+
+int ext2_fs_info(ext2_fs *fs, struct ext2_fs_info *info) {
+    struct chamada anterior = entrar(fs, 0);
+    memset(info, 0, sizeof(*info));
+    memcpy(info->nome_volume, fs->sb.s_volume_name, sizeof(fs->sb.s_volume_name));
+    info->tamanho_bloco = BLOCK_SIZE;
+    info->blocos = fs->sb.s_blocks_count;
+    info->blocos_livres = fs->sb.s_free_blocks_count;
+    info->inodes = fs->sb.s_inodes_count;
+    info->inodes_livres = fs->sb.s_free_inodes_count;
+    info->grupos = motor_atual->descritores.num_grupos;
+    info->blocos_por_grupo = fs->sb.s_blocks_per_group;
+    info->inodes_por_grupo = fs->sb.s_inodes_per_group;
+    info->tamanho_inode = (uint16_t)(1u << motor_atual->geometria.log_inode);
+    return sair(fs, 0, anterior, EXT2_FS_OK);
+}
+
+int ext2_fs_stat(ext2_fs *fs, const char *caminho, struct ext2_fs_stat *stat_out) {
+    struct chamada anterior = entrar(fs, 0);
+    uint32_t inode_num;
+    struct ext2_inode inode;
+    int resultado = resolver(fs, caminho, &inode_num, &inode);
+    if (resultado == EXT2_FS_OK) {
+        stat_out->inode = inode_num;
+        stat_out->modo = inode.i_mode;
+        stat_out->links = inode.i_links_count;
+        stat_out->uid = inode.i_uid;
+        stat_out->gid = inode.i_gid;
+        stat_out->tamanho = inode.i_size;
+        stat_out->blocos_512 = inode.i_blocks;
+        stat_out->atime = inode.i_atime;
+        stat_out->mtime = inode.i_mtime;
+        stat_out->ctime = inode.i_ctime;
+    }
+    return sair(fs, 0, anterior, resultado);
+}
+
+// Chama 'visitante' para cada entrada usada do diretório (todos os blocos até i_size).
+// Retorna EXT2_FS_OK, EXT2_FS_ERRO_ES para um bloco corrompido, ou o retorno do visitante.
+static int percorrer_diretorio(ext2_fs *fs, const struct ext2_inode *diretorio,
+                               ext2_fs_visitante visitante, void *contexto) {
+    char bloco[BLOCK_SIZE_MAX];
+    struct ext2_fs_entrada saida;
+    uint32_t num_blocos = (diretorio->i_size + BLOCK_SIZE - 1) >> motor_atual->geometria.log_bloco;
+
+    for (uint32_t logico = 0; logico < num_blocos; ++logico) {
+        uint32_t fisico = bmap_ler(fs->fd, diretorio, logico);
+        if (fisico == 0) continue;
+        if (ler_bloco(fs->fd, fisico, bloco, BLOCO_DIRETORIO) != 0) return EXT2_FS_ERRO_ES;
+
+        uint32_t offset = 0;
+        while (offset + 8 <= BLOCK_SIZE) {
+            struct ext2_dir_entry_2 *entrada = (struct ext2_dir_entry_2 *)(bloco + offset);
+            if (entrada->rec_len < 8 || offset + entrada->rec_len > BLOCK_SIZE ||
+                8u + entrada->name_len > entrada->rec_len) {
+                return EXT2_FS_ERRO_ES;
+            }
+            if (entrada->inode != 0) {
+                saida.inode = entrada->inode;
+                saida.tipo = entrada->file_type;
+                saida.tamanho_nome = entrada->name_len;
+                memcpy(saida.nome, entrada->name, entrada->name_len);
+                saida.nome[entrada->name_len] = '\0';
+                int retorno = visitante(&saida, contexto);
+                if (retorno != 0) return retorno;
+            }
+            offset += entrada->rec_len;
+        }
+    }
+    return EXT2_FS_OK;
+}
+
+int ext2_fs_listar(ext2_fs *fs, const char *caminho, ext2_fs_visitante visitante, void *contexto) {
+    struct chamada anterior = entrar(fs, 0);
+    uint32_t inode_num;
+    struct ext2_inode inode;
+    int resultado = resolver(fs, caminho, &inode_num, &inode);
+    if (resultado == EXT2_FS_OK && !S_ISDIR(inode.i_mode)) resultado = EXT2_FS_NAO_DIRETORIO;
+    if (resultado == EXT2_FS_OK) resultado = percorrer_diretorio(fs, &inode, visitante, contexto);
+    return sair(fs, 0, anterior, resultado);
+}
+
+// Resolve um arquivo regular para leitura ou acréscimo. Retorna EXT2_FS_OK ou o erro.
+static int resolver_arquivo(ext2_fs *fs, const char *caminho, uint32_t *inode_num, struct ext2_inode *inode) {
+    int resultado = resolver(fs, caminho, inode_num, inode);
+    if (resultado != EXT2_FS_OK) return resultado;
+    if (S_ISDIR(inode->i_mode)) return EXT2_FS_E_DIRETORIO;
+    if (!S_ISREG(inode->i_mode)) return EXT2_FS_INVALIDO;
+    return EXT2_FS_OK;
+}
+
+int ext2_fs_ler(ext2_fs *fs, const char *caminho, uint64_t offset, void *buffer, size_t tamanho, size_t *lidos) {
+    *lidos = 0;
+    struct chamada anterior = entrar(fs, 0);
+    uint32_t inode_num;
+    struct ext2_inode inode;
+    int resultado = resolver_arquivo(fs, caminho, &inode_num, &inode);
+    if (resultado != EXT2_FS_OK || offset >= inode.i_size) return sair(fs, 0, anterior, resultado);
+    if (tamanho > inode.i_size - offset) tamanho = (size_t)(inode.i_size - offset);
+
+    // Lê de uma vez cada sequência de blocos fisicamente contíguos; buracos viram zeros.
+    char *destino = (char *)buffer;
+    size_t feitos = 0;
+    while (feitos < tamanho) {
+        uint64_t posicao = offset + feitos;
+        uint32_t logico = (uint32_t)(posicao >> motor_atual->geometria.log_bloco);
+        uint32_t dentro = (uint32_t)(posicao & (BLOCK_SIZE - 1));
+        uint32_t fisico = bmap_ler(fs->fd, &inode, logico);
+        size_t parte = BLOCK_SIZE - dentro;
+        uint32_t blocos = 1;
+        while (parte < tamanho - feitos) {
+            uint32_t seguinte = bmap_ler(fs->fd, &inode, logico + blocos);
+            if ((fisico == 0) != (seguinte == 0) || (fisico != 0 && seguinte != fisico + blocos)) break;
+            parte += BLOCK_SIZE;
+            blocos++;
+        }
+        if (parte > tamanho - feitos) parte = tamanho - feitos;
+
+        if (fisico == 0) {
+            memset(destino + feitos, 0, parte);
+        } else {
+            ESTAT(estatisticas.blocos_lidos[BLOCO_DADOS] += blocos);
+            if (dev_pread(fs->fd, destino + feitos, parte, offset_do_bloco(fisico) + dentro) != (ssize_t)parte) {
+                resultado = EXT2_FS_ERRO_ES;
+                break;
+            }
+        }
+        feitos += parte;
+    }
+    *lidos = feitos;
+    return sair(fs, 0, anterior, resultado);
+}
+
+int ext2_fs_spans(ext2_fs *fs, const char *caminho, uint64_t offset, uint64_t tamanho,
+                  struct ext2_fs_span *spans, size_t max_spans, size_t *num_spans) {
+    *num_spans = 0;
+    if (max_spans == 0) return EXT2_FS_INVALIDO;
+    struct chamada anterior = entrar(fs, 0);
+    uint32_t inode_num;
+    struct ext2_inode inode;
+    int resultado = resolver_arquivo(fs, caminho, &inode_num, &inode);
+    if (resultado == EXT2_FS_OK && fs->mapa == NULL) resultado = EXT2_FS_ERRO_ES;
+    if (resultado != EXT2_FS_OK || offset >= inode.i_size) return sair(fs, 0, anterior, resultado);
+    uint64_t fim = (tamanho > inode.i_size - offset) ? inode.i_size : offset + tamanho;
+
+    // Um bloco estende o último trecho quando continua a mesma região de memória (blocos
+    // vizinhos na imagem mapeada) ou o mesmo buraco.
+    size_t n = 0;
+    uint64_t posicao = offset;
+    while (posicao < fim) {
+        uint32_t logico = (uint32_t)(posicao >> motor_atual->geometria.log_bloco);
+        uint32_t dentro = (uint32_t)(posicao & (BLOCK_SIZE - 1));
+        uint32_t parte = BLOCK_SIZE - dentro;
+        if (parte > fim - posicao) parte = (uint32_t)(fim - posicao);
+
+        const unsigned char *dados = NULL;
+        uint32_t fisico = bmap_ler(fs->fd, &inode, logico);
+        if (fisico != 0) {
+            int64_t pendente = transacao_procurar(&motor_atual->journal_pendentes, fisico);
+            if (pendente >= 0) {
+                dados = (const unsigned char *)transacao_dados(&motor_atual->journal_pendentes, pendente) + dentro;
+            } else if ((uint64_t)offset_do_bloco(fisico) + BLOCK_SIZE <= fs->tamanho_mapa) {
+                dados = fs->mapa + offset_do_bloco(fisico) + dentro;
+            } else {
+                resultado = EXT2_FS_ERRO_ES; // Bloco fora da imagem
+                break;
+            }
+        }
+
+        struct ext2_fs_span *ultimo = n > 0 ? &spans[n - 1] : NULL;
+        if (ultimo != NULL && (dados == NULL ? ultimo->dados == NULL
+                                             : (const unsigned char *)ultimo->dados + ultimo->tamanho == dados) &&
+            ultimo->tamanho <= UINT32_MAX - parte) {
+            ultimo->tamanho += parte;
+        } else {
+            if (n == max_spans) break;
+            spans[n].dados = dados;
+            spans[n].offset = posicao;
+            spans[n].tamanho = parte;
+            n++;
+        }
+        posicao += parte;
+    }
+    *num_spans = n;
+    return sair(fs, 0, anterior, resultado);
+}
+
+int ext2_fs_criar(ext2_fs *fs, const char *caminho) {
+    struct chamada anterior = entrar(fs, 1);
+    uint32_t pai_num;
+    char raiz[] = "/";
+    int resultado = verificar_novo(fs, caminho, &pai_num);
+    if (resultado == EXT2_FS_OK && comando_touch(fs->fd, &fs->sb, fs->bgdt, EXT2_ROOT_INO, raiz, caminho) != 0) {
+        resultado = falha_da_alteracao(fs);
+    }
+    return sair(fs, 1, anterior, resultado);
+}
+
+int ext2_fs_mkdir(ext2_fs *fs, const char *caminho) {
+    struct chamada anterior = entrar(fs, 1);
+    uint32_t pai_num;
+    char raiz[] = "/";
+    int resultado = verificar_novo(fs, caminho, &pai_num);
+    if (resultado == EXT2_FS_OK && comando_mkdir(fs->fd, &fs->sb, fs->bgdt, EXT2_ROOT_INO, raiz, caminho) != 0) {
+        resultado = falha_da_alteracao(fs);
+    }
+    return sair(fs, 1, anterior, resultado);
+}
+
+int ext2_fs_remover(ext2_fs *fs, const char *caminho) {
+    struct chamada anterior = entrar(fs, 1);
+    uint32_t inode_num;
+    struct ext2_inode inode;
+    int resultado = resolver_arquivo(fs, caminho, &inode_num, &inode);
+    if (resultado == EXT2_FS_OK && nome_final(caminho) == NULL) resultado = EXT2_FS_INVALIDO; // Ex.: "a/"
+    if (resultado == EXT2_FS_OK && comando_rm(fs->fd, &fs->sb, fs->bgdt, EXT2_ROOT_INO, caminho) != 0) {
+        resultado = falha_da_alteracao(fs);
+    }
+    return sair(fs, 1, anterior, resultado);
+}
+
+// Visitante que recusa qualquer entrada além de "." e "..".
+static int entrada_alem_de_ponto(const struct ext2_fs_entrada *entrada, void *contexto) {
+    (void)contexto;
+    if (strcmp(entrada->nome, ".") == 0 || strcmp(entrada->nome, "..") == 0) return 0;
+    return EXT2_FS_NAO_VAZIO;
+}
+
+int ext2_fs_rmdir(ext2_fs *fs, const char *caminho) {
+    struct chamada anterior = entrar(fs, 1);
+    uint32_t inode_num;
+    struct ext2_inode inode;
+    int resultado = resolver(fs, caminho, &inode_num, &inode);
+    if (resultado == EXT2_FS_OK && !S_ISDIR(inode.i_mode)) resultado = EXT2_FS_NAO_DIRETORIO;
+    if (resultado == EXT2_FS_OK && inode_num == EXT2_ROOT_INO) resultado = EXT2_FS_INVALIDO;
+    if (resultado == EXT2_FS_OK) resultado = percorrer_diretorio(fs, &inode, entrada_alem_de_ponto, NULL);
+    if (resultado == EXT2_FS_OK && comando_rmdir(fs->fd, &fs->sb, fs->bgdt, EXT2_ROOT_INO, caminho) != 0) {
+        resultado = EXT2_FS_INVALIDO; // Os casos restantes são "." e ".." no fim do caminho
+    }
+    return sair(fs, 1, anterior, resultado);
+}
+
+int ext2_fs_mover(ext2_fs *fs, const char *origem, const char *destino) {
+    struct chamada anterior = entrar(fs, 1);
+    uint32_t inode_num;
+    struct ext2_inode inode;
+    int resultado = resolver(fs, origem, &inode_num, &inode);
+    if (resultado == EXT2_FS_OK && inode_num == EXT2_ROOT_INO) resultado = EXT2_FS_INVALIDO;
+    if (resultado == EXT2_FS_OK) resultado = verificar_destino(fs, origem, destino);
+    if (resultado == EXT2_FS_OK && comando_mv(fs->fd, &fs->sb, fs->bgdt, EXT2_ROOT_INO, origem, destino) != 0) {
+        resultado = falha_da_alteracao(fs);
+    }
+    return sair(fs, 1, anterior, resultado);
+}
+
+int ext2_fs_copiar(ext2_fs *fs, const char *origem, const char *destino) {
+    struct chamada anterior = entrar(fs, 1);
+    uint32_t inode_num;
+    struct ext2_inode inode;
+    int resultado = resolver_arquivo(fs, origem, &inode_num, &inode);
+    if (resultado == EXT2_FS_OK) resultado = verificar_destino(fs, origem, destino);
+    if (resultado == EXT2_FS_OK && comando_cp(fs->fd, &fs->sb, fs->bgdt, EXT2_ROOT_INO, origem, destino) != 0) {
+        resultado = falha_da_alteracao(fs);
+    }
+    return sair(fs, 1, anterior, resultado);
+}
+
+int ext2_fs_anexar(ext2_fs *fs, const char *caminho, const void *dados, size_t tamanho) {
+    struct chamada anterior = entrar(fs, 1);
+    uint32_t inode_num;
+    struct ext2_inode inode;
+    int resultado = resolver_arquivo(fs, caminho, &inode_num, &inode);
+    if (resultado == EXT2_FS_OK && tamanho > UINT32_MAX - inode.i_size) resultado = EXT2_FS_INVALIDO; // i_size tem 32 bits
+    if (resultado == EXT2_FS_OK &&
+        anexar_ao_arquivo(fs->fd, &fs->sb, fs->bgdt, inode_num, &inode, (const char *)dados, (uint32_t)tamanho) != 0) {
+        resultado = falha_da_alteracao(fs);
+    }
+    return sair(fs, 1, anterior, resultado);
+}
+
+int ext2_fs_sincronizar(ext2_fs *fs) {
+    struct chamada anterior = usar(fs);
+    durabilidade_bloquear();
+    saida_cliente = fs->mensagens ? fs->mensagens : fs->descarte;
+    int resultado = EXT2_FS_OK;
+    if (gravar_metadados_adiados(fs->fd, &fs->sb, fs->bgdt) != 0) resultado = EXT2_FS_ERRO_ES;
+    if (descritores_gravar_copias(fs->fd) != 0) resultado = EXT2_FS_ERRO_ES;
+    if (durabilidade_sincronizar(fs->fd) != 0) resultado = EXT2_FS_ERRO_ES;
+    durabilidade_desbloquear();
+    restaurar(anterior);
+    return resultado;
+}
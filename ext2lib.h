@@ -0,0 +1,147 @@
+/*
+    Biblioteca Ext2: o motor do ext2shell exposto para outros programas.
+
+    Um 'ext2_fs' é o sistema de arquivos aberto: ele é dono do descritor da imagem, do
+    superbloco, da tabela de descritores de grupo, dos índices em memória, do journal e
+    da geometria. As funções retornam EXT2_FS_OK (0) ou um código de erro negativo
+    (EXT2_FS_*) e não imprimem nada: os diagnósticos do motor vão para o FILE definido
+    com ext2_fs_mensagens (por padrão são descartados). Só falhas de chamadas de sistema
+    (perror) continuam indo para stderr.
+
+    Os caminhos são sempre relativos à raiz ("a/b" e "/a/b" são o mesmo arquivo).
+
+    As chamadas podem ser feitas de várias threads: as de leitura rodam em paralelo e as
+    que alteram a imagem são serializadas. Cada 'ext2_fs' tem o seu próprio estado, então
+    várias imagens podem estar abertas ao mesmo tempo e chamadas em imagens diferentes
+    não esperam umas pelas outras.
+
+    Compilação: make libext2lib.a; cc programa.c libext2lib.a -pthread
+*/
+
+#ifndef EXT2LIB_H
+#define EXT2LIB_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ext2_fs ext2_fs;
+
+// Códigos de retorno.
+enum {
+    EXT2_FS_OK              =   0,
+    EXT2_FS_ERRO_ES         =  -1, // Falha de leitura/escrita ou imagem inconsistente
+    EXT2_FS_NAO_ENCONTRADO  =  -2, // Caminho inexistente
+    EXT2_FS_NAO_DIRETORIO   =  -3, // Um diretório era esperado
+    EXT2_FS_E_DIRETORIO     =  -4, // Um arquivo regular era esperado
+    EXT2_FS_JA_EXISTE       =  -5, // O destino já existe
+    EXT2_FS_SEM_ESPACO      =  -6, // Sem blocos ou inodes livres
+    EXT2_FS_INVALIDO        =  -7, // Argumento inválido (nome vazio, ".", "..", etc.)
+    EXT2_FS_SEM_MEMORIA     =  -9,
+    EXT2_FS_NAO_VAZIO       = -10, // Diretório com entradas
+    EXT2_FS_NAO_EXT2        = -11  // A imagem não é um Ext2 (magic ou tamanho de bloco)
+};
+
+// Opções de ext2_fs_abrir.
+#define EXT2_FS_JOURNAL     0x1 // Registra cada alteração no journal "<imagem>.journal"
+#define EXT2_FS_SINCRONIZAR 0x2 // fdatasync ao final de cada alteração (política "comando")
+
+// Tipos de entrada de diretório (campo file_type do Ext2).
+#define EXT2_FS_TIPO_DESCONHECIDO 0
+#define EXT2_FS_TIPO_ARQUIVO      1
+#define EXT2_FS_TIPO_DIRETORIO    2
+#define EXT2_FS_TIPO_LINK         7
+
+struct ext2_fs_info {
+    char nome_volume[17];
+    uint32_t tamanho_bloco;
+    uint32_t blocos;
+    uint32_t blocos_livres;
+    uint32_t inodes;
+    uint32_t inodes_livres;
+    uint32_t grupos;
+    uint32_t blocos_por_grupo;
+    uint32_t inodes_por_grupo;
+    uint16_t tamanho_inode;
+};
+
+struct ext2_fs_stat {
+    uint32_t inode;
+    uint16_t modo;             // Tipo e permissões (como st_mode)
+    uint16_t links;
+    uint16_t uid;
+    uint16_t gid;
+    uint32_t tamanho;
+    uint32_t blocos_512;       // Blocos ocupados, em unidades de 512 bytes
+    uint32_t atime, mtime, ctime;
+};
+
+struct ext2_fs_entrada {
+    uint32_t inode;
+    uint8_t tipo;              // EXT2_FS_TIPO_*
+    uint8_t tamanho_nome;
+    char nome[256];            // Terminado em '\0'
+};
+
+// Trecho de um arquivo entregue sem cópia (ver ext2_fs_spans). 'dados' aponta para
+// 'tamanho' bytes do arquivo a partir de 'offset', ou é NULL para um buraco (zeros).
+struct ext2_fs_span {
+    const void *dados;
+    uint64_t offset;
+    uint32_t tamanho;
+};
+
+// Chamada por ext2_fs_listar para cada entrada; um retorno diferente de 0 interrompe
+// a listagem e vira o retorno de ext2_fs_listar. Roda com o sistema de arquivos travado
+// para leitura: não pode chamar funções que alteram a imagem.
+typedef int (*ext2_fs_visitante)(const struct ext2_fs_entrada *entrada, void *contexto);
+
+// Abre a imagem (reaplicando o journal, se houver registros pendentes).
+int ext2_fs_abrir(const char *caminho_imagem, unsigned int opcoes, ext2_fs **fs_out);
+
+// Grava o que estiver pendente, fecha a imagem e libera o 'fs'.
+int ext2_fs_fechar(ext2_fs *fs);
+
+// Descrição, em texto, de um código de retorno.
+const char *ext2_fs_erro_texto(int codigo);
+
+// Destino dos diagnósticos do motor (NULL descarta). O FILE é do chamador.
+void ext2_fs_mensagens(ext2_fs *fs, FILE *destino);
+
+int ext2_fs_info(ext2_fs *fs, struct ext2_fs_info *info);
+int ext2_fs_stat(ext2_fs *fs, const char *caminho, struct ext2_fs_stat *stat_out);
+int ext2_fs_listar(ext2_fs *fs, const char *caminho, ext2_fs_visitante visitante, void *contexto);
+
+// Copia até 'tamanho' bytes do arquivo a partir de 'offset' para 'buffer'.
+// '*lidos' recebe quantos bytes foram copiados (menos que 'tamanho' no fim do arquivo).
+int ext2_fs_ler(ext2_fs *fs, const char *caminho, uint64_t offset, void *buffer, size_t tamanho, size_t *lidos);
+
+// Leitura sem cópia: preenche até 'max_spans' trechos que cobrem o arquivo a partir de
+// 'offset' (até 'tamanho' bytes), cada um com blocos fisicamente contíguos da imagem
+// mapeada em memória. '*num_spans' recebe quantos foram preenchidos; se o último não
+// chegar ao fim do pedido, basta chamar de novo a partir dele. Os ponteiros só valem
+// até a próxima chamada que altera a imagem (de qualquer thread) ou ext2_fs_fechar.
+int ext2_fs_spans(ext2_fs *fs, const char *caminho, uint64_t offset, uint64_t tamanho,
+                  struct ext2_fs_span *spans, size_t max_spans, size_t *num_spans);
+
+// Alterações. Cada chamada é uma transação (e um registro no journal, se ativo).
+int ext2_fs_criar(ext2_fs *fs, const char *caminho);       // Arquivo regular vazio
+int ext2_fs_mkdir(ext2_fs *fs, const char *caminho);
+int ext2_fs_remover(ext2_fs *fs, const char *caminho);     // Arquivo regular (blocos de arquivos grandes liberados em segundo plano)
+int ext2_fs_rmdir(ext2_fs *fs, const char *caminho);       // Diretório vazio
+int ext2_fs_mover(ext2_fs *fs, const char *origem, const char *destino); // Como o mv do shell
+int ext2_fs_copiar(ext2_fs *fs, const char *origem, const char *destino); // Como o cp do shell
+int ext2_fs_anexar(ext2_fs *fs, const char *caminho, const void *dados, size_t tamanho);
+
+// Força para o disco as alterações feitas até aqui (commit do journal e fdatasync).
+int ext2_fs_sincronizar(ext2_fs *fs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EXT2LIB_H
@@ -0,0 +1,481 @@
+/*
+    Macro-benchmark no estilo PostMark para o ext2shell.
+
+    Cria uma imagem (mkfs embutido), popula um conjunto inicial de arquivos espalhados
+    em diretórios e executa uma sequência determinística de transações sorteadas entre
+    touch, cat, cp, rm, mv e ls, sempre pelo mesmo caminho dos comandos do shell
+    (executar_comando). Ao final remove os arquivos restantes. Grava em JSON as
+    transações/s de cada fase e, por operação, a latência (média, percentis e
+    histograma em potências de 2) e as chamadas de sistema e bytes de E/S.
+
+    Uso: ext2mark [-s MiB] [-d diretórios] [-f arquivos] [-t transações] [-z min:max]
+                  [-r semente] [-x mistura] [-p durabilidade] [-j] [-w diretório] [-o saida.json]
+*/
+
+#include "motor.h"
+
+#define MARK_FAIXAS_HISTOGRAMA 48 // Faixas [2^i, 2^(i+1)) ns
+
+enum { OP_TOUCH, OP_CAT, OP_CP, OP_RM, OP_MV, OP_LS, NUM_OPERACOES };
+static const char *nomes_operacoes[NUM_OPERACOES] = { "touch", "cat", "cp", "rm", "mv", "ls" };
+
+// Parâmetros da execução.
+struct configuracao_mark {
+    unsigned long tamanho_mib;
+    unsigned int num_diretorios;
+    unsigned int arquivos_iniciais;
+    unsigned long transacoes;
+    unsigned long tamanho_min;     // Tamanho dos arquivos criados: uniforme em [min, max]
+    unsigned long tamanho_max;
+    uint64_t semente;
+    unsigned int pesos[NUM_OPERACOES];
+    enum modo_durabilidade durabilidade;
+    int usar_journal;
+    const char *diretorio_trabalho;
+    const char *saida_json;
+};
+
+// Estatísticas de um tipo de operação.
+struct estatisticas_operacao {
+    uint64_t operacoes;
+    uint64_t falhas;
+    uint64_t total_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    uint64_t histograma[MARK_FAIXAS_HISTOGRAMA];
+    struct contadores_es es;       // Chamadas de sistema e bytes somados das operações
+};
+
+// Arquivo vivo no conjunto.
+struct arquivo_mark {
+    char caminho[48];
+};
+
+// Estado da execução.
+struct estado_mark {
+    int fd;
+    struct ext2_super_block sb;
+    struct ext2_group_desc *bgdt;
+    struct sessao_shell sessao;
+    struct arquivo_mark *arquivos;
+    uint32_t num_arquivos;
+    uint32_t capacidade;
+    uint32_t proximo_nome;         // Contador para nomes únicos
+    char *dados;                   // Conteúdo usado nas escritas
+    struct estatisticas_operacao estatisticas[NUM_OPERACOES];
+};
+
+// Resultado de uma fase (população, transações ou remoção).
+struct fase_mark {
+    const char *nome;
+    uint64_t operacoes;
+    uint64_t falhas;
+    double segundos;
+    struct contadores_es es;
+};
+
+static uint64_t estado_aleatorio;
+
+static uint64_t aleatorio(void) { // xorshift64*
+    estado_aleatorio ^= estado_aleatorio >> 12;
+    estado_aleatorio ^= estado_aleatorio << 25;
+    estado_aleatorio ^= estado_aleatorio >> 27;
+    return estado_aleatorio * 2685821657736338717ull;
+}
+
+static void somar_contadores(struct contadores_es *total, const struct contadores_es *antes) {
+    total->leituras += contadores_es.leituras - antes->leituras;
+    total->bytes_lidos += contadores_es.bytes_lidos - antes->bytes_lidos;
+    total->escritas += contadores_es.escritas - antes->escritas;
+    total->bytes_escritos += contadores_es.bytes_escritos - antes->bytes_escritos;
+    total->sincronizacoes += contadores_es.sincronizacoes - antes->sincronizacoes;
+}
+
+static void registrar_operacao(struct estatisticas_operacao *s, uint64_t inicio,
+                               const struct contadores_es *antes, int falhou) {
+    uint64_t duracao = relogio_ns() - inicio;
+    int faixa = 0;
+    while (faixa < MARK_FAIXAS_HISTOGRAMA - 1 && (duracao >> (faixa + 1)) != 0) faixa++;
+    if (s->operacoes == 0 || duracao < s->min_ns) s->min_ns = duracao;
+    if (duracao > s->max_ns) s->max_ns = duracao;
+    s->operacoes++;
+    s->total_ns += duracao;
+    s->histograma[faixa]++;
+    if (falhou) s->falhas++;
+    somar_contadores(&s->es, antes);
+}
+
+// Executa uma linha de comando do shell. Retorna 0 se o comando teve sucesso.
+static int executar_linha(struct estado_mark *e, const char *linha) {
+    char copia[256];
+    int sair = 0;
+    snprintf(copia, sizeof(copia), "%s", linha);
+    return executar_comando(e->fd, &e->sb, e->bgdt, &e->sessao, copia, &sair) != STATUS_OK;
+}
+
+// Escreve 'tamanho' bytes no arquivo recém-criado, como um comando: uma transação,
+// com a mesma política de durabilidade dos comandos. Retorna 0 em sucesso.
+static int escrever_conteudo(struct estado_mark *e, const char *caminho, uint32_t tamanho) {
+    if (tamanho == 0) return 0;
+    uint32_t inode_num = path_to_inode_number(e->fd, &e->sb, e->bgdt, EXT2_ROOT_INO, caminho, NULL);
+    struct ext2_inode inode;
+    if (inode_num == 0 || read_inode(e->fd, &e->sb, e->bgdt, inode_num, &inode) != 0) return -1;
+    durabilidade_bloquear();
+    transacao_iniciar();
+    int resultado = anexar_ao_arquivo(e->fd, &e->sb, e->bgdt, inode_num, &inode, e->dados, tamanho);
+    if (transacao_confirmar(e->fd) != 0 || durabilidade_apos_comando(e->fd) != 0) resultado = -1;
+    durabilidade_desbloquear();
+    return resultado;
+}
+
+static struct arquivo_mark* novo_arquivo(struct estado_mark *e, const struct configuracao_mark *cfg) {
+    if (e->num_arquivos == e->capacidade) {
+        uint32_t nova = e->capacidade ? e->capacidade * 2 : 1024;
+        struct arquivo_mark *novos = (struct arquivo_mark *)realloc(e->arquivos, nova * sizeof(struct arquivo_mark));
+        if (!novos) return NULL;
+        e->arquivos = novos;
+        e->capacidade = nova;
+    }
+    struct arquivo_mark *a = &e->arquivos[e->num_arquivos];
+    snprintf(a->caminho, sizeof(a->caminho), "/mark/d%u/f%u",
+             (unsigned int)(aleatorio() % cfg->num_diretorios), e->proximo_nome++);
+    return a;
+}
+
+static uint32_t sortear_tamanho(const struct configuracao_mark *cfg) {
+    return (uint32_t)(cfg->tamanho_min + aleatorio() % (cfg->tamanho_max - cfg->tamanho_min + 1));
+}
+
+// touch seguido da escrita do conteúdo (a criação do PostMark). Retorna 0 em sucesso.
+static int operacao_touch(struct estado_mark *e, const struct configuracao_mark *cfg) {
+    char linha[96];
+    struct arquivo_mark *a = novo_arquivo(e, cfg);
+    if (!a) return -1;
+    snprintf(linha, sizeof(linha), "touch %s", a->caminho);
+    if (executar_linha(e, linha) != 0) return -1;
+    e->num_arquivos++;
+    return escrever_conteudo(e, a->caminho, sortear_tamanho(cfg));
+}
+
+// Executa uma operação sorteada. Retorna 0 em sucesso.
+static int executar_operacao(struct estado_mark *e, const struct configuracao_mark *cfg, int op) {
+    char linha[160];
+    uint32_t indice = e->num_arquivos ? (uint32_t)(aleatorio() % e->num_arquivos) : 0;
+
+    switch (op) {
+        case OP_TOUCH:
+            return operacao_touch(e, cfg);
+        case OP_CAT:
+            snprintf(linha, sizeof(linha), "cat %s", e->arquivos[indice].caminho);
+            return executar_linha(e, linha);
+        case OP_CP: {
+            char origem[48];
+            snprintf(origem, sizeof(origem), "%s", e->arquivos[indice].caminho);
+            struct arquivo_mark *a = novo_arquivo(e, cfg);
+            if (!a) return -1;
+            snprintf(linha, sizeof(linha), "cp %s %s", origem, a->caminho);
+            if (executar_linha(e, linha) != 0) return -1;
+            e->num_arquivos++;
+            return 0;
+        }
+        case OP_RM: {
+            snprintf(linha, sizeof(linha), "rm %s", e->arquivos[indice].caminho);
+            int resultado = executar_linha(e, linha);
+            if (resultado == 0) e->arquivos[indice] = e->arquivos[--e->num_arquivos];
+            return resultado;
+        }
+        case OP_MV: {
+            struct arquivo_mark *a = &e->arquivos[indice];
+            char nome[48];
+            snprintf(nome, sizeof(nome), "%s", strrchr(a->caminho, '/') + 1);
+            unsigned int origem = (unsigned int)strtoul(a->caminho + strlen("/mark/d"), NULL, 10);
+            unsigned int destino = (unsigned int)(aleatorio() % cfg->num_diretorios);
+            if (destino == origem) destino = (destino + 1) % cfg->num_diretorios; // mv exige outro diretório
+            snprintf(linha, sizeof(linha), "mv %s /mark/d%u", a->caminho, destino);
+            if (executar_linha(e, linha) != 0) return -1;
+            snprintf(a->caminho, sizeof(a->caminho), "/mark/d%u/%.24s", destino, nome); // Nomes são "f<número>"
+            return 0;
+        }
+        default:
+            snprintf(linha, sizeof(linha), "ls /mark/d%u", (unsigned int)(aleatorio() % cfg->num_diretorios));
+            return executar_linha(e, linha);
+    }
+}
+
+static int sortear_operacao(const struct estado_mark *e, const struct configuracao_mark *cfg) {
+    unsigned int soma = 0;
+    for (int op = 0; op < NUM_OPERACOES; ++op) soma += cfg->pesos[op];
+    unsigned int sorteio = (unsigned int)(aleatorio() % soma);
+    int escolhida = OP_LS;
+    for (int op = 0; op < NUM_OPERACOES; ++op) {
+        if (sorteio < cfg->pesos[op]) { escolhida = op; break; }
+        sorteio -= cfg->pesos[op];
+    }
+    // Sem arquivos, as operações que precisam de um viram criações.
+    if (e->num_arquivos == 0 && escolhida != OP_LS) return OP_TOUCH;
+    return escolhida;
+}
+
+// Interpreta a mistura "touch=20,cat=30,...". Retorna 0 em sucesso, -1 em erro.
+static int ler_mistura(const char *texto, unsigned int pesos[NUM_OPERACOES]) {
+    char copia[256];
+    snprintf(copia, sizeof(copia), "%s", texto);
+    memset(pesos, 0, NUM_OPERACOES * sizeof(unsigned int));
+    unsigned int soma = 0;
+    char *contexto = NULL;
+    for (char *item = strtok_r(copia, ",", &contexto); item; item = strtok_r(NULL, ",", &contexto)) {
+        char *igual = strchr(item, '=');
+        if (!igual) return -1;
+        *igual = '\0';
+        int op;
+        for (op = 0; op < NUM_OPERACOES && strcmp(item, nomes_operacoes[op]) != 0; ++op) {
+        }
+        if (op == NUM_OPERACOES) return -1;
+        pesos[op] = (unsigned int)strtoul(igual + 1, NULL, 10);
+        soma += pesos[op];
+    }
+    return soma > 0 ? 0 : -1;
+}
+
+// Limite superior (ns) da faixa do histograma que contém o percentil 'p'.
+static uint64_t percentil_histograma(const struct estatisticas_operacao *s, double p) {
+    uint64_t alvo = (uint64_t)(p * s->operacoes + 0.5);
+    uint64_t acumulado = 0;
+    if (alvo == 0) alvo = 1;
+    for (int faixa = 0; faixa < MARK_FAIXAS_HISTOGRAMA; ++faixa) {
+        acumulado += s->histograma[faixa];
+        if (acumulado >= alvo) {
+            uint64_t limite = 2ull << faixa;
+            return limite < s->max_ns ? limite : s->max_ns;
+        }
+    }
+    return s->max_ns;
+}
+
+static void imprimir_contadores_json(FILE *saida, const struct contadores_es *c, uint64_t operacoes) {
+    double n = operacoes ? (double)operacoes : 1.0;
+    fprintf(saida, "{\"leituras\": %llu, \"bytes_lidos\": %llu, \"escritas\": %llu, \"bytes_escritos\": %llu, "
+                   "\"sincronizacoes\": %llu, \"leituras_por_op\": %.2f, \"escritas_por_op\": %.2f, "
+                   "\"bytes_lidos_por_op\": %.1f, \"bytes_escritos_por_op\": %.1f}",
+            (unsigned long long)c->leituras, (unsigned long long)c->bytes_lidos,
+            (unsigned long long)c->escritas, (unsigned long long)c->bytes_escritos,
+            (unsigned long long)c->sincronizacoes, c->leituras / n, c->escritas / n,
+            c->bytes_lidos / n, c->bytes_escritos / n);
+}
+
+// Grava os resultados em JSON. Retorna 0 em sucesso, -1 em erro.
+static int gravar_json(const struct configuracao_mark *cfg, const struct estado_mark *e,
+                       const struct fase_mark fases[3]) {
+    FILE *saida = cfg->saida_json ? fopen(cfg->saida_json, "w") : stdout;
+    if (!saida) {
+        perror("ext2mark: Erro ao abrir o arquivo de saída");
+        return -1;
+    }
+
+    fprintf(saida, "{\n  \"parametros\": {\"tamanho_mib\": %lu, \"diretorios\": %u, \"arquivos_iniciais\": %u, "
+                   "\"transacoes\": %lu, \"tamanho_min\": %lu, \"tamanho_max\": %lu, \"semente\": %llu, "
+                   "\"durabilidade\": \"%s\", \"journal\": %s, \"mistura\": {",
+            cfg->tamanho_mib, cfg->num_diretorios, cfg->arquivos_iniciais, cfg->transacoes,
+            cfg->tamanho_min, cfg->tamanho_max, (unsigned long long)cfg->semente,
+            nomes_durabilidade[cfg->durabilidade], cfg->usar_journal ? "true" : "false");
+    for (int op = 0; op < NUM_OPERACOES; ++op) {
+        fprintf(saida, "%s\"%s\": %u", op ? ", " : "", nomes_operacoes[op], cfg->pesos[op]);
+    }
+    fprintf(saida, "}},\n  \"fases\": [\n");
+    for (int i = 0; i < 3; ++i) {
+        const struct fase_mark *f = &fases[i];
+        fprintf(saida, "    {\"nome\": \"%s\", \"operacoes\": %llu, \"falhas\": %llu, \"segundos\": %.3f, "
+                       "\"transacoes_por_s\": %.1f, \"es\": ",
+                f->nome, (unsigned long long)f->operacoes, (unsigned long long)f->falhas, f->segundos,
+                f->segundos > 0 ? f->operacoes / f->segundos : 0.0);
+        imprimir_contadores_json(saida, &f->es, f->operacoes);
+        fprintf(saida, "}%s\n", i < 2 ? "," : "");
+    }
+    fprintf(saida, "  ],\n  \"operacoes\": [\n");
+    int primeira = 1;
+    for (int op = 0; op < NUM_OPERACOES; ++op) {
+        const struct estatisticas_operacao *s = &e->estatisticas[op];
+        if (s->operacoes == 0) continue;
+        fprintf(saida, "%s    {\"nome\": \"%s\", \"operacoes\": %llu, \"falhas\": %llu, \"ns_por_op\": %.1f, "
+                       "\"min_ns\": %llu, \"p50_ns\": %llu, \"p90_ns\": %llu, \"p99_ns\": %llu, \"max_ns\": %llu,\n"
+                       "     \"histograma\": [",
+                primeira ? "" : ",\n", nomes_operacoes[op], (unsigned long long)s->operacoes,
+                (unsigned long long)s->falhas, (double)s->total_ns / s->operacoes,
+                (unsigned long long)s->min_ns, (unsigned long long)percentil_histograma(s, 0.50),
+                (unsigned long long)percentil_histograma(s, 0.90), (unsigned long long)percentil_histograma(s, 0.99),
+                (unsigned long long)s->max_ns);
+        int primeira_faixa = 1;
+        for (int faixa = 0; faixa < MARK_FAIXAS_HISTOGRAMA; ++faixa) {
+            if (s->histograma[faixa] == 0) continue;
+            fprintf(saida, "%s{\"ate_ns\": %llu, \"operacoes\": %llu}", primeira_faixa ? "" : ", ",
+                    (unsigned long long)(2ull << faixa), (unsigned long long)s->histograma[faixa]);
+            primeira_faixa = 0;
+        }
+        fprintf(saida, "],\n     \"es\": ");
+        imprimir_contadores_json(saida, &s->es, s->operacoes);
+        fprintf(saida, "}");
+        primeira = 0;
+    }
+    fprintf(saida, "\n  ]\n}\n");
+    if (saida != stdout) fclose(saida);
+    return 0;
+}
+
+static void iniciar_fase(struct fase_mark *f, const char *nome, uint64_t *inicio, struct contadores_es *antes) {
+    memset(f, 0, sizeof(*f));
+    f->nome = nome;
+    *antes = contadores_es;
+    *inicio = relogio_ns();
+}
+
+static void encerrar_fase(struct fase_mark *f, uint64_t inicio, const struct contadores_es *antes) {
+    f->segundos = (relogio_ns() - inicio) / 1e9;
+    somar_contadores(&f->es, antes);
+}
+
+int main(int argc, char *argv[]) {
+    struct configuracao_mark cfg = { 128, 50, 500, 10000, 512, 16384, 1, { 15, 30, 10, 25, 10, 10 },
+                                     DURABILIDADE_NENHUMA, 0, "/tmp", NULL };
+    int opcao;
+
+    while ((opcao = getopt(argc, argv, "s:d:f:t:z:r:x:p:jw:o:h")) != -1) {
+        switch (opcao) {
+            case 's': cfg.tamanho_mib = strtoul(optarg, NULL, 10); break;
+            case 'd': cfg.num_diretorios = (unsigned int)strtoul(optarg, NULL, 10); break;
+            case 'f': cfg.arquivos_iniciais = (unsigned int)strtoul(optarg, NULL, 10); break;
+            case 't': cfg.transacoes = strtoul(optarg, NULL, 10); break;
+            case 'z':
+                if (sscanf(optarg, "%lu:%lu", &cfg.tamanho_min, &cfg.tamanho_max) != 2) cfg.tamanho_max = 0;
+                break;
+            case 'r': cfg.semente = strtoull(optarg, NULL, 10); break;
+            case 'x':
+                if (ler_mistura(optarg, cfg.pesos) != 0) {
+                    fprintf(stderr, "ext2mark: mistura inválida '%s' (ex.: touch=20,cat=30,cp=10,rm=20,mv=10,ls=10)\n", optarg);
+                    return 2;
+                }
+                break;
+            case 'p':
+                if (durabilidade_modo_por_nome(optarg, &cfg.durabilidade) != 0) {
+                    fprintf(stderr, "ext2mark: política de durabilidade desconhecida '%s'\n", optarg);
+                    return 2;
+                }
+                break;
+            case 'j': cfg.usar_journal = 1; break;
+            case 'w': cfg.diretorio_trabalho = optarg; break;
+            case 'o': cfg.saida_json = optarg; break;
+            default:
+                fprintf(stderr, "Uso: %s [-s MiB] [-d diretórios] [-f arquivos] [-t transações] [-z min:max] "
+                                "[-r semente] [-x mistura] [-p durabilidade] [-j] [-w diretório] [-o saida.json]\n", argv[0]);
+                return opcao == 'h' ? 0 : 2;
+        }
+    }
+    if (cfg.tamanho_mib == 0 || cfg.num_diretorios == 0 || cfg.tamanho_max == 0 ||
+        cfg.tamanho_min > cfg.tamanho_max || cfg.tamanho_max > (64u << 20)) {
+        fprintf(stderr, "ext2mark: parâmetros inválidos (tamanhos entre 0 e 64 MiB, min <= max)\n");
+        return 2;
+    }
+    estado_aleatorio = cfg.semente * 0x9E3779B97F4A7C15ull + 1;
+
+    char caminho_imagem[1024];
+    snprintf(caminho_imagem, sizeof(caminho_imagem), "%s/ext2mark.img", cfg.diretorio_trabalho);
+    unlink(caminho_imagem);
+    modo_verboso = 0;
+    struct parametros_mkfs parametros = { (uint64_t)cfg.tamanho_mib << 20, 0, 0, 0, 0 };
+    if (criar_sistema_de_arquivos(caminho_imagem, &parametros) != 0) return 1;
+
+    struct estado_mark e;
+    unsigned int num_grupos = 0;
+    memset(&e, 0, sizeof(e));
+    e.fd = read_superblock(caminho_imagem, &e.sb);
+    if (e.fd < 0) return 1;
+    e.bgdt = read_block_group_descriptor_table(e.fd, &e.sb, &num_grupos);
+    e.dados = (char *)malloc(cfg.tamanho_max + 1);
+    if (!e.bgdt || !e.dados) return 1;
+    for (unsigned long i = 0; i < cfg.tamanho_max; ++i) e.dados[i] = (char)('a' + i % 26);
+    construir_indice_livre(e.fd, &e.sb, e.bgdt);
+    e.sessao.diretorio_atual_inode = EXT2_ROOT_INO;
+    strcpy(e.sessao.diretorio_atual, "/");
+
+    // Mesmas regras do shell: metadados adiados só sem journal e sem sincronização.
+    motor_atual->metadados_adiados = (!cfg.usar_journal && cfg.durabilidade == DURABILIDADE_NENHUMA);
+    char caminho_journal[1100];
+    snprintf(caminho_journal, sizeof(caminho_journal), "%s.journal", caminho_imagem);
+    unlink(caminho_journal);
+    if (cfg.usar_journal && journal_abrir(caminho_imagem, 32, &e.sb) != 0) return 1;
+    if (durabilidade_iniciar(e.fd, cfg.durabilidade, 1000) != 0) return 1;
+
+    // Os comandos do shell imprimem (cat, ls e mensagens de erro): a saída é descartada
+    // durante a execução; as falhas ficam contadas no JSON.
+    fflush(stdout);
+    fflush(stderr);
+    int stdout_original = dup(STDOUT_FILENO);
+    int stderr_original = dup(STDERR_FILENO);
+    int nulo = open("/dev/null", O_WRONLY);
+    dup2(nulo, STDOUT_FILENO);
+    dup2(nulo, STDERR_FILENO);
+    close(nulo);
+
+    struct fase_mark fases[3];
+    struct contadores_es antes_fase, antes_op;
+    uint64_t inicio_fase, inicio_op;
+    char linha[96];
+
+    // Fase 1: diretórios e conjunto inicial de arquivos.
+    iniciar_fase(&fases[0], "criacao", &inicio_fase, &antes_fase);
+    executar_linha(&e, "mkdir /mark");
+    for (unsigned int d = 0; d < cfg.num_diretorios; ++d) {
+        snprintf(linha, sizeof(linha), "mkdir /mark/d%u", d);
+        if (executar_linha(&e, linha) != 0) fases[0].falhas++;
+    }
+    for (unsigned int i = 0; i < cfg.arquivos_iniciais; ++i) {
+        if (operacao_touch(&e, &cfg) != 0) fases[0].falhas++;
+        fases[0].operacoes++;
+    }
+    encerrar_fase(&fases[0], inicio_fase, &antes_fase);
+
+    // Fase 2: transações.
+    iniciar_fase(&fases[1], "transacoes", &inicio_fase, &antes_fase);
+    for (unsigned long i = 0; i < cfg.transacoes; ++i) {
+        int op = sortear_operacao(&e, &cfg);
+        antes_op = contadores_es;
+        inicio_op = relogio_ns();
+        int falhou = executar_operacao(&e, &cfg, op) != 0;
+        registrar_operacao(&e.estatisticas[op], inicio_op, &antes_op, falhou);
+        fases[1].operacoes++;
+        if (falhou) fases[1].falhas++;
+    }
+    encerrar_fase(&fases[1], inicio_fase, &antes_fase);
+
+    // Fase 3: remoção dos arquivos restantes.
+    iniciar_fase(&fases[2], "remocao", &inicio_fase, &antes_fase);
+    while (e.num_arquivos > 0) {
+        snprintf(linha, sizeof(linha), "rm %s", e.arquivos[--e.num_arquivos].caminho);
+        if (executar_linha(&e, linha) != 0) fases[2].falhas++;
+        fases[2].operacoes++;
+    }
+    encerrar_fase(&fases[2], inicio_fase, &antes_fase);
+
+    int resultado = 0;
+    if (gravar_metadados_adiados(e.fd, &e.sb, e.bgdt) != 0) resultado = -1;
+    if (descritores_gravar_copias(e.fd) != 0) resultado = -1;
+    if (durabilidade_encerrar(e.fd) != 0) resultado = -1;
+    if (journal_fechar(e.fd) != 0) resultado = -1;
+
+    fflush(stdout);
+    fflush(stderr);
+    dup2(stdout_original, STDOUT_FILENO);
+    dup2(stderr_original, STDERR_FILENO);
+    close(stdout_original);
+    close(stderr_original);
+
+    if (gravar_json(&cfg, &e, fases) != 0) resultado = -1;
+
+    liberar_indice_livre();
+    liberar_mapas_diretorios();
+    liberar_transacoes();
+    free(e.arquivos);
+    free(e.dados);
+    liberar_descritores();
+    close(e.fd);
+    return resultado == 0 ? 0 : 1;
+}
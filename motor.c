@@ -0,0 +1,8249 @@
+/*
+    Implementação do sistema de arquivos Ext2 em C
+    Alunos:
+        Eduardo Knabben Tiyo         RA:2551748
+        Pedro Chouery Grigolli       RA: 2551845
+        Felipe Martins Sanches       RA: 2390809
+        Ingrid Reupke Sbeguen Moran  RA: 2349388
+
+    Data de criação: 24/05/2025
+    Datas de alteação: 24/05/2025, 2/06/2025, 3/06/2025, 4/06/2025, 5/06/2025, 10/06/2025
+*/
+
+#include "motor.h"
+
+// Laços quentes que dependem do tamanho do bloco são escritos uma vez, como funções
+// ESPECIALIZADA que recebem o tamanho como parâmetro, e chamados por um switch em
+// log_bloco (POR_TAMANHO_DE_BLOCO): cada tamanho ganha uma cópia com o tamanho
+// constante, em que limites, deslocamentos e máscaras viram imediatos.
+#define ESPECIALIZADA static inline __attribute__((always_inline))
+#define POR_TAMANHO_DE_BLOCO(funcao, ...) \
+    (motor_atual->geometria.log_bloco == 10 ? funcao(__VA_ARGS__, 1024) : \
+     motor_atual->geometria.log_bloco == 11 ? funcao(__VA_ARGS__, 2048) : funcao(__VA_ARGS__, 4096))
+
+// ---------------------------------------------------------------------------
+// Motores. 'motor_padrao' é o motor do shell e das ferramentas, pronto antes de main;
+// a biblioteca cria um para cada imagem aberta (motor_criar) e o põe em 'motor_atual'
+// durante as suas chamadas.
+// ---------------------------------------------------------------------------
+
+static struct motor motor_padrao;
+
+__thread struct motor *motor_atual = &motor_padrao;
+
+// Estado inicial de um motor: nenhuma imagem aberta, sem journal, sem somas e sem
+// política de durabilidade. Retorna 0 em sucesso, -1 em erro.
+static int motor_iniciar(struct motor *motor) {
+    memset(motor, 0, sizeof(*motor));
+    motor->geometria = (struct geometria){ 1024, 10, 8, 7, 1, 0, 0, 0, 0, 2048 };
+    motor->descritores.fd = -1;
+    motor->journal.fd = -1;
+    motor->journal.sequencia = 1;
+    motor->journal.grupo_max = 32;
+    motor->somas_blocos.fd = -1;
+    motor->durabilidade.modo = DURABILIDADE_NENHUMA;
+    motor->durabilidade.intervalo_ms = 1000;
+    motor->durabilidade.fd = -1;
+    motor->recolhedor.fd = -1;
+
+    // Com preferência para escritores: um fluxo contínuo de comandos de leitura não
+    // adia indefinidamente as alterações (modo servidor).
+    pthread_rwlockattr_t atributos;
+    if (pthread_rwlockattr_init(&atributos) != 0) return -1;
+    pthread_rwlockattr_setkind_np(&atributos, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    int erro = pthread_rwlock_init(&motor->durabilidade.trava, &atributos);
+    pthread_rwlockattr_destroy(&atributos);
+    if (erro != 0) return -1;
+    pthread_mutex_init(&motor->descritores.mutex, NULL);
+    pthread_mutex_init(&motor->durabilidade.mutex, NULL);
+    pthread_cond_init(&motor->durabilidade.cond, NULL);
+    pthread_mutex_init(&motor->recolhedor.mutex, NULL);
+    pthread_cond_init(&motor->recolhedor.cond, NULL);
+    return 0;
+}
+
+__attribute__((constructor)) static void motor_padrao_iniciar(void) {
+    if (motor_iniciar(&motor_padrao) != 0) abort();
+}
+
+// Cria um motor para uma nova imagem. Retorna NULL se faltar memória.
+struct motor *motor_criar(void) {
+    struct motor *motor = (struct motor *)malloc(sizeof(struct motor));
+    if (motor && motor_iniciar(motor) != 0) {
+        free(motor);
+        motor = NULL;
+    }
+    return motor;
+}
+
+// Libera um motor de motor_criar. A imagem já deve estar fechada e as estruturas em
+// memória liberadas (liberar_descritores, liberar_transacoes, ...).
+void motor_destruir(struct motor *motor) {
+    if (!motor) return;
+    pthread_rwlock_destroy(&motor->durabilidade.trava);
+    pthread_mutex_destroy(&motor->descritores.mutex);
+    pthread_mutex_destroy(&motor->durabilidade.mutex);
+    pthread_cond_destroy(&motor->durabilidade.cond);
+    pthread_mutex_destroy(&motor->recolhedor.mutex);
+    pthread_cond_destroy(&motor->recolhedor.cond);
+    free(motor);
+}
+
+int modo_verboso = 1;
+__thread FILE *saida_cliente;
+
+// ---------------------------------------------------------------------------
+// Camada de E/S posicional e transações de metadados.
+// Todas as leituras e escritas da imagem passam por dev_pread/dev_pwrite.
+// Enquanto uma transação está ativa, as escritas não vão para o disco: os blocos
+// afetados são copiados para um buffer da transação (lendo o bloco original quando
+// a escrita é parcial, como em inodes, superbloco e descritores) e as leituras
+// enxergam essas versões. Na confirmação os blocos sujos são ordenados pelo número
+// e gravados com uma chamada pwritev por sequência de blocos consecutivos.
+// Com o journal ativo, a confirmação registra os blocos no journal e eles ficam
+// pendentes em memória até o commit do grupo (ver seção do journal abaixo).
+// ---------------------------------------------------------------------------
+
+#define TRANSACAO_MAX_VETORES 1024 // Máximo de iovecs por chamada pwritev (UIO_MAXIOV no Linux)
+
+__thread struct contadores_es contadores_es;
+
+// ---------------------------------------------------------------------------
+// Instrumentação (comando 'stats' e opção -J).
+// Além das chamadas de sistema, conta os blocos lidos por tipo, o trabalho dos
+// alocadores (bits do bitmap ou extensões do índice examinados por alocação) e o
+// tempo de cada comando em um histograma de potências de 2. Os pontos de contagem
+// somam em variáveis da thread, sem trava; no fim de cada comando executar_comando
+// passa o que a thread contou para o total do processo (estatisticas_processo), de
+// modo que no modo servidor 'stats' e -J mostram todos os clientes. As threads
+// auxiliares de scrub, dupes e cp devolvem seus contadores ao comando que as criou.
+// Compilar com -DEXT2_SEM_ESTATISTICAS remove todos os pontos de contagem (ESTAT(...)
+// não gera código); contadores_es continua ativo para o trace.
+// ---------------------------------------------------------------------------
+
+static const char *nomes_tipos_bloco[NUM_TIPOS_BLOCO] = {
+    "metadados", "bitmap", "tabela_inodes", "diretorio", "indireto", "dados"
+};
+
+__thread struct estatisticas estatisticas;
+
+// Serializa o registro dos comandos (estatísticas do processo, eventos e trace), que
+// no modo servidor é feito por várias threads.
+static pthread_mutex_t registro_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Total do processo desde o último 'stats reset' (protegido por registro_mutex) e a
+// parte de contadores_es desta thread que já foi somada a ele.
+static struct estatisticas estatisticas_processo;
+static __thread struct contadores_es es_recolhidos;
+
+// Soma ao total do processo o que a thread atual contou desde a última chamada e zera
+// os contadores da thread. Chamada com registro_mutex travado.
+static void estatisticas_recolher(void) {
+    struct contadores_es *es = &estatisticas_processo.es;
+    es->leituras += contadores_es.leituras - es_recolhidos.leituras;
+    es->bytes_lidos += contadores_es.bytes_lidos - es_recolhidos.bytes_lidos;
+    es->escritas += contadores_es.escritas - es_recolhidos.escritas;
+    es->bytes_escritos += contadores_es.bytes_escritos - es_recolhidos.bytes_escritos;
+    es->sincronizacoes += contadores_es.sincronizacoes - es_recolhidos.sincronizacoes;
+    es_recolhidos = contadores_es;
+#ifndef EXT2_SEM_ESTATISTICAS
+    for (int t = 0; t < NUM_TIPOS_BLOCO; ++t) estatisticas_processo.blocos_lidos[t] += estatisticas.blocos_lidos[t];
+    memset(estatisticas.blocos_lidos, 0, sizeof(estatisticas.blocos_lidos));
+    struct estatisticas_alocador *da_thread[2] = { &estatisticas.alocador_inodes, &estatisticas.alocador_blocos };
+    struct estatisticas_alocador *do_processo[2] = { &estatisticas_processo.alocador_inodes, &estatisticas_processo.alocador_blocos };
+    for (int i = 0; i < 2; ++i) {
+        do_processo[i]->alocacoes += da_thread[i]->alocacoes;
+        do_processo[i]->passos += da_thread[i]->passos;
+        if (da_thread[i]->max_passos > do_processo[i]->max_passos) do_processo[i]->max_passos = da_thread[i]->max_passos;
+        da_thread[i]->alocacoes = da_thread[i]->passos = da_thread[i]->max_passos = 0; // passos_atual segue com a thread
+    }
+#endif
+}
+
+#ifndef EXT2_SEM_ESTATISTICAS
+// Soma às estatísticas da thread os blocos lidos por uma thread auxiliar.
+static void estat_somar_blocos_lidos(const uint64_t *blocos_lidos) {
+    for (int t = 0; t < NUM_TIPOS_BLOCO; ++t) estatisticas.blocos_lidos[t] += blocos_lidos[t];
+}
+
+static void estat_alocacao(struct estatisticas_alocador *a, uint64_t passos) {
+    passos += a->passos_atual;
+    a->passos_atual = 0;
+    a->alocacoes++;
+    a->passos += passos;
+    if (passos > a->max_passos) a->max_passos = passos;
+}
+
+// Registra a execução de um comando no total do processo (com registro_mutex travado).
+// Comandos além de ESTAT_MAX_COMANDOS ficam acumulados na última posição ("outros").
+static void estat_comando(const char *nome, uint64_t duracao_ns, int falhou) {
+    struct estatisticas *e = &estatisticas_processo;
+    struct estatisticas_comando *c = NULL;
+    for (int i = 0; i < e->num_comandos; ++i) {
+        if (strcmp(e->comandos[i].nome, nome) == 0) { c = &e->comandos[i]; break; }
+    }
+    if (!c) {
+        if (e->num_comandos < ESTAT_MAX_COMANDOS) {
+            c = &e->comandos[e->num_comandos++];
+            snprintf(c->nome, sizeof(c->nome), "%s", e->num_comandos == ESTAT_MAX_COMANDOS ? "outros" : nome);
+        } else {
+            c = &e->comandos[ESTAT_MAX_COMANDOS - 1];
+        }
+    }
+    int faixa = 0;
+    while (faixa < ESTAT_FAIXAS - 1 && (duracao_ns >> (faixa + 1)) != 0) faixa++;
+    c->execucoes++;
+    c->total_ns += duracao_ns;
+    if (duracao_ns > c->max_ns) c->max_ns = duracao_ns;
+    c->histograma[faixa]++;
+    if (falhou) c->falhas++;
+}
+#endif // EXT2_SEM_ESTATISTICAS
+
+// Zera as estatísticas do processo ('stats reset').
+void estatisticas_zerar(void) {
+    pthread_mutex_lock(&registro_mutex);
+    estatisticas_recolher();
+    memset(&estatisticas_processo, 0, sizeof(estatisticas_processo));
+    pthread_mutex_unlock(&registro_mutex);
+}
+
+// Cópia do total do processo, já com o que a thread atual contou.
+static struct estatisticas estat_copiar_processo(void) {
+    pthread_mutex_lock(&registro_mutex);
+    estatisticas_recolher();
+    struct estatisticas e = estatisticas_processo;
+    pthread_mutex_unlock(&registro_mutex);
+    return e;
+}
+
+// Limite superior (ns) da faixa do histograma que contém o percentil 'p'.
+static uint64_t estat_percentil(const struct estatisticas_comando *c, double p) {
+    uint64_t alvo = (uint64_t)(p * c->execucoes + 0.5);
+    uint64_t acumulado = 0;
+    if (alvo == 0) alvo = 1;
+    for (int faixa = 0; faixa < ESTAT_FAIXAS; ++faixa) {
+        acumulado += c->histograma[faixa];
+        if (acumulado >= alvo) return (2ull << faixa) < c->max_ns ? (2ull << faixa) : c->max_ns;
+    }
+    return c->max_ns;
+}
+
+static void estat_imprimir_alocador(FILE *saida, const char *nome, const struct estatisticas_alocador *a) {
+    fprintf(saida, "alocador de %s: %llu alocações, %.1f passos/alocação (máximo %llu)\n", nome,
+            (unsigned long long)a->alocacoes, a->alocacoes ? (double)a->passos / a->alocacoes : 0.0,
+            (unsigned long long)a->max_passos);
+}
+
+// Imprime as estatísticas do processo em texto (comando 'stats').
+void estatisticas_imprimir(FILE *saida) {
+    struct estatisticas e = estat_copiar_processo();
+    const struct contadores_es *es = &e.es;
+    fprintf(saida, "E/S: %llu leituras (%llu bytes), %llu escritas (%llu bytes), %llu sincronizações\n",
+            (unsigned long long)es->leituras, (unsigned long long)es->bytes_lidos, (unsigned long long)es->escritas,
+            (unsigned long long)es->bytes_escritos, (unsigned long long)es->sincronizacoes);
+    if (!ESTATISTICAS_ATIVAS) {
+        fprintf(saida, "(contadores detalhados desativados na compilação: EXT2_SEM_ESTATISTICAS)\n");
+        return;
+    }
+    fprintf(saida, "blocos lidos:");
+    for (int t = 0; t < NUM_TIPOS_BLOCO; ++t) {
+        fprintf(saida, " %s %llu", nomes_tipos_bloco[t], (unsigned long long)e.blocos_lidos[t]);
+    }
+    fprintf(saida, "\n");
+    estat_imprimir_alocador(saida, "inodes", &e.alocador_inodes);
+    estat_imprimir_alocador(saida, "blocos", &e.alocador_blocos);
+    fprintf(saida, "%-10s %8s %7s %10s %10s %10s %10s\n", "comando", "n", "falhas", "media_us", "p50_us", "p99_us", "max_us");
+    for (int i = 0; i < e.num_comandos; ++i) {
+        const struct estatisticas_comando *c = &e.comandos[i];
+        fprintf(saida, "%-10s %8llu %7llu %10.1f %10.1f %10.1f %10.1f\n", c->nome, (unsigned long long)c->execucoes,
+                (unsigned long long)c->falhas, c->total_ns / 1e3 / c->execucoes, estat_percentil(c, 0.50) / 1e3,
+                estat_percentil(c, 0.99) / 1e3, c->max_ns / 1e3);
+    }
+}
+
+// Grava as estatísticas do processo em JSON (opção -J). Retorna 0 em sucesso, -1 em erro.
+int estatisticas_gravar_json(const char *caminho) {
+    FILE *saida = fopen(caminho, "w");
+    if (!saida) {
+        perror("stats: Erro ao criar o arquivo JSON");
+        return -1;
+    }
+    struct estatisticas e = estat_copiar_processo();
+    const struct contadores_es *es = &e.es;
+    fprintf(saida, "{\n  \"es\": {\"leituras\": %llu, \"bytes_lidos\": %llu, \"escritas\": %llu, "
+                   "\"bytes_escritos\": %llu, \"sincronizacoes\": %llu},\n  \"detalhadas\": %s,\n  \"blocos_lidos\": {",
+            (unsigned long long)es->leituras, (unsigned long long)es->bytes_lidos, (unsigned long long)es->escritas,
+            (unsigned long long)es->bytes_escritos, (unsigned long long)es->sincronizacoes,
+            ESTATISTICAS_ATIVAS ? "true" : "false");
+    for (int t = 0; t < NUM_TIPOS_BLOCO; ++t) {
+        fprintf(saida, "%s\"%s\": %llu", t ? ", " : "", nomes_tipos_bloco[t], (unsigned long long)e.blocos_lidos[t]);
+    }
+    fprintf(saida, "},\n  \"alocadores\": {");
+    const struct estatisticas_alocador *alocadores[2] = { &e.alocador_inodes, &e.alocador_blocos };
+    for (int i = 0; i < 2; ++i) {
+        fprintf(saida, "%s\"%s\": {\"alocacoes\": %llu, \"passos\": %llu, \"max_passos\": %llu}", i ? ", " : "",
+                i ? "blocos" : "inodes", (unsigned long long)alocadores[i]->alocacoes,
+                (unsigned long long)alocadores[i]->passos, (unsigned long long)alocadores[i]->max_passos);
+    }
+    fprintf(saida, "},\n  \"comandos\": [");
+    for (int i = 0; i < e.num_comandos; ++i) {
+        const struct estatisticas_comando *c = &e.comandos[i];
+        fprintf(saida, "%s\n    {\"nome\": \"%s\", \"execucoes\": %llu, \"falhas\": %llu, \"total_ns\": %llu, "
+                       "\"p50_ns\": %llu, \"p99_ns\": %llu, \"max_ns\": %llu, \"histograma\": [",
+                i ? "," : "", c->nome, (unsigned long long)c->execucoes, (unsigned long long)c->falhas,
+                (unsigned long long)c->total_ns, (unsigned long long)estat_percentil(c, 0.50),
+                (unsigned long long)estat_percentil(c, 0.99), (unsigned long long)c->max_ns);
+        int primeira = 1;
+        for (int faixa = 0; faixa < ESTAT_FAIXAS; ++faixa) {
+            if (c->histograma[faixa] == 0) continue;
+            fprintf(saida, "%s{\"ate_ns\": %llu, \"execucoes\": %llu}", primeira ? "" : ", ",
+                    (unsigned long long)(2ull << faixa), (unsigned long long)c->histograma[faixa]);
+            primeira = 0;
+        }
+        fprintf(saida, "]}");
+    }
+    fprintf(saida, "\n  ]\n}\n");
+    int resultado = (fclose(saida) == 0) ? 0 : -1;
+    if (resultado != 0) perror("stats: Erro ao gravar o arquivo JSON");
+    return resultado;
+}
+
+// Relógio monotônico em nanossegundos (durações de comandos, sincronizações e eventos).
+uint64_t relogio_ns(void) {
+    struct timespec agora;
+    clock_gettime(CLOCK_MONOTONIC, &agora);
+    return (uint64_t)agora.tv_sec * 1000000000ull + (uint64_t)agora.tv_nsec;
+}
+
+// ---------------------------------------------------------------------------
+// Eventos para o Perfetto (opção -P).
+// Grava spans aninhados no Trace Event Format (JSON), para abrir no ui.perfetto.dev
+// ou no chrome://tracing: o comando, a resolução de caminhos (path_to_inode_number,
+// dir_lookup) e a E/S (leituras de bloco e de inode, gravações de blocos e da
+// transação, fdatasync), cada uma com os blocos e bytes envolvidos. Cada span é um
+// evento completo ("ph":"X"); o aninhamento vem dos tempos dentro da mesma thread.
+// Com o arquivo fechado, cada ponto custa um teste. Compilar com -DEXT2_SEM_ESTATISTICAS
+// também remove os eventos.
+// ---------------------------------------------------------------------------
+
+static struct {
+    FILE *arquivo;
+    uint64_t inicio_ns;  // Instante do ts = 0
+    int num_threads;     // Identificadores já distribuídos
+} eventos;
+
+static __thread int eventos_thread; // Identificador da thread nos eventos (0 = ainda sem)
+
+#ifndef EXT2_SEM_ESTATISTICAS
+#define EVENTOS_ATIVOS (eventos.arquivo != NULL)
+#else
+#define EVENTOS_ATIVOS 0
+#endif
+#define EVENTO_INICIO() (EVENTOS_ATIVOS ? relogio_ns() : 0)
+
+// Copia 'texto' para 'saida' escapando-o para uma string JSON (truncado se preciso).
+void evento_texto_json(char *saida, size_t tamanho_saida, const char *texto) {
+    size_t n = 0;
+    for (; *texto != '\0' && n + 7 < tamanho_saida; ++texto) {
+        unsigned char c = (unsigned char)*texto;
+        if (c == '"' || c == '\\') {
+            saida[n++] = '\\';
+            saida[n++] = (char)c;
+        } else if (c < 0x20) {
+            n += (size_t)snprintf(saida + n, tamanho_saida - n, "\\u%04x", c);
+        } else {
+            saida[n++] = (char)c;
+        }
+    }
+    saida[n] = '\0';
+}
+
+// Abre o arquivo de eventos. Retorna 0 em sucesso, -1 em erro.
+int eventos_abrir(const char *caminho) {
+    if (!ESTATISTICAS_ATIVAS) {
+        fprintf(erros_comando(), "eventos: indisponíveis (compilado com EXT2_SEM_ESTATISTICAS)\n");
+        return -1;
+    }
+    eventos.arquivo = fopen(caminho, "w");
+    if (!eventos.arquivo) {
+        perror("eventos: Erro ao criar o arquivo");
+        return -1;
+    }
+    eventos.inicio_ns = relogio_ns();
+    // O primeiro evento (nome do processo) permite prefixar todos os outros com ','.
+    fprintf(eventos.arquivo, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+                             "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"ext2shell\"}}");
+    return 0;
+}
+
+// Fecha o arquivo de eventos (sem efeito se não houver um aberto). Retorna 0 em sucesso, -1 em erro.
+int eventos_fechar(void) {
+    if (!eventos.arquivo) return 0;
+    fprintf(eventos.arquivo, "\n]}\n");
+    int resultado = fclose(eventos.arquivo);
+    eventos.arquivo = NULL;
+    if (resultado != 0) perror("eventos: Erro ao gravar o arquivo");
+    return resultado == 0 ? 0 : -1;
+}
+
+// Grava um span de 'inicio' (relogio_ns) até agora. 'formato_args', se não for NULL,
+// monta o conteúdo do objeto "args" (pares JSON já formatados, sem as chaves).
+void evento(const char *categoria, const char *nome, uint64_t inicio, const char *formato_args, ...) {
+    if (!eventos.arquivo) return;
+    uint64_t fim = relogio_ns();
+    if (eventos_thread == 0) eventos_thread = __sync_add_and_fetch(&eventos.num_threads, 1);
+
+    char args[768] = "";
+    if (formato_args) {
+        va_list lista;
+        va_start(lista, formato_args);
+        vsnprintf(args, sizeof(args), formato_args, lista);
+        va_end(lista);
+    }
+    // Uma única chamada por evento: o FILE é travado por chamada, então eventos de
+    // threads diferentes não se misturam.
+    fprintf(eventos.arquivo, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                             "\"pid\":1,\"tid\":%d,\"args\":{%s}}",
+            nome, categoria, (inicio - eventos.inicio_ns) / 1e3, (fim - inicio) / 1e3, eventos_thread, args);
+}
+
+static uint32_t transacao_hash(uint32_t numero) {
+    return numero * 2654435761u; // Hash multiplicativo de Knuth
+}
+
+// Procura o bloco no conjunto. Retorna o índice em 'blocos' ou -1.
+int64_t transacao_procurar(const struct transacao *t, uint32_t numero) {
+    if (t->tabela_cap == 0) return -1;
+    uint32_t mascara = t->tabela_cap - 1;
+    for (uint32_t pos = transacao_hash(numero) & mascara; ; pos = (pos + 1) & mascara) {
+        uint32_t entrada = t->tabela[pos];
+        if (entrada == 0) return -1;
+        if (t->blocos[entrada - 1].numero == numero) return entrada - 1;
+    }
+}
+
+// Reconstrói a tabela hash com o dobro da capacidade. Retorna 0 em sucesso, -1 em erro.
+static int transacao_crescer_tabela(struct transacao *t) {
+    uint32_t nova_cap = t->tabela_cap ? t->tabela_cap * 2 : 64;
+    uint32_t *nova = (uint32_t *)calloc(nova_cap, sizeof(uint32_t));
+    if (!nova) {
+        perror("transacao: Erro ao alocar tabela de blocos");
+        return -1;
+    }
+    for (uint32_t i = 0; i < t->num_blocos; ++i) {
+        uint32_t pos = transacao_hash(t->blocos[i].numero) & (nova_cap - 1);
+        while (nova[pos] != 0) pos = (pos + 1) & (nova_cap - 1);
+        nova[pos] = i + 1;
+    }
+    free(t->tabela);
+    t->tabela = nova;
+    t->tabela_cap = nova_cap;
+    return 0;
+}
+
+// Retorna o buffer do bloco 'numero' dentro do conjunto, criando-o se necessário.
+// Se 'carregar' for 1, um bloco novo é preenchido com o conteúdo atual da imagem
+// (incluindo versões ainda pendentes no journal).
+// O ponteiro retornado só é válido até a próxima chamada (o vetor pode ser realocado).
+static char* transacao_bloco(struct transacao *t, int fd, uint32_t numero, int carregar) {
+    int64_t indice = transacao_procurar(t, numero);
+    if (indice >= 0) return transacao_dados(t, indice);
+
+    if (t->num_blocos == t->capacidade) {
+        uint32_t nova_cap = t->capacidade ? t->capacidade * 2 : 16;
+        struct bloco_transacao *novos = (struct bloco_transacao *)realloc(t->blocos,
+                                                                          nova_cap * sizeof(struct bloco_transacao));
+        if (novos) t->blocos = novos;
+        char *dados = (char *)realloc(t->dados, (size_t)nova_cap << motor_atual->geometria.log_bloco);
+        if (dados) t->dados = dados;
+        if (!novos || !dados) {
+            perror("transacao: Erro ao alocar blocos");
+            return NULL;
+        }
+        t->capacidade = nova_cap;
+    }
+    if ((t->num_blocos + 1) * 2 > t->tabela_cap && transacao_crescer_tabela(t) != 0) {
+        return NULL;
+    }
+
+    struct bloco_transacao *bloco = &t->blocos[t->num_blocos];
+    bloco->numero = numero;
+    bloco->slot = t->num_blocos; // Os espaços só são reaproveitados depois de transacao_limpar
+    char *dados = transacao_dados(t, t->num_blocos);
+    if (carregar) {
+        int64_t pendente = (t != &motor_atual->journal_pendentes) ? transacao_procurar(&motor_atual->journal_pendentes, numero) : -1;
+        if (pendente >= 0) {
+            memcpy(dados, transacao_dados(&motor_atual->journal_pendentes, pendente), BLOCK_SIZE);
+        } else {
+            ssize_t lidos = pread(fd, dados, BLOCK_SIZE, offset_do_bloco(numero));
+            contadores_es.leituras++;
+            if (lidos < 0) {
+                perror("transacao: Erro ao carregar bloco");
+                return NULL;
+            }
+            contadores_es.bytes_lidos += (uint64_t)lidos;
+            if (lidos < BLOCK_SIZE) memset(dados + lidos, 0, BLOCK_SIZE - lidos);
+        }
+    }
+
+    uint32_t mascara = t->tabela_cap - 1;
+    uint32_t pos = transacao_hash(numero) & mascara;
+    while (t->tabela[pos] != 0) pos = (pos + 1) & mascara;
+    t->tabela[pos] = t->num_blocos + 1;
+    t->num_blocos++;
+    return dados;
+}
+
+// Copia para 'buffer' (que representa a faixa [offset, offset + tamanho)) os blocos
+// do conjunto que interceptam essa faixa.
+static void transacao_sobrepor(const struct transacao *t, void *buffer, size_t tamanho, off_t offset) {
+    if (t->num_blocos == 0) return;
+    uint32_t primeiro = (uint32_t)(offset >> motor_atual->geometria.log_bloco);
+    uint32_t ultimo = (uint32_t)((offset + tamanho - 1) >> motor_atual->geometria.log_bloco);
+    for (uint32_t numero = primeiro; numero <= ultimo; ++numero) {
+        int64_t indice = transacao_procurar(t, numero);
+        if (indice < 0) continue;
+        off_t inicio_bloco = offset_do_bloco(numero);
+        off_t de = offset > inicio_bloco ? offset : inicio_bloco;
+        off_t ate = (offset + (off_t)tamanho < inicio_bloco + BLOCK_SIZE) ? offset + (off_t)tamanho : inicio_bloco + BLOCK_SIZE;
+        memcpy((char *)buffer + (de - offset), transacao_dados(t, indice) + (de - inicio_bloco), ate - de);
+    }
+}
+
+// Somas de verificação dos blocos gravados na imagem (ver "<imagem>.crc" abaixo).
+static void somas_atualizar(uint32_t primeiro, const char *dados, uint32_t num_blocos);
+static void somas_recalcular(int fd, off_t offset, size_t tamanho);
+
+// 1 se o bloco 'numero' tem uma versão pendente na transação ou no journal (que seria
+// gravada por cima de uma escrita feita direto na imagem).
+static int bloco_pendente(uint32_t numero) {
+    return transacao_procurar(&motor_atual->transacao_atual, numero) >= 0 || transacao_procurar(&motor_atual->journal_pendentes, numero) >= 0;
+}
+
+// Leitura posicional da imagem. Enxerga as escritas pendentes no journal e na transação.
+// Retorna o número de bytes lidos ou -1 em erro (mesma semântica de pread).
+ssize_t dev_pread(int fd, void *buffer, size_t tamanho, off_t offset) {
+    ssize_t lidos = pread(fd, buffer, tamanho, offset);
+    contadores_es.leituras++;
+    if (lidos <= 0) return lidos;
+    contadores_es.bytes_lidos += (uint64_t)lidos;
+    transacao_sobrepor(&motor_atual->journal_pendentes, buffer, (size_t)lidos, offset); // Mais antigos primeiro
+    transacao_sobrepor(&motor_atual->transacao_atual, buffer, (size_t)lidos, offset);
+    return lidos;
+}
+
+// Escrita posicional na imagem. Com uma transação ativa, a escrita fica no buffer
+// da transação até transacao_confirmar().
+// Retorna o número de bytes escritos ou -1 em erro (mesma semântica de pwrite).
+ssize_t dev_pwrite(int fd, const void *buffer, size_t tamanho, off_t offset) {
+    if (motor_atual->transacao_atual.aninhamento == 0) {
+        ssize_t escritos = pwrite(fd, buffer, tamanho, offset);
+        contadores_es.escritas++;
+        if (escritos > 0) {
+            contadores_es.bytes_escritos += (uint64_t)escritos;
+            somas_recalcular(fd, offset, (size_t)escritos);
+        }
+        return escritos;
+    }
+
+    size_t escritos = 0;
+    while (escritos < tamanho) {
+        off_t posicao = offset + escritos;
+        uint32_t numero = (uint32_t)(posicao >> motor_atual->geometria.log_bloco);
+        size_t dentro = (size_t)(posicao & (BLOCK_SIZE - 1));
+        size_t parte = BLOCK_SIZE - dentro;
+        if (parte > tamanho - escritos) parte = tamanho - escritos;
+
+        // Só é preciso ler o bloco original quando a escrita não o cobre inteiro.
+        char *dados = transacao_bloco(&motor_atual->transacao_atual, fd, numero, parte != BLOCK_SIZE);
+        if (!dados) return -1;
+        memcpy(dados + dentro, (const char *)buffer + escritos, parte);
+        escritos += parte;
+    }
+    return (ssize_t)escritos;
+}
+
+// Escrita de blocos inteiros de dados de arquivo ('offset' e 'tamanho' múltiplos do
+// bloco). Os dados não entram na transação: vão direto para a imagem, antes do commit dos
+// metadados que passam a apontá-los, como no modo 'ordered' do ext3. Um bloco liberado só
+// é realocado depois que a liberação fica durável (ver liberacao_registrar), então a
+// escrita nunca atinge um bloco que metadados ainda no disco apontam. Só quando algum dos
+// blocos tem versão pendente na transação ou no journal (que seria gravada por cima) a
+// escrita segue por dev_pwrite.
+// Retorna o número de bytes escritos ou -1 em erro (mesma semântica de pwrite).
+ssize_t dev_pwrite_dados(int fd, const void *buffer, size_t tamanho, off_t offset) {
+    uint32_t primeiro = (uint32_t)(offset >> motor_atual->geometria.log_bloco);
+    uint32_t num_blocos = (uint32_t)(tamanho >> motor_atual->geometria.log_bloco);
+    if (motor_atual->transacao_atual.aninhamento == 0) return dev_pwrite(fd, buffer, tamanho, offset);
+    for (uint32_t i = 0; i < num_blocos; ++i) {
+        if (bloco_pendente(primeiro + i)) return dev_pwrite(fd, buffer, tamanho, offset);
+    }
+    ssize_t escritos = pwrite(fd, buffer, tamanho, offset);
+    contadores_es.escritas++;
+    if (escritos > 0) {
+        contadores_es.bytes_escritos += (uint64_t)escritos;
+        motor_atual->escritas_nao_sincronizadas = 1;
+    }
+    if (escritos == (ssize_t)tamanho) somas_atualizar(primeiro, (const char *)buffer, num_blocos);
+    return escritos;
+}
+
+// Abre (ou aninha) uma transação. Transações aninhadas só são gravadas quando a
+// mais externa é confirmada, o que permite agrupar vários comandos em um lote.
+void transacao_iniciar(void) {
+    motor_atual->transacao_atual.aninhamento++;
+}
+
+static int comparar_blocos_transacao(const void *a, const void *b) {
+    uint32_t na = ((const struct bloco_transacao *)a)->numero;
+    uint32_t nb = ((const struct bloco_transacao *)b)->numero;
+    return (na > nb) - (na < nb);
+}
+
+// Grava os blocos do conjunto na imagem, ordenados pelo número do bloco, usando uma
+// chamada pwritev para cada sequência de blocos consecutivos.
+// Retorna 0 em sucesso, -1 em erro.
+static int transacao_gravar(struct transacao *t, int fd) {
+    struct iovec vetores[TRANSACAO_MAX_VETORES];
+    int resultado = 0;
+    int chamadas = 0;
+    uint64_t inicio_evento = EVENTO_INICIO();
+
+    qsort(t->blocos, t->num_blocos, sizeof(struct bloco_transacao), comparar_blocos_transacao);
+
+    uint32_t i = 0;
+    while (i < t->num_blocos) {
+        uint32_t inicio = t->blocos[i].numero;
+        int num_vetores = 0;
+        while (i < t->num_blocos && num_vetores < TRANSACAO_MAX_VETORES &&
+               t->blocos[i].numero == inicio + (uint32_t)num_vetores) {
+            vetores[num_vetores].iov_base = transacao_dados(t, i);
+            vetores[num_vetores].iov_len = BLOCK_SIZE;
+            num_vetores++;
+            i++;
+        }
+        ssize_t esperado = (ssize_t)num_vetores * BLOCK_SIZE;
+        chamadas++;
+        contadores_es.escritas++;
+        contadores_es.bytes_escritos += (uint64_t)esperado;
+        if (pwritev(fd, vetores, num_vetores, offset_do_bloco(inicio)) != esperado) {
+            perror("transacao: Erro ao gravar blocos");
+            resultado = -1;
+        }
+        for (int v = 0; v < num_vetores; ++v) somas_atualizar(inicio + (uint32_t)v, (const char *)vetores[v].iov_base, 1);
+    }
+    if (EVENTOS_ATIVOS) {
+        evento("es", "transacao_gravar", inicio_evento, "\"blocos\":%u,\"bytes\":%llu,\"pwritev\":%d",
+               t->num_blocos, (unsigned long long)t->num_blocos * BLOCK_SIZE, chamadas);
+    }
+    return resultado;
+}
+
+// Descarta os blocos do conjunto (após gravados). A tabela hash é esvaziada, não liberada.
+static void transacao_limpar(struct transacao *t) {
+    t->num_blocos = 0;
+    if (t->tabela) memset(t->tabela, 0, t->tabela_cap * sizeof(uint32_t));
+}
+
+static void transacao_liberar(struct transacao *t) {
+    free(t->blocos);
+    free(t->dados);
+    free(t->tabela);
+    memset(t, 0, sizeof(*t));
+}
+
+static int journal_registrar(int fd, struct transacao *t);
+static void liberacoes_concluir(void);
+
+// Confirma a transação. Só grava quando a transação mais externa é fechada: direto na
+// imagem ou, com o journal ativo, no journal (a imagem é atualizada no commit do grupo).
+// Retorna 0 em sucesso, -1 em erro.
+int transacao_confirmar(int fd) {
+    if (motor_atual->transacao_atual.aninhamento == 0) return 0;
+    if (--motor_atual->transacao_atual.aninhamento > 0) return 0;
+
+    int resultado = 0;
+    // As liberações da transação passam a esperar só a durabilidade (ver liberacao_registrar).
+    motor_atual->liberacoes.confirmadas = motor_atual->liberacoes.tamanho;
+    if (motor_atual->transacao_atual.num_blocos > 0) {
+        motor_atual->escritas_nao_sincronizadas = 1;
+        if (motor_atual->journal.fd >= 0) {
+            resultado = journal_registrar(fd, &motor_atual->transacao_atual);
+        } else {
+            resultado = transacao_gravar(&motor_atual->transacao_atual, fd);
+        }
+    }
+    transacao_limpar(&motor_atual->transacao_atual);
+    if (motor_atual->journal.fd < 0 && motor_atual->durabilidade.modo == DURABILIDADE_NENHUMA) {
+        liberacoes_concluir(); // Sem journal nem sincronização, gravar é o que há de durável
+    }
+    return resultado;
+}
+
+// Libera a memória usada pelas transações.
+void liberar_transacoes(void) {
+    transacao_liberar(&motor_atual->transacao_atual);
+    transacao_liberar(&motor_atual->journal_pendentes);
+    free(motor_atual->liberacoes.itens);
+    memset(&motor_atual->liberacoes, 0, sizeof(motor_atual->liberacoes));
+}
+
+// ---------------------------------------------------------------------------
+// Journal de metadados (write-ahead, no estilo do ext3), em um arquivo auxiliar
+// "<imagem>.journal". Cada transação confirmada vira um registro:
+//
+//   cabeçalho | números dos blocos (uint32) | conteúdo dos blocos | rodapé (com CRC32C)
+//
+// Só metadados entram no journal: os blocos de dados são gravados direto na imagem antes
+// do registro (dev_pwrite_dados), e o commit de grupo sincroniza a imagem antes do journal
+// quando houve essas escritas, como no modo 'ordered' do ext3. O cabeçalho traz o UUID, o
+// número de blocos e o tamanho de bloco da imagem: um journal de outra imagem (um
+// "<imagem>.journal" esquecido) não é reaplicado.
+// Os blocos só são gravados na imagem (checkpoint) depois que o journal foi
+// sincronizado com fdatasync. O fdatasync é feito uma vez por grupo de transações
+// (commit de grupo); até lá os blocos ficam em 'journal_pendentes' e as leituras
+// os enxergam. Quando o journal passa de JOURNAL_LIMITE_BYTES, a imagem é
+// sincronizada e o journal é truncado. Ao abrir a imagem, apenas os registros
+// completos (rodapé presente e CRC correto) do journal são reaplicados.
+// ---------------------------------------------------------------------------
+
+#define JOURNAL_MAGIC_INICIO 0x4A324558u  // "EX2J"
+#define JOURNAL_MAGIC_FIM    0x4D434A45u  // "EJCM"
+#define JOURNAL_LIMITE_BYTES (8u * 1024 * 1024) // Tamanho que dispara o checkpoint completo
+
+struct journal_cabecalho {
+    uint32_t magic;          // JOURNAL_MAGIC_INICIO
+    uint32_t num_blocos;     // Quantidade de blocos no registro
+    uint64_t sequencia;      // Número da transação
+    uint8_t uuid[16];        // s_uuid da imagem
+    uint32_t blocos_imagem;  // s_blocks_count da imagem
+    uint32_t tamanho_bloco;  // Tamanho de bloco da imagem
+};
+
+struct journal_rodape {
+    uint32_t magic;          // JOURNAL_MAGIC_FIM
+    uint32_t crc;            // CRC32C dos números e do conteúdo dos blocos
+    uint64_t sequencia;      // Deve coincidir com o cabeçalho
+};
+
+// CRC32C (polinômio de Castagnoli). A implementação é escolhida na primeira chamada: a
+// instrução crc32 do SSE4.2 (x86-64, detectada em tempo de execução) ou do ARMv8 (quando
+// compilado com suporte a ela); senão, tabelas "slicing-by-8", que processam 8 bytes por
+// iteração. Com a instrução, entradas grandes (como blocos) são divididas em três partes
+// calculadas intercaladas, para esconder a latência da instrução, e os três restos são
+// combinados multiplicando por x^(8n) mod P.
+#define CRC32C_POLINOMIO 0x82F63B78u // Refletido
+#define CRC32C_MINIMO_INTERCALADO 768 // Bytes a partir dos quais a entrada é dividida em três
+
+static uint32_t crc32c_tabelas[8][256];
+static uint32_t crc32c_potencias[32]; // x^(2^k) mod P
+static uint32_t (*crc32c_implementacao)(uint32_t crc, const unsigned char *p, size_t tamanho);
+static pthread_once_t crc32c_escolha = PTHREAD_ONCE_INIT;
+
+// a * b mod P, com os polinômios refletidos (bit 31 = x^0).
+static uint32_t crc32c_multiplicar(uint32_t a, uint32_t b) {
+    uint32_t produto = 0;
+    for (uint32_t bit = 1u << 31; bit != 0; bit >>= 1) {
+        if (a & bit) produto ^= b;
+        b = (b >> 1) ^ (CRC32C_POLINOMIO & (0u - (b & 1)));
+    }
+    return produto;
+}
+
+// x^(8 * bytes) mod P: desloca um resto de CRC por 'bytes' bytes nulos.
+static uint32_t crc32c_deslocamento(uint64_t bytes) {
+    uint32_t resultado = 1u << 31; // x^0
+    uint64_t bits = bytes * 8;
+    for (int k = 0; bits != 0 && k < 32; ++k, bits >>= 1) {
+        if (bits & 1) resultado = crc32c_multiplicar(crc32c_potencias[k], resultado);
+    }
+    return resultado;
+}
+
+static uint32_t crc32c_software(uint32_t crc, const unsigned char *p, size_t tamanho) {
+    while (tamanho > 0 && ((uintptr_t)p & 7) != 0) {
+        crc = crc32c_tabelas[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        tamanho--;
+    }
+    while (tamanho >= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        v ^= crc;
+        crc = crc32c_tabelas[7][v & 0xFF] ^ crc32c_tabelas[6][(v >> 8) & 0xFF] ^
+              crc32c_tabelas[5][(v >> 16) & 0xFF] ^ crc32c_tabelas[4][(v >> 24) & 0xFF] ^
+              crc32c_tabelas[3][(v >> 32) & 0xFF] ^ crc32c_tabelas[2][(v >> 40) & 0xFF] ^
+              crc32c_tabelas[1][(v >> 48) & 0xFF] ^ crc32c_tabelas[0][v >> 56];
+        p += 8;
+        tamanho -= 8;
+    }
+    while (tamanho--) crc = crc32c_tabelas[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+// Deslocamentos das partes da última entrada intercalada (normalmente sempre o mesmo
+// tamanho de bloco), para não recalculá-los a cada chamada.
+static __thread uint64_t crc32c_parte_anterior;
+static __thread uint32_t crc32c_deslocamentos[2];
+
+static void crc32c_deslocamentos_parte(uint64_t parte) {
+    if (parte == crc32c_parte_anterior) return;
+    crc32c_deslocamentos[0] = crc32c_deslocamento(parte);
+    crc32c_deslocamentos[1] = crc32c_deslocamento(2 * parte);
+    crc32c_parte_anterior = parte;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const unsigned char *p, size_t tamanho) {
+    while (tamanho > 0 && ((uintptr_t)p & 7) != 0) {
+        crc = __builtin_ia32_crc32qi(crc, *p++);
+        tamanho--;
+    }
+    if (tamanho >= CRC32C_MINIMO_INTERCALADO) {
+        size_t parte = (tamanho / 3) & ~(size_t)7;
+        uint64_t a = crc, b = 0, c = 0, v;
+        const unsigned char *pa = p, *pb = p + parte, *pc = p + 2 * parte;
+        for (size_t i = 0; i < parte; i += 8) {
+            memcpy(&v, pa + i, 8); a = __builtin_ia32_crc32di(a, v);
+            memcpy(&v, pb + i, 8); b = __builtin_ia32_crc32di(b, v);
+            memcpy(&v, pc + i, 8); c = __builtin_ia32_crc32di(c, v);
+        }
+        crc32c_deslocamentos_parte(parte);
+        crc = crc32c_multiplicar(crc32c_deslocamentos[1], (uint32_t)a) ^
+              crc32c_multiplicar(crc32c_deslocamentos[0], (uint32_t)b) ^ (uint32_t)c;
+        p += 3 * parte;
+        tamanho -= 3 * parte;
+    }
+    uint64_t c64 = crc, v;
+    for (; tamanho >= 8; p += 8, tamanho -= 8) {
+        memcpy(&v, p, 8);
+        c64 = __builtin_ia32_crc32di(c64, v);
+    }
+    crc = (uint32_t)c64;
+    while (tamanho--) crc = __builtin_ia32_crc32qi(crc, *p++);
+    return crc;
+}
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+static uint32_t crc32c_armv8(uint32_t crc, const unsigned char *p, size_t tamanho) {
+    uint64_t v;
+    for (; tamanho >= 8; p += 8, tamanho -= 8) {
+        memcpy(&v, p, 8);
+        crc = __crc32cd(crc, v);
+    }
+    while (tamanho--) crc = __crc32cb(crc, *p++);
+    return crc;
+}
+#endif
+
+static void crc32c_inicializar(void) {
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (int k = 0; k < 8; ++k) crc = (crc >> 1) ^ (CRC32C_POLINOMIO & (0u - (crc & 1)));
+        crc32c_tabelas[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; ++i) {
+        for (int k = 1; k < 8; ++k) {
+            uint32_t anterior = crc32c_tabelas[k - 1][i];
+            crc32c_tabelas[k][i] = crc32c_tabelas[0][anterior & 0xFF] ^ (anterior >> 8);
+        }
+    }
+    crc32c_potencias[0] = 1u << 30; // x^1
+    for (int k = 1; k < 32; ++k) crc32c_potencias[k] = crc32c_multiplicar(crc32c_potencias[k - 1], crc32c_potencias[k - 1]);
+
+    crc32c_implementacao = crc32c_software;
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("sse4.2")) crc32c_implementacao = crc32c_sse42;
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+    crc32c_implementacao = crc32c_armv8;
+#endif
+}
+
+// Nome da implementação em uso (para o 'scrub').
+static const char *crc32c_nome(void) {
+    pthread_once(&crc32c_escolha, crc32c_inicializar);
+#if defined(__x86_64__)
+    if (crc32c_implementacao == crc32c_sse42) return "sse4.2";
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+    if (crc32c_implementacao == crc32c_armv8) return "armv8";
+#endif
+    return "tabela";
+}
+
+uint32_t crc32c(uint32_t crc, const void *dados, size_t tamanho) {
+    pthread_once(&crc32c_escolha, crc32c_inicializar);
+    return ~crc32c_implementacao(~crc, (const unsigned char *)dados, tamanho);
+}
+
+// Monta o caminho do journal a partir do caminho da imagem.
+static void journal_caminho(const char *caminho_imagem, char *saida, size_t tamanho_saida) {
+    snprintf(saida, tamanho_saida, "%s.journal", caminho_imagem);
+}
+
+// Commit de grupo: torna o journal durável com um único fdatasync e então grava na
+// imagem todos os blocos pendentes. Retorna 0 em sucesso, -1 em erro.
+int journal_commit_grupo(int fd) {
+    struct journal *j = &motor_atual->journal;
+    if (j->fd < 0 || j->transacoes_pendentes == 0) return 0;
+
+    // Dados gravados direto na imagem devem estar no disco antes dos metadados que os apontam.
+    if (motor_atual->escritas_nao_sincronizadas) {
+        contadores_es.sincronizacoes++;
+        if (fdatasync(fd) != 0) {
+            perror("journal: Erro no fdatasync da imagem");
+            return -1;
+        }
+        motor_atual->escritas_nao_sincronizadas = 0;
+    }
+    contadores_es.sincronizacoes++;
+    uint64_t inicio_evento = EVENTO_INICIO();
+    int erro = fdatasync(j->fd);
+    if (EVENTOS_ATIVOS) evento("es", "fdatasync", inicio_evento, "\"arquivo\":\"journal\",\"transacoes\":%u", j->transacoes_pendentes);
+    if (erro != 0) {
+        perror("journal: Erro no fdatasync do journal");
+        return -1;
+    }
+    liberacoes_concluir(); // As transações que liberaram os blocos já estão no journal
+    int resultado = transacao_gravar(&motor_atual->journal_pendentes, fd); // Checkpoint
+    transacao_limpar(&motor_atual->journal_pendentes);
+    j->transacoes_pendentes = 0;
+
+    if (resultado == 0 && j->tamanho >= (off_t)JOURNAL_LIMITE_BYTES) {
+        // Tudo que está no journal já foi gravado na imagem: sincroniza a imagem e recomeça o journal.
+        contadores_es.sincronizacoes++;
+        if (fdatasync(fd) != 0 || ftruncate(j->fd, 0) != 0) {
+            perror("journal: Erro ao truncar o journal");
+            return -1;
+        }
+        j->tamanho = 0;
+    }
+    return resultado;
+}
+
+// Acrescenta a transação ao journal e move seus blocos para 'journal_pendentes'.
+// Dispara o commit de grupo quando o grupo está completo. Retorna 0 em sucesso, -1 em erro.
+static int journal_registrar(int fd, struct transacao *t) {
+    struct journal *j = &motor_atual->journal;
+    struct journal_cabecalho cabecalho = { JOURNAL_MAGIC_INICIO, t->num_blocos, j->sequencia, { 0 },
+                                           j->blocos_imagem, BLOCK_SIZE };
+    memcpy(cabecalho.uuid, j->uuid, sizeof(cabecalho.uuid));
+    uint32_t *numeros = (uint32_t *)malloc(t->num_blocos * sizeof(uint32_t));
+    if (!numeros) {
+        perror("journal: Erro ao alocar registro");
+        return -1;
+    }
+
+    uint32_t crc = 0;
+    for (uint32_t i = 0; i < t->num_blocos; ++i) numeros[i] = t->blocos[i].numero;
+    crc = crc32c(crc, numeros, t->num_blocos * sizeof(uint32_t));
+    for (uint32_t i = 0; i < t->num_blocos; ++i) crc = crc32c(crc, transacao_dados(t, i), BLOCK_SIZE);
+    struct journal_rodape rodape = { JOURNAL_MAGIC_FIM, crc, j->sequencia };
+
+    // Grava o registro com pwritev, em partes de no máximo TRANSACAO_MAX_VETORES vetores.
+    struct iovec vetores[TRANSACAO_MAX_VETORES];
+    int num_vetores = 0;
+    int resultado = 0;
+    off_t posicao = j->tamanho;
+    size_t pendente_bytes = 0;
+    uint32_t proximo_bloco = 0;
+    int etapa = 0; // 0: cabeçalho+números, 1: blocos, 2: rodapé, 3: fim
+
+    while (etapa < 3 && resultado == 0) {
+        if (etapa == 0) {
+            vetores[num_vetores].iov_base = &cabecalho; vetores[num_vetores++].iov_len = sizeof(cabecalho);
+            vetores[num_vetores].iov_base = numeros; vetores[num_vetores++].iov_len = t->num_blocos * sizeof(uint32_t);
+            pendente_bytes += sizeof(cabecalho) + t->num_blocos * sizeof(uint32_t);
+            etapa = 1;
+        }
+        while (etapa == 1 && num_vetores < TRANSACAO_MAX_VETORES) {
+            if (proximo_bloco == t->num_blocos) { etapa = 2; break; }
+            vetores[num_vetores].iov_base = transacao_dados(t, proximo_bloco++);
+            vetores[num_vetores++].iov_len = BLOCK_SIZE;
+            pendente_bytes += BLOCK_SIZE;
+        }
+        if (etapa == 2 && num_vetores < TRANSACAO_MAX_VETORES) {
+            vetores[num_vetores].iov_base = &rodape; vetores[num_vetores++].iov_len = sizeof(rodape);
+            pendente_bytes += sizeof(rodape);
+            etapa = 3;
+        }
+        if (num_vetores == TRANSACAO_MAX_VETORES || etapa == 3) {
+            contadores_es.escritas++;
+            contadores_es.bytes_escritos += pendente_bytes;
+            if (pwritev(j->fd, vetores, num_vetores, posicao) != (ssize_t)pendente_bytes) {
+                perror("journal: Erro ao gravar registro");
+                resultado = -1;
+            }
+            posicao += pendente_bytes;
+            num_vetores = 0;
+            pendente_bytes = 0;
+        }
+    }
+    free(numeros);
+    if (resultado != 0) return -1;
+
+    j->tamanho = posicao;
+    j->sequencia++;
+
+    // Os blocos passam a ser pendentes de checkpoint (versões mais novas substituem as antigas).
+    for (uint32_t i = 0; i < t->num_blocos; ++i) {
+        char *destino = transacao_bloco(&motor_atual->journal_pendentes, fd, t->blocos[i].numero, 0);
+        if (!destino) return -1;
+        memcpy(destino, transacao_dados(t, i), BLOCK_SIZE);
+    }
+    j->transacoes_pendentes++;
+
+    if (j->transacoes_pendentes >= j->grupo_max) {
+        return journal_commit_grupo(fd);
+    }
+    return 0;
+}
+
+// Reaplica na imagem os registros completos do journal e o trunca. Um journal cujo
+// cabeçalho não identifica a imagem 'sb' (superbloco já validado) é deixado intacto.
+// Deve ser chamada ao abrir a imagem, antes de ler os metadados.
+// Retorna o número de transações reaplicadas, ou -1 em erro.
+int journal_recuperar(int fd, const char *caminho_imagem, const struct ext2_super_block *sb) {
+    char caminho[4096];
+    journal_caminho(caminho_imagem, caminho, sizeof(caminho));
+
+    int jfd = open(caminho, O_RDWR);
+    if (jfd < 0) return 0; // Sem journal: nada a recuperar
+
+    struct stat info;
+    if (fstat(jfd, &info) != 0 || info.st_size == 0) {
+        close(jfd);
+        return 0;
+    }
+
+    int reaplicadas = 0;
+    off_t posicao = 0;
+    char *registro = NULL;
+    size_t registro_cap = 0;
+
+    while (posicao + (off_t)sizeof(struct journal_cabecalho) <= info.st_size) {
+        struct journal_cabecalho cabecalho;
+        if (pread(jfd, &cabecalho, sizeof(cabecalho), posicao) != sizeof(cabecalho) ||
+            cabecalho.magic != JOURNAL_MAGIC_INICIO) {
+            break;
+        }
+        if (memcmp(cabecalho.uuid, sb->s_uuid, sizeof(cabecalho.uuid)) != 0 ||
+            cabecalho.blocos_imagem != sb->s_blocks_count || cabecalho.tamanho_bloco != BLOCK_SIZE) {
+            if (reaplicadas == 0) {
+                fprintf(erros_comando(), "journal: %s não pertence a esta imagem (UUID ou tamanho diferente); "
+                        "nada foi reaplicado e o arquivo foi mantido.\n", caminho);
+                free(registro);
+                close(jfd);
+                return 0;
+            }
+            break;
+        }
+        size_t corpo = (size_t)cabecalho.num_blocos * (sizeof(uint32_t) + BLOCK_SIZE);
+        off_t fim = posicao + sizeof(cabecalho) + corpo + sizeof(struct journal_rodape);
+        if (fim > info.st_size) break; // Registro incompleto (queda durante a escrita)
+
+        if (corpo > registro_cap) {
+            char *novo = (char *)realloc(registro, corpo);
+            if (!novo) {
+                perror("journal: Erro ao alocar memória na recuperação");
+                break;
+            }
+            registro = novo;
+            registro_cap = corpo;
+        }
+        struct journal_rodape rodape;
+        if (pread(jfd, registro, corpo, posicao + sizeof(cabecalho)) != (ssize_t)corpo ||
+            pread(jfd, &rodape, sizeof(rodape), fim - sizeof(rodape)) != sizeof(rodape)) {
+            break;
+        }
+        if (rodape.magic != JOURNAL_MAGIC_FIM || rodape.sequencia != cabecalho.sequencia ||
+            rodape.crc != crc32c(0, registro, corpo)) {
+            break; // Registro sem commit válido: ele e os seguintes são descartados
+        }
+
+        const uint32_t *numeros = (const uint32_t *)registro;
+        const char *dados = registro + cabecalho.num_blocos * sizeof(uint32_t);
+        uint32_t fora = 0;
+        for (uint32_t i = 0; i < cabecalho.num_blocos; ++i) fora |= numeros[i] >= sb->s_blocks_count;
+        if (fora) break; // Bloco fora da imagem: o registro não é desta imagem
+        for (uint32_t i = 0; i < cabecalho.num_blocos; ++i) {
+            if (pwrite(fd, dados + (size_t)i * BLOCK_SIZE, BLOCK_SIZE,
+                       offset_do_bloco(numeros[i])) != (ssize_t)BLOCK_SIZE) {
+                perror("journal: Erro ao reaplicar bloco");
+                free(registro);
+                close(jfd);
+                return -1;
+            }
+        }
+        reaplicadas++;
+        posicao = fim;
+    }
+    free(registro);
+
+    if (fdatasync(fd) != 0 || ftruncate(jfd, 0) != 0 || fdatasync(jfd) != 0) {
+        perror("journal: Erro ao finalizar a recuperação");
+        close(jfd);
+        return -1;
+    }
+    close(jfd);
+    return reaplicadas;
+}
+
+// Ativa o journal para a imagem 'sb' (cria o arquivo se não existir).
+// 'grupo_max' é o número de transações por commit de grupo. Retorna 0 em sucesso, -1 em erro.
+int journal_abrir(const char *caminho_imagem, uint32_t grupo_max, const struct ext2_super_block *sb) {
+    struct journal *j = &motor_atual->journal;
+    char caminho[4096];
+    journal_caminho(caminho_imagem, caminho, sizeof(caminho));
+
+    j->fd = open(caminho, O_RDWR | O_CREAT, 0644);
+    if (j->fd < 0) {
+        perror("journal: Erro ao abrir o journal");
+        return -1;
+    }
+    // journal_recuperar esvazia o journal da imagem depois de reaplicá-lo: o que sobrou é
+    // de outra imagem e não é apagado.
+    struct stat info;
+    if (fstat(j->fd, &info) == 0 && info.st_size > 0) {
+        fprintf(erros_comando(), "journal: %s não pertence a esta imagem; remova-o para usar o journal.\n", caminho);
+        close(j->fd);
+        j->fd = -1;
+        return -1;
+    }
+    j->tamanho = 0;
+    j->transacoes_pendentes = 0;
+    j->grupo_max = grupo_max > 0 ? grupo_max : 1;
+    memcpy(j->uuid, sb->s_uuid, sizeof(j->uuid));
+    j->blocos_imagem = sb->s_blocks_count;
+    return 0;
+}
+
+// Fecha o journal: commit do grupo pendente, sincroniza a imagem e esvazia o journal.
+// Retorna 0 em sucesso, -1 em erro.
+int journal_fechar(int fd) {
+    if (motor_atual->journal.fd < 0) return 0;
+    int resultado = journal_commit_grupo(fd);
+    if (resultado == 0 && (fdatasync(fd) != 0 || ftruncate(motor_atual->journal.fd, 0) != 0)) {
+        perror("journal: Erro ao fechar o journal");
+        resultado = -1;
+    }
+    close(motor_atual->journal.fd);
+    motor_atual->journal.fd = -1;
+    return resultado;
+}
+
+// ---------------------------------------------------------------------------
+// Somas de verificação por bloco, em um arquivo auxiliar "<imagem>.crc":
+//
+//   cabeçalho | CRC32C de cada bloco da imagem (uint32, pelo número do bloco)
+//
+// O arquivo é criado pelo 'scrub -c' e fica mapeado em memória enquanto a imagem está
+// aberta. A soma de um bloco é atualizada sempre que ele é gravado na imagem (nos
+// checkpoints das transações e nas escritas diretas), de modo que o arquivo sempre
+// descreve o conteúdo em disco; o 'scrub' relê a imagem e compara. O cabeçalho registra
+// se a sessão foi encerrada normalmente e o mtime da imagem nesse momento. Somas de uma
+// sessão interrompida, ou de uma imagem alterada por outro programa, nunca são apagadas
+// automaticamente (seriam justamente a evidência de uma corrupção): o arquivo é aberto
+// como desatualizado, o 'scrub' compara com ele e avisa, e só o 'scrub -c' o recria.
+// ---------------------------------------------------------------------------
+
+#define SOMAS_MAGIC 0x43324558u // "EX2C"
+
+struct somas_cabecalho {
+    uint32_t magic;          // SOMAS_MAGIC
+    uint32_t tamanho_bloco;
+    uint32_t num_blocos;     // s_blocks_count quando o arquivo foi criado
+    uint32_t limpo;          // 1 = sessão encerrada normalmente; 0 = imagem aberta
+    int64_t mtime_seg;       // mtime da imagem no encerramento
+    int64_t mtime_ns;
+};
+
+static void somas_caminho(const char *caminho_imagem, char *saida, size_t tamanho_saida) {
+    snprintf(saida, tamanho_saida, "%s.crc", caminho_imagem);
+}
+
+// Mapeia o arquivo de somas já aberto em somas_blocos.fd. Retorna 0 ou -1 em erro.
+static int somas_mapear(size_t tamanho) {
+    void *mapa = mmap(NULL, tamanho, PROT_READ | PROT_WRITE, MAP_SHARED, motor_atual->somas_blocos.fd, 0);
+    if (mapa == MAP_FAILED) {
+        perror("somas: Erro ao mapear o arquivo de somas");
+        return -1;
+    }
+    motor_atual->somas_blocos.cabecalho = (struct somas_cabecalho *)mapa;
+    motor_atual->somas_blocos.somas = (uint32_t *)((char *)mapa + sizeof(struct somas_cabecalho));
+    motor_atual->somas_blocos.tamanho = tamanho;
+    return 0;
+}
+
+// Marca o arquivo como em uso (gravado em disco antes de qualquer alteração na imagem).
+static int somas_marcar_em_uso(void) {
+    motor_atual->somas_blocos.cabecalho->limpo = 0;
+    if (msync(motor_atual->somas_blocos.cabecalho, sizeof(struct somas_cabecalho), MS_SYNC) != 0) {
+        perror("somas: Erro ao gravar o cabeçalho");
+        return -1;
+    }
+    return 0;
+}
+
+static void somas_desativar(void) {
+    struct somas_blocos *s = &motor_atual->somas_blocos;
+    if (s->cabecalho) munmap(s->cabecalho, s->tamanho);
+    if (s->fd >= 0) close(s->fd);
+    s->fd = -1;
+    s->cabecalho = NULL;
+    s->somas = NULL;
+    s->tamanho = 0;
+}
+
+// Ativa as somas da imagem 'fd', se "<imagem>.crc" existir. Um arquivo que não
+// corresponde à imagem (tamanho de bloco ou número de blocos) é ignorado; um arquivo de
+// uma sessão interrompida ou de uma imagem alterada por outro programa é aberto como
+// desatualizado. Nenhum dos dois é apagado. Deve ser chamada depois de journal_recuperar.
+// Retorna 0 (inclusive sem somas) ou -1 em erro.
+int somas_abrir(int fd, const char *caminho_imagem, const struct ext2_super_block *sb) {
+    somas_caminho(caminho_imagem, motor_atual->somas_blocos.caminho, sizeof(motor_atual->somas_blocos.caminho));
+    motor_atual->somas_blocos.desatualizado = motor_atual->somas_blocos.invalido = 0;
+    motor_atual->somas_blocos.fd = open(motor_atual->somas_blocos.caminho, O_RDWR);
+    if (motor_atual->somas_blocos.fd < 0) return 0; // Sem somas
+
+    struct somas_cabecalho cabecalho;
+    struct stat imagem, arquivo;
+    size_t esperado = sizeof(cabecalho) + (size_t)sb->s_blocks_count * sizeof(uint32_t);
+    if (pread(motor_atual->somas_blocos.fd, &cabecalho, sizeof(cabecalho), 0) != sizeof(cabecalho) ||
+        fstat(motor_atual->somas_blocos.fd, &arquivo) != 0 || fstat(fd, &imagem) != 0 ||
+        cabecalho.magic != SOMAS_MAGIC || cabecalho.tamanho_bloco != BLOCK_SIZE ||
+        cabecalho.num_blocos != sb->s_blocks_count || (size_t)arquivo.st_size != esperado) {
+        fprintf(stderr, "somas: %s não corresponde à imagem; ignorado. Use 'scrub -c' para recriá-lo.\n",
+                motor_atual->somas_blocos.caminho);
+        somas_desativar();
+        motor_atual->somas_blocos.invalido = 1;
+        return 0;
+    }
+    if (!cabecalho.limpo || cabecalho.mtime_seg != (int64_t)imagem.st_mtim.tv_sec ||
+        cabecalho.mtime_ns != (int64_t)imagem.st_mtim.tv_nsec) {
+        fprintf(stderr, "somas: %s desatualizado (sessão interrompida ou imagem alterada por outro programa); "
+                        "o 'scrub' compara com ele e o 'scrub -c' o recria.\n", motor_atual->somas_blocos.caminho);
+        motor_atual->somas_blocos.desatualizado = 1;
+    }
+    // Um arquivo desatualizado continua marcado como em uso, e assim fica até o 'scrub -c'.
+    if (somas_mapear(esperado) != 0 || somas_marcar_em_uso() != 0) {
+        somas_desativar();
+        return -1;
+    }
+    return 0;
+}
+
+// Cria (ou recria) o arquivo de somas, ainda sem as somas. Retorna 0 ou -1 em erro.
+static int somas_criar(const struct ext2_super_block *sb) {
+    struct somas_blocos *s = &motor_atual->somas_blocos;
+    somas_desativar();
+    s->desatualizado = s->invalido = 0;
+    size_t tamanho = sizeof(struct somas_cabecalho) + (size_t)sb->s_blocks_count * sizeof(uint32_t);
+    s->fd = open(s->caminho, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (s->fd < 0 || ftruncate(s->fd, (off_t)tamanho) != 0) {
+        perror("somas: Erro ao criar o arquivo de somas");
+        somas_desativar();
+        return -1;
+    }
+    if (somas_mapear(tamanho) != 0) {
+        somas_desativar();
+        return -1;
+    }
+    s->cabecalho->magic = SOMAS_MAGIC;
+    s->cabecalho->tamanho_bloco = BLOCK_SIZE;
+    s->cabecalho->num_blocos = sb->s_blocks_count;
+    if (somas_marcar_em_uso() != 0) {
+        somas_desativar();
+        return -1;
+    }
+    return 0;
+}
+
+// Atualiza as somas dos 'num_blocos' blocos a partir de 'primeiro', recém-gravados com 'dados'.
+static void somas_atualizar(uint32_t primeiro, const char *dados, uint32_t num_blocos) {
+    if (!motor_atual->somas_blocos.somas) return;
+    for (uint32_t i = 0; i < num_blocos && primeiro + i < motor_atual->somas_blocos.cabecalho->num_blocos; ++i) {
+        motor_atual->somas_blocos.somas[primeiro + i] = crc32c(0, dados + ((size_t)i << motor_atual->geometria.log_bloco), BLOCK_SIZE);
+    }
+}
+
+// Recalcula, relendo da imagem, as somas dos blocos que interceptam a faixa gravada
+// [offset, offset + tamanho) (escritas diretas, que podem cobrir só parte de um bloco).
+static void somas_recalcular(int fd, off_t offset, size_t tamanho) {
+    if (!motor_atual->somas_blocos.somas || tamanho == 0) return;
+    char bloco[BLOCK_SIZE_MAX];
+    uint32_t ultimo = (uint32_t)((offset + (off_t)tamanho - 1) >> motor_atual->geometria.log_bloco);
+    for (uint32_t numero = (uint32_t)(offset >> motor_atual->geometria.log_bloco); numero <= ultimo; ++numero) {
+        ssize_t lidos = pread(fd, bloco, BLOCK_SIZE, offset_do_bloco(numero));
+        if (lidos < 0) continue;
+        if (lidos < BLOCK_SIZE) memset(bloco + lidos, 0, BLOCK_SIZE - lidos);
+        somas_atualizar(numero, bloco, 1);
+    }
+}
+
+// Grava as somas e marca o arquivo como em dia com a imagem 'fd', que já deve ter
+// recebido todas as escritas da sessão. Retorna 0 em sucesso, -1 em erro.
+int somas_fechar(int fd) {
+    struct somas_blocos *s = &motor_atual->somas_blocos;
+    if (s->fd < 0) return 0;
+    struct stat imagem;
+    int resultado = 0;
+    if (fdatasync(fd) != 0 || fstat(fd, &imagem) != 0 ||
+        msync(s->cabecalho, s->tamanho, MS_SYNC) != 0) {
+        perror("somas: Erro ao gravar as somas");
+        resultado = -1; // O arquivo fica marcado como em uso (desatualizado na próxima abertura)
+    } else if (!s->desatualizado) {
+        s->cabecalho->mtime_seg = (int64_t)imagem.st_mtim.tv_sec;
+        s->cabecalho->mtime_ns = (int64_t)imagem.st_mtim.tv_nsec;
+        s->cabecalho->limpo = 1;
+        if (msync(s->cabecalho, sizeof(struct somas_cabecalho), MS_SYNC) != 0) {
+            perror("somas: Erro ao gravar o cabeçalho");
+            resultado = -1;
+        }
+    }
+    somas_desativar();
+    return resultado;
+}
+
+// ---------------------------------------------------------------------------
+// Política de durabilidade: quando as alterações são forçadas para o disco.
+//   nenhuma   - nada é sincronizado (imagens descartáveis; comportamento antigo)
+//   comando   - fdatasync ao final de cada comando que alterou a imagem
+//   periodica - uma thread sincroniza a cada 'intervalo_ms' milissegundos
+// Com o journal ativo, sincronizar significa fazer o commit do grupo pendente.
+// A execução dos comandos e a thread periódica são serializadas por 'mutex'.
+// A latência de cada sincronização é registrada para comparar as políticas.
+// ---------------------------------------------------------------------------
+
+const char *nomes_durabilidade[] = { "nenhuma", "comando", "periodica" };
+
+// Converte o nome da política. Retorna 0 em sucesso, -1 se o nome for desconhecido.
+int durabilidade_modo_por_nome(const char *nome, enum modo_durabilidade *modo) {
+    for (int i = 0; i < 3; ++i) {
+        if (strcmp(nome, nomes_durabilidade[i]) == 0) {
+            *modo = (enum modo_durabilidade)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Trava o sistema de arquivos com exclusividade (comandos que alteram a imagem e
+// sincronizações).
+void durabilidade_bloquear(void) {
+    pthread_rwlock_wrlock(&motor_atual->durabilidade.trava);
+}
+
+// Trava o sistema de arquivos para leitura: vários comandos de leitura podem rodar juntos.
+void durabilidade_bloquear_leitura(void) {
+    pthread_rwlock_rdlock(&motor_atual->durabilidade.trava);
+}
+
+void durabilidade_desbloquear(void) {
+    pthread_rwlock_unlock(&motor_atual->durabilidade.trava);
+}
+
+// Força para o disco as alterações já confirmadas e registra a latência.
+// Deve ser chamada com a trava exclusiva (durabilidade_bloquear). Retorna 0 em sucesso, -1 em erro.
+int durabilidade_sincronizar(int fd) {
+    if (!motor_atual->escritas_nao_sincronizadas && motor_atual->journal.transacoes_pendentes == 0) return 0;
+
+    uint64_t inicio = relogio_ns();
+    int resultado;
+    if (motor_atual->journal.fd >= 0) {
+        resultado = journal_commit_grupo(fd); // O fdatasync do journal já torna as transações duráveis
+    } else {
+        resultado = fdatasync(fd);
+        contadores_es.sincronizacoes++;
+        if (resultado != 0) perror("durabilidade: Erro no fdatasync");
+        else liberacoes_concluir();
+        if (EVENTOS_ATIVOS) evento("es", "fdatasync", inicio, "\"arquivo\":\"imagem\"");
+    }
+    uint64_t latencia = relogio_ns() - inicio;
+    if (EVENTOS_ATIVOS) evento("durabilidade", "durabilidade_sincronizar", inicio, "\"resultado\":%d", resultado);
+
+    if (resultado == 0) motor_atual->escritas_nao_sincronizadas = 0;
+    motor_atual->durabilidade.num_sincronizacoes++;
+    motor_atual->durabilidade.latencia_total_ns += latencia;
+    if (motor_atual->durabilidade.num_sincronizacoes == 1 || latencia < motor_atual->durabilidade.latencia_min_ns) motor_atual->durabilidade.latencia_min_ns = latencia;
+    if (latencia > motor_atual->durabilidade.latencia_max_ns) motor_atual->durabilidade.latencia_max_ns = latencia;
+    return resultado;
+}
+
+static void *durabilidade_thread(void *argumento) {
+    motor_atual = (struct motor *)argumento;
+    struct durabilidade *d = &motor_atual->durabilidade;
+    pthread_mutex_lock(&d->mutex);
+    while (!d->parar) {
+        struct timespec limite;
+        clock_gettime(CLOCK_REALTIME, &limite);
+        limite.tv_sec += d->intervalo_ms / 1000;
+        limite.tv_nsec += (long)(d->intervalo_ms % 1000) * 1000000L;
+        if (limite.tv_nsec >= 1000000000L) {
+            limite.tv_sec++;
+            limite.tv_nsec -= 1000000000L;
+        }
+        // Espera o intervalo; a trava só é tomada para a sincronização.
+        while (!d->parar &&
+               pthread_cond_timedwait(&d->cond, &d->mutex, &limite) == 0) {
+        }
+        if (d->parar) break;
+        pthread_mutex_unlock(&d->mutex);
+        durabilidade_bloquear();
+        durabilidade_sincronizar(d->fd);
+        durabilidade_desbloquear();
+        pthread_mutex_lock(&d->mutex);
+    }
+    pthread_mutex_unlock(&d->mutex);
+    return NULL;
+}
+
+// Ativa a política de durabilidade para a imagem 'fd'. Retorna 0 em sucesso, -1 em erro.
+int durabilidade_iniciar(int fd, enum modo_durabilidade modo, unsigned long intervalo_ms) {
+    struct durabilidade *d = &motor_atual->durabilidade;
+    d->modo = modo;
+    d->intervalo_ms = intervalo_ms > 0 ? intervalo_ms : 1;
+    d->fd = fd;
+    d->parar = 0;
+    if (modo != DURABILIDADE_PERIODICA) return 0;
+
+    int erro = pthread_create(&d->thread, NULL, durabilidade_thread, motor_atual);
+    if (erro != 0) {
+        fprintf(erros_comando(), "durabilidade: Erro ao criar a thread de sincronização: %s\n", strerror(erro));
+        return -1;
+    }
+    d->thread_ativa = 1;
+    return 0;
+}
+
+// Chamada após cada comando (com a trava exclusiva): na política 'comando',
+// sincroniza se o comando alterou a imagem. Retorna 0 em sucesso, -1 em erro.
+int durabilidade_apos_comando(int fd) {
+    if (motor_atual->durabilidade.modo != DURABILIDADE_COMANDO || motor_atual->transacao_atual.aninhamento > 0) return 0;
+    return durabilidade_sincronizar(fd);
+}
+
+// 1 enquanto a thread executa um comando com a trava exclusiva (ver executar_comando).
+static __thread int trava_exclusiva_do_comando;
+
+// Pausa um comando longo (como o defrag) entre duas etapas para que outros clientes usem
+// o sistema de arquivos: confirma a transação do comando, aplica a política de
+// durabilidade, solta a trava exclusiva por 'pausa_ns' nanossegundos e a retoma com uma
+// transação nova. Dentro de um lote (begin/commit) ou fora de executar_comando só espera.
+// Retorna 0 em sucesso, -1 se a confirmação falhou.
+int comando_ceder(int fd, uint64_t pausa_ns) {
+    int resultado = 0;
+    int soltar = trava_exclusiva_do_comando && motor_atual->transacao_atual.aninhamento == 1;
+    if (soltar) {
+        if (transacao_confirmar(fd) != 0) resultado = -1;
+        if (durabilidade_apos_comando(fd) != 0) resultado = -1;
+        durabilidade_desbloquear();
+    }
+    if (pausa_ns > 0) {
+        struct timespec espera = { (time_t)(pausa_ns / 1000000000ull), (long)(pausa_ns % 1000000000ull) };
+        nanosleep(&espera, NULL);
+    } else if (soltar) {
+        sched_yield(); // Dá a vez a quem espera pela trava
+    }
+    if (soltar) {
+        durabilidade_bloquear();
+        transacao_iniciar();
+    }
+    return resultado;
+}
+
+// Encerra a thread periódica e faz a última sincronização.
+// Retorna 0 em sucesso, -1 em erro.
+int durabilidade_encerrar(int fd) {
+    struct durabilidade *d = &motor_atual->durabilidade;
+    if (d->thread_ativa) {
+        pthread_mutex_lock(&d->mutex);
+        d->parar = 1;
+        pthread_cond_signal(&d->cond);
+        pthread_mutex_unlock(&d->mutex);
+        pthread_join(d->thread, NULL);
+        d->thread_ativa = 0;
+    }
+    if (d->modo == DURABILIDADE_NENHUMA) return 0;
+
+    durabilidade_bloquear();
+    int resultado = durabilidade_sincronizar(fd);
+    durabilidade_desbloquear();
+    return resultado;
+}
+
+// Imprime as estatísticas de latência das sincronizações.
+void durabilidade_imprimir_estatisticas(FILE *saida) {
+    struct durabilidade *d = &motor_atual->durabilidade;
+    fprintf(saida, "durabilidade (%s): %llu sincronizações", nomes_durabilidade[d->modo],
+            (unsigned long long)d->num_sincronizacoes);
+    if (d->num_sincronizacoes > 0) {
+        fprintf(saida, ", latência média %.1f us, mínima %.1f us, máxima %.1f us, total %.1f ms",
+                d->latencia_total_ns / 1e3 / d->num_sincronizacoes,
+                d->latencia_min_ns / 1e3, d->latencia_max_ns / 1e3,
+                d->latencia_total_ns / 1e6);
+    }
+    fprintf(saida, "\n");
+}
+
+// Calcula a geometria (struct geometria) a partir do superbloco lido.
+// Retorna 0 em sucesso, -1 se o tamanho de bloco ou de inode não for suportado.
+int geometria_configurar(const struct ext2_super_block *sb) {
+    struct geometria *g = &motor_atual->geometria;
+    if (sb->s_log_block_size > EXT2_MAX_LOG_BLOCO - EXT2_MIN_LOG_BLOCO) {
+        fprintf(erros_comando(), "Erro: tamanho de bloco não suportado (s_log_block_size = %u; use blocos de 1, 2 ou 4 KiB).\n",
+                sb->s_log_block_size);
+        return -1;
+    }
+    uint32_t log_bloco = EXT2_MIN_LOG_BLOCO + sb->s_log_block_size;
+    uint32_t tamanho_inode = EXT2_GOOD_OLD_INODE_SIZE;
+    if (sb->s_rev_level >= EXT2_DYNAMIC_REV && sb->s_inode_size > 0) tamanho_inode = sb->s_inode_size;
+    if (tamanho_inode < EXT2_GOOD_OLD_INODE_SIZE || (tamanho_inode & (tamanho_inode - 1)) != 0 ||
+        tamanho_inode > (1u << log_bloco)) {
+        fprintf(erros_comando(), "Erro: tamanho de inode não suportado (%u bytes).\n", tamanho_inode);
+        return -1;
+    }
+    if (sb->s_inodes_per_group < 2 || sb->s_blocks_per_group < 2 || sb->s_blocks_per_group > (8u << log_bloco)) {
+        fprintf(erros_comando(), "Erro: superbloco inválido (%u blocos e %u inodes por grupo).\n",
+                sb->s_blocks_per_group, sb->s_inodes_per_group);
+        return -1;
+    }
+
+    g->tamanho_bloco = 1u << log_bloco;
+    g->log_bloco = log_bloco;
+    g->log_ponteiros = log_bloco - 2;
+    g->log_inode = (uint32_t)__builtin_ctz(tamanho_inode);
+    g->primeiro_bloco_dados = sb->s_first_data_block;
+    g->inodes_por_grupo = sb->s_inodes_per_group;
+    g->blocos_por_grupo = sb->s_blocks_per_group;
+    g->inverso_inodes_por_grupo = UINT64_MAX / sb->s_inodes_per_group + 1;
+    g->inverso_blocos_por_grupo = UINT64_MAX / sb->s_blocks_per_group + 1;
+    g->offset_descritores = (off_t)(sb->s_first_data_block + 1) << log_bloco;
+    return 0;
+}
+
+// Função para ler o superbloco de uma imagem de disco Ext2.
+// Abre o arquivo da imagem, posiciona no offset do superbloco e lê os dados.
+// Retorna o file descriptor (fd) em caso de sucesso, -1 em caso de erro.
+int read_superblock(const char *device_path, struct ext2_super_block *sb) {
+    int fd = open(device_path, O_RDWR); // Abre para leitura e escrita
+    if (fd < 0) {
+        perror("Erro ao abrir a imagem do disco");
+        return -1;
+    }
+
+    ESTAT(estatisticas.blocos_lidos[BLOCO_METADADOS]++);
+    if (dev_pread(fd, sb, sizeof(struct ext2_super_block), SUPERBLOCK_OFFSET) != sizeof(struct ext2_super_block)) { // Lê o superbloco
+        perror("Erro ao ler o superbloco");
+        close(fd);
+        return -1;
+    }
+    // A checagem do magic fica com o chamador; a geometria só faz sentido para um Ext2.
+    if (sb->s_magic == EXT2_SUPER_MAGIC && geometria_configurar(sb) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd; // Sucesso, retorna o file descriptor
+}
+
+// Função para escrever o superbloco de volta para a imagem de disco.
+// Posiciona no offset do superbloco e escreve os dados do superbloco fornecido.
+// Retorna 0 em sucesso, -1 em erro.
+int write_superblock(int fd, const struct ext2_super_block *sb) {
+    if (motor_atual->metadados_adiados) { // Apenas marca; a escrita ocorre em gravar_metadados_adiados()
+        motor_atual->superbloco_sujo = 1;
+        return 0;
+    }
+
+    if (dev_pwrite(fd, sb, sizeof(struct ext2_super_block), SUPERBLOCK_OFFSET) != sizeof(struct ext2_super_block)) { // Escreve o superbloco
+        perror("Erro ao escrever o superbloco");
+        return -1;
+    }
+    return 0; // Sucesso
+}
+
+// Com sparse_super, só os grupos 0, 1 e potências de 3, 5 e 7 têm cópia do superbloco
+// (e da BGDT, no bloco seguinte).
+int grupo_tem_superbloco(uint32_t grupo) {
+    if (grupo <= 1) return 1;
+    for (uint32_t base = 3; base <= 7; base += 2) {
+        uint32_t potencia = base;
+        while (potencia < grupo) potencia *= base;
+        if (potencia == grupo) return 1;
+    }
+    return 0;
+}
+
+// Lê o pedaço 'pedaco' (um bloco) da cópia da BGDT guardada após o superbloco do grupo
+// 'grupo' (a cópia primária é a do grupo 0) para 'destino', com 'quantidade' descritores,
+// e confere se os bitmaps e a tabela de inodes de cada um ficam dentro da imagem (e
+// fora do bloco 0).
+// Retorna 0 em sucesso, -1 se a leitura falhar ou a cópia parecer corrompida.
+static int descritores_ler_copia(uint32_t grupo, uint32_t pedaco,
+                                 struct ext2_group_desc *destino, uint32_t quantidade) {
+    uint32_t bloco = grupo * motor_atual->geometria.blocos_por_grupo + motor_atual->geometria.primeiro_bloco_dados + 1 + pedaco;
+    size_t tamanho = (size_t)quantidade * sizeof(struct ext2_group_desc);
+    ESTAT(estatisticas.blocos_lidos[BLOCO_METADADOS]++);
+    if (dev_pread(motor_atual->descritores.fd, destino, tamanho, offset_do_bloco(bloco)) != (ssize_t)tamanho) return -1;
+    for (uint32_t k = 0; k < quantidade; ++k) {
+        // Bloco 0 nunca guarda metadados de grupo: um descritor zerado também é inválido.
+        if (destino[k].bg_block_bitmap - 1 >= motor_atual->descritores.num_blocos - 1 ||
+            destino[k].bg_inode_bitmap - 1 >= motor_atual->descritores.num_blocos - 1 ||
+            destino[k].bg_inode_table - 1 >= motor_atual->descritores.num_blocos - 1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Carrega o pedaço 'pedaco' da BGDT na tabela em memória e no resumo de livres. Se a
+// cópia primária não puder ser lida ou estiver corrompida, usa a primeira cópia de
+// segurança válida (grupos com superbloco). Sem nenhuma cópia válida, os descritores
+// ficam zerados e os grupos constam sem espaço livre.
+// Retorna 0 em sucesso, -1 em erro.
+int descritores_carregar_pedaco(uint32_t pedaco) {
+    struct descritores *d = &motor_atual->descritores;
+    int resultado = 0;
+    pthread_mutex_lock(&d->mutex);
+    if (!d->pedaco_carregado[pedaco]) {
+        uint32_t primeiro = pedaco << d->log_por_pedaco;
+        uint32_t quantidade = d->num_grupos - primeiro;
+        if (quantidade > (1u << d->log_por_pedaco)) quantidade = 1u << d->log_por_pedaco;
+        struct ext2_group_desc *destino = &d->tabela[primeiro];
+
+        uint32_t grupo = 0;
+        while (grupo < d->num_grupos && descritores_ler_copia(grupo, pedaco, destino, quantidade) != 0) {
+            do {
+                grupo++;
+            } while (grupo < d->num_grupos && d->sparse_super && !grupo_tem_superbloco(grupo));
+        }
+        if (grupo >= d->num_grupos) {
+            fprintf(erros_comando(), "Erro: Nenhuma cópia válida dos descritores dos grupos %u a %u.\n",
+                    primeiro, primeiro + quantidade - 1);
+            memset(destino, 0, (size_t)quantidade * sizeof(struct ext2_group_desc));
+            resultado = -1;
+        } else if (grupo > 0) {
+            // As cópias só são atualizadas no fechamento (descritores_gravar_copias): se a
+            // sessão anterior foi interrompida, os contadores podem estar atrasados.
+            fprintf(erros_comando(), "Aviso: Descritores dos grupos %u a %u lidos da cópia de segurança do grupo %u, "
+                    "que pode estar desatualizada; confira a imagem com e2fsck.\n",
+                    primeiro, primeiro + quantidade - 1, grupo);
+        }
+        for (uint32_t k = 0; k < quantidade; ++k) descritores_resumir(primeiro + k, &destino[k]);
+        __atomic_store_n(&d->pedaco_carregado[pedaco], PEDACO_CARREGADO, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&d->mutex);
+    return resultado;
+}
+
+// Primeiro grupo a partir de 'de' cujo valor no resumo 'livres' não é zero (grupos ainda
+// não carregados contam como candidatos), ou 'num_grupos' se não houver. Os grupos são
+// testados em janelas de 64 com um OU acumulado, que o compilador vetoriza.
+uint32_t grupo_com_livres(const uint16_t *livres, uint32_t de, uint32_t num_grupos) {
+    uint32_t grupo = de;
+    while (grupo + 64 <= num_grupos) {
+        uint16_t acumulado = 0;
+        for (uint32_t k = 0; k < 64; ++k) acumulado |= livres[grupo + k];
+        if (acumulado) break;
+        grupo += 64;
+    }
+    for (; grupo < num_grupos; ++grupo) {
+        if (livres[grupo]) return grupo;
+    }
+    return num_grupos;
+}
+
+// Libera a BGDT em memória e o resumo de livres.
+void liberar_descritores(void) {
+    struct descritores *d = &motor_atual->descritores;
+    free(d->tabela);
+    free(d->pedaco_carregado);
+    free(d->blocos_livres);
+    free(d->inodes_livres);
+    d->tabela = NULL;
+    d->pedaco_carregado = NULL;
+    d->blocos_livres = d->inodes_livres = NULL;
+    d->num_grupos = d->num_pedacos = 0;
+}
+
+// Função para preparar a Tabela de Descritores de Grupo de Blocos (BGDT).
+// Nada é lido aqui: a tabela é alocada zerada e cada pedaço de um bloco é lido na
+// primeira vez que um de seus descritores é acessado (ver descritor_grupo), de modo que
+// abrir uma imagem com centenas de milhares de grupos não depende do tamanho da BGDT.
+// Retorna um ponteiro para a BGDT, ou NULL em erro. A memória é liberada com
+// liberar_descritores().
+struct ext2_group_desc* read_block_group_descriptor_table(
+    int fd,
+    const struct ext2_super_block *sb,
+    unsigned int *num_block_groups_out
+) {
+    struct descritores *d = &motor_atual->descritores;
+    // Calcula o número total de grupos de blocos
+    unsigned int num_block_groups = numero_de_grupos(sb);
+    if (num_block_groups_out) {
+        *num_block_groups_out = num_block_groups;
+    }
+
+    liberar_descritores();
+    d->fd = fd;
+    d->num_grupos = num_block_groups;
+    d->log_por_pedaco = motor_atual->geometria.log_bloco - 5; // Descritores de 32 bytes
+    d->num_pedacos = (num_block_groups + (1u << d->log_por_pedaco) - 1) >> d->log_por_pedaco;
+    d->num_blocos = sb->s_blocks_count;
+    d->sparse_super = (sb->s_feature_ro_compat & EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER) != 0;
+
+    // calloc de regiões grandes devolve páginas zeradas sob demanda: só os pedaços usados ocupam memória.
+    d->tabela = (struct ext2_group_desc *)calloc(num_block_groups, sizeof(struct ext2_group_desc));
+    d->pedaco_carregado = (uint8_t *)calloc(d->num_pedacos, 1);
+    d->blocos_livres = (uint16_t *)malloc(num_block_groups * sizeof(uint16_t));
+    d->inodes_livres = (uint16_t *)malloc(num_block_groups * sizeof(uint16_t));
+    if (!d->tabela || !d->pedaco_carregado || !d->blocos_livres || !d->inodes_livres) {
+        perror("Erro ao alocar memória para a BGDT");
+        liberar_descritores();
+        return NULL;
+    }
+    memset(d->blocos_livres, 0xFF, num_block_groups * sizeof(uint16_t)); // RESUMO_DESCONHECIDO
+    memset(d->inodes_livres, 0xFF, num_block_groups * sizeof(uint16_t));
+
+    if (modo_verboso) {
+        fprintf(saida_comando(), "BGDT: %u grupos em %u blocos, lidos sob demanda\n", num_block_groups, d->num_pedacos);
+    }
+    return d->tabela;
+}
+
+// Função para ler um inode específico.
+// Calcula o offset do inode no disco com base em seu número e no grupo de blocos a que pertence.
+// Retorna 0 em sucesso, -1 em erro. O inode lido é armazenado em 'inode_out'.
+int read_inode(
+    int fd, 
+    const struct ext2_super_block *sb, 
+    const struct ext2_group_desc *bgdt, 
+    uint32_t inode_num, 
+    struct ext2_inode *inode_out
+) {
+    if (inode_num == 0 || inode_num > sb->s_inodes_count) {
+        fprintf(erros_comando(), "Erro: Número de inode inválido (%u).\n", inode_num);
+        return -1;
+    }
+
+    // Calcula o offset final do inode no disco: grupo e índice no grupo (inodes são
+    // numerados a partir de 1), início da tabela de inodes do grupo e tamanho do inode
+    // (128 bytes na revisão 0, s_inode_size na revisão dinâmica), pela geometria.
+    off_t final_inode_offset = offset_do_inode(bgdt, inode_num);
+
+    ESTAT(estatisticas.blocos_lidos[BLOCO_TABELA_INODES]++);
+    uint64_t inicio_evento = EVENTO_INICIO();
+    if (dev_pread(fd, inode_out, sizeof(struct ext2_inode), final_inode_offset) != sizeof(struct ext2_inode)) { // Lê o inode
+        char err_msg[200];
+        snprintf(err_msg, sizeof(err_msg), "Erro ao ler o inode %u (offset %ld)", inode_num, (long)final_inode_offset);
+        perror(err_msg);
+        return -1;
+    }
+    if (EVENTOS_ATIVOS) {
+        evento("es", "read_inode", inicio_evento, "\"inode\":%u,\"bloco\":%llu,\"offset\":%lld,\"bytes\":%zu", inode_num,
+               (unsigned long long)(final_inode_offset >> motor_atual->geometria.log_bloco), (long long)final_inode_offset, sizeof(struct ext2_inode));
+    }
+    return 0; // Sucesso
+}
+
+// Função auxiliar para ler um bloco do disco, contabilizado nas estatísticas pelo 'tipo'.
+// Lê o conteúdo do bloco especificado em 'block_num' para 'buffer'.
+// Retorna 0 em sucesso, -1 em erro. 'buffer' deve ter pelo menos BLOCK_SIZE bytes.
+int ler_bloco(int fd, uint32_t block_num, char *buffer, enum tipo_bloco tipo) {
+    (void)tipo; // Só usado pelas estatísticas
+    ESTAT(estatisticas.blocos_lidos[tipo]++);
+    if (block_num == 0) { // Bloco 0 é especial (pode ser boot block ou usado para sparse files)
+        memset(buffer, 0, BLOCK_SIZE); // Preenche com zeros para representar um bloco não alocado
+        return 0; 
+    }
+
+    off_t offset = offset_do_bloco(block_num); // Calcula o offset do bloco
+    uint64_t inicio_evento = EVENTO_INICIO();
+    if (dev_pread(fd, buffer, BLOCK_SIZE, offset) != (ssize_t)BLOCK_SIZE) { // Lê o bloco
+        char err_msg[100];
+        snprintf(err_msg, sizeof(err_msg), "Erro ao ler o bloco de dados %u (offset %ld)", block_num, (long)offset);
+        perror(err_msg);
+        return -1;
+    }
+    if (EVENTOS_ATIVOS) {
+        evento("es", "ler_bloco", inicio_evento, "\"tipo\":\"%s\",\"bloco\":%u,\"bytes\":%u",
+               nomes_tipos_bloco[tipo], block_num, BLOCK_SIZE);
+    }
+    return 0; // Sucesso
+}
+
+// Lê um bloco de dados de arquivo (ver ler_bloco).
+int read_data_block(int fd, uint32_t block_num, char *buffer) {
+    return ler_bloco(fd, block_num, buffer, BLOCO_DADOS);
+}
+
+// Função auxiliar para escrever um bloco de dados no disco.
+// Escreve o conteúdo de 'buffer' para o bloco especificado por 'block_num'.
+// Retorna 0 em sucesso, -1 em erro.
+int write_data_block(int fd, uint32_t block_num, const char *buffer) {
+    if (block_num == 0) {
+        fprintf(erros_comando(), "Erro write_data_block: Tentativa de escrever no bloco de dados 0.\n");
+        return -1; 
+    }
+    off_t offset = offset_do_bloco(block_num); // Calcula o offset do bloco
+    uint64_t inicio_evento = EVENTO_INICIO();
+    if (dev_pwrite(fd, buffer, BLOCK_SIZE, offset) != (ssize_t)BLOCK_SIZE) { // Escreve o bloco
+        char err_msg[100];
+        snprintf(err_msg, sizeof(err_msg), "Erro write_data_block: ao escrever bloco %u", block_num);
+        perror(err_msg);
+        return -1;
+    }
+    if (EVENTOS_ATIVOS) evento("es", "write_data_block", inicio_evento, "\"bloco\":%u,\"bytes\":%u", block_num, BLOCK_SIZE);
+    return 0; 
+}
+
+// Função para escrever uma entrada (inode) na tabela de inodes.
+// Escreve o conteúdo de 'inode_to_write' para o slot do inode 'inode_num' no disco.
+// Retorna 0 em sucesso, -1 em erro.
+int write_inode_table_entry(int fd, const struct ext2_super_block *sb,
+                            const struct ext2_group_desc *bgdt, 
+                            uint32_t inode_num, const struct ext2_inode *inode_to_write) {
+    if (inode_num == 0 || inode_num > sb->s_inodes_count) {
+        fprintf(erros_comando(), "Erro write_inode_table_entry: Tentativa de escrever no inode %u.\n", inode_num);
+        return -1;
+    }
+    // Calcula o offset final do inode no disco (ver offset_do_inode).
+    off_t final_inode_offset = offset_do_inode(bgdt, inode_num);
+
+    uint64_t inicio_evento = EVENTO_INICIO();
+    if (dev_pwrite(fd, inode_to_write, sizeof(struct ext2_inode), final_inode_offset) != sizeof(struct ext2_inode)) { // Escreve o inode
+        perror("Erro write_inode_table_entry: write");
+        return -1;
+    }
+    if (EVENTOS_ATIVOS) {
+        evento("es", "write_inode_table_entry", inicio_evento, "\"inode\":%u,\"bloco\":%llu,\"offset\":%lld,\"bytes\":%zu", inode_num,
+               (unsigned long long)(final_inode_offset >> motor_atual->geometria.log_bloco), (long long)final_inode_offset, sizeof(struct ext2_inode));
+    }
+    return 0; 
+}
+
+// Função para escrever um descritor de grupo específico na BGDT.
+// Retorna 0 em sucesso, -1 em erro.
+int write_group_descriptor(int fd, const struct ext2_super_block *sb, 
+                           uint32_t group_index_to_write, 
+                           const struct ext2_group_desc *group_desc_to_write) {
+    // Calcula o offset da BGDT, que começa após o superbloco.
+    off_t bgdt_base_offset = motor_atual->geometria.offset_descritores;
+    // Calcula o offset do descritor de grupo específico.
+    off_t specific_group_desc_offset = bgdt_base_offset + (group_index_to_write * sizeof(struct ext2_group_desc));
+
+    // Valida o índice do grupo.
+    unsigned int num_block_groups = numero_de_grupos(sb);
+    if (group_index_to_write >= num_block_groups) {
+        fprintf(erros_comando(), "Erro write_group_descriptor: Índice de grupo %u é inválido (total de grupos %u).\n", 
+                group_index_to_write, num_block_groups);
+        return -1;
+    }
+
+    descritores_resumir(group_index_to_write, group_desc_to_write);
+    if (motor_atual->descritores.pedaco_carregado && group_index_to_write < motor_atual->descritores.num_grupos) {
+        motor_atual->descritores.pedaco_carregado[group_index_to_write >> motor_atual->descritores.log_por_pedaco] = PEDACO_ALTERADO;
+    }
+
+    if (motor_atual->metadados_adiados) { // Apenas registra a faixa de descritores pendentes
+        if (!motor_atual->descritores_sujos || group_index_to_write < motor_atual->descritor_sujo_min) motor_atual->descritor_sujo_min = group_index_to_write;
+        if (!motor_atual->descritores_sujos || group_index_to_write > motor_atual->descritor_sujo_max) motor_atual->descritor_sujo_max = group_index_to_write;
+        motor_atual->descritores_sujos = 1;
+        return 0;
+    }
+
+    if (dev_pwrite(fd, group_desc_to_write, sizeof(struct ext2_group_desc), specific_group_desc_offset) != sizeof(struct ext2_group_desc)) { // Escreve o descritor
+        perror("Erro write_group_descriptor: write");
+        return -1;
+    }
+    return 0; // Sucesso
+}
+
+// Função para gravar o superbloco e os descritores de grupo cuja escrita foi adiada.
+// Os descritores pendentes são gravados com uma escrita por bloco da BGDT na faixa suja.
+// Retorna 0 em sucesso, -1 em erro.
+int gravar_metadados_adiados(int fd, const struct ext2_super_block *sb, const struct ext2_group_desc *bgdt) {
+    int adiados = motor_atual->metadados_adiados;
+    int resultado = 0;
+    motor_atual->metadados_adiados = 0; // Permite que as funções de escrita gravem de fato
+
+    if (motor_atual->superbloco_sujo) {
+        if (write_superblock(fd, sb) != 0) resultado = -1;
+        motor_atual->superbloco_sujo = 0;
+    }
+    if (motor_atual->descritores_sujos) {
+        // Uma escrita por pedaço carregado da faixa suja: os pedaços não carregados não
+        // foram alterados e estão zerados em memória.
+        uint32_t por_pedaco = 1u << motor_atual->descritores.log_por_pedaco;
+        for (uint32_t inicio = motor_atual->descritor_sujo_min; inicio <= motor_atual->descritor_sujo_max; ) {
+            uint32_t fim = (inicio | (por_pedaco - 1)) + 1; // Início do pedaço seguinte
+            if (fim > motor_atual->descritor_sujo_max + 1) fim = motor_atual->descritor_sujo_max + 1;
+            if (bgdt != motor_atual->descritores.tabela || motor_atual->descritores.pedaco_carregado[inicio >> motor_atual->descritores.log_por_pedaco]) {
+                off_t offset = motor_atual->geometria.offset_descritores + (off_t)inicio * sizeof(struct ext2_group_desc);
+                size_t tamanho = (size_t)(fim - inicio) * sizeof(struct ext2_group_desc);
+                if (dev_pwrite(fd, &bgdt[inicio], tamanho, offset) != (ssize_t)tamanho) {
+                    perror("Erro ao gravar descritores de grupo adiados");
+                    resultado = -1;
+                }
+            }
+            inicio = fim;
+        }
+        motor_atual->descritores_sujos = 0;
+    }
+
+    motor_atual->metadados_adiados = adiados;
+    return resultado;
+}
+
+// Grava os pedaços da BGDT alterados desde a abertura nas cópias de segurança (grupos com
+// superbloco, ou todos sem sparse_super), para que descritores_carregar_pedaco não recorra
+// a uma cópia atrasada. Chamada no fechamento e na sincronização, depois de
+// gravar_metadados_adiados(); fora de uma transação, as escritas vão direto para a imagem.
+// Retorna 0 em sucesso, -1 em erro.
+int descritores_gravar_copias(int fd) {
+    struct descritores *d = &motor_atual->descritores;
+    int resultado = 0;
+    for (uint32_t pedaco = 0; pedaco < d->num_pedacos; ++pedaco) {
+        if (d->pedaco_carregado[pedaco] != PEDACO_ALTERADO) continue;
+        uint32_t primeiro = pedaco << d->log_por_pedaco;
+        uint32_t quantidade = d->num_grupos - primeiro;
+        if (quantidade > (1u << d->log_por_pedaco)) quantidade = 1u << d->log_por_pedaco;
+        size_t tamanho = (size_t)quantidade * sizeof(struct ext2_group_desc);
+        for (uint32_t grupo = 1; grupo < d->num_grupos; ++grupo) {
+            if (d->sparse_super && !grupo_tem_superbloco(grupo)) continue;
+            uint32_t bloco = grupo * motor_atual->geometria.blocos_por_grupo + motor_atual->geometria.primeiro_bloco_dados + 1 + pedaco;
+            if (dev_pwrite(fd, &d->tabela[primeiro], tamanho, offset_do_bloco(bloco)) != (ssize_t)tamanho) {
+                perror("Erro ao gravar cópia de segurança dos descritores");
+                resultado = -1;
+            }
+        }
+        d->pedaco_carregado[pedaco] = PEDACO_CARREGADO;
+    }
+    return resultado;
+}
+
+// Implementa o comando 'info', que exibe informações detalhadas do superbloco Ext2.
+int comando_info(struct ext2_super_block *sb) {
+    // Exibe o nome do volume
+    fprintf(saida_comando(), "Volume name.....: %.16s\n", sb->s_volume_name);
+    
+    // Calcula o tamanho total da imagem (em bytes)
+    uint64_t tamanho_imagem = (uint64_t)sb->s_blocks_count * BLOCK_SIZE;
+    fprintf(saida_comando(), "Image size......: %llu bytes\n", (unsigned long long)tamanho_imagem);
+
+    // Espaço livre em KiB
+    uint32_t espaco_livre_kib = (sb->s_free_blocks_count * BLOCK_SIZE) / 1024;
+    fprintf(saida_comando(), "Free space......: %u KiB\n", espaco_livre_kib);
+    
+    // Inodes livres
+    fprintf(saida_comando(), "Free inodes.....: %u\n", sb->s_free_inodes_count);
+    
+    // Blocos livres
+    fprintf(saida_comando(), "Free blocks.....: %u\n", sb->s_free_blocks_count);
+    
+    // Tamanho do bloco
+    fprintf(saida_comando(), "Block size......: %u bytes\n", BLOCK_SIZE);
+    
+    // Tamanho do inode
+    uint16_t inode_size = (sb->s_rev_level >= EXT2_DYNAMIC_REV && sb->s_inode_size > 0) ? 
+                          sb->s_inode_size : EXT2_GOOD_OLD_INODE_SIZE;
+    fprintf(saida_comando(), "Inode size......: %u bytes\n", inode_size);
+    
+    // Quantidade de grupos
+    unsigned int num_block_groups = numero_de_grupos(sb);
+    fprintf(saida_comando(), "Groups count....: %u\n", num_block_groups);
+    
+    // Tamanho de cada grupo em blocos
+    fprintf(saida_comando(), "Groups size.....: %u blocks\n", sb->s_blocks_per_group);
+    
+    // Inodes por grupo
+    fprintf(saida_comando(), "Groups inodes...: %u inodes\n", sb->s_inodes_per_group);
+    
+    // Tamanho da tabela de inodes em blocos
+    uint32_t inode_table_size_blocks = (sb->s_inodes_per_group * inode_size) / BLOCK_SIZE;
+    if ((sb->s_inodes_per_group * inode_size) % BLOCK_SIZE != 0) {
+        inode_table_size_blocks++; // Arredonda para cima se necessário
+    }
+    fprintf(saida_comando(), "Inodetable size.: %u blocks\n", inode_table_size_blocks);
+    return 0;
+}
+
+// Procura 'nome' nas entradas do bloco de diretório 'bloco' (até 'tamanho' bytes, limitado
+// ao bloco). Retorna o inode da entrada (e o tipo em '*tipo', se não for NULL) ou 0 se não
+// encontrar; ver POR_TAMANHO_DE_BLOCO.
+ESPECIALIZADA uint32_t dir_procurar_especializado(const char *bloco, uint32_t tamanho, const char *nome,
+                                                  uint8_t *tipo, const uint32_t tamanho_bloco) {
+    size_t tamanho_nome = strlen(nome);
+    if (tamanho > tamanho_bloco) tamanho = tamanho_bloco; // Impede leitura além do bloco
+    uint32_t offset = 0;
+    while (offset + offsetof(struct ext2_dir_entry_2, name) <= tamanho) { // Itera pelas entradas do diretório
+        const struct ext2_dir_entry_2 *entry = (const struct ext2_dir_entry_2 *)(bloco + offset);
+        if (entry->rec_len == 0) break; // Prevenção contra corrupção
+
+        // Verifica se a entrada está em uso (inode != 0) e se o nome corresponde.
+        if (entry->inode != 0 && entry->name_len == tamanho_nome && memcmp(entry->name, nome, tamanho_nome) == 0) {
+            if (tipo != NULL) *tipo = entry->file_type; // Retorna o tipo do arquivo encontrado
+            return entry->inode; // Entrada encontrada, retorna o número do inode
+        }
+        offset += entry->rec_len; // Move para a próxima entrada
+    }
+    return 0; // Entrada não encontrada
+}
+
+uint32_t bmap_ler(int fd, const struct ext2_inode *inode, uint32_t logico); // Definida com o alocador
+
+// Função auxiliar para procurar uma entrada em um diretório e retornar seu inode.
+// Lê os blocos de dados do diretório (até i_size) e itera pelas entradas de cada um.
+// Retorna o número do inode se encontrado, 0 caso contrário.
+static uint32_t dir_lookup_sem_evento(int fd, const struct ext2_super_block *sb,
+                                      const struct ext2_group_desc *bgdt,
+                                      uint32_t dir_inode_num, const char *name_to_find, 
+                                      uint8_t *found_file_type) {
+    struct ext2_inode dir_inode;
+    if (read_inode(fd, sb, bgdt, dir_inode_num, &dir_inode) != 0) {
+        return 0; 
+    }
+
+    if (!S_ISDIR(dir_inode.i_mode)) { // Verifica se é um diretório
+        return 0; 
+    }
+
+    char data_block_buffer[BLOCK_SIZE_MAX];
+    uint32_t num_blocos = (dir_inode.i_size + BLOCK_SIZE - 1) >> motor_atual->geometria.log_bloco;
+    for (uint32_t logico = 0; logico < num_blocos; ++logico) {
+        uint32_t fisico = bmap_ler(fd, &dir_inode, logico);
+        if (fisico == 0) continue; // Buraco no diretório
+        if (ler_bloco(fd, fisico, data_block_buffer, BLOCO_DIRETORIO) != 0) {
+            return 0;
+        }
+        uint32_t restante = dir_inode.i_size - (logico << motor_atual->geometria.log_bloco);
+        uint32_t encontrado = POR_TAMANHO_DE_BLOCO(dir_procurar_especializado, data_block_buffer,
+                                                   restante < BLOCK_SIZE ? restante : BLOCK_SIZE,
+                                                   name_to_find, found_file_type);
+        if (encontrado != 0) return encontrado;
+    }
+    return 0;
+}
+
+// dir_lookup com o span do Perfetto (ver evento).
+uint32_t dir_lookup(int fd, const struct ext2_super_block *sb,
+                    const struct ext2_group_desc *bgdt,
+                    uint32_t dir_inode_num, const char *name_to_find, 
+                    uint8_t *found_file_type) {
+    uint64_t inicio_evento = EVENTO_INICIO();
+    uint32_t encontrado = dir_lookup_sem_evento(fd, sb, bgdt, dir_inode_num, name_to_find, found_file_type);
+    if (EVENTOS_ATIVOS) {
+        char nome_json[2 * EXT2_NAME_LEN];
+        evento_texto_json(nome_json, sizeof(nome_json), name_to_find);
+        evento("resolucao", "dir_lookup", inicio_evento, "\"diretorio\":%u,\"nome\":\"%s\",\"inode\":%u",
+               dir_inode_num, nome_json, encontrado);
+    }
+    return encontrado;
+}
+
+// Função para resolver um caminho de arquivo/diretório para um número de inode.
+// Percorre o caminho, componente por componente, usando dir_lookup.
+// Retorna o número do inode se o caminho for resolvido, 0 caso contrário.
+static uint32_t path_to_inode_number_sem_evento(int fd, const struct ext2_super_block *sb,
+                                                const struct ext2_group_desc *bgdt,
+                                                uint32_t base_inode_num, const char *path_str,
+                                                uint8_t *resolved_final_type) {
+    char mutable_path[1024]; // Buffer mutável para strtok_r
+    strncpy(mutable_path, path_str, sizeof(mutable_path) - 1);
+    mutable_path[sizeof(mutable_path) - 1] = '\0';
+
+    uint32_t current_inode;
+
+    if (resolved_final_type) *resolved_final_type = EXT2_FT_UNKNOWN; // Inicializa o tipo final
+
+    if (strlen(mutable_path) == 0) { // Caminho vazio
+        current_inode = base_inode_num;
+        if (resolved_final_type) { // Obtém o tipo do inode base
+            struct ext2_inode temp_inode_info;
+            if (read_inode(fd, sb, bgdt, current_inode, &temp_inode_info) == 0) {
+                if (S_ISDIR(temp_inode_info.i_mode)) *resolved_final_type = EXT2_FT_DIR;
+                else if (S_ISREG(temp_inode_info.i_mode)) *resolved_final_type = EXT2_FT_REG_FILE;
+            }
+        }
+        return current_inode;
+    }
+
+    char *p_path_for_strtok;
+    if (mutable_path[0] == '/') { // Caminho absoluto, começa da raiz
+        current_inode = EXT2_ROOT_INO;
+        p_path_for_strtok = mutable_path + 1; // Pula a barra inicial
+        if (*p_path_for_strtok == '\0') { // Se o caminho é apenas "/", retorna o inode raiz
+            if (resolved_final_type) *resolved_final_type = EXT2_FT_DIR;
+            return EXT2_ROOT_INO;
+        }
+    } else { // Caminho relativo, começa do diretório base
+        current_inode = base_inode_num;
+        p_path_for_strtok = mutable_path;
+    }
+
+    char *restante; // Posição do strtok_r (strtok não pode ser usado por várias threads)
+    char *token = strtok_r(p_path_for_strtok, "/", &restante); // Quebra o caminho em componentes
+    uint8_t last_token_type = EXT2_FT_UNKNOWN;
+
+    while (token != NULL) {
+        if (strlen(token) == 0) { // Ignora tokens vazios (ex: //)
+            token = strtok_r(NULL, "/", &restante);
+            continue;
+        }
+        
+        uint32_t next_inode_num;
+        uint8_t current_token_file_type = EXT2_FT_UNKNOWN;
+
+        if (strcmp(token, ".") == 0) { // Trata "." (diretório atual)
+            next_inode_num = current_inode;
+            struct ext2_inode temp_inode_info;
+            if (read_inode(fd, sb, bgdt, current_inode, &temp_inode_info) != 0 || !S_ISDIR(temp_inode_info.i_mode)) {
+                return 0;
+            }
+            current_token_file_type = EXT2_FT_DIR;
+        } else if (strcmp(token, "..") == 0) { // Trata ".." (diretório pai)
+            if (current_inode == EXT2_ROOT_INO) {
+                next_inode_num = EXT2_ROOT_INO; // ".." na raiz é a própria raiz
+                current_token_file_type = EXT2_FT_DIR;
+            } else {
+                next_inode_num = dir_lookup(fd, sb, bgdt, current_inode, "..", &current_token_file_type);
+                if (next_inode_num == 0) return 0;
+            }
+        } else { // Procura o componente no diretório atual
+            next_inode_num = dir_lookup(fd, sb, bgdt, current_inode, token, &current_token_file_type);
+            if (next_inode_num == 0) {
+                return 0; // Componente não encontrado
+            }
+        }
+        
+        current_inode = next_inode_num;
+        last_token_type = current_token_file_type;
+
+        char *peek_next_token = strtok_r(NULL, "/", &restante);
+        token = peek_next_token;
+
+        if (token != NULL) { // Se houver mais componentes, o componente atual deve ser um diretório
+            if (last_token_type != EXT2_FT_DIR) {
+                 struct ext2_inode temp_inode_check_dir;
+                 if(read_inode(fd,sb,bgdt,current_inode, &temp_inode_check_dir)!=0 || !S_ISDIR(temp_inode_check_dir.i_mode)){
+                    return 0; // Componente intermediário não é diretório
+                 }
+            }
+        }
+    }
+
+    if (resolved_final_type) { // Define o tipo do último componente resolvido
+        *resolved_final_type = last_token_type;
+        if (*resolved_final_type == EXT2_FT_UNKNOWN && current_inode != 0) { // Se o tipo não foi determinado pela entrada de diretório
+            struct ext2_inode final_inode_info;
+            if (read_inode(fd, sb, bgdt, current_inode, &final_inode_info) == 0) {
+                if (S_ISDIR(final_inode_info.i_mode)) *resolved_final_type = EXT2_FT_DIR;
+                else if (S_ISREG(final_inode_info.i_mode)) *resolved_final_type = EXT2_FT_REG_FILE;
+                else if (S_ISLNK(final_inode_info.i_mode)) *resolved_final_type = EXT2_FT_SYMLINK;
+            }
+        }
+    }
+    return current_inode; // Retorna o inode do caminho resolvido
+}
+
+// path_to_inode_number com o span do Perfetto (ver evento).
+uint32_t path_to_inode_number(int fd, const struct ext2_super_block *sb,
+                               const struct ext2_group_desc *bgdt,
+                               uint32_t base_inode_num, const char *path_str,
+                               uint8_t *resolved_final_type) {
+    uint64_t inicio_evento = EVENTO_INICIO();
+    uint32_t inode_num = path_to_inode_number_sem_evento(fd, sb, bgdt, base_inode_num, path_str, resolved_final_type);
+    if (EVENTOS_ATIVOS) {
+        char caminho_json[512];
+        evento_texto_json(caminho_json, sizeof(caminho_json), path_str);
+        evento("resolucao", "path_to_inode_number", inicio_evento, "\"base\":%u,\"caminho\":\"%s\",\"inode\":%u",
+               base_inode_num, caminho_json, inode_num);
+    }
+    return inode_num;
+}
+
+// Implementa o comando 'ls', que lista o conteúdo de um diretório com detalhes adicionais.
+int comando_ls(int fd, const struct ext2_super_block *sb, 
+                const struct ext2_group_desc *bgdt, 
+                uint32_t diretorio_inode_num, const char* path_argumento) {
+    
+    uint32_t inode_a_listar = diretorio_inode_num; // Inode padrão: diretório atual
+    uint8_t tipo_resolvido = EXT2_FT_UNKNOWN;
+
+    if (path_argumento != NULL && strlen(path_argumento) > 0) {
+        // Se um caminho for fornecido, resolve-o para obter o inode.
+        inode_a_listar = path_to_inode_number(fd, sb, bgdt, diretorio_inode_num, path_argumento, &tipo_resolvido);
+        if (inode_a_listar == 0) {
+            fprintf(saida_comando(), "ls: não foi possível acessar '%s': Arquivo ou diretório não encontrado\n", path_argumento);
+            return 1;
+        }
+        if (tipo_resolvido != EXT2_FT_DIR) { // Se não é um diretório, assume-se que é um arquivo regular.
+            struct ext2_inode temp_check;
+            if(read_inode(fd,sb,bgdt,inode_a_listar,&temp_check)==0 && S_ISREG(temp_check.i_mode)){
+                fprintf(saida_comando(), "%s\n", path_argumento); // Lista o próprio arquivo
+                return 0;
+            } else if (tipo_resolvido != EXT2_FT_DIR) {
+                 fprintf(saida_comando(), "ls: não é possível listar '%s': Não é um diretório\n", path_argumento);
+                 return 1;
+            }
+        }
+    }
+
+    struct ext2_inode dir_inode_obj;
+    if (read_inode(fd, sb, bgdt, inode_a_listar, &dir_inode_obj) != 0) {
+        fprintf(saida_comando(), "ls: erro ao ler inode %u\n", inode_a_listar);
+        return 1;
+    }
+
+    if (!S_ISDIR(dir_inode_obj.i_mode)) { // Confere se o inode é de um diretório
+        fprintf(saida_comando(), "ls: inode %u não é um diretório.\n", inode_a_listar);
+        return 1;
+    }
+
+    char data_block_buffer[BLOCK_SIZE_MAX];
+    uint32_t num_blocos = (dir_inode_obj.i_size + BLOCK_SIZE - 1) >> motor_atual->geometria.log_bloco;
+    for (uint32_t logico = 0; logico < num_blocos; ++logico) {
+        uint32_t fisico = bmap_ler(fd, &dir_inode_obj, logico);
+        if (fisico == 0) continue; // Buraco no diretório
+        if (ler_bloco(fd, fisico, data_block_buffer, BLOCO_DIRETORIO) != 0) {
+            fprintf(saida_comando(), "ls: erro ao ler bloco de dados do diretório (inode %u)\n", inode_a_listar);
+            return 1;
+        }
+
+        // Itera pelas entradas do bloco
+        unsigned int offset = 0;
+        while (offset < BLOCK_SIZE) {
+            struct ext2_dir_entry_2 *entry = (struct ext2_dir_entry_2 *)(data_block_buffer + offset);
+            if (entry->rec_len == 0) break; // Prevenção contra corrupção
+
+            if (entry->inode != 0) { // Se a entrada estiver em uso
+                char name_buffer[EXT2_NAME_LEN + 1];
+                strncpy(name_buffer, entry->name, entry->name_len);
+                name_buffer[entry->name_len] = '\0';
+
+                // Imprime os detalhes da entrada no formato solicitado
+                fprintf(saida_comando(), "%s\n", name_buffer);
+                fprintf(saida_comando(), "inode: %u\n", entry->inode);
+                fprintf(saida_comando(), "record lenght: %u\n", entry->rec_len);
+                fprintf(saida_comando(), "name lenght: %u\n", entry->name_len);
+                fprintf(saida_comando(), "file type: %u\n", entry->file_type);
+                fprintf(saida_comando(), "\n");
+            }
+            offset += entry->rec_len; // Move para a próxima entrada
+        }
+    }
+    return 0;
+}
+
+// Função para ler todo o conteúdo de um arquivo, dado seu inode.
+// Lida com blocos diretos e indiretos (simples, duplo, triplo - embora os últimos possam ser limitados).
+// Retorna um buffer alocado dinamicamente com o conteúdo do arquivo.
+// O chamador DEVE liberar este buffer usando free().
+// file_size_out: (saída) armazena o tamanho do arquivo lido.
+// Retorna NULL em caso de erro ou se não for um arquivo regular.
+char* read_file_data(int fd, const struct ext2_super_block *sb,
+                     const struct ext2_group_desc *bgdt,
+                     const struct ext2_inode *file_inode, uint32_t *file_size_out) {
+
+    if (!S_ISREG(file_inode->i_mode)) { // Verifica se é um arquivo regular
+        fprintf(erros_comando(), "read_file_data: Inode não é um arquivo regular.\n");
+        return NULL;
+    }
+
+    *file_size_out = file_inode->i_size; // Obtém o tamanho do arquivo
+    if (*file_size_out == 0) { // Arquivo vazio
+        char *empty_buffer = (char*)malloc(1);
+        if (empty_buffer) empty_buffer[0] = '\0';
+        return empty_buffer; 
+    }
+
+    char *file_content_buffer = (char *)malloc(*file_size_out + 1); // Aloca buffer para o conteúdo
+    if (!file_content_buffer) {
+        perror("read_file_data: Erro ao alocar memória para conteúdo do arquivo");
+        return NULL;
+    }
+
+    char block_read_buffer[BLOCK_SIZE_MAX];
+    uint32_t bytes_read = 0;
+    unsigned int i;
+
+    // 1. Lendo Blocos Diretos (i_block[0] a i_block[11])
+    for (i = 0; i < 12 && bytes_read < *file_size_out; ++i) {
+        if (file_inode->i_block[i] == 0) { // Bloco não alocado (sparse file)
+            uint32_t to_copy = (bytes_read + BLOCK_SIZE > *file_size_out) ? (*file_size_out - bytes_read) : BLOCK_SIZE;
+            memset(file_content_buffer + bytes_read, 0, to_copy); // Preenche com zeros
+            bytes_read += to_copy;
+            continue;
+        }
+        if (read_data_block(fd, file_inode->i_block[i], block_read_buffer) != 0) { // Lê o bloco de dados
+            fprintf(erros_comando(), "read_file_data: Erro ao ler bloco direto %u (bloco real %u)\n", i, file_inode->i_block[i]);
+            free(file_content_buffer);
+            return NULL;
+        }
+        uint32_t to_copy = (*file_size_out - bytes_read < BLOCK_SIZE) ? (*file_size_out - bytes_read) : BLOCK_SIZE;
+        memcpy(file_content_buffer + bytes_read, block_read_buffer, to_copy); // Copia para o buffer principal
+        bytes_read += to_copy;
+    }
+
+    // 2. Lendo Bloco de Indireção Simples (i_block[12])
+    if (bytes_read < *file_size_out && file_inode->i_block[12] != 0) {
+        char indirect_block_pointers_buffer[BLOCK_SIZE_MAX];
+        if (ler_bloco(fd, file_inode->i_block[12], indirect_block_pointers_buffer, BLOCO_INDIRETO) != 0) { // Lê o bloco de ponteiros
+            fprintf(erros_comando(), "read_file_data: Erro ao ler bloco de indireção simples (bloco %u)\n", file_inode->i_block[12]);
+            free(file_content_buffer);
+            return NULL;
+        }
+        uint32_t *indirect_pointers = (uint32_t *)indirect_block_pointers_buffer;
+        unsigned int num_pointers_in_block = BLOCK_SIZE / sizeof(uint32_t);
+
+        for (i = 0; i < num_pointers_in_block && bytes_read < *file_size_out; ++i) {
+            if (indirect_pointers[i] == 0) { // Bloco não alocado
+                uint32_t to_copy = (bytes_read + BLOCK_SIZE > *file_size_out) ? (*file_size_out - bytes_read) : BLOCK_SIZE;
+                memset(file_content_buffer + bytes_read, 0, to_copy);
+                bytes_read += to_copy;
+                continue;
+            }
+            if (read_data_block(fd, indirect_pointers[i], block_read_buffer) != 0) {
+                fprintf(erros_comando(), "read_file_data: Erro ao ler bloco de dados %u (apontado por indireção simples)\n", indirect_pointers[i]);
+                free(file_content_buffer);
+                return NULL;
+            }
+            uint32_t to_copy = (*file_size_out - bytes_read < BLOCK_SIZE) ? (*file_size_out - bytes_read) : BLOCK_SIZE;
+            memcpy(file_content_buffer + bytes_read, block_read_buffer, to_copy);
+            bytes_read += to_copy;
+        }
+    }
+
+    // 3. Lendo Bloco de Dupla Indireção (i_block[13])
+    if (bytes_read < *file_size_out && file_inode->i_block[13] != 0) {
+        char double_indirect_block_pointers_buffer[BLOCK_SIZE_MAX];
+        if (ler_bloco(fd, file_inode->i_block[13], double_indirect_block_pointers_buffer, BLOCO_INDIRETO) != 0) { // Lê o bloco de ponteiros de segundo nível
+            fprintf(erros_comando(), "read_file_data: Erro ao ler bloco de dupla indireção (bloco %u)\n", file_inode->i_block[13]);
+            free(file_content_buffer);
+            return NULL;
+        }
+        uint32_t *double_indirect_pointers = (uint32_t *)double_indirect_block_pointers_buffer;
+        unsigned int num_pointers_in_block = BLOCK_SIZE / sizeof(uint32_t);
+
+        for (i = 0; i < num_pointers_in_block && bytes_read < *file_size_out; ++i) {
+            if (double_indirect_pointers[i] == 0) continue; 
+
+            char indirect_block_pointers_buffer[BLOCK_SIZE_MAX]; 
+            if (ler_bloco(fd, double_indirect_pointers[i], indirect_block_pointers_buffer, BLOCO_INDIRETO) != 0) { // Lê o bloco de ponteiros de primeiro nível
+                fprintf(erros_comando(), "read_file_data: Erro ao ler bloco de indireção simples (nível 2, bloco %u) da dupla indireção\n", double_indirect_pointers[i]);
+                free(file_content_buffer);
+                return NULL;
+            }
+            uint32_t *indirect_pointers = (uint32_t *)indirect_block_pointers_buffer;
+
+            unsigned int j;
+            for (j = 0; j < num_pointers_in_block && bytes_read < *file_size_out; ++j) {
+                 if (indirect_pointers[j] == 0) { // Bloco não alocado
+                    uint32_t to_copy = (bytes_read + BLOCK_SIZE > *file_size_out) ? (*file_size_out - bytes_read) : BLOCK_SIZE;
+                    memset(file_content_buffer + bytes_read, 0, to_copy);
+                    bytes_read += to_copy;
+                    continue;
+                }
+                if (read_data_block(fd, indirect_pointers[j], block_read_buffer) != 0) { // Lê o bloco de dados final
+                    fprintf(erros_comando(), "read_file_data: Erro ao ler bloco de dados %u (apontado por dupla indireção)\n", indirect_pointers[j]);
+                    free(file_content_buffer);
+                    return NULL;
+                }
+                uint32_t to_copy = (*file_size_out - bytes_read < BLOCK_SIZE) ? (*file_size_out - bytes_read) : BLOCK_SIZE;
+                memcpy(file_content_buffer + bytes_read, block_read_buffer, to_copy);
+                bytes_read += to_copy;
+            }
+        }
+    }
+    // Bloco de Tripla Indireção (i_block[14]) - Não implementado aqui.
+
+    file_content_buffer[*file_size_out] = '\0'; // Adiciona terminador null para facilitar tratamento como string
+    return file_content_buffer;
+}
+
+// Implementa o comando 'cat', que exibe o conteúdo de um arquivo.
+int comando_cat(int fd, const struct ext2_super_block *sb, 
+                 const struct ext2_group_desc *bgdt, 
+                 uint32_t diretorio_atual_inode_num, const char* path_arquivo) {
+
+    if (path_arquivo == NULL || strlen(path_arquivo) == 0) {
+        fprintf(saida_comando(), "cat: Caminho do arquivo não especificado.\n");
+        return 1;
+    }
+
+    uint8_t tipo_resolvido = EXT2_FT_UNKNOWN;
+    // Resolve o caminho para obter o inode do arquivo
+    uint32_t arquivo_inode_num = path_to_inode_number(fd, sb, bgdt, diretorio_atual_inode_num, path_arquivo, &tipo_resolvido);
+
+    if (arquivo_inode_num == 0) {
+        fprintf(saida_comando(), "cat: '%s': Arquivo ou diretório não encontrado\n", path_arquivo);
+        return 1;
+    }
+
+    struct ext2_inode arquivo_inode_obj;
+    if (read_inode(fd, sb, bgdt, arquivo_inode_num, &arquivo_inode_obj) != 0) { // Lê o inode do arquivo
+        fprintf(saida_comando(), "cat: Erro ao ler inode %u para o arquivo '%s'\n", arquivo_inode_num, path_arquivo);
+        return 1;
+    }
+
+    if (!S_ISREG(arquivo_inode_obj.i_mode)) { // Verifica se é um arquivo regular
+        if (S_ISDIR(arquivo_inode_obj.i_mode)) {
+             fprintf(saida_comando(), "cat: '%s': É um diretório\n", path_arquivo);
+        } else {
+             fprintf(saida_comando(), "cat: '%s': Não é um arquivo regular\n", path_arquivo);
+        }
+        return 1;
+    }
+
+    uint32_t tamanho_do_arquivo;
+    char *conteudo_arquivo = read_file_data(fd, sb, bgdt, &arquivo_inode_obj, &tamanho_do_arquivo); // Lê o conteúdo do arquivo
+
+    if (conteudo_arquivo == NULL) {
+        fprintf(saida_comando(), "cat: Falha ao ler o conteúdo de '%s'\n", path_arquivo);
+        return 1;
+    }
+
+    if (tamanho_do_arquivo > 0) {
+        fwrite(conteudo_arquivo, 1, tamanho_do_arquivo, saida_comando()); // Imprime o conteúdo
+    }
+
+    free(conteudo_arquivo); // Libera a memória alocada
+    return 0;
+}
+
+// Implementa o comando 'attr', que exibe os atributos (metadados) de um arquivo ou diretório.
+int comando_attr(int fd, const struct ext2_super_block *sb, 
+                  const struct ext2_group_desc *bgdt, 
+                  uint32_t diretorio_atual_inode_num, const char* path_alvo) {
+
+    if (path_alvo == NULL || strlen(path_alvo) == 0) {
+        fprintf(saida_comando(), "attr: Caminho do arquivo ou diretório não especificado.\n");
+        return 1;
+    }
+
+    uint8_t tipo_resolvido = EXT2_FT_UNKNOWN;
+    // Resolve o caminho para obter o inode do alvo
+    uint32_t alvo_inode_num = path_to_inode_number(fd, sb, bgdt, diretorio_atual_inode_num, path_alvo, &tipo_resolvido);
+
+    if (alvo_inode_num == 0) {
+        fprintf(saida_comando(), "attr: '%s': Arquivo ou diretório não encontrado\n", path_alvo);
+        return 1;
+    }
+
+    struct ext2_inode alvo_inode_obj;
+    if (read_inode(fd, sb, bgdt, alvo_inode_num, &alvo_inode_obj) != 0) { // Lê o inode do alvo
+        fprintf(saida_comando(), "attr: Erro ao ler inode %u para '%s'\n", alvo_inode_num, path_alvo);
+        return 1;
+    }
+
+    fprintf(saida_comando(), "Atributos para '%s' (Inode: %u):\n", path_alvo, alvo_inode_num);
+
+    // Exibe o tipo de arquivo
+    char tipo_str[50] = "Desconhecido";
+    if (S_ISREG(alvo_inode_obj.i_mode)) strcpy(tipo_str, "Arquivo Regular");
+    else if (S_ISDIR(alvo_inode_obj.i_mode)) strcpy(tipo_str, "Diretório");
+    else if (S_ISLNK(alvo_inode_obj.i_mode)) strcpy(tipo_str, "Link Simbólico");
+    else if (S_ISCHR(alvo_inode_obj.i_mode)) strcpy(tipo_str, "Dispositivo de Caractere");
+    else if (S_ISBLK(alvo_inode_obj.i_mode)) strcpy(tipo_str, "Dispositivo de Bloco");
+    else if (S_ISFIFO(alvo_inode_obj.i_mode)) strcpy(tipo_str, "FIFO/Pipe");
+    else if (S_ISSOCK(alvo_inode_obj.i_mode)) strcpy(tipo_str, "Socket");
+    fprintf(saida_comando(), "  Tipo:          %s (0x%X)\n", tipo_str, alvo_inode_obj.i_mode & 0xF000);
+
+    // Exibe as permissões
+    fprintf(saida_comando(), "  Modo (perms):  %o (octal)\n", alvo_inode_obj.i_mode & 0xFFF);
+    char perms_str[10];
+    perms_str[0] = (alvo_inode_obj.i_mode & S_IRUSR) ? 'r' : '-';
+    perms_str[1] = (alvo_inode_obj.i_mode & S_IWUSR) ? 'w' : '-';
+    perms_str[2] = (alvo_inode_obj.i_mode & S_IXUSR) ? 'x' : '-';
+    perms_str[3] = (alvo_inode_obj.i_mode & S_IRGRP) ? 'r' : '-';
+    perms_str[4] = (alvo_inode_obj.i_mode & S_IWGRP) ? 'w' : '-';
+    perms_str[5] = (alvo_inode_obj.i_mode & S_IXGRP) ? 'x' : '-';
+    perms_str[6] = (alvo_inode_obj.i_mode & S_IROTH) ? 'r' : '-';
+    perms_str[7] = (alvo_inode_obj.i_mode & S_IWOTH) ? 'w' : '-';
+    perms_str[8] = (alvo_inode_obj.i_mode & S_IXOTH) ? 'x' : '-';
+    perms_str[9] = '\0';
+    fprintf(saida_comando(), "  Permissões:    %s (u:%c%c%c g:%c%c%c o:%c%c%c)\n", perms_str,
+           (alvo_inode_obj.i_mode & S_IRUSR) ? 'r' : '-', (alvo_inode_obj.i_mode & S_IWUSR) ? 'w' : '-', (alvo_inode_obj.i_mode & S_IXUSR) ? 'x' : '-', 
+           (alvo_inode_obj.i_mode & S_IRGRP) ? 'r' : '-', (alvo_inode_obj.i_mode & S_IWGRP) ? 'w' : '-', (alvo_inode_obj.i_mode & S_IXGRP) ? 'x' : '-', 
+           (alvo_inode_obj.i_mode & S_IROTH) ? 'r' : '-', (alvo_inode_obj.i_mode & S_IWOTH) ? 'w' : '-', (alvo_inode_obj.i_mode & S_IXOTH) ? 'x' : '-'  
+          );
+    if (alvo_inode_obj.i_mode & S_ISUID) fprintf(saida_comando(), "                 (setuid bit set)\n");
+    if (alvo_inode_obj.i_mode & S_ISGID) fprintf(saida_comando(), "                 (setgid bit set)\n");
+
+    fprintf(saida_comando(), "  UID:           %u\n", alvo_inode_obj.i_uid);
+    fprintf(saida_comando(), "  GID:           %u\n", alvo_inode_obj.i_gid);
+    fprintf(saida_comando(), "  Tamanho:       %u bytes\n", alvo_inode_obj.i_size);
+    fprintf(saida_comando(), "  Links:         %u\n", alvo_inode_obj.i_links_count);
+    fprintf(saida_comando(), "  Blocos (FS):   %u (calculado: %u)\n", alvo_inode_obj.i_blocks / (BLOCK_SIZE/512), alvo_inode_obj.i_blocks ); 
+    
+    // Exibe os timestamps formatados
+    time_t atime_val = alvo_inode_obj.i_atime;
+    time_t ctime_val = alvo_inode_obj.i_ctime;
+    time_t mtime_val = alvo_inode_obj.i_mtime;
+    char buffer_time[30];
+    
+    ctime_r(&atime_val, buffer_time);
+    buffer_time[strcspn(buffer_time, "\n")] = 0;
+    fprintf(saida_comando(), "  Acesso:        %s\n", buffer_time);
+
+    ctime_r(&ctime_val, buffer_time);
+    buffer_time[strcspn(buffer_time, "\n")] = 0;
+    fprintf(saida_comando(), "  Criação Inode: %s\n", buffer_time);
+
+    ctime_r(&mtime_val, buffer_time);
+    buffer_time[strcspn(buffer_time, "\n")] = 0;
+    fprintf(saida_comando(), "  Modificação:   %s\n", buffer_time);
+    
+    if (alvo_inode_obj.i_dtime != 0) {
+        time_t dtime_val = alvo_inode_obj.i_dtime;
+        ctime_r(&dtime_val, buffer_time);
+        buffer_time[strcspn(buffer_time, "\n")] = 0;
+        fprintf(saida_comando(), "  Deleção:       %s\n", buffer_time);
+    }
+
+    fprintf(saida_comando(), "  Flags Inode:   0x%X\n", alvo_inode_obj.i_flags);
+
+    fprintf(saida_comando(), "  Ponteiros de Bloco (i_block):\n");
+    for (int k=0; k<15; ++k) { // Exibe os 15 ponteiros de bloco
+        fprintf(saida_comando(), "    i_block[%2d]: %u (0x%X)\n", k, alvo_inode_obj.i_block[k], alvo_inode_obj.i_block[k]);
+    }
+    return 0;
+}
+
+// Implementa o comando 'pwd' (print working directory), que exibe o caminho completo do diretório atual.
+int comando_pwd(const char* diretorio_atual_str) {
+    fprintf(saida_comando(), "%s\n", diretorio_atual_str);
+    return 0;
+}
+
+// Função auxiliar para normalizar uma string de caminho (ex: remove barras duplas, trata . e ..).
+// Retorna uma string alocada dinamicamente que deve ser liberada pelo chamador.
+char* normalizar_path_string(const char* base, const char* append) {
+    char temp_path[2048]; 
+    
+    if (append && append[0] == '/') { // Se 'append' é um caminho absoluto, usa-o diretamente
+        strncpy(temp_path, append, sizeof(temp_path) -1 );
+    } else { // Caso contrário, constrói o caminho relativo
+        strncpy(temp_path, base, sizeof(temp_path) - 1);
+        if (append && strlen(append) > 0) {
+            if (temp_path[strlen(temp_path) - 1] != '/') {
+                strncat(temp_path, "/", sizeof(temp_path) - strlen(temp_path) - 1);
+            }
+            strncat(temp_path, append, sizeof(temp_path) - strlen(temp_path) - 1);
+        }
+    }
+    temp_path[sizeof(temp_path) -1] = '\0';
+
+    size_t len = strlen(temp_path);
+    while (len > 1 && temp_path[len-1] == '/') { // Remove barras extras no final (exceto para a raiz)
+        temp_path[len-1] = '\0';
+        len--;
+    }
+    if (strlen(temp_path) == 0 && ( (append && append[0] == '/') || (base && base[0] == '/' && (!append || strlen(append)==0))  ) ) {
+        strcpy(temp_path, "/"); // Garante que a raiz seja representada como "/"
+    }
+
+    return strdup(temp_path); // Retorna uma cópia alocada dinamicamente
+}
+
+// Implementa o comando 'cd' (change directory), que muda o diretório de trabalho atual.
+int comando_cd(int fd, const struct ext2_super_block *sb, 
+                const struct ext2_group_desc *bgdt, 
+                uint32_t *diretorio_atual_inode_num_ptr, 
+                char* diretorio_atual_str, 
+                size_t diretorio_atual_str_max_len,
+                const char* path_alvo) {
+
+    if (path_alvo == NULL || strlen(path_alvo) == 0) { // 'cd' sem argumentos vai para a raiz
+        *diretorio_atual_inode_num_ptr = EXT2_ROOT_INO;
+        strncpy(diretorio_atual_str, "/", diretorio_atual_str_max_len -1);
+        diretorio_atual_str[diretorio_atual_str_max_len -1] = '\0';
+        return 0;
+    }
+
+    uint8_t tipo_resolvido = EXT2_FT_UNKNOWN;
+    // Resolve o caminho alvo para obter o inode do novo diretório
+    uint32_t novo_inode_num = path_to_inode_number(fd, sb, bgdt, *diretorio_atual_inode_num_ptr, path_alvo, &tipo_resolvido);
+
+    if (novo_inode_num == 0) {
+        fprintf(saida_comando(), "cd: '%s': Arquivo ou diretório não encontrado\n", path_alvo);
+        return 1;
+    }
+
+    struct ext2_inode novo_inode_obj;
+    if (read_inode(fd, sb, bgdt, novo_inode_num, &novo_inode_obj) != 0) { // Lê o inode do alvo
+        fprintf(saida_comando(), "cd: Erro ao ler inode %u para '%s'\n", novo_inode_num, path_alvo);
+        return 1;
+    }
+
+    if (!S_ISDIR(novo_inode_obj.i_mode)) { // Verifica se o alvo é um diretório
+        fprintf(saida_comando(), "cd: '%s': Não é um diretório\n", path_alvo);
+        return 1;
+    }
+
+    *diretorio_atual_inode_num_ptr = novo_inode_num; // Atualiza o inode do diretório atual
+
+    // Atualiza a string do diretório atual para o prompt
+    char* path_normalizado;
+    if (path_alvo[0] == '/') { // Caminho absoluto
+        path_normalizado = normalizar_path_string(path_alvo, NULL);
+    } else { // Caminho relativo
+        path_normalizado = normalizar_path_string(diretorio_atual_str, path_alvo);
+    }
+    
+    if (*diretorio_atual_inode_num_ptr == EXT2_ROOT_INO) { // Se o novo diretório é a raiz, a string é "/"
+        strncpy(diretorio_atual_str, "/", diretorio_atual_str_max_len -1);
+    } else {
+        strncpy(diretorio_atual_str, path_normalizado, diretorio_atual_str_max_len - 1);
+    }
+    diretorio_atual_str[diretorio_atual_str_max_len - 1] = '\0';
+    free(path_normalizado); // Libera a memória alocada pela normalizar_path_string
+    return 0;
+}
+
+// Função auxiliar: Retorna 1 se o bit estiver setado (1), 0 se estiver limpo (0) no bitmap.
+int is_bit_set(const unsigned char *bitmap_buffer, int bit_num) {
+    return (bitmap_buffer[bit_num / 8] & (1 << (bit_num % 8))) != 0;
+}
+
+// Função auxiliar: Seta o bit (para 1) no bitmap.
+void set_bit(unsigned char *bitmap_buffer, int bit_num) {
+    bitmap_buffer[bit_num / 8] |= (1 << (bit_num % 8));
+}
+
+// Função auxiliar: Limpa o bit (para 0) no bitmap.
+void clear_bit(unsigned char *bitmap_buffer, int bit_num) {
+    bitmap_buffer[bit_num / 8] &= ~(1 << (bit_num % 8));
+}
+
+// Próximo bit em [de, limite) com o valor 'valor' (0 ou 1), ou 'limite' se não houver.
+// Examina o bitmap (um bloco) em palavras de 64 bits, na ordem de bits do disco
+// (little-endian); ver POR_TAMANHO_DE_BLOCO.
+ESPECIALIZADA uint32_t bitmap_proximo_especializado(const unsigned char *bitmap, uint32_t de, uint32_t limite,
+                                                    int valor, const uint32_t tamanho_bloco) {
+    const uint64_t inverter = valor ? 0 : ~0ull;
+    if (limite > tamanho_bloco * 8) limite = tamanho_bloco * 8;
+    for (uint32_t palavra = de >> 6; palavra < tamanho_bloco / 8 && (palavra << 6) < limite; ++palavra) {
+        uint64_t bits;
+        memcpy(&bits, bitmap + (palavra << 3), sizeof(bits));
+        bits ^= inverter;
+        if (palavra == (de >> 6)) bits &= ~0ull << (de & 63);
+        if (bits != 0) {
+            uint32_t bit = (palavra << 6) + (uint32_t)__builtin_ctzll(bits);
+            return bit < limite ? bit : limite;
+        }
+    }
+    return limite;
+}
+
+uint32_t bitmap_proximo(const unsigned char *bitmap, uint32_t de, uint32_t limite, int valor) {
+    if (de >= limite) return limite;
+    return POR_TAMANHO_DE_BLOCO(bitmap_proximo_especializado, bitmap, de, limite, valor);
+}
+
+// ---------------------------------------------------------------------------
+// Índice de extensões livres.
+// Mantém em memória as sequências de blocos livres (extensões) lidas dos bitmaps
+// de blocos, organizadas em duas treaps: uma ordenada por offset (bloco inicial)
+// e outra ordenada por (tamanho, offset). Assim "primeiro bloco livre", "extensão
+// que contém o bloco X" e "melhor ajuste de N blocos perto do bloco G" custam
+// O(log n) em vez de uma varredura linear dos bitmaps.
+// Uma extensão nunca atravessa a fronteira de um grupo de blocos, de modo que
+// cada alocação/liberação toca o bitmap de um único grupo.
+// ---------------------------------------------------------------------------
+
+#define ARVORE_OFFSET  0 // Treap ordenada pelo bloco inicial
+#define ARVORE_TAMANHO 1 // Treap ordenada por (tamanho, bloco inicial)
+
+// Máximo de extensões visitadas a partir do objetivo antes de recorrer ao melhor ajuste.
+#define INDICE_LIVRE_MAX_VIZINHOS 8
+
+// Nó do índice. Cada extensão participa das duas árvores ao mesmo tempo.
+struct extensao_livre {
+    uint32_t inicio;                   // Primeiro bloco livre da extensão
+    uint32_t tamanho;                  // Quantidade de blocos livres contíguos
+    uint32_t prioridade;               // Prioridade aleatória (propriedade de heap da treap)
+    struct extensao_livre *esq[2];     // Filho esquerdo em cada árvore
+    struct extensao_livre *dir[2];     // Filho direito em cada árvore
+};
+
+// Gerador xorshift simples para as prioridades da treap (estado por thread: imagens
+// diferentes podem alocar ao mesmo tempo).
+static uint32_t indice_livre_prioridade(void) {
+    static __thread uint32_t estado = 2463534242u;
+    estado ^= estado << 13;
+    estado ^= estado >> 17;
+    estado ^= estado << 5;
+    return estado;
+}
+
+// Compara duas extensões segundo a ordem da árvore indicada.
+static int extensao_cmp(const struct extensao_livre *a, const struct extensao_livre *b, int arvore) {
+    if (arvore == ARVORE_TAMANHO && a->tamanho != b->tamanho) {
+        return (a->tamanho < b->tamanho) ? -1 : 1;
+    }
+    if (a->inicio != b->inicio) {
+        return (a->inicio < b->inicio) ? -1 : 1;
+    }
+    return 0;
+}
+
+static struct extensao_livre* treap_inserir(struct extensao_livre *raiz, struct extensao_livre *no, int arvore) {
+    if (raiz == NULL) return no;
+    if (extensao_cmp(no, raiz, arvore) < 0) {
+        raiz->esq[arvore] = treap_inserir(raiz->esq[arvore], no, arvore);
+        if (raiz->esq[arvore]->prioridade > raiz->prioridade) { // Rotação à direita
+            struct extensao_livre *filho = raiz->esq[arvore];
+            raiz->esq[arvore] = filho->dir[arvore];
+            filho->dir[arvore] = raiz;
+            raiz = filho;
+        }
+    } else {
+        raiz->dir[arvore] = treap_inserir(raiz->dir[arvore], no, arvore);
+        if (raiz->dir[arvore]->prioridade > raiz->prioridade) { // Rotação à esquerda
+            struct extensao_livre *filho = raiz->dir[arvore];
+            raiz->dir[arvore] = filho->esq[arvore];
+            filho->esq[arvore] = raiz;
+            raiz = filho;
+        }
+    }
+    return raiz;
+}
+
+// Junta duas subárvores (todas as chaves de 'a' são menores que as de 'b').
+static struct extensao_livre* treap_juntar(struct extensao_livre *a, struct extensao_livre *b, int arvore) {
+    if (a == NULL) return b;
+    if (b == NULL) return a;
+    if (a->prioridade > b->prioridade) {
+        a->dir[arvore] = treap_juntar(a->dir[arvore], b, arvore);
+        return a;
+    }
+    b->esq[arvore] = treap_juntar(a, b->esq[arvore], arvore);
+    return b;
+}
+
+static struct extensao_livre* treap_remover(struct extensao_livre *raiz, struct extensao_livre *no, int arvore) {
+    if (raiz == NULL) return NULL;
+    if (raiz == no) {
+        struct extensao_livre *resultado = treap_juntar(raiz->esq[arvore], raiz->dir[arvore], arvore);
+        no->esq[arvore] = no->dir[arvore] = NULL;
+        return resultado;
+    }
+    if (extensao_cmp(no, raiz, arvore) < 0) {
+        raiz->esq[arvore] = treap_remover(raiz->esq[arvore], no, arvore);
+    } else {
+        raiz->dir[arvore] = treap_remover(raiz->dir[arvore], no, arvore);
+    }
+    return raiz;
+}
+
+// Insere um nó já preenchido nas duas árvores.
+static void indice_livre_inserir_no(struct extensao_livre *no) {
+    struct indice_extensoes_livres *indice = &motor_atual->indice_livre;
+    no->esq[0] = no->esq[1] = no->dir[0] = no->dir[1] = NULL;
+    no->prioridade = indice_livre_prioridade();
+    indice->raiz[ARVORE_OFFSET] = treap_inserir(indice->raiz[ARVORE_OFFSET], no, ARVORE_OFFSET);
+    indice->raiz[ARVORE_TAMANHO] = treap_inserir(indice->raiz[ARVORE_TAMANHO], no, ARVORE_TAMANHO);
+    indice->num_extensoes++;
+    indice->blocos_livres += no->tamanho;
+}
+
+// Retira um nó das duas árvores (sem liberar a memória).
+static void indice_livre_retirar_no(struct extensao_livre *no) {
+    struct indice_extensoes_livres *indice = &motor_atual->indice_livre;
+    indice->raiz[ARVORE_OFFSET] = treap_remover(indice->raiz[ARVORE_OFFSET], no, ARVORE_OFFSET);
+    indice->raiz[ARVORE_TAMANHO] = treap_remover(indice->raiz[ARVORE_TAMANHO], no, ARVORE_TAMANHO);
+    indice->num_extensoes--;
+    indice->blocos_livres -= no->tamanho;
+}
+
+// Cria e insere uma nova extensão. Retorna 0 em sucesso, -1 se faltar memória.
+static int indice_livre_nova_extensao(uint32_t inicio, uint32_t tamanho) {
+    struct extensao_livre *no = (struct extensao_livre *)malloc(sizeof(struct extensao_livre));
+    if (!no) {
+        perror("indice_livre: Erro ao alocar extensão");
+        return -1;
+    }
+    no->inicio = inicio;
+    no->tamanho = tamanho;
+    indice_livre_inserir_no(no);
+    return 0;
+}
+
+// Retorna a extensão com maior 'inicio' <= bloco (ou NULL).
+static struct extensao_livre* indice_livre_anterior_ou_igual(uint32_t bloco) {
+    struct extensao_livre *no = motor_atual->indice_livre.raiz[ARVORE_OFFSET], *melhor = NULL;
+    while (no) {
+        if (no->inicio <= bloco) { melhor = no; no = no->dir[ARVORE_OFFSET]; }
+        else { no = no->esq[ARVORE_OFFSET]; }
+    }
+    return melhor;
+}
+
+// Retorna a extensão com menor 'inicio' > bloco (ou NULL).
+static struct extensao_livre* indice_livre_seguinte(uint32_t bloco) {
+    struct extensao_livre *no = motor_atual->indice_livre.raiz[ARVORE_OFFSET], *melhor = NULL;
+    while (no) {
+        if (no->inicio > bloco) { melhor = no; no = no->esq[ARVORE_OFFSET]; }
+        else { no = no->dir[ARVORE_OFFSET]; }
+    }
+    return melhor;
+}
+
+// Retorna a menor extensão com tamanho >= quantidade (melhor ajuste), ou NULL.
+static struct extensao_livre* indice_livre_melhor_ajuste(uint32_t quantidade) {
+    struct extensao_livre *no = motor_atual->indice_livre.raiz[ARVORE_TAMANHO], *melhor = NULL;
+    while (no) {
+        if (no->tamanho >= quantidade) { melhor = no; no = no->esq[ARVORE_TAMANHO]; }
+        else { no = no->dir[ARVORE_TAMANHO]; }
+    }
+    return melhor;
+}
+
+// Indica se dois blocos pertencem ao mesmo grupo de blocos.
+static int indice_livre_mesmo_grupo(uint32_t a, uint32_t b) {
+    return grupo_do_bloco(a, NULL) == grupo_do_bloco(b, NULL);
+}
+
+// Procura uma sequência de 'quantidade' blocos livres, preferindo o bloco 'objetivo'.
+// Estratégia: (1) a própria posição do objetivo, se couber; (2) as extensões seguintes
+// ao objetivo que comportem o pedido (limitado a INDICE_LIVRE_MAX_VIZINHOS);
+// (3) melhor ajuste global pela árvore de tamanhos.
+// Com objetivo 0 retorna o primeiro bloco livre (mesma política first-fit dos bitmaps).
+// Retorna 1 e preenche 'inicio_out' se encontrou, 0 caso contrário.
+int indice_livre_procurar(uint32_t objetivo, uint32_t quantidade, uint32_t *inicio_out) {
+    if (!motor_atual->indice_livre.construido || quantidade == 0) return 0;
+
+    // Cada extensão examinada conta como um passo do alocador nas estatísticas.
+    if (objetivo == 0 && quantidade == 1) { // Primeiro bloco livre: extensão mais à esquerda
+        ESTAT(estatisticas.alocador_blocos.passos_atual++);
+        struct extensao_livre *no = motor_atual->indice_livre.raiz[ARVORE_OFFSET];
+        if (!no) return 0;
+        while (no->esq[ARVORE_OFFSET]) no = no->esq[ARVORE_OFFSET];
+        *inicio_out = no->inicio;
+        return 1;
+    }
+
+    if (objetivo != 0) {
+        struct extensao_livre *no = indice_livre_anterior_ou_igual(objetivo);
+        ESTAT(estatisticas.alocador_blocos.passos_atual++);
+        if (no && objetivo - no->inicio < no->tamanho &&
+            no->tamanho - (objetivo - no->inicio) >= quantidade) {
+            *inicio_out = objetivo; // O objetivo está livre e há espaço à frente
+            return 1;
+        }
+        uint32_t cursor = objetivo;
+        for (int passos = 0; passos < INDICE_LIVRE_MAX_VIZINHOS; ++passos) {
+            no = indice_livre_seguinte(cursor);
+            if (!no) break;
+            ESTAT(estatisticas.alocador_blocos.passos_atual++);
+            if (no->tamanho >= quantidade) {
+                *inicio_out = no->inicio;
+                return 1;
+            }
+            cursor = no->inicio;
+        }
+    }
+
+    struct extensao_livre *ajuste = indice_livre_melhor_ajuste(quantidade);
+    ESTAT(estatisticas.alocador_blocos.passos_atual++);
+    if (!ajuste) return 0;
+    *inicio_out = ajuste->inicio;
+    return 1;
+}
+
+// Remove o intervalo [inicio, inicio + quantidade) do índice (blocos foram alocados).
+// O intervalo deve estar contido em uma única extensão.
+// Retorna 0 em sucesso, -1 se o intervalo não estiver livre no índice.
+int indice_livre_remover_intervalo(uint32_t inicio, uint32_t quantidade) {
+    if (!motor_atual->indice_livre.construido) return 0;
+    struct extensao_livre *no = indice_livre_anterior_ou_igual(inicio);
+    if (!no || inicio - no->inicio >= no->tamanho || no->tamanho - (inicio - no->inicio) < quantidade) {
+        return -1;
+    }
+    uint32_t fim_extensao = no->inicio + no->tamanho;
+    uint32_t fim_intervalo = inicio + quantidade;
+
+    indice_livre_retirar_no(no);
+    if (no->inicio < inicio) { // Sobra à esquerda: reaproveita o nó
+        no->tamanho = inicio - no->inicio;
+        indice_livre_inserir_no(no);
+        if (fim_intervalo < fim_extensao) {
+            return indice_livre_nova_extensao(fim_intervalo, fim_extensao - fim_intervalo);
+        }
+    } else if (fim_intervalo < fim_extensao) { // Sobra só à direita
+        no->inicio = fim_intervalo;
+        no->tamanho = fim_extensao - fim_intervalo;
+        indice_livre_inserir_no(no);
+    } else {
+        free(no);
+    }
+    return 0;
+}
+
+// Adiciona o intervalo [inicio, inicio + quantidade) ao índice (blocos foram liberados),
+// fundindo-o com as extensões vizinhas do mesmo grupo.
+void indice_livre_adicionar_intervalo(uint32_t inicio, uint32_t quantidade) {
+    if (!motor_atual->indice_livre.construido || quantidade == 0) return;
+    struct extensao_livre *anterior = indice_livre_anterior_ou_igual(inicio);
+    struct extensao_livre *seguinte = indice_livre_seguinte(inicio);
+
+    if (anterior && inicio - anterior->inicio < anterior->tamanho) {
+        fprintf(erros_comando(), "indice_livre: Bloco %u já consta como livre no índice.\n", inicio);
+        return;
+    }
+
+    int funde_anterior = anterior && anterior->inicio + anterior->tamanho == inicio &&
+                         indice_livre_mesmo_grupo(anterior->inicio, inicio);
+    int funde_seguinte = seguinte && inicio + quantidade == seguinte->inicio &&
+                         indice_livre_mesmo_grupo(inicio, seguinte->inicio);
+
+    if (funde_anterior && funde_seguinte) {
+        indice_livre_retirar_no(anterior);
+        indice_livre_retirar_no(seguinte);
+        anterior->tamanho += quantidade + seguinte->tamanho;
+        free(seguinte);
+        indice_livre_inserir_no(anterior);
+    } else if (funde_anterior) {
+        indice_livre_retirar_no(anterior);
+        anterior->tamanho += quantidade;
+        indice_livre_inserir_no(anterior);
+    } else if (funde_seguinte) {
+        indice_livre_retirar_no(seguinte);
+        seguinte->inicio = inicio;
+        seguinte->tamanho += quantidade;
+        indice_livre_inserir_no(seguinte);
+    } else {
+        indice_livre_nova_extensao(inicio, quantidade);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Liberações pendentes. Um bloco liberado só volta ao índice de extensões livres (e só
+// então pode ser realocado) quando a liberação é durável: com o journal, no commit de
+// grupo; sem ele, no fdatasync da imagem da política de durabilidade (sem política, assim
+// que a transação é gravada). Os dados de arquivo são gravados direto na imagem
+// (dev_pwrite_dados, cp, defrag); se o bloco fosse reaproveitado antes, uma queda
+// deixaria o dono antigo apontando para os dados do novo. Os blocos liberados pela
+// transação em andamento esperam ao menos a confirmação dela, como no jbd2 do ext3/ext4.
+// ---------------------------------------------------------------------------
+
+// Registra a liberação de [inicio, inicio + quantidade), um intervalo de um só grupo.
+static void liberacao_registrar(uint32_t inicio, uint32_t quantidade) {
+    struct liberacoes_pendentes *l = &motor_atual->liberacoes;
+    if (quantidade == 0) return;
+    if (l->tamanho > l->confirmadas) { // Emenda com a anterior da mesma transação
+        struct liberacao_pendente *ultima = &l->itens[l->tamanho - 1];
+        if (ultima->inicio + ultima->quantidade == inicio && indice_livre_mesmo_grupo(ultima->inicio, inicio)) {
+            ultima->quantidade += quantidade;
+            return;
+        }
+    }
+    if (l->tamanho == l->capacidade) {
+        size_t capacidade = l->capacidade ? l->capacidade * 2 : 64;
+        struct liberacao_pendente *itens = (struct liberacao_pendente *)realloc(l->itens, capacidade * sizeof(*itens));
+        if (!itens) { // Os blocos ficam livres no bitmap, mas fora do índice até ele ser reconstruído
+            perror("liberacao_registrar: Erro ao alocar memória");
+            return;
+        }
+        l->itens = itens;
+        l->capacidade = capacidade;
+    }
+    l->itens[l->tamanho++] = (struct liberacao_pendente){ inicio, quantidade };
+    if (motor_atual->transacao_atual.aninhamento == 0) l->confirmadas = l->tamanho; // Já gravada
+}
+
+// Devolve ao índice os blocos liberados pelas transações confirmadas (a liberação ficou
+// durável). As liberações da transação em andamento continuam pendentes.
+static void liberacoes_concluir(void) {
+    struct liberacoes_pendentes *l = &motor_atual->liberacoes;
+    if (l->confirmadas == 0) return;
+    for (size_t i = 0; i < l->confirmadas; ++i) indice_livre_adicionar_intervalo(l->itens[i].inicio, l->itens[i].quantidade);
+    memmove(l->itens, l->itens + l->confirmadas, (l->tamanho - l->confirmadas) * sizeof(*l->itens));
+    l->tamanho -= l->confirmadas;
+    l->confirmadas = 0;
+}
+
+// 1 se o bloco tem liberação pendente (para a varredura dos bitmaps, sem o índice).
+static int liberacao_pendente(uint32_t bloco) {
+    const struct liberacoes_pendentes *l = &motor_atual->liberacoes;
+    for (size_t i = 0; i < l->tamanho; ++i) {
+        if (bloco - l->itens[i].inicio < l->itens[i].quantidade) return 1;
+    }
+    return 0;
+}
+
+// Sem espaço no índice: torna duráveis as liberações já confirmadas (commit de grupo ou
+// fdatasync) para que voltem a ele. Retorna 1 se algum bloco voltou ao índice.
+static int liberacoes_antecipar(int fd) {
+    if (motor_atual->liberacoes.confirmadas == 0) return 0;
+    if (durabilidade_sincronizar(fd) != 0) return 0;
+    liberacoes_concluir();
+    return 1;
+}
+
+static void liberar_subarvore_offset(struct extensao_livre *no) {
+    if (!no) return;
+    liberar_subarvore_offset(no->esq[ARVORE_OFFSET]);
+    liberar_subarvore_offset(no->dir[ARVORE_OFFSET]);
+    free(no);
+}
+
+// Libera toda a memória do índice.
+void liberar_indice_livre(void) {
+    liberar_subarvore_offset(motor_atual->indice_livre.raiz[ARVORE_OFFSET]);
+    memset(&motor_atual->indice_livre, 0, sizeof(motor_atual->indice_livre));
+}
+
+// Constrói o índice lendo o bitmap de blocos de cada grupo.
+// Retorna 0 em sucesso, -1 em erro (o índice fica desativado e os alocadores
+// voltam a varrer os bitmaps).
+int construir_indice_livre(int fd, const struct ext2_super_block *sb, const struct ext2_group_desc *bgdt) {
+    unsigned int num_block_groups = numero_de_grupos(sb);
+    unsigned char block_bitmap_buffer[BLOCK_SIZE_MAX];
+
+    liberar_indice_livre();
+    motor_atual->indice_livre.construido = 1; // Necessário para que as inserções abaixo tenham efeito
+
+    for (unsigned int group_idx = 0; group_idx < num_block_groups; ++group_idx) {
+        if (ler_bloco(fd, descritor_grupo(bgdt, group_idx)->bg_block_bitmap, (char*)block_bitmap_buffer, BLOCO_BITMAP) != 0) {
+            fprintf(erros_comando(), "construir_indice_livre: Erro ao ler bitmap de blocos do grupo %u\n", group_idx);
+            liberar_indice_livre();
+            return -1;
+        }
+
+        // O último grupo pode ter menos blocos que s_blocks_per_group.
+        uint32_t primeiro_bloco_grupo = group_idx * sb->s_blocks_per_group + sb->s_first_data_block;
+        uint32_t blocos_no_grupo = sb->s_blocks_count - primeiro_bloco_grupo;
+        if (blocos_no_grupo > sb->s_blocks_per_group) blocos_no_grupo = sb->s_blocks_per_group;
+        if (blocos_no_grupo > BLOCK_SIZE * 8) blocos_no_grupo = BLOCK_SIZE * 8;
+
+        // Cada sequência de bits 0 (do próximo livre ao próximo ocupado) vira uma extensão.
+        uint32_t bit = bitmap_proximo(block_bitmap_buffer, 0, blocos_no_grupo, 0);
+        while (bit < blocos_no_grupo) {
+            uint32_t fim_run = bitmap_proximo(block_bitmap_buffer, bit, blocos_no_grupo, 1);
+            if (indice_livre_nova_extensao(primeiro_bloco_grupo + bit, fim_run - bit) != 0) {
+                liberar_indice_livre();
+                return -1;
+            }
+            bit = bitmap_proximo(block_bitmap_buffer, fim_run, blocos_no_grupo, 0);
+        }
+    }
+    // Os blocos com liberação pendente estão livres no bitmap, mas não podem ser alocados.
+    for (size_t i = 0; i < motor_atual->liberacoes.tamanho; ++i) {
+        indice_livre_remover_intervalo(motor_atual->liberacoes.itens[i].inicio, motor_atual->liberacoes.itens[i].quantidade);
+    }
+    return 0;
+}
+
+// Função para alocar um inode livre.
+// Percorre o resumo de inodes livres dos grupos (ver grupo_com_livres) e procura um inode
+// livre no bitmap de inodes do primeiro grupo que tiver algum.
+// Atualiza o superbloco, descritor de grupo e o bitmap de inodes no disco.
+// Retorna o número do inode alocado em sucesso, 0 em falha (sem inodes livres).
+uint32_t allocate_inode(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt) {
+    unsigned int num_block_groups = numero_de_grupos(sb);
+    unsigned char inode_bitmap_buffer[BLOCK_SIZE_MAX];
+
+    for (unsigned int group_idx = grupo_com_livres(motor_atual->descritores.inodes_livres, 0, num_block_groups);
+         group_idx < num_block_groups;
+         group_idx = grupo_com_livres(motor_atual->descritores.inodes_livres, group_idx + 1, num_block_groups)) {
+        struct ext2_group_desc *desc = descritor_grupo(bgdt, group_idx); // Carrega o pedaço da BGDT, se preciso
+        if (desc->bg_free_inodes_count > 0) { // Se o grupo tem inodes livres
+            // Lê o bitmap de inodes do grupo
+            if (ler_bloco(fd, desc->bg_inode_bitmap, (char*)inode_bitmap_buffer, BLOCO_BITMAP) != 0) {
+                fprintf(erros_comando(), "allocate_inode: Erro ao ler bitmap de inodes do grupo %u (bloco %u)\n", 
+                        group_idx, desc->bg_inode_bitmap);
+                continue; 
+            }
+
+            // Encontra o primeiro bit 0 (inode livre) no bitmap
+            for (unsigned int bit_in_group = bitmap_proximo(inode_bitmap_buffer, 0, sb->s_inodes_per_group, 0);
+                 bit_in_group < sb->s_inodes_per_group; ++bit_in_group) {
+                if (!is_bit_set(inode_bitmap_buffer, bit_in_group)) { // Se o bit está limpo (inode livre)
+                    set_bit(inode_bitmap_buffer, bit_in_group); // Seta o bit (marca como usado)
+
+                    // Escreve o bitmap de inodes atualizado de volta para o disco
+                    if (write_data_block(fd, desc->bg_inode_bitmap, (char*)inode_bitmap_buffer) != 0) {
+                        fprintf(erros_comando(), "allocate_inode: Erro ao escrever bitmap de inodes atualizado para grupo %u\n", group_idx);
+                        return 0; 
+                    }
+
+                    // Atualiza as contagens de inodes livres no superbloco e no descritor de grupo
+                    sb->s_free_inodes_count--;
+                    desc->bg_free_inodes_count--;
+
+                    // Escreve o superbloco e o descritor de grupo atualizados
+                    if (write_superblock(fd, sb) != 0) {
+                        fprintf(erros_comando(), "allocate_inode: Erro ao escrever superbloco após alocação\n");
+                        return 0;
+                    }
+                    if (write_group_descriptor(fd, sb, group_idx, desc) != 0) {
+                        fprintf(erros_comando(), "allocate_inode: Erro ao escrever descritor de grupo %u após alocação\n", group_idx);
+                        return 0;
+                    }
+
+                    // Calcula o número global do inode (inodes são 1-indexados)
+                    uint32_t allocated_inode_num = (group_idx * sb->s_inodes_per_group) + bit_in_group + 1;
+                    ESTAT(estat_alocacao(&estatisticas.alocador_inodes, bit_in_group + 1));
+                    return allocated_inode_num;
+                }
+            }
+            fprintf(erros_comando(), "Alerta allocate_inode: Grupo %u indicou inodes livres (%u), mas bitmap estava cheio ou erro.\n", 
+                    group_idx, desc->bg_free_inodes_count);
+            desc->bg_free_inodes_count = 0; 
+            descritores_resumir(group_idx, desc);
+        }
+    }
+
+    fprintf(erros_comando(), "allocate_inode: Não há inodes livres em nenhum grupo de blocos.\n");
+    return 0; // Nenhum inode livre encontrado
+}
+
+// ---------------------------------------------------------------------------
+// Inserção e remoção de entradas de diretório, compartilhadas pelos comandos.
+// Um diretório pode ter vários blocos (até i_size). Para não reler o diretório inteiro
+// a cada inserção, cada diretório alterado na sessão tem em memória um mapa com o maior
+// buraco de cada bloco (o maior espaço onde cabe uma entrada nova: uma entrada livre
+// inteira ou a folga após o tamanho real de uma entrada) e o bloco com o maior buraco de
+// todos. A inserção consulta o mapa e lê só o bloco escolhido; se nenhum bloco tiver
+// espaço, o diretório ganha um bloco novo. Os mapas são atualizados por quem altera os
+// blocos (dir_adicionar_entrada, dir_remover_nome, compact) e descartados quando o inode
+// do diretório é liberado. Ficam em uma tabela de acesso direto pelo número do inode: um
+// diretório que colide com outro toma o lugar dele (e o outro é remontado se voltar a ser usado).
+// ---------------------------------------------------------------------------
+
+// Definidas mais abaixo, com o bmap e o alocador.
+int bmap_definir(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt,
+                 struct ext2_inode *inode, uint32_t logico, uint32_t fisico);
+static uint32_t alocar_bloco_proximo(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt, uint32_t objetivo);
+void deallocate_data_block(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt, uint32_t block_num);
+void deallocate_inode(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt, uint32_t inode_num);
+
+// Tamanho real de uma entrada com um nome de 'tamanho_nome' bytes (alinhado a 4 bytes).
+static inline uint16_t dir_tamanho_entrada(uint32_t tamanho_nome) {
+    return (uint16_t)((offsetof(struct ext2_dir_entry_2, name) + tamanho_nome + 3) & ~3u);
+}
+
+// Espaço de 'entrada' que pode receber uma entrada nova.
+static inline uint16_t dir_buraco_entrada(const struct ext2_dir_entry_2 *entrada) {
+    if (entrada->inode == 0) return entrada->rec_len;
+    uint16_t real = dir_tamanho_entrada(entrada->name_len);
+    return entrada->rec_len > real ? entrada->rec_len - real : 0;
+}
+
+// Maior buraco de um bloco de diretório (0 se o bloco estiver corrompido).
+static uint16_t dir_maior_buraco(const char *bloco) {
+    uint16_t maior = 0;
+    uint32_t offset = 0;
+    while (offset + offsetof(struct ext2_dir_entry_2, name) <= BLOCK_SIZE) {
+        const struct ext2_dir_entry_2 *entrada = (const struct ext2_dir_entry_2 *)(bloco + offset);
+        if (entrada->rec_len == 0 || offset + entrada->rec_len > BLOCK_SIZE) return 0;
+        uint16_t buraco = dir_buraco_entrada(entrada);
+        if (buraco > maior) maior = buraco;
+        offset += entrada->rec_len;
+    }
+    return maior;
+}
+
+// Descarta o mapa do diretório 'inode_num', se houver (o inode foi liberado).
+static void mapa_diretorio_descartar(uint32_t inode_num) {
+    struct mapa_diretorio *m = &motor_atual->mapas_diretorios[inode_num & (MAPAS_DIRETORIOS - 1)];
+    if (m->inode != inode_num) return;
+    free(m->maior_buraco);
+    memset(m, 0, sizeof(*m));
+}
+
+// Libera todos os mapas.
+void liberar_mapas_diretorios(void) {
+    for (uint32_t i = 0; i < MAPAS_DIRETORIOS; ++i) {
+        free(motor_atual->mapas_diretorios[i].maior_buraco);
+        memset(&motor_atual->mapas_diretorios[i], 0, sizeof(motor_atual->mapas_diretorios[i]));
+    }
+}
+
+// Registra o maior buraco do bloco lógico 'logico' e mantém 'melhor' apontando para o
+// bloco com o maior buraco (só percorre o vetor quando o melhor bloco encolhe).
+static void mapa_diretorio_atualizar(struct mapa_diretorio *m, uint32_t logico, uint16_t buraco) {
+    m->maior_buraco[logico] = buraco;
+    if (buraco >= m->maior_buraco[m->melhor]) {
+        m->melhor = logico;
+    } else if (logico == m->melhor) {
+        for (uint32_t i = 0; i < m->num_blocos; ++i) {
+            if (m->maior_buraco[i] > m->maior_buraco[m->melhor]) m->melhor = i;
+        }
+    }
+}
+
+// Acrescenta um bloco lógico ao mapa. Retorna 0 em sucesso, -1 em erro.
+static int mapa_diretorio_crescer(struct mapa_diretorio *m, uint16_t buraco) {
+    if (m->num_blocos == m->capacidade) {
+        uint32_t nova_cap = m->capacidade ? m->capacidade * 2 : 4;
+        uint16_t *novo = (uint16_t *)realloc(m->maior_buraco, nova_cap * sizeof(uint16_t));
+        if (!novo) {
+            perror("mapa_diretorio: Erro ao alocar mapa");
+            return -1;
+        }
+        m->maior_buraco = novo;
+        m->capacidade = nova_cap;
+    }
+    m->maior_buraco[m->num_blocos++] = 0;
+    mapa_diretorio_atualizar(m, m->num_blocos - 1, buraco);
+    return 0;
+}
+
+// Retorna o mapa do diretório 'dir_inode_num', montando-o (uma leitura por bloco) se não
+// estiver em memória ou estiver desatualizado. Retorna NULL em erro.
+static struct mapa_diretorio *mapa_diretorio_obter(int fd, uint32_t dir_inode_num, const struct ext2_inode *dir_inode) {
+    struct mapa_diretorio *m = &motor_atual->mapas_diretorios[dir_inode_num & (MAPAS_DIRETORIOS - 1)];
+    uint32_t num_blocos = (dir_inode->i_size + BLOCK_SIZE - 1) >> motor_atual->geometria.log_bloco;
+    if (m->inode == dir_inode_num && m->num_blocos == num_blocos) return m;
+
+    free(m->maior_buraco);
+    memset(m, 0, sizeof(*m));
+    char bloco[BLOCK_SIZE_MAX];
+    for (uint32_t logico = 0; logico < num_blocos; ++logico) {
+        uint32_t fisico = bmap_ler(fd, dir_inode, logico);
+        uint16_t buraco = 0; // Buraco no diretório (inválido) ou bloco ilegível: nunca escolhido
+        if (fisico != 0 && ler_bloco(fd, fisico, bloco, BLOCO_DIRETORIO) == 0) buraco = dir_maior_buraco(bloco);
+        if (mapa_diretorio_crescer(m, buraco) != 0) {
+            free(m->maior_buraco); // Slot vazio: a próxima busca monta o mapa de novo
+            memset(m, 0, sizeof(*m));
+            return NULL;
+        }
+    }
+    m->inode = dir_inode_num;
+    return m;
+}
+
+// Adiciona a entrada 'nome' -> 'inode_num' (tipo 'tipo') ao diretório 'dir_inode_num'. O
+// bloco vem do mapa de buracos; sem espaço em nenhum bloco, o diretório ganha um bloco
+// novo perto do último. Atualiza os tempos (e i_size/i_blocks, se crescer) de 'dir_inode'
+// e o grava. Não verifica se o nome já existe. Retorna 0 em sucesso, -1 em erro.
+int dir_adicionar_entrada(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt,
+                          uint32_t dir_inode_num, struct ext2_inode *dir_inode,
+                          const char *nome, uint32_t inode_num, uint8_t tipo) {
+    size_t tamanho_nome = strlen(nome);
+    if (tamanho_nome == 0 || tamanho_nome > EXT2_NAME_LEN) return -1;
+    uint16_t necessario = dir_tamanho_entrada((uint32_t)tamanho_nome);
+
+    struct mapa_diretorio *m = mapa_diretorio_obter(fd, dir_inode_num, dir_inode);
+    if (m == NULL) return -1;
+
+    char bloco[BLOCK_SIZE_MAX];
+    while (m->num_blocos > 0 && m->maior_buraco[m->melhor] >= necessario) {
+        uint32_t logico = m->melhor;
+        uint32_t fisico = bmap_ler(fd, dir_inode, logico);
+        if (fisico == 0 || ler_bloco(fd, fisico, bloco, BLOCO_DIRETORIO) != 0) {
+            mapa_diretorio_atualizar(m, logico, 0);
+            continue;
+        }
+
+        // Primeira entrada do bloco com espaço: uma entrada livre é reaproveitada; uma
+        // entrada em uso é encurtada para o seu tamanho real e a nova ocupa a folga.
+        uint32_t offset = 0;
+        struct ext2_dir_entry_2 *nova = NULL;
+        while (offset + offsetof(struct ext2_dir_entry_2, name) <= BLOCK_SIZE) {
+            struct ext2_dir_entry_2 *entrada = (struct ext2_dir_entry_2 *)(bloco + offset);
+            if (entrada->rec_len == 0 || offset + entrada->rec_len > BLOCK_SIZE) break;
+            if (dir_buraco_entrada(entrada) >= necessario) {
+                if (entrada->inode == 0) {
+                    nova = entrada;
+                } else {
+                    uint16_t real = dir_tamanho_entrada(entrada->name_len);
+                    nova = (struct ext2_dir_entry_2 *)(bloco + offset + real);
+                    nova->rec_len = entrada->rec_len - real;
+                    entrada->rec_len = real;
+                }
+                break;
+            }
+            offset += entrada->rec_len;
+        }
+        if (nova == NULL) { // O mapa estava desatualizado para este bloco
+            mapa_diretorio_atualizar(m, logico, dir_maior_buraco(bloco));
+            continue;
+        }
+
+        nova->inode = inode_num;
+        nova->name_len = (uint8_t)tamanho_nome;
+        nova->file_type = tipo;
+        memcpy(nova->name, nome, tamanho_nome);
+        if (write_data_block(fd, fisico, bloco) != 0) return -1;
+        mapa_diretorio_atualizar(m, logico, dir_maior_buraco(bloco));
+
+        dir_inode->i_mtime = dir_inode->i_ctime = time(NULL);
+        return write_inode_table_entry(fd, sb, bgdt, dir_inode_num, dir_inode);
+    }
+
+    // Nenhum bloco com espaço: o diretório cresce um bloco, com a entrada nova ocupando-o todo.
+    uint32_t logico = m->num_blocos;
+    uint32_t objetivo = logico > 0 ? bmap_ler(fd, dir_inode, logico - 1) + 1
+                                   : grupo_do_inode(dir_inode_num, NULL) * sb->s_blocks_per_group + sb->s_first_data_block;
+    uint32_t fisico = alocar_bloco_proximo(fd, sb, bgdt, objetivo);
+    if (fisico == 0) {
+        fprintf(erros_comando(), "dir_adicionar_entrada: sem blocos livres para o diretório %u\n", dir_inode_num);
+        return -1;
+    }
+    memset(bloco, 0, BLOCK_SIZE);
+    struct ext2_dir_entry_2 *nova = (struct ext2_dir_entry_2 *)bloco;
+    nova->inode = inode_num;
+    nova->rec_len = (uint16_t)BLOCK_SIZE;
+    nova->name_len = (uint8_t)tamanho_nome;
+    nova->file_type = tipo;
+    memcpy(nova->name, nome, tamanho_nome);
+    if (write_data_block(fd, fisico, bloco) != 0 || bmap_definir(fd, sb, bgdt, dir_inode, logico, fisico) != 0) {
+        deallocate_data_block(fd, sb, bgdt, fisico);
+        return -1;
+    }
+    dir_inode->i_blocks += BLOCK_SIZE / 512;
+    dir_inode->i_size = (logico + 1) << motor_atual->geometria.log_bloco;
+    if (mapa_diretorio_crescer(m, dir_buraco_entrada(nova)) != 0) mapa_diretorio_descartar(dir_inode_num);
+
+    dir_inode->i_mtime = dir_inode->i_ctime = time(NULL);
+    return write_inode_table_entry(fd, sb, bgdt, dir_inode_num, dir_inode);
+}
+
+// Remove 'entrada' de um bloco de diretório como o kernel faz: o espaço é incorporado
+// ao rec_len da entrada anterior do mesmo bloco, sem deixar uma entrada morta para as
+// buscas pularem. Só a primeira entrada do bloco (sem anterior) vira inode 0.
+static void dir_remover_entrada(struct ext2_dir_entry_2 *entrada, struct ext2_dir_entry_2 *anterior) {
+    if (anterior != NULL) {
+        anterior->rec_len += entrada->rec_len;
+    } else {
+        entrada->inode = 0;
+    }
+}
+
+// Remove a entrada 'nome' do diretório 'dir_inode_num' (ver dir_remover_entrada), em
+// qualquer bloco, e grava o bloco e o inode do diretório (tempos atualizados).
+// '*inode_removido' (se não for NULL) recebe o inode da entrada.
+// Retorna 0 em sucesso, 1 se o nome não existir, -1 em erro.
+int dir_remover_nome(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt,
+                     uint32_t dir_inode_num, struct ext2_inode *dir_inode, const char *nome,
+                     uint32_t *inode_removido) {
+    size_t tamanho_nome = strlen(nome);
+    char bloco[BLOCK_SIZE_MAX];
+    uint32_t num_blocos = (dir_inode->i_size + BLOCK_SIZE - 1) >> motor_atual->geometria.log_bloco;
+
+    for (uint32_t logico = 0; logico < num_blocos; ++logico) {
+        uint32_t fisico = bmap_ler(fd, dir_inode, logico);
+        if (fisico == 0) continue;
+        if (ler_bloco(fd, fisico, bloco, BLOCO_DIRETORIO) != 0) return -1;
+
+        uint32_t offset = 0;
+        struct ext2_dir_entry_2 *anterior = NULL;
+        while (offset + offsetof(struct ext2_dir_entry_2, name) <= BLOCK_SIZE) {
+            struct ext2_dir_entry_2 *entrada = (struct ext2_dir_entry_2 *)(bloco + offset);
+            if (entrada->rec_len == 0 || offset + entrada->rec_len > BLOCK_SIZE) break;
+            if (entrada->inode != 0 && entrada->name_len == tamanho_nome &&
+                memcmp(entrada->name, nome, tamanho_nome) == 0) {
+                if (inode_removido) *inode_removido = entrada->inode;
+                dir_remover_entrada(entrada, anterior);
+                if (write_data_block(fd, fisico, bloco) != 0) return -1;
+
+                struct mapa_diretorio *m = &motor_atual->mapas_diretorios[dir_inode_num & (MAPAS_DIRETORIOS - 1)];
+                if (m->inode == dir_inode_num && logico < m->num_blocos) {
+                    mapa_diretorio_atualizar(m, logico, dir_maior_buraco(bloco));
+                }
+                dir_inode->i_mtime = dir_inode->i_ctime = time(NULL);
+                return write_inode_table_entry(fd, sb, bgdt, dir_inode_num, dir_inode) != 0 ? -1 : 0;
+            }
+            anterior = entrada;
+            offset += entrada->rec_len;
+        }
+    }
+    return 1;
+}
+
+// Implementa o comando 'touch', que cria um novo arquivo vazio ou atualiza o timestamp de um existente.
+int comando_touch(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt,
+                   uint32_t diretorio_atual_inode_num, char* diretorio_atual_str, 
+                   const char* path_alvo) {
+
+    if (path_alvo == NULL || strlen(path_alvo) == 0) {
+        fprintf(saida_comando(), "touch: Nome do arquivo não especificado.\n");
+        return 1;
+    }
+
+    char nome_arquivo[EXT2_NAME_LEN + 1];
+    char caminho_pai_str[1024]; 
+    uint32_t inode_pai_num;
+
+    // 1. Analisa o caminho para separar o nome do arquivo do caminho do diretório pai.
+    const char *ultimo_slash = strrchr(path_alvo, '/');
+    if (ultimo_slash != NULL) { 
+        size_t len_caminho_pai = ultimo_slash - path_alvo;
+        if (len_caminho_pai == 0) { strcpy(caminho_pai_str, "/"); } // Caso de caminho absoluto, ex: "/arquivo.txt"
+        else { strncpy(caminho_pai_str, path_alvo, len_caminho_pai); caminho_pai_str[len_caminho_pai] = '\0'; }
+        strncpy(nome_arquivo, ultimo_slash + 1, EXT2_NAME_LEN); // Nome do arquivo é o que vem depois da última barra
+        nome_arquivo[EXT2_NAME_LEN] = '\0';
+    } else { // Se não há barra, o pai é o diretório atual
+        strcpy(caminho_pai_str, "."); 
+        strncpy(nome_arquivo, path_alvo, EXT2_NAME_LEN);
+        nome_arquivo[EXT2_NAME_LEN] = '\0';
+    }
+    
+    if (strlen(nome_arquivo) == 0) {
+        fprintf(saida_comando(), "touch: Nome do arquivo inválido (vazio).\n");
+        return 1;
+    }
+    if (strchr(nome_arquivo, '/') != NULL) {
+        fprintf(saida_comando(), "touch: Nome do arquivo não pode conter '/'.\n");
+        return 1;
+    }
+
+    // 2. Obtém o inode do diretório pai.
+    uint8_t tipo_pai;
+    inode_pai_num = path_to_inode_number(fd, sb, bgdt, diretorio_atual_inode_num, caminho_pai_str, &tipo_pai);
+    if (inode_pai_num == 0) {
+        fprintf(saida_comando(), "touch: Diretório pai '%s' não encontrado.\n", caminho_pai_str);
+        return 1;
+    }
+    struct ext2_inode inode_pai_obj;
+    if (read_inode(fd, sb, bgdt, inode_pai_num, &inode_pai_obj) != 0 || !S_ISDIR(inode_pai_obj.i_mode)) {
+        fprintf(saida_comando(), "touch: Caminho pai '%s' não é um diretório.\n", caminho_pai_str);
+        return 1;
+    }
+
+    // 3. Verifica se o nome do arquivo já existe no diretório pai.
+    if (dir_lookup(fd, sb, bgdt, inode_pai_num, nome_arquivo, NULL) != 0) {
+        fprintf(saida_comando(), "touch: '%s' já existe.\n", path_alvo);
+        return 1;
+    }
+
+    // 4. Aloca um novo inode para o arquivo.
+    uint32_t novo_inode_arquivo_num = allocate_inode(fd, sb, bgdt);
+    if (novo_inode_arquivo_num == 0) {
+        fprintf(saida_comando(), "touch: Falha ao alocar novo inode. Disco cheio?\n");
+        return 1;
+    }
+
+    // 5. Inicializa e escreve o novo inode do arquivo.
+    struct ext2_inode novo_inode_arquivo_obj;
+    memset(&novo_inode_arquivo_obj, 0, sizeof(struct ext2_inode)); // Zera a estrutura do inode
+    novo_inode_arquivo_obj.i_mode = S_IFREG | 0644; // Define como arquivo regular e permissões rw-r--r--
+    novo_inode_arquivo_obj.i_uid = 0; // UID: root (simplificação)
+    novo_inode_arquivo_obj.i_gid = 0; // GID: root (simplificação)
+    novo_inode_arquivo_obj.i_size = 0; // Arquivo vazio
+    novo_inode_arquivo_obj.i_links_count = 1; // Um hard link (do diretório pai)
+    novo_inode_arquivo_obj.i_atime = novo_inode_arquivo_obj.i_mtime = novo_inode_arquivo_obj.i_ctime = time(NULL); // Define timestamps
+    novo_inode_arquivo_obj.i_dtime = 0;
+    novo_inode_arquivo_obj.i_blocks = 0; // Nenhum bloco de dados alocado
+
+    if (write_inode_table_entry(fd, sb, bgdt, novo_inode_arquivo_num, &novo_inode_arquivo_obj) != 0) { // Escreve o novo inode
+        fprintf(saida_comando(), "touch: Falha ao escrever o novo inode do arquivo no disco.\n");
+        return 1;
+    }
+
+    // 6. Adiciona a nova entrada no diretório pai (e grava o inode do pai com os tempos atualizados).
+    if (dir_adicionar_entrada(fd, sb, bgdt, inode_pai_num, &inode_pai_obj, nome_arquivo,
+                              novo_inode_arquivo_num, EXT2_FT_REG_FILE) != 0) {
+        fprintf(saida_comando(), "touch: Falha ao adicionar entrada no diretório pai '%s'.\n", caminho_pai_str);
+        deallocate_inode(fd, sb, bgdt, novo_inode_arquivo_num);
+        return 1;
+    }
+
+    fprintf(saida_comando(), "touch: Arquivo '%s' criado com sucesso (inode %u).\n", path_alvo, novo_inode_arquivo_num);
+    return 0;
+}
+
+// Marca 'quantidade' blocos a partir de 'inicio' como usados no bitmap de blocos do grupo,
+// atualiza as contagens de blocos livres, o superbloco, o descritor de grupo e o índice
+// de extensões livres. Todos os blocos devem pertencer ao mesmo grupo.
+// Retorna 0 em sucesso, -1 em erro de E/S e -2 se algum bloco já estava ocupado no bitmap
+// (o bloco é então retirado do índice e o chamador pode tentar novamente).
+static int marcar_blocos_alocados(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt,
+                                  uint32_t inicio, uint32_t quantidade) {
+    uint32_t bit_inicial;
+    uint32_t group_idx = grupo_do_bloco(inicio, &bit_inicial);
+    struct ext2_group_desc *desc = descritor_grupo(bgdt, group_idx);
+    unsigned char block_bitmap_buffer[BLOCK_SIZE_MAX];
+
+    if (ler_bloco(fd, desc->bg_block_bitmap, (char*)block_bitmap_buffer, BLOCO_BITMAP) != 0) {
+        fprintf(erros_comando(), "allocate_data_block: Erro ao ler bitmap de blocos do grupo %u (bloco %u)\n", 
+                group_idx, desc->bg_block_bitmap);
+        return -1;
+    }
+
+    for (uint32_t k = 0; k < quantidade; ++k) { // Confere o bitmap antes de alterar qualquer coisa
+        if (is_bit_set(block_bitmap_buffer, bit_inicial + k)) {
+            fprintf(erros_comando(), "Alerta allocate_data_block: Bloco %u livre no índice mas ocupado no bitmap.\n", inicio + k);
+            indice_livre_remover_intervalo(inicio + k, 1);
+            return -2;
+        }
+    }
+    for (uint32_t k = 0; k < quantidade; ++k) {
+        set_bit(block_bitmap_buffer, bit_inicial + k);
+    }
+
+    if (write_data_block(fd, desc->bg_block_bitmap, (char*)block_bitmap_buffer) != 0) {
+        fprintf(erros_comando(), "allocate_data_block: Erro ao escrever bitmap de blocos atualizado para grupo %u\n", group_idx);
+        return -1;
+    }
+
+    sb->s_free_blocks_count -= quantidade;
+    desc->bg_free_blocks_count -= quantidade;
+
+    if (write_superblock(fd, sb) != 0) {
+        fprintf(erros_comando(), "allocate_data_block: Erro ao escrever superbloco\n");
+        return -1;
+    }
+    if (write_group_descriptor(fd, sb, group_idx, desc) != 0) {
+        fprintf(erros_comando(), "allocate_data_block: Erro ao escrever descritor de grupo %u\n", group_idx);
+        return -1;
+    }
+    indice_livre_remover_intervalo(inicio, quantidade);
+    return 0;
+}
+
+// Função para alocar uma sequência contígua de blocos de dados perto de um bloco objetivo.
+// Usa o índice de extensões livres (construído sob demanda se ainda não existir).
+// Retorna o primeiro bloco da sequência alocada, ou 0 se não houver sequência desse tamanho.
+uint32_t allocate_data_blocks_near(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt,
+                                   uint32_t objetivo, uint32_t quantidade) {
+    if (quantidade == 0) return 0;
+    if (!motor_atual->indice_livre.construido && construir_indice_livre(fd, sb, bgdt) != 0) {
+        return 0;
+    }
+
+    uint32_t inicio;
+    while (indice_livre_procurar(objetivo, quantidade, &inicio)) {
+        int resultado = marcar_blocos_alocados(fd, sb, bgdt, inicio, quantidade);
+        if (resultado == 0) {
+            ESTAT(estat_alocacao(&estatisticas.alocador_blocos, 0));
+            return inicio;
+        }
+        if (resultado == -1) return 0;
+    }
+    if (motor_atual->indice_livre.blocos_livres < quantidade && liberacoes_antecipar(fd)) {
+        return allocate_data_blocks_near(fd, sb, bgdt, objetivo, quantidade);
+    }
+    ESTAT(estatisticas.alocador_blocos.passos_atual = 0); // Procura sem sucesso não conta como alocação
+    return 0;
+}
+
+// Função para alocar um bloco de dados livre.
+// Consulta o índice de extensões livres (construído sob demanda se ainda não existir)
+// para achar o primeiro bloco livre sem varrer os bitmaps; se o índice não estiver
+// disponível, percorre o resumo de blocos livres dos grupos (ver grupo_com_livres) e
+// procura um bloco livre no bitmap de blocos do primeiro grupo que tiver algum.
+// Atualiza o superbloco, descritor de grupo e o bitmap de blocos no disco.
+// Retorna o número do bloco alocado em sucesso, 0 em falha (sem blocos livres).
+uint32_t allocate_data_block(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt) {
+    if (motor_atual->indice_livre.construido || construir_indice_livre(fd, sb, bgdt) == 0) {
+        uint32_t bloco;
+        while (indice_livre_procurar(0, 1, &bloco)) {
+            int resultado = marcar_blocos_alocados(fd, sb, bgdt, bloco, 1);
+            if (resultado == 0) {
+                ESTAT(estat_alocacao(&estatisticas.alocador_blocos, 0));
+                return bloco;
+            }
+            if (resultado == -1) return 0;
+        }
+        if (liberacoes_antecipar(fd)) return allocate_data_block(fd, sb, bgdt);
+        ESTAT(estatisticas.alocador_blocos.passos_atual = 0);
+        fprintf(erros_comando(), "allocate_data_block: Não há blocos de dados livres em nenhum grupo.\n");
+        return 0;
+    }
+
+    unsigned int num_block_groups = numero_de_grupos(sb);
+    unsigned char block_bitmap_buffer[BLOCK_SIZE_MAX];
+
+    for (unsigned int group_idx = grupo_com_livres(motor_atual->descritores.blocos_livres, 0, num_block_groups);
+         group_idx < num_block_groups;
+         group_idx = grupo_com_livres(motor_atual->descritores.blocos_livres, group_idx + 1, num_block_groups)) {
+        struct ext2_group_desc *desc = descritor_grupo(bgdt, group_idx); // Carrega o pedaço da BGDT, se preciso
+        if (desc->bg_free_blocks_count > 0) { // Se o grupo tem blocos livres
+            // Lê o bitmap de blocos do grupo
+            if (ler_bloco(fd, desc->bg_block_bitmap, (char*)block_bitmap_buffer, BLOCO_BITMAP) != 0) {
+                fprintf(erros_comando(), "allocate_data_block: Erro ao ler bitmap de blocos do grupo %u (bloco %u)\n", 
+                        group_idx, desc->bg_block_bitmap);
+                continue; 
+            }
+
+            // Encontra o primeiro bit 0 (bloco livre) no bitmap
+            for (unsigned int bit_in_group = bitmap_proximo(block_bitmap_buffer, 0, sb->s_blocks_per_group, 0);
+                 bit_in_group < sb->s_blocks_per_group; ++bit_in_group) {
+                uint32_t bloco = (group_idx * sb->s_blocks_per_group) + sb->s_first_data_block + bit_in_group;
+                if (!is_bit_set(block_bitmap_buffer, bit_in_group) && !liberacao_pendente(bloco)) { // Bloco livre
+                    set_bit(block_bitmap_buffer, bit_in_group); // Seta o bit (marca como usado)
+
+                    // Escreve o bitmap de blocos atualizado de volta para o disco
+                    if (write_data_block(fd, desc->bg_block_bitmap, (char*)block_bitmap_buffer) != 0) {
+                        fprintf(erros_comando(), "allocate_data_block: Erro ao escrever bitmap de blocos atualizado para grupo %u\n", group_idx);
+                        return 0; 
+                    }
+
+                    // Atualiza as contagens de blocos livres no superbloco e no descritor de grupo
+                    sb->s_free_blocks_count--;
+                    desc->bg_free_blocks_count--;
+
+                    // Escreve o superbloco e o descritor de grupo atualizados
+                    if (write_superblock(fd, sb) != 0) {
+                        fprintf(erros_comando(), "allocate_data_block: Erro ao escrever superbloco\n");
+                        return 0;
+                    }
+                    if (write_group_descriptor(fd, sb, group_idx, desc) != 0) {
+                        fprintf(erros_comando(), "allocate_data_block: Erro ao escrever descritor de grupo %u\n", group_idx);
+                        return 0;
+                    }
+
+                    ESTAT(estat_alocacao(&estatisticas.alocador_blocos, bit_in_group + 1));
+                    return bloco;
+                }
+            }
+            fprintf(erros_comando(), "Alerta allocate_data_block: Grupo %u indicou blocos livres (%u), mas bitmap estava cheio.\n", 
+                    group_idx, desc->bg_free_blocks_count);
+            desc->bg_free_blocks_count = 0; 
+            descritores_resumir(group_idx, desc);
+        }
+    }
+
+    fprintf(erros_comando(), "allocate_data_block: Não há blocos de dados livres em nenhum grupo.\n");
+    return 0; 
+}
+
+// Implementa o comando 'mkdir', que cria um novo diretório.
+int comando_mkdir(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt,
+                   uint32_t diretorio_atual_inode_num, char* diretorio_atual_str, 
+                   const char* path_alvo) {
+
+    if (path_alvo == NULL || strlen(path_alvo) == 0) {
+        fprintf(saida_comando(), "mkdir: Nome do diretório não especificado.\n");
+        return 1;
+    }
+
+    char nome_novo_dir[EXT2_NAME_LEN + 1];
+    char caminho_pai_str[1024];
+    uint32_t inode_pai_num;
+
+    // 1. Analisa o caminho alvo (similar ao 'touch').
+    const char *ultimo_slash = strrchr(path_alvo, '/');
+    if (ultimo_slash != NULL) {
+        size_t len_caminho_pai = ultimo_slash - path_alvo;
+        if (len_caminho_pai == 0) { strcpy(caminho_pai_str, "/"); }
+        else { strncpy(caminho_pai_str, path_alvo, len_caminho_pai); caminho_pai_str[len_caminho_pai] = '\0'; }
+        strncpy(nome_novo_dir, ultimo_slash + 1, EXT2_NAME_LEN); nome_novo_dir[EXT2_NAME_LEN] = '\0';
+    } else {
+        strcpy(caminho_pai_str, ".");
+        strncpy(nome_novo_dir, path_alvo, EXT2_NAME_LEN); nome_novo_dir[EXT2_NAME_LEN] = '\0';
+    }
+    // Validações do nome do novo diretório
+    if (strlen(nome_novo_dir) == 0 || strcmp(nome_novo_dir, ".") == 0 || strcmp(nome_novo_dir, "..") == 0) {
+        fprintf(saida_comando(), "mkdir: Nome de diretório inválido: '%s'\n", nome_novo_dir);
+        return 1;
+    }
+    if (strchr(nome_novo_dir, '/') != NULL) {
+        fprintf(saida_comando(), "mkdir: Nome do diretório não pode conter '/'.\n");
+        return 1;
+    }
+
+    // 2. Obtém o inode do diretório pai.
+    uint8_t tipo_pai;
+    inode_pai_num = path_to_inode_number(fd, sb, bgdt, diretorio_atual_inode_num, caminho_pai_str, &tipo_pai);
+    if (inode_pai_num == 0) {
+        fprintf(saida_comando(), "mkdir: Diretório pai '%s' não encontrado.\n", caminho_pai_str);
+        return 1;
+    }
+    struct ext2_inode inode_pai_obj;
+    if (read_inode(fd, sb, bgdt, inode_pai_num, &inode_pai_obj) != 0 || !S_ISDIR(inode_pai_obj.i_mode)) {
+        fprintf(saida_comando(), "mkdir: Caminho pai '%s' não é um diretório.\n", caminho_pai_str);
+        return 1;
+    }
+
+    // 3. Verifica se o nome já existe no diretório pai.
+    if (dir_lookup(fd, sb, bgdt, inode_pai_num, nome_novo_dir, NULL) != 0) {
+        fprintf(saida_comando(), "mkdir: '%s' já existe.\n", path_alvo);
+        return 1;
+    }
+
+    // 4. Aloca um novo inode para o diretório.
+    uint32_t novo_dir_inode_num = allocate_inode(fd, sb, bgdt);
+    if (novo_dir_inode_num == 0) {
+        fprintf(saida_comando(), "mkdir: Falha ao alocar inode para novo diretório. Disco cheio?\n");
+        return 1;
+    }
+
+    // 5. Aloca um bloco de dados para o novo diretório (para armazenar . e ..).
+    uint32_t novo_dir_data_block_num = allocate_data_block(fd, sb, bgdt);
+    if (novo_dir_data_block_num == 0) {
+        fprintf(saida_comando(), "mkdir: Falha ao alocar bloco de dados para novo diretório. Disco cheio?\n");
+        return 1;
+    }
+
+    // 6. Inicializa o inode do novo diretório.
+    struct ext2_inode novo_dir_inode_obj;
+    memset(&novo_dir_inode_obj, 0, sizeof(struct ext2_inode)); // Zera a estrutura
+    novo_dir_inode_obj.i_mode = S_IFDIR | 0755; // Define como diretório e permissões rwxr-xr-x
+    novo_dir_inode_obj.i_uid = 0; 
+    novo_dir_inode_obj.i_gid = 0; 
+    novo_dir_inode_obj.i_size = BLOCK_SIZE; // Tamanho de um bloco para . e ..
+    novo_dir_inode_obj.i_links_count = 2; // Para '.' e para a entrada no diretório pai
+    novo_dir_inode_obj.i_atime = novo_dir_inode_obj.i_mtime = novo_dir_inode_obj.i_ctime = time(NULL);
+    novo_dir_inode_obj.i_blocks = BLOCK_SIZE / 512; // Número de blocos de 512 bytes
+    novo_dir_inode_obj.i_block[0] = novo_dir_data_block_num; // Aponta para o primeiro bloco de dados
+
+    // 7. Escreve o inode do novo diretório no disco.
+    if (write_inode_table_entry(fd, sb, bgdt, novo_dir_inode_num, &novo_dir_inode_obj) != 0) {
+        fprintf(saida_comando(), "mkdir: Falha ao escrever inode do novo diretório.\n");
+        return 1;
+    }
+
+    // 8. Prepara e escreve o bloco de dados do novo diretório (com entradas '.' e '..').
+    char novo_dir_data_block_buffer[BLOCK_SIZE_MAX];
+    memset(novo_dir_data_block_buffer, 0, BLOCK_SIZE);
+    
+    // Configura a entrada "." (aponta para o próprio diretório)
+    struct ext2_dir_entry_2 *dot_entry = (struct ext2_dir_entry_2 *)novo_dir_data_block_buffer;
+    dot_entry->inode = novo_dir_inode_num;
+    dot_entry->name_len = 1;
+    dot_entry->file_type = EXT2_FT_DIR;
+    strcpy(dot_entry->name, ".");
+    dot_entry->rec_len = (offsetof(struct ext2_dir_entry_2, name) + dot_entry->name_len + 3) & ~3; // Calcula rec_len alinhado
+    if (dot_entry->rec_len < 12) dot_entry->rec_len = 12; 
+
+    // Configura a entrada ".." (aponta para o diretório pai)
+    struct ext2_dir_entry_2 *dotdot_entry = (struct ext2_dir_entry_2 *)(novo_dir_data_block_buffer + dot_entry->rec_len);
+    dotdot_entry->inode = inode_pai_num;
+    dotdot_entry->name_len = 2;
+    dotdot_entry->file_type = EXT2_FT_DIR;
+    strcpy(dotdot_entry->name, "..");
+    dotdot_entry->rec_len = BLOCK_SIZE - dot_entry->rec_len; // Ocupa o restante do bloco
+
+    if (write_data_block(fd, novo_dir_data_block_num, novo_dir_data_block_buffer) != 0) { // Escreve o bloco de dados
+        fprintf(saida_comando(), "mkdir: Falha ao escrever bloco de dados do novo diretório.\n");
+        return 1;
+    }
+
+    // 9. Adiciona a entrada para o novo diretório no diretório pai. O link count do pai
+    // sobe por causa do '..' do novo diretório e é gravado junto com a entrada.
+    inode_pai_obj.i_links_count++;
+    if (dir_adicionar_entrada(fd, sb, bgdt, inode_pai_num, &inode_pai_obj, nome_novo_dir,
+                              novo_dir_inode_num, EXT2_FT_DIR) != 0) {
+        fprintf(saida_comando(), "mkdir: Falha ao adicionar entrada no diretório pai '%s'.\n", caminho_pai_str);
+        deallocate_data_block(fd, sb, bgdt, novo_dir_data_block_num);
+        deallocate_inode(fd, sb, bgdt, novo_dir_inode_num);
+        return 1;
+    }
+
+    // 10. Atualiza o contador de diretórios usados no descritor de grupo do NOVO diretório.
+    uint32_t grupo_idx_novo_dir = grupo_do_inode(novo_dir_inode_num, NULL);
+    descritor_grupo(bgdt, grupo_idx_novo_dir)->bg_used_dirs_count++;
+    if (write_group_descriptor(fd, sb, grupo_idx_novo_dir, &bgdt[grupo_idx_novo_dir]) != 0) {
+        fprintf(saida_comando(), "mkdir: Falha ao atualizar contador de diretórios no descritor de grupo %u.\n", grupo_idx_novo_dir);
+    }
+
+    fprintf(saida_comando(), "mkdir: Diretório '%s' criado com sucesso (inode %u, data block %u).\n", 
+           path_alvo, novo_dir_inode_num, novo_dir_data_block_num);
+    return 0;
+}
+
+// Função para desalocar um inode.
+// Limpa o bit correspondente no bitmap de inodes e atualiza as contagens de inodes livres.
+void deallocate_inode(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt, uint32_t inode_num) {
+    if (inode_num == 0 || inode_num == EXT2_ROOT_INO) { // Não permite desalocar inode 0 ou o inode raiz
+        fprintf(erros_comando(), "deallocate_inode: Tentativa de desalocar inode inválido ou raiz (%u).\n", inode_num);
+        return;
+    }
+    // Calcula o grupo de blocos e o bit dentro do bitmap correspondente ao inode.
+    uint32_t bit_in_group;
+    uint32_t group_idx = grupo_do_inode(inode_num, &bit_in_group);
+    unsigned char inode_bitmap_buffer[BLOCK_SIZE_MAX];
+
+    // Valida o índice do grupo.
+    if (group_idx >= numero_de_grupos(sb)) {
+        fprintf(erros_comando(), "deallocate_inode: Índice de grupo inválido %u para inode %u.\n", group_idx, inode_num);
+        return;
+    }
+
+    // Lê o bitmap de inodes do grupo.
+    if (ler_bloco(fd, descritor_grupo(bgdt, group_idx)->bg_inode_bitmap, (char*)inode_bitmap_buffer, BLOCO_BITMAP) != 0) {
+        fprintf(erros_comando(), "deallocate_inode: Erro ao ler bitmap de inodes do grupo %u.\n", group_idx);
+        return; 
+    }
+
+    if (!is_bit_set(inode_bitmap_buffer, bit_in_group)) { // Verifica se o bit já está limpo
+        fprintf(erros_comando(), "deallocate_inode: Inode %u (bit %u no grupo %u) já está livre.\n", inode_num, bit_in_group, group_idx);
+    } else {
+        clear_bit(inode_bitmap_buffer, bit_in_group); // Limpa o bit (marca como livre)
+        mapa_diretorio_descartar(inode_num); // O número pode voltar como outro diretório
+        if (write_data_block(fd, descritor_grupo(bgdt, group_idx)->bg_inode_bitmap, (char*)inode_bitmap_buffer) != 0) { // Escreve o bitmap atualizado
+            fprintf(erros_comando(), "deallocate_inode: Erro ao escrever bitmap de inodes atualizado para grupo %u.\n", group_idx);
+            return; 
+        }
+        sb->s_free_inodes_count++; // Incrementa a contagem de inodes livres no superbloco
+        descritor_grupo(bgdt, group_idx)->bg_free_inodes_count++; // Incrementa a contagem de inodes livres no grupo
+        
+        if (write_superblock(fd, sb) != 0) { // Escreve o superbloco atualizado
+            fprintf(erros_comando(), "deallocate_inode: Erro ao escrever superbloco.\n");
+        }
+        if (write_group_descriptor(fd, sb, group_idx, &bgdt[group_idx]) != 0) { // Escreve o descritor de grupo atualizado
+            fprintf(erros_comando(), "deallocate_inode: Erro ao escrever descritor de grupo %u.\n", group_idx);
+        }
+    }
+}
+
+// Função para desalocar um bloco de dados.
+// Limpa o bit correspondente no bitmap de blocos e atualiza as contagens de blocos livres.
+void deallocate_data_block(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt, uint32_t block_num) {
+    if (block_num == 0) { // Bloco 0 não é gerenciado por bitmaps de dados (pode ser boot block)
+        fprintf(erros_comando(), "deallocate_data_block: Tentativa de desalocar bloco de dados 0.\n");
+        return;
+    }
+    // Calcula o grupo de blocos e o bit dentro do bitmap correspondente ao bloco.
+    uint32_t bit_in_group;
+    uint32_t group_idx = grupo_do_bloco(block_num, &bit_in_group);
+    unsigned char block_bitmap_buffer[BLOCK_SIZE_MAX];
+
+    // Valida o índice do grupo.
+    if (group_idx >= numero_de_grupos(sb)) {
+        fprintf(erros_comando(), "deallocate_data_block: Índice de grupo inválido %u para bloco %u.\n", group_idx, block_num);
+        return;
+    }
+    
+    // Lê o bitmap de blocos do grupo.
+    if (ler_bloco(fd, descritor_grupo(bgdt, group_idx)->bg_block_bitmap, (char*)block_bitmap_buffer, BLOCO_BITMAP) != 0) {
+        fprintf(erros_comando(), "deallocate_data_block: Erro ao ler bitmap de blocos do grupo %u.\n", group_idx);
+        return;
+    }
+
+    if (!is_bit_set(block_bitmap_buffer, bit_in_group)) { // Verifica se o bit já está limpo
+        fprintf(erros_comando(), "deallocate_data_block: Bloco %u (bit %u no grupo %u) já está livre.\n", block_num, bit_in_group, group_idx);
+    } else {
+        clear_bit(block_bitmap_buffer, bit_in_group); // Limpa o bit (marca como livre)
+        if (write_data_block(fd, descritor_grupo(bgdt, group_idx)->bg_block_bitmap, (char*)block_bitmap_buffer) != 0) { // Escreve o bitmap atualizado
+            fprintf(erros_comando(), "deallocate_data_block: Erro ao escrever bitmap de blocos atualizado para grupo %u.\n", group_idx);
+            return;
+        }
+        sb->s_free_blocks_count++; // Incrementa a contagem de blocos livres no superbloco
+        descritor_grupo(bgdt, group_idx)->bg_free_blocks_count++; // Incrementa a contagem de blocos livres no grupo
+        liberacao_registrar(block_num, 1); // Volta ao índice quando a liberação for durável
+
+        if (write_superblock(fd, sb) != 0) { // Escreve o superbloco atualizado
+            fprintf(erros_comando(), "deallocate_data_block: Erro ao escrever superbloco.\n");
+        }
+        if (write_group_descriptor(fd, sb, group_idx, &bgdt[group_idx]) != 0) { // Escreve o descritor de grupo atualizado
+            fprintf(erros_comando(), "deallocate_data_block: Erro ao escrever descritor de grupo %u.\n", group_idx);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Liberação em lote: os blocos (ou inodes) a liberar são ordenados e cada bitmap afetado é
+// lido, alterado e gravado uma única vez, com os contadores do grupo e o superbloco
+// atualizados uma vez, em vez de uma leitura e uma escrita do bitmap por bloco.
+// ---------------------------------------------------------------------------
+
+// Vetor de números de blocos ou inodes que cresce sob demanda.
+struct vetor_u32 {
+    uint32_t *itens;
+    size_t tamanho;
+    size_t capacidade;
+};
+
+static int vetor_u32_adicionar(struct vetor_u32 *v, uint32_t valor) {
+    if (v->tamanho == v->capacidade) {
+        size_t capacidade = v->capacidade ? v->capacidade * 2 : 256;
+        uint32_t *itens = (uint32_t *)realloc(v->itens, capacidade * sizeof(uint32_t));
+        if (!itens) {
+            perror("Erro ao alocar memória");
+            return -1;
+        }
+        v->itens = itens;
+        v->capacidade = capacidade;
+    }
+    v->itens[v->tamanho++] = valor;
+    return 0;
+}
+
+static int comparar_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Libera os 'quantidade' blocos de 'blocos' (o vetor é ordenado). Cada bitmap de blocos
+// afetado é gravado uma vez, as sequências liberadas são registradas em liberacao_registrar
+// (voltam ao índice quando a liberação for durável) e o superbloco é gravado uma vez ao final. Retorna 0 em sucesso, -1 em erro.
+int liberar_blocos_lote(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt,
+                        uint32_t *blocos, size_t quantidade) {
+    unsigned int num_grupos = numero_de_grupos(sb);
+    unsigned char bitmap[BLOCK_SIZE_MAX];
+    int resultado = 0;
+    qsort(blocos, quantidade, sizeof(uint32_t), comparar_u32);
+
+    size_t i = 0;
+    while (i < quantidade) {
+        if (blocos[i] == 0 || blocos[i] >= sb->s_blocks_count) {
+            fprintf(erros_comando(), "liberar_blocos_lote: Bloco inválido %u.\n", blocos[i]);
+            resultado = -1;
+            i++;
+            continue;
+        }
+        uint32_t grupo = grupo_do_bloco(blocos[i], NULL);
+        size_t fim = i;
+        while (fim < quantidade && blocos[fim] < sb->s_blocks_count && grupo_do_bloco(blocos[fim], NULL) == grupo) fim++;
+        if (grupo >= num_grupos ||
+            ler_bloco(fd, descritor_grupo(bgdt, grupo)->bg_block_bitmap, (char *)bitmap, BLOCO_BITMAP) != 0) {
+            fprintf(erros_comando(), "liberar_blocos_lote: Erro ao ler bitmap de blocos do grupo %u.\n", grupo);
+            resultado = -1;
+            i = fim;
+            continue;
+        }
+
+        // Limpa os bits do grupo e devolve cada sequência contígua ao índice.
+        uint32_t liberados = 0, inicio_sequencia = 0, tamanho_sequencia = 0;
+        for (; i < fim; ++i) {
+            uint32_t bit;
+            grupo_do_bloco(blocos[i], &bit);
+            if (!is_bit_set(bitmap, bit)) { // Já livre (ou repetido no vetor)
+                if (i == 0 || blocos[i] != blocos[i - 1]) {
+                    fprintf(erros_comando(), "liberar_blocos_lote: Bloco %u já está livre.\n", blocos[i]);
+                }
+                continue;
+            }
+            clear_bit(bitmap, bit);
+            liberados++;
+            if (tamanho_sequencia > 0 && blocos[i] == inicio_sequencia + tamanho_sequencia) {
+                tamanho_sequencia++;
+                continue;
+            }
+            liberacao_registrar(inicio_sequencia, tamanho_sequencia);
+            inicio_sequencia = blocos[i];
+            tamanho_sequencia = 1;
+        }
+        liberacao_registrar(inicio_sequencia, tamanho_sequencia);
+        if (liberados == 0) continue;
+
+        if (write_data_block(fd, descritor_grupo(bgdt, grupo)->bg_block_bitmap, (char *)bitmap) != 0) {
+            fprintf(erros_comando(), "liberar_blocos_lote: Erro ao escrever bitmap de blocos do grupo %u.\n", grupo);
+            resultado = -1;
+        }
+        sb->s_free_blocks_count += liberados;
+        descritor_grupo(bgdt, grupo)->bg_free_blocks_count += liberados;
+        if (write_group_descriptor(fd, sb, grupo, &bgdt[grupo]) != 0) resultado = -1;
+    }
+    if (quantidade > 0 && write_superblock(fd, sb) != 0) resultado = -1;
+    return resultado;
+}
+
+// Libera os 'quantidade' inodes de 'inodes' (o vetor é ordenado), com uma escrita por
+// bitmap de inodes afetado. A contagem de diretórios dos grupos (bg_used_dirs_count) é
+// responsabilidade de quem chama; os descritores dos grupos afetados são gravados aqui.
+// Retorna 0 em sucesso, -1 em erro.
+int liberar_inodes_lote(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt,
+                        uint32_t *inodes, size_t quantidade) {
+    unsigned int num_grupos = numero_de_grupos(sb);
+    unsigned char bitmap[BLOCK_SIZE_MAX];
+    int resultado = 0;
+    qsort(inodes, quantidade, sizeof(uint32_t), comparar_u32);
+
+    size_t i = 0;
+    while (i < quantidade) {
+        uint32_t grupo = grupo_do_inode(inodes[i], NULL);
+        size_t fim = i;
+        while (fim < quantidade && grupo_do_inode(inodes[fim], NULL) == grupo) fim++;
+        if (inodes[i] == 0 || grupo >= num_grupos ||
+            ler_bloco(fd, descritor_grupo(bgdt, grupo)->bg_inode_bitmap, (char *)bitmap, BLOCO_BITMAP) != 0) {
+            fprintf(erros_comando(), "liberar_inodes_lote: Erro ao ler bitmap de inodes do grupo %u.\n", grupo);
+            resultado = -1;
+            i = fim;
+            continue;
+        }
+        uint32_t liberados = 0;
+        for (; i < fim; ++i) {
+            uint32_t bit;
+            grupo_do_inode(inodes[i], &bit);
+            if (!is_bit_set(bitmap, bit)) {
+                fprintf(erros_comando(), "liberar_inodes_lote: Inode %u já está livre.\n", inodes[i]);
+                continue;
+            }
+            clear_bit(bitmap, bit);
+            mapa_diretorio_descartar(inodes[i]);
+            liberados++;
+        }
+        if (liberados > 0 &&
+            write_data_block(fd, descritor_grupo(bgdt, grupo)->bg_inode_bitmap, (char *)bitmap) != 0) {
+            fprintf(erros_comando(), "liberar_inodes_lote: Erro ao escrever bitmap de inodes do grupo %u.\n", grupo);
+            resultado = -1;
+        }
+        sb->s_free_inodes_count += liberados;
+        descritor_grupo(bgdt, grupo)->bg_free_inodes_count += liberados;
+        if (write_group_descriptor(fd, sb, grupo, &bgdt[grupo]) != 0) resultado = -1;
+    }
+    if (quantidade > 0 && write_superblock(fd, sb) != 0) resultado = -1;
+    return resultado;
+}
+
+// ---------------------------------------------------------------------------
+// Mapeamento de blocos de arquivos (bmap): tradução de blocos lógicos para blocos
+// físicos pelos ponteiros diretos e indiretos do inode, escrita de dados no fim do
+// arquivo e liberação de todos os blocos de um arquivo.
+// ---------------------------------------------------------------------------
+
+#define PONTEIROS_POR_BLOCO (BLOCK_SIZE / sizeof(uint32_t))
+#define EXT2_NDIR_BLOCKS 12 // Ponteiros diretos em i_block[]
+
+// Decompõe o bloco lógico no caminho de ponteiros: 'indices[0]' é a posição em i_block[]
+// e os seguintes são as posições dentro de cada bloco indireto.
+// Retorna a profundidade (0 = direto, 1 a 3 = nível de indireção) ou -1 se estiver fora do alcance.
+ESPECIALIZADA int bmap_caminho_especializado(uint32_t logico, uint32_t indices[4], const uint32_t tamanho_bloco) {
+    const uint32_t log_p = (uint32_t)__builtin_ctz(tamanho_bloco) - 2; // Ponteiros de 4 bytes
+    const uint64_t p = 1ull << log_p;
+    const uint64_t mascara = p - 1;
+    uint64_t resto = logico;
+    if (resto < EXT2_NDIR_BLOCKS) {
+        indices[0] = (uint32_t)resto;
+        return 0;
+    }
+    resto -= EXT2_NDIR_BLOCKS;
+    if (resto < p) {
+        indices[0] = 12;
+        indices[1] = (uint32_t)resto;
+        return 1;
+    }
+    resto -= p;
+    if (resto < p * p) {
+        indices[0] = 13;
+        indices[1] = (uint32_t)(resto >> log_p);
+        indices[2] = (uint32_t)(resto & mascara);
+        return 2;
+    }
+    resto -= p * p;
+    if (resto < p * p * p) {
+        indices[0] = 14;
+        indices[1] = (uint32_t)(resto >> (2 * log_p));
+        indices[2] = (uint32_t)((resto >> log_p) & mascara);
+        indices[3] = (uint32_t)(resto & mascara);
+        return 3;
+    }
+    return -1;
+}
+
+static int bmap_caminho(uint32_t logico, uint32_t indices[4]) {
+    return POR_TAMANHO_DE_BLOCO(bmap_caminho_especializado, logico, indices);
+}
+
+// Retorna o bloco físico do bloco lógico 'logico' do arquivo, ou 0 se não estiver
+// alocado (buraco) ou em caso de erro.
+uint32_t bmap_ler(int fd, const struct ext2_inode *inode, uint32_t logico) {
+    uint32_t indices[4];
+    int profundidade = bmap_caminho(logico, indices);
+    if (profundidade < 0) return 0;
+
+    uint32_t bloco = inode->i_block[indices[0]];
+    for (int nivel = 1; nivel <= profundidade && bloco != 0; ++nivel) {
+        uint32_t ponteiros[PONTEIROS_POR_BLOCO_MAX];
+        if (ler_bloco(fd, bloco, (char *)ponteiros, BLOCO_INDIRETO) != 0) return 0;
+        bloco = ponteiros[indices[nivel]];
+    }
+    return bloco;
+}
+
+// Aloca um bloco perto de 'objetivo' (qualquer bloco livre se não houver vizinho).
+static uint32_t alocar_bloco_proximo(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt, uint32_t objetivo) {
+    uint32_t bloco = allocate_data_blocks_near(fd, sb, bgdt, objetivo, 1);
+    return bloco ? bloco : allocate_data_block(fd, sb, bgdt);
+}
+
+// Associa o bloco lógico 'logico' do arquivo ao bloco físico 'fisico', alocando (perto de
+// 'fisico') e zerando os blocos indiretos que faltarem. Os blocos indiretos são somados em
+// i_blocks; o inode não é gravado (responsabilidade do chamador).
+// Retorna 0 em sucesso, -1 em erro.
+int bmap_definir(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt,
+                 struct ext2_inode *inode, uint32_t logico, uint32_t fisico) {
+    uint32_t indices[4];
+    int profundidade = bmap_caminho(logico, indices);
+    if (profundidade < 0) {
+        fprintf(erros_comando(), "bmap: bloco lógico %u fora do alcance dos ponteiros do inode\n", logico);
+        return -1;
+    }
+    if (profundidade == 0) {
+        inode->i_block[indices[0]] = fisico;
+        return 0;
+    }
+
+    uint32_t *ponteiro_pai = &inode->i_block[indices[0]]; // Ponteiro para o bloco do nível atual
+    uint32_t bloco_pai = 0;                               // Bloco indireto que contém 'ponteiro_pai' (0 = inode)
+    uint32_t ponteiros[PONTEIROS_POR_BLOCO_MAX];
+    uint32_t ponteiros_pai[PONTEIROS_POR_BLOCO_MAX];
+
+    for (int nivel = 1; nivel <= profundidade; ++nivel) {
+        uint32_t bloco = *ponteiro_pai;
+        if (bloco == 0) { // Bloco indireto ainda não existe
+            bloco = alocar_bloco_proximo(fd, sb, bgdt, fisico);
+            if (bloco == 0) return -1;
+            memset(ponteiros, 0, sizeof(ponteiros));
+            if (write_data_block(fd, bloco, (const char *)ponteiros) != 0) return -1;
+            inode->i_blocks += BLOCK_SIZE / 512;
+            *ponteiro_pai = bloco;
+            if (bloco_pai != 0 && write_data_block(fd, bloco_pai, (const char *)ponteiros_pai) != 0) return -1;
+        } else if (ler_bloco(fd, bloco, (char *)ponteiros, BLOCO_INDIRETO) != 0) {
+            return -1;
+        }
+
+        if (nivel == profundidade) {
+            ponteiros[indices[nivel]] = fisico;
+            return write_data_block(fd, bloco, (const char *)ponteiros);
+        }
+        memcpy(ponteiros_pai, ponteiros, sizeof(ponteiros));
+        bloco_pai = bloco;
+        ponteiro_pai = &ponteiros_pai[indices[nivel]];
+    }
+    return 0;
+}
+
+// Acrescenta 'tamanho' bytes de 'dados' ao fim do arquivo 'inode_num'. Os blocos novos são
+// alocados em sequências contíguas logo após o último bloco do arquivo (ou no início do
+// grupo do inode, para arquivos vazios). Atualiza e grava o inode, inclusive quando falta
+// espaço no meio (o tamanho reflete o que foi escrito).
+// Retorna 0 em sucesso, -1 em erro.
+int anexar_ao_arquivo(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt,
+                      uint32_t inode_num, struct ext2_inode *inode, const char *dados, uint32_t tamanho) {
+    char bloco[BLOCK_SIZE_MAX];
+    uint32_t escritos = 0;
+    int resultado = 0;
+
+    // 1. Completa o último bloco, se estiver parcialmente ocupado.
+    uint32_t deslocamento = inode->i_size % BLOCK_SIZE;
+    if (deslocamento != 0 && tamanho > 0) {
+        uint32_t fisico = bmap_ler(fd, inode, inode->i_size / BLOCK_SIZE);
+        uint32_t parte = BLOCK_SIZE - deslocamento;
+        if (parte > tamanho) parte = tamanho;
+        if (fisico == 0 || read_data_block(fd, fisico, bloco) != 0) return -1;
+        memcpy(bloco + deslocamento, dados, parte);
+        if (dev_pwrite_dados(fd, bloco, BLOCK_SIZE, offset_do_bloco(fisico)) != (ssize_t)BLOCK_SIZE) {
+            perror("anexar_ao_arquivo: erro ao gravar o último bloco");
+            return -1;
+        }
+        escritos = parte;
+    }
+
+    // 2. Blocos novos, alocados em sequências contíguas perto do fim do arquivo.
+    uint32_t logico = (inode->i_size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    uint32_t objetivo;
+    if (logico > 0) {
+        objetivo = bmap_ler(fd, inode, logico - 1) + 1;
+    } else {
+        objetivo = grupo_do_inode(inode_num, NULL) * sb->s_blocks_per_group + sb->s_first_data_block;
+    }
+
+    while (escritos < tamanho) {
+        uint32_t faltam = (tamanho - escritos + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        uint32_t pedido = faltam < sb->s_blocks_per_group ? faltam : sb->s_blocks_per_group;
+        uint32_t inicio = 0;
+        while (pedido > 1 && (inicio = allocate_data_blocks_near(fd, sb, bgdt, objetivo, pedido)) == 0) {
+            pedido /= 2; // Não há sequência desse tamanho: tenta uma menor
+        }
+        if (inicio == 0) {
+            pedido = 1;
+            inicio = alocar_bloco_proximo(fd, sb, bgdt, objetivo);
+        }
+        if (inicio == 0) {
+            fprintf(erros_comando(), "anexar_ao_arquivo: sem blocos livres\n");
+            resultado = -1;
+            break;
+        }
+
+        for (uint32_t i = 0; i < pedido; ++i) {
+            uint32_t parte = tamanho - escritos;
+            if (parte > BLOCK_SIZE) parte = BLOCK_SIZE;
+            memcpy(bloco, dados + escritos, parte);
+            if (parte < BLOCK_SIZE) memset(bloco + parte, 0, BLOCK_SIZE - parte);
+            if (dev_pwrite_dados(fd, bloco, BLOCK_SIZE, offset_do_bloco(inicio + i)) != (ssize_t)BLOCK_SIZE ||
+                bmap_definir(fd, sb, bgdt, inode, logico, inicio + i) != 0) {
+                for (uint32_t j = i; j < pedido; ++j) deallocate_data_block(fd, sb, bgdt, inicio + j);
+                resultado = -1;
+                break;
+            }
+            inode->i_blocks += BLOCK_SIZE / 512;
+            escritos += parte;
+            logico++;
+        }
+        if (resultado != 0) break;
+        objetivo = inicio + pedido;
+    }
+
+    inode->i_size += escritos;
+    inode->i_mtime = inode->i_ctime = time(NULL);
+    if (write_inode_table_entry(fd, sb, bgdt, inode_num, inode) != 0) return -1;
+    return resultado;
+}
+
+// Acrescenta a 'blocos' o bloco indireto 'bloco' de nível 'nivel' (1 = aponta para dados)
+// e todos os blocos que ele aponta. Retorna 0 em sucesso, -1 em erro de memória.
+static int coletar_bloco_indireto(int fd, uint32_t bloco, int nivel, struct vetor_u32 *blocos) {
+    uint32_t ponteiros[PONTEIROS_POR_BLOCO_MAX];
+    if (ler_bloco(fd, bloco, (char *)ponteiros, BLOCO_INDIRETO) == 0) {
+        for (uint32_t i = 0; i < PONTEIROS_POR_BLOCO; ++i) {
+            if (ponteiros[i] == 0) continue;
+            if (nivel > 1) {
+                if (coletar_bloco_indireto(fd, ponteiros[i], nivel - 1, blocos) != 0) return -1;
+            } else if (vetor_u32_adicionar(blocos, ponteiros[i]) != 0) {
+                return -1;
+            }
+        }
+    }
+    return vetor_u32_adicionar(blocos, bloco);
+}
+
+// Acrescenta a 'blocos' todos os blocos de dados e indiretos do inode (nada para links
+// simbólicos rápidos, que guardam o destino em i_block). Retorna 0 em sucesso, -1 em erro.
+int coletar_blocos_inode(int fd, const struct ext2_inode *inode, struct vetor_u32 *blocos) {
+    if (S_ISLNK(inode->i_mode) && inode->i_blocks == 0) return 0;
+    for (int i = 0; i < EXT2_N_BLOCKS; ++i) {
+        if (inode->i_block[i] == 0) continue;
+        int erro = i < EXT2_NDIR_BLOCKS ? vetor_u32_adicionar(blocos, inode->i_block[i])
+                                        : coletar_bloco_indireto(fd, inode->i_block[i], i - EXT2_NDIR_BLOCKS + 1, blocos);
+        if (erro != 0) return -1;
+    }
+    return 0;
+}
+
+// Libera todos os blocos de dados e indiretos do arquivo (em lote, ver liberar_blocos_lote)
+// e zera os ponteiros, i_blocks e i_size do inode (que não é gravado).
+void liberar_blocos_arquivo(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt, struct ext2_inode *inode) {
+    struct vetor_u32 blocos = { NULL, 0, 0 };
+    int coletado = coletar_blocos_inode(fd, inode, &blocos);
+    liberar_blocos_lote(fd, sb, bgdt, blocos.itens, blocos.tamanho);
+    if (coletado != 0) { // Sem memória para a lista: só o que foi coletado foi liberado
+        fprintf(erros_comando(), "liberar_blocos_arquivo: Nem todos os blocos do arquivo foram liberados.\n");
+    }
+    free(blocos.itens);
+    memset(inode->i_block, 0, sizeof(inode->i_block));
+    inode->i_blocks = 0;
+    inode->i_size = 0;
+}
+
+// Acrescenta a 'blocos' os blocos lógicos a partir de 'corte' da subárvore do bloco indireto
+// 'bloco' de nível 'nivel', que começa no bloco lógico 'base', e zera os ponteiros para eles
+// (gravando o bloco indireto se ele continuar em uso). Só os blocos indiretos que cobrem o
+// trecho cortado são lidos. Retorna 1 se o bloco indireto ficou vazio (e também entrou em
+// 'blocos'), 0 se ainda aponta para blocos antes do corte, -1 em erro.
+static int truncar_indireto(int fd, uint32_t bloco, int nivel, uint64_t base, uint64_t corte, struct vetor_u32 *blocos) {
+    uint64_t por_ponteiro = 1; // Blocos lógicos cobertos por cada ponteiro deste bloco
+    for (int i = 1; i < nivel; ++i) por_ponteiro *= PONTEIROS_POR_BLOCO;
+    uint32_t ponteiros[PONTEIROS_POR_BLOCO_MAX];
+    if (ler_bloco(fd, bloco, (char *)ponteiros, BLOCO_INDIRETO) != 0) return -1;
+
+    int alterado = 0, mantidos = 0;
+    for (uint32_t i = 0; i < PONTEIROS_POR_BLOCO; ++i) {
+        if (ponteiros[i] == 0) continue;
+        uint64_t inicio = base + i * por_ponteiro;
+        if (inicio + por_ponteiro <= corte) { // Inteiramente antes do corte
+            mantidos++;
+            continue;
+        }
+        int vazio = 1;
+        if (nivel > 1) {
+            vazio = truncar_indireto(fd, ponteiros[i], nivel - 1, inicio, corte, blocos);
+            if (vazio < 0) return -1;
+        } else if (vetor_u32_adicionar(blocos, ponteiros[i]) != 0) {
+            return -1;
+        }
+        if (vazio) {
+            ponteiros[i] = 0;
+            alterado = 1;
+        } else {
+            mantidos++;
+        }
+    }
+    if (mantidos == 0) return vetor_u32_adicionar(blocos, bloco) == 0 ? 1 : -1;
+    if (alterado && write_data_block(fd, bloco, (const char *)ponteiros) != 0) return -1;
+    return 0;
+}
+
+// Libera (em lote) os blocos lógicos do arquivo a partir de 'corte' e os blocos indiretos
+// que ficam vazios, e ajusta i_blocks e i_size (o inode não é gravado). Com 'corte' 0
+// libera todos os blocos. Retorna 0 em sucesso, -1 em erro.
+int truncar_arquivo(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt,
+                    struct ext2_inode *inode, uint32_t corte) {
+    struct vetor_u32 blocos = { NULL, 0, 0 };
+    int resultado = 0;
+    for (uint32_t i = corte; i < EXT2_NDIR_BLOCKS && resultado == 0; ++i) {
+        if (inode->i_block[i] == 0) continue;
+        if (vetor_u32_adicionar(&blocos, inode->i_block[i]) != 0) resultado = -1;
+        else inode->i_block[i] = 0;
+    }
+    uint64_t base = EXT2_NDIR_BLOCKS, cobertos = 1;
+    for (int nivel = 1; nivel <= 3 && resultado == 0; ++nivel) {
+        cobertos *= PONTEIROS_POR_BLOCO;
+        uint32_t *ponteiro = &inode->i_block[EXT2_NDIR_BLOCKS + nivel - 1];
+        if (*ponteiro != 0 && base + cobertos > corte) {
+            int vazio = truncar_indireto(fd, *ponteiro, nivel, base, corte, &blocos);
+            if (vazio < 0) resultado = -1;
+            else if (vazio) *ponteiro = 0;
+        }
+        base += cobertos;
+    }
+    if (liberar_blocos_lote(fd, sb, bgdt, blocos.itens, blocos.tamanho) != 0) resultado = -1;
+    uint32_t setores = (uint32_t)blocos.tamanho << (motor_atual->geometria.log_bloco - 9);
+    inode->i_blocks = inode->i_blocks > setores ? inode->i_blocks - setores : 0;
+    if ((uint64_t)corte << motor_atual->geometria.log_bloco < inode->i_size) inode->i_size = corte << motor_atual->geometria.log_bloco;
+    free(blocos.itens);
+    return resultado;
+}
+
+// Lista de blocos de um arquivo (ver listar_blocos_arquivo).
+struct lista_blocos {
+    uint32_t *fisicos;     // Bloco de cada bloco lógico (0 = buraco)
+    uint32_t num_blocos;
+    uint32_t *ordem;       // Blocos de dados e indiretos na ordem do ext2 (opcional)
+    uint32_t tamanho_ordem;
+    uint32_t indiretos;
+    uint64_t logico;
+};
+
+// Maior número de blocos (dados e indiretos) de um arquivo com 'num_blocos' blocos lógicos.
+static inline uint32_t blocos_com_indiretos_max(uint32_t num_blocos) {
+    return num_blocos + num_blocos / (PONTEIROS_POR_BLOCO / 2) + 4;
+}
+
+// Lista os blocos apontados pelo bloco indireto 'bloco' de nível 'nivel' (1 = aponta para
+// dados), a partir do bloco lógico l->logico. Retorna 0 em sucesso, -1 em erro de leitura.
+static int listar_blocos_indireto(int fd, uint32_t bloco, int nivel, struct lista_blocos *l) {
+    uint64_t cobertos = 1;
+    for (int i = 0; i < nivel; ++i) cobertos *= PONTEIROS_POR_BLOCO;
+    if (bloco == 0) { // Buraco: todos os blocos lógicos cobertos ficam em 0
+        l->logico += cobertos;
+        return 0;
+    }
+    uint32_t ponteiros[PONTEIROS_POR_BLOCO_MAX];
+    if (ler_bloco(fd, bloco, (char *)ponteiros, BLOCO_INDIRETO) != 0) return -1;
+    l->indiretos++;
+    if (l->ordem) l->ordem[l->tamanho_ordem++] = bloco;
+    for (uint32_t i = 0; i < PONTEIROS_POR_BLOCO && l->logico < l->num_blocos; ++i) {
+        if (nivel > 1) {
+            if (listar_blocos_indireto(fd, ponteiros[i], nivel - 1, l) != 0) return -1;
+            continue;
+        }
+        l->fisicos[l->logico++] = ponteiros[i];
+        if (l->ordem && ponteiros[i] != 0) l->ordem[l->tamanho_ordem++] = ponteiros[i];
+    }
+    return 0;
+}
+
+// Lista os blocos dos 'num_blocos' primeiros blocos lógicos do arquivo em uma passada pelos
+// blocos indiretos (cada um é lido uma vez, em vez de um caminho do bmap por bloco).
+// 'fisicos' deve ter 'num_blocos' posições (0 = buraco). Se 'ordem' não for NULL (com
+// blocos_com_indiretos_max(num_blocos) posições), recebe os blocos de dados e indiretos na
+// ordem em que o ext2 os dispõe (cada indireto antes dos blocos que aponta), e
+// '*tamanho_ordem' quantos são. '*indiretos' (se não for NULL) recebe quantos blocos
+// indiretos o arquivo usa. Retorna 0 em sucesso, -1 em erro.
+int listar_blocos_arquivo(int fd, const struct ext2_inode *inode, uint32_t *fisicos, uint32_t num_blocos,
+                          uint32_t *ordem, uint32_t *tamanho_ordem, uint32_t *indiretos) {
+    struct lista_blocos l = { fisicos, num_blocos, ordem, 0, 0, 0 };
+    memset(fisicos, 0, (size_t)num_blocos * sizeof(uint32_t));
+    for (int i = 0; i < EXT2_NDIR_BLOCKS && l.logico < num_blocos; ++i) {
+        fisicos[l.logico++] = inode->i_block[i];
+        if (ordem && inode->i_block[i] != 0) ordem[l.tamanho_ordem++] = inode->i_block[i];
+    }
+    for (int nivel = 1; nivel <= 3 && l.logico < num_blocos; ++nivel) {
+        if (listar_blocos_indireto(fd, inode->i_block[EXT2_NDIR_BLOCKS + nivel - 1], nivel, &l) != 0) return -1;
+    }
+    if (tamanho_ordem) *tamanho_ordem = l.tamanho_ordem;
+    if (indiretos) *indiretos = l.indiretos;
+    return 0;
+}
+
+// Número de extensões (sequências de blocos fisicamente contíguos) da lista de blocos.
+static uint32_t contar_extensoes(const uint32_t *fisicos, uint32_t num_blocos) {
+    uint32_t extensoes = 0, anterior = 0;
+    for (uint32_t i = 0; i < num_blocos; ++i) {
+        if (fisicos[i] != 0 && (anterior == 0 || fisicos[i] != anterior + 1)) extensoes++;
+        anterior = fisicos[i];
+    }
+    return extensoes;
+}
+
+// ---------------------------------------------------------------------------
+// Métricas de fragmentação da imagem: extensões por arquivo, layout score (fração de
+// blocos lógicos vizinhos que também são vizinhos no disco), buracos nos blocos de
+// diretório e fragmentação do espaço livre. Percorre os inodes em uso pelas tabelas de
+// inodes (em trechos, guiado pelos bitmaps de inodes) e os bitmaps de blocos.
+// ---------------------------------------------------------------------------
+
+#define INODES_LOTE_BLOCOS 64 // Blocos da tabela de inodes por leitura em percorrer_inodes
+
+// Chamada por percorrer_inodes para cada inode em uso; um retorno diferente de 0 interrompe.
+typedef int (*visitante_inode)(uint32_t inode_num, const struct ext2_inode *inode, void *contexto);
+
+// Chama 'visitante' para cada inode em uso da imagem (pelos bitmaps de inodes; a raiz
+// entra, os outros reservados não). A tabela de inodes de cada grupo é lida em trechos de
+// INODES_LOTE_BLOCOS blocos, do início até o último inode em uso, em vez de uma leitura por
+// inode. Retorna 0 em sucesso, -1 em erro de leitura ou o retorno do visitante.
+int percorrer_inodes(int fd, const struct ext2_super_block *sb, const struct ext2_group_desc *bgdt,
+                     visitante_inode visitante, void *contexto) {
+    unsigned int num_grupos = numero_de_grupos(sb);
+    uint32_t primeiro = sb->s_rev_level >= EXT2_DYNAMIC_REV ? sb->s_first_ino : 11;
+    uint32_t inodes_por_bloco = BLOCK_SIZE >> motor_atual->geometria.log_inode;
+    unsigned char bitmap[BLOCK_SIZE_MAX];
+    char *tabela = (char *)malloc((size_t)INODES_LOTE_BLOCOS * BLOCK_SIZE);
+    if (!tabela) {
+        perror("percorrer_inodes: Erro ao alocar memória");
+        return -1;
+    }
+
+    int resultado = 0;
+    for (unsigned int g = 0; g < num_grupos && resultado == 0; ++g) {
+        const struct ext2_group_desc *desc = descritor_grupo(bgdt, g);
+        if (desc->bg_free_inodes_count == sb->s_inodes_per_group) continue; // Grupo sem inodes em uso
+        if (ler_bloco(fd, desc->bg_inode_bitmap, (char *)bitmap, BLOCO_BITMAP) != 0) {
+            resultado = -1;
+            break;
+        }
+        uint32_t usados = sb->s_inodes_per_group; // Um além do último bit marcado
+        while (usados > 0 && !is_bit_set(bitmap, (int)(usados - 1))) usados--;
+
+        for (uint32_t bit = 0; bit < usados && resultado == 0; ) {
+            // Um trecho da tabela a partir do bloco que contém o inode 'bit'.
+            uint32_t bloco_tabela = bit / inodes_por_bloco;
+            uint32_t blocos = (usados + inodes_por_bloco - 1) / inodes_por_bloco - bloco_tabela;
+            if (blocos > INODES_LOTE_BLOCOS) blocos = INODES_LOTE_BLOCOS;
+            size_t bytes = (size_t)blocos << motor_atual->geometria.log_bloco;
+            ESTAT(estatisticas.blocos_lidos[BLOCO_TABELA_INODES] += blocos);
+            if (dev_pread(fd, tabela, bytes, offset_do_bloco(desc->bg_inode_table + bloco_tabela)) != (ssize_t)bytes) {
+                perror("percorrer_inodes: Erro ao ler a tabela de inodes");
+                resultado = -1;
+                break;
+            }
+            uint32_t fim = (bloco_tabela + blocos) * inodes_por_bloco;
+            if (fim > usados) fim = usados;
+            for (; bit < fim && resultado == 0; ++bit) {
+                if (!is_bit_set(bitmap, (int)bit)) continue;
+                uint32_t inode_num = g * sb->s_inodes_per_group + bit + 1;
+                if (inode_num != EXT2_ROOT_INO && inode_num < primeiro) continue; // Reservados
+                const struct ext2_inode *inode =
+                    (const struct ext2_inode *)(tabela + ((size_t)(bit - bloco_tabela * inodes_por_bloco) << motor_atual->geometria.log_inode));
+                resultado = visitante(inode_num, inode, contexto);
+            }
+        }
+    }
+    free(tabela);
+    return resultado;
+}
+
+// Espaço livre do grupo 'g' pelo bitmap de blocos: blocos livres, sequências de blocos
+// livres e a maior delas. Retorna 0 em sucesso, -1 em erro.
+static int medir_livres_grupo(int fd, const struct ext2_super_block *sb, const struct ext2_group_desc *bgdt,
+                              unsigned int g, uint64_t *livres, uint64_t *extensoes, uint64_t *maior) {
+    unsigned int num_grupos = numero_de_grupos(sb);
+    unsigned char bitmap[BLOCK_SIZE_MAX];
+    *livres = *extensoes = *maior = 0;
+    if (ler_bloco(fd, descritor_grupo(bgdt, g)->bg_block_bitmap, (char *)bitmap, BLOCO_BITMAP) != 0) return -1;
+    uint32_t blocos_grupo = sb->s_blocks_per_group;
+    if (g == num_grupos - 1) blocos_grupo = sb->s_blocks_count - sb->s_first_data_block - g * sb->s_blocks_per_group;
+    uint64_t sequencia = 0;
+    for (uint32_t bit = 0; bit <= blocos_grupo; ++bit) {
+        if (bit < blocos_grupo && !is_bit_set(bitmap, (int)bit)) {
+            sequencia++;
+            continue;
+        }
+        if (sequencia > 0) {
+            (*extensoes)++;
+            *livres += sequencia;
+            if (sequencia > *maior) *maior = sequencia;
+            sequencia = 0;
+        }
+    }
+    return 0;
+}
+
+// Lista dos blocos de um arquivo reaproveitada entre os arquivos de uma passada.
+struct buffer_blocos {
+    uint32_t *fisicos;
+    uint32_t *ordem;
+    uint32_t capacidade;  // Blocos lógicos que cabem em 'fisicos'
+};
+
+// Garante espaço para 'num_blocos' blocos lógicos (e a ordem com os indiretos).
+// Retorna 0 em sucesso, -1 em erro.
+static int buffer_blocos_reservar(struct buffer_blocos *b, uint32_t num_blocos) {
+    if (num_blocos <= b->capacidade) return 0;
+    uint32_t *fisicos = (uint32_t *)realloc(b->fisicos, (size_t)num_blocos * sizeof(uint32_t));
+    if (fisicos) b->fisicos = fisicos;
+    uint32_t *ordem = (uint32_t *)realloc(b->ordem, (size_t)blocos_com_indiretos_max(num_blocos) * sizeof(uint32_t));
+    if (ordem) b->ordem = ordem;
+    if (!fisicos || !ordem) {
+        perror("Erro ao alocar a lista de blocos");
+        return -1;
+    }
+    b->capacidade = num_blocos;
+    return 0;
+}
+
+// Acumula as métricas de um arquivo regular a partir dos seus blocos lógicos.
+static void medir_arquivo(const uint32_t *fisicos, uint32_t num_blocos, struct metricas_fragmentacao *m) {
+    uint64_t extensoes = 0;
+    uint32_t anterior = 0;
+    for (uint32_t logico = 0; logico < num_blocos; ++logico) {
+        uint32_t fisico = fisicos[logico];
+        if (fisico == 0) { // Buraco: interrompe a extensão
+            anterior = 0;
+            continue;
+        }
+        m->blocos_arquivos++;
+        if (anterior != 0) {
+            m->pares_total++;
+            if (fisico == anterior + 1) m->pares_contiguos++;
+        }
+        if (anterior == 0 || fisico != anterior + 1) extensoes++;
+        anterior = fisico;
+    }
+    if (extensoes == 0) {
+        m->arquivos_vazios++;
+        return;
+    }
+    m->arquivos++;
+    m->extensoes += extensoes;
+    if (extensoes > 1) m->arquivos_fragmentados++;
+    if (extensoes > m->max_extensoes) m->max_extensoes = extensoes;
+}
+
+// Acumula as métricas dos blocos de um diretório.
+static void medir_diretorio(int fd, const struct ext2_inode *inode, struct metricas_fragmentacao *m) {
+    char bloco[BLOCK_SIZE_MAX];
+    m->diretorios++;
+    uint32_t num_blocos = (inode->i_size + BLOCK_SIZE - 1) >> motor_atual->geometria.log_bloco;
+    for (uint32_t logico = 0; logico < num_blocos; ++logico) {
+        uint32_t fisico = bmap_ler(fd, inode, logico);
+        if (fisico == 0 || ler_bloco(fd, fisico, bloco, BLOCO_DIRETORIO) != 0) continue;
+        m->bytes_diretorios += BLOCK_SIZE;
+
+        uint32_t offset = 0;
+        while (offset + offsetof(struct ext2_dir_entry_2, name) <= BLOCK_SIZE) {
+            struct ext2_dir_entry_2 *entrada = (struct ext2_dir_entry_2 *)(bloco + offset);
+            if (entrada->rec_len == 0) break;
+            if (entrada->inode == 0) {
+                m->entradas_mortas++;
+                m->bytes_entradas_mortas += entrada->rec_len;
+            } else {
+                m->entradas_vivas++;
+                m->bytes_entradas_vivas += (offsetof(struct ext2_dir_entry_2, name) + entrada->name_len + 3) & ~3u;
+            }
+            offset += entrada->rec_len;
+        }
+    }
+}
+
+struct contexto_medicao {
+    int fd;
+    struct metricas_fragmentacao *m;
+    struct buffer_blocos blocos;
+};
+
+static int medir_inode(uint32_t inode_num, const struct ext2_inode *inode, void *contexto) {
+    (void)inode_num;
+    struct contexto_medicao *c = (struct contexto_medicao *)contexto;
+    if (S_ISDIR(inode->i_mode)) {
+        medir_diretorio(c->fd, inode, c->m);
+    } else if (S_ISREG(inode->i_mode)) {
+        uint32_t num_blocos = (inode->i_size + BLOCK_SIZE - 1) >> motor_atual->geometria.log_bloco;
+        if (buffer_blocos_reservar(&c->blocos, num_blocos) != 0) return -1;
+        if (listar_blocos_arquivo(c->fd, inode, c->blocos.fisicos, num_blocos, NULL, NULL, NULL) != 0) return -1;
+        medir_arquivo(c->blocos.fisicos, num_blocos, c->m);
+    }
+    return 0;
+}
+
+// Calcula as métricas de fragmentação da imagem. Retorna 0 em sucesso, -1 em erro.
+int medir_fragmentacao(int fd, const struct ext2_super_block *sb, const struct ext2_group_desc *bgdt,
+                       struct metricas_fragmentacao *m) {
+    unsigned int num_grupos = numero_de_grupos(sb);
+    memset(m, 0, sizeof(*m));
+
+    struct contexto_medicao c = { fd, m, { NULL, NULL, 0 } };
+    int resultado = percorrer_inodes(fd, sb, bgdt, medir_inode, &c);
+    free(c.blocos.fisicos);
+    free(c.blocos.ordem);
+    if (resultado != 0) return -1;
+
+    // Extensões livres de cada grupo.
+    for (unsigned int g = 0; g < num_grupos; ++g) {
+        uint64_t livres, extensoes, maior;
+        if (medir_livres_grupo(fd, sb, bgdt, g, &livres, &extensoes, &maior) != 0) return -1;
+        m->blocos_livres += livres;
+        m->extensoes_livres += extensoes;
+        if (maior > m->maior_extensao_livre) m->maior_extensao_livre = maior;
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Análise de fragmentação e disposição (comando 'frag'): por arquivo regular, as extensões
+// (na ordem do ext2, com os blocos indiretos, como o defrag as conta), o comprimento médio
+// das sequências e a distância média, em grupos, entre o grupo do inode e os seus blocos;
+// para a imagem, histogramas em potências de 2 dessas medidas e, por grupo, a fragmentação
+// do espaço livre. Uma passada sequencial pelas tabelas de inodes (percorrer_inodes) e
+// pelos blocos indiretos de cada arquivo.
+// ---------------------------------------------------------------------------
+
+#define FRAG_FAIXAS 33 // Faixa 0: valor 0; faixa i > 0: [2^(i-1), 2^i)
+
+struct analise_frag {
+    int fd;
+    int todos;                        // Lista todos os arquivos (senão, só os fragmentados)
+    struct buffer_blocos lista;
+    uint64_t arquivos, vazios, fragmentados;
+    uint64_t blocos, extensoes;
+    uint64_t hist_extensoes[FRAG_FAIXAS];   // Arquivos por número de extensões
+    uint64_t hist_sequencias[FRAG_FAIXAS];  // Sequências por comprimento (blocos)
+    uint64_t hist_distancia[FRAG_FAIXAS];   // Arquivos pela distância média (grupos, arredondada)
+};
+
+static inline int frag_faixa(uint64_t valor) {
+    int faixa = 0;
+    while (valor != 0 && faixa < FRAG_FAIXAS - 1) {
+        valor >>= 1;
+        faixa++;
+    }
+    return faixa;
+}
+
+static int analisar_arquivo(uint32_t inode_num, const struct ext2_inode *inode, void *contexto) {
+    struct analise_frag *a = (struct analise_frag *)contexto;
+    if (!S_ISREG(inode->i_mode)) return 0;
+    uint32_t num_blocos = (inode->i_size + BLOCK_SIZE - 1) >> motor_atual->geometria.log_bloco;
+    if (buffer_blocos_reservar(&a->lista, num_blocos) != 0) return -1;
+    uint32_t tamanho = 0;
+    if (num_blocos > 0 &&
+        listar_blocos_arquivo(a->fd, inode, a->lista.fisicos, num_blocos, a->lista.ordem, &tamanho, NULL) != 0) {
+        fprintf(erros_comando(), "frag: erro ao ler os blocos do inode %u\n", inode_num);
+        return -1;
+    }
+    if (tamanho == 0) {
+        a->vazios++;
+        return 0;
+    }
+
+    // Sequências de blocos contíguos e distância de cada bloco ao grupo do inode.
+    const uint32_t *ordem = a->lista.ordem;
+    uint32_t grupo_inode = grupo_do_inode(inode_num, NULL);
+    uint64_t distancia = 0;
+    uint32_t extensoes = 0, sequencia = 0;
+    for (uint32_t i = 0; i < tamanho; ++i) {
+        uint32_t grupo = grupo_do_bloco(ordem[i], NULL);
+        distancia += grupo > grupo_inode ? grupo - grupo_inode : grupo_inode - grupo;
+        if (i > 0 && ordem[i] == ordem[i - 1] + 1) {
+            sequencia++;
+            continue;
+        }
+        if (sequencia > 0) a->hist_sequencias[frag_faixa(sequencia)]++;
+        extensoes++;
+        sequencia = 1;
+    }
+    a->hist_sequencias[frag_faixa(sequencia)]++;
+
+    double media_sequencia = (double)tamanho / extensoes;
+    double media_distancia = (double)distancia / tamanho;
+    a->arquivos++;
+    a->blocos += tamanho;
+    a->extensoes += extensoes;
+    if (extensoes > 1) a->fragmentados++;
+    a->hist_extensoes[frag_faixa(extensoes)]++;
+    a->hist_distancia[frag_faixa((uint64_t)(media_distancia + 0.5))]++;
+    if (a->todos || extensoes > 1) {
+        fprintf(saida_comando(), "inode %u: %u blocos, %u extensões, sequência média %.1f blocos, distância média %.2f grupos\n",
+                inode_num, tamanho, extensoes, media_sequencia, media_distancia);
+    }
+    return 0;
+}
+
+static void frag_imprimir_histograma(const char *titulo, const uint64_t *hist) {
+    fprintf(saida_comando(), "%s:\n", titulo);
+    for (int faixa = 0; faixa < FRAG_FAIXAS; ++faixa) {
+        if (hist[faixa] == 0) continue;
+        uint64_t minimo = faixa == 0 ? 0 : 1ull << (faixa - 1);
+        uint64_t maximo = faixa == 0 ? 0 : (1ull << faixa) - 1;
+        char faixa_texto[48];
+        if (minimo == maximo) snprintf(faixa_texto, sizeof(faixa_texto), "%llu", (unsigned long long)minimo);
+        else snprintf(faixa_texto, sizeof(faixa_texto), "%llu-%llu", (unsigned long long)minimo, (unsigned long long)maximo);
+        fprintf(saida_comando(), "  %-12s %llu\n", faixa_texto, (unsigned long long)hist[faixa]);
+    }
+}
+
+// Implementa o comando 'frag'. Com 'todos', lista todos os arquivos; senão, só os que têm
+// mais de uma extensão.
+int comando_frag(int fd, const struct ext2_super_block *sb, const struct ext2_group_desc *bgdt, int todos) {
+    struct analise_frag a;
+    memset(&a, 0, sizeof(a));
+    a.fd = fd;
+    a.todos = todos;
+    int resultado = percorrer_inodes(fd, sb, bgdt, analisar_arquivo, &a);
+    free(a.lista.fisicos);
+    free(a.lista.ordem);
+    if (resultado != 0) {
+        fprintf(erros_comando(), "frag: erro ao percorrer as tabelas de inodes\n");
+        return 1;
+    }
+
+    // As médias e a porcentagem são sobre os arquivos com dados; os vazios são contados à parte.
+    fprintf(saida_comando(), "frag: %llu arquivos com dados, %llu vazio(s); %llu fragmentados (%.1f%%), %.2f extensões por arquivo, "
+            "sequência média %.1f blocos\n",
+            (unsigned long long)a.arquivos, (unsigned long long)a.vazios, (unsigned long long)a.fragmentados,
+            a.arquivos ? 100.0 * a.fragmentados / a.arquivos : 0.0,
+            a.arquivos ? (double)a.extensoes / a.arquivos : 0.0,
+            a.extensoes ? (double)a.blocos / a.extensoes : 0.0);
+    frag_imprimir_histograma("extensões por arquivo", a.hist_extensoes);
+    frag_imprimir_histograma("comprimento das sequências (blocos)", a.hist_sequencias);
+    frag_imprimir_histograma("distância média ao grupo do inode (grupos)", a.hist_distancia);
+
+    // Fragmentação do espaço livre de cada grupo: 1 - maior extensão livre / blocos livres
+    // (0 = todo o espaço livre em uma extensão).
+    unsigned int num_grupos = numero_de_grupos(sb);
+    uint64_t total_livres = 0, soma_ponderada = 0;
+    fprintf(saida_comando(), "grupo   livres  extensões     maior  fragmentação\n");
+    for (unsigned int g = 0; g < num_grupos; ++g) {
+        uint64_t livres, extensoes, maior;
+        if (medir_livres_grupo(fd, sb, bgdt, g, &livres, &extensoes, &maior) != 0) {
+            fprintf(erros_comando(), "frag: erro ao ler o bitmap de blocos do grupo %u\n", g);
+            return 1;
+        }
+        double pontuacao = livres ? 1.0 - (double)maior / livres : 0.0;
+        total_livres += livres;
+        soma_ponderada += livres - maior;
+        fprintf(saida_comando(), "%5u %8llu %10llu %9llu %13.3f\n", g, (unsigned long long)livres,
+                (unsigned long long)extensoes, (unsigned long long)maior, pontuacao);
+    }
+    fprintf(saida_comando(), "fragmentação do espaço livre (média ponderada): %.3f\n",
+            total_livres ? (double)soma_ponderada / total_livres : 0.0);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Verificação das somas (comando 'scrub'). A imagem é lida em lotes de 1 MiB, distribuídos
+// entre uma thread por processador; cada thread calcula o CRC32C de cada bloco e compara
+// com "<imagem>.crc" ('scrub') ou grava a soma ('scrub -c'). As leituras vão direto ao
+// disco (sem as versões pendentes na transação ou no journal), que é o conteúdo que as
+// somas descrevem.
+// ---------------------------------------------------------------------------
+
+#define SCRUB_LOTE_BYTES (1u << 20)
+#define SCRUB_MAX_TRABALHADORES 16
+#define SCRUB_MAX_LISTADOS 32 // Blocos divergentes listados individualmente
+
+struct trabalhador_scrub {
+    struct motor *motor;
+    int fd;
+    uint32_t num_blocos;
+    int criar;                       // 1: grava as somas; 0: compara
+    uint64_t *proximo;               // Próximo lote livre (incrementado atomicamente)
+    struct vetor_u32 divergentes;
+    int erro;
+    struct contadores_es es;         // E/S da thread, somada à do comando no fim
+    uint64_t blocos_lidos[NUM_TIPOS_BLOCO]; // Idem para as estatísticas (a imagem inteira conta como dados)
+};
+
+static void *scrub_trabalhador(void *argumento) {
+    struct trabalhador_scrub *t = (struct trabalhador_scrub *)argumento;
+    motor_atual = t->motor;
+    uint32_t por_lote = SCRUB_LOTE_BYTES >> motor_atual->geometria.log_bloco;
+    char *buffer = (char *)malloc(SCRUB_LOTE_BYTES);
+    if (!buffer) {
+        t->erro = 1;
+        return NULL;
+    }
+    uint64_t lote;
+    while ((lote = __atomic_fetch_add(t->proximo, 1, __ATOMIC_RELAXED)) * por_lote < t->num_blocos) {
+        uint32_t primeiro = (uint32_t)(lote * por_lote);
+        uint32_t blocos = t->num_blocos - primeiro < por_lote ? t->num_blocos - primeiro : por_lote;
+        size_t bytes = (size_t)blocos << motor_atual->geometria.log_bloco;
+        ssize_t lidos = pread(t->fd, buffer, bytes, offset_do_bloco(primeiro));
+        t->es.leituras++;
+        if (lidos < 0) {
+            t->erro = 1;
+            break;
+        }
+        t->es.bytes_lidos += (uint64_t)lidos;
+        ESTAT(t->blocos_lidos[BLOCO_DADOS] += blocos);
+        if ((size_t)lidos < bytes) memset(buffer + lidos, 0, bytes - (size_t)lidos); // Fim da imagem
+        for (uint32_t i = 0; i < blocos; ++i) {
+            uint32_t soma = crc32c(0, buffer + ((size_t)i << motor_atual->geometria.log_bloco), BLOCK_SIZE);
+            if (t->criar) {
+                motor_atual->somas_blocos.somas[primeiro + i] = soma;
+            } else if (soma != motor_atual->somas_blocos.somas[primeiro + i] && vetor_u32_adicionar(&t->divergentes, primeiro + i) != 0) {
+                t->erro = 1;
+            }
+        }
+    }
+    free(buffer);
+    return NULL;
+}
+
+// Descreve o que o bloco guarda (pela posição no grupo e pelo bitmap de blocos).
+static const char *scrub_tipo_bloco(int fd, const struct ext2_super_block *sb, const struct ext2_group_desc *bgdt,
+                                    uint32_t bloco) {
+    if (bloco < sb->s_first_data_block) return "setor de boot";
+    uint32_t bit;
+    uint32_t grupo = grupo_do_bloco(bloco, &bit);
+    const struct ext2_group_desc *d = descritor_grupo(bgdt, grupo);
+    uint32_t blocos_tabela = (uint32_t)((((uint64_t)sb->s_inodes_per_group << motor_atual->geometria.log_inode) + BLOCK_SIZE - 1) >> motor_atual->geometria.log_bloco);
+    if (bloco == d->bg_block_bitmap) return "bitmap de blocos";
+    if (bloco == d->bg_inode_bitmap) return "bitmap de inodes";
+    if (bloco >= d->bg_inode_table && bloco < d->bg_inode_table + blocos_tabela) return "tabela de inodes";
+    if (bloco < d->bg_block_bitmap && grupo_do_bloco(d->bg_block_bitmap, NULL) == grupo) return "superbloco/descritores";
+    unsigned char bitmap[BLOCK_SIZE_MAX];
+    if (ler_bloco(fd, d->bg_block_bitmap, (char *)bitmap, BLOCO_BITMAP) != 0) return "?";
+    return is_bit_set(bitmap, (int)bit) ? "em uso" : "livre";
+}
+
+// Implementa 'scrub' (verifica as somas) e 'scrub -c' (cria "<imagem>.crc" com as somas
+// do conteúdo atual). Retorna 0 sem divergências, 1 com divergências ou em erro.
+int comando_scrub(int fd, const struct ext2_super_block *sb, const struct ext2_group_desc *bgdt, int criar) {
+    if (!criar && !motor_atual->somas_blocos.somas) {
+        if (motor_atual->somas_blocos.invalido) {
+            fprintf(erros_comando(), "scrub: %s não corresponde à imagem (recrie com 'scrub -c')\n", motor_atual->somas_blocos.caminho);
+        } else {
+            fprintf(erros_comando(), "scrub: a imagem não tem somas de verificação (crie com 'scrub -c')\n");
+        }
+        return 1;
+    }
+    if (criar && somas_criar(sb) != 0) return 1;
+
+    long processadores = sysconf(_SC_NPROCESSORS_ONLN);
+    int num_trabalhadores = processadores < 1 ? 1 : processadores > SCRUB_MAX_TRABALHADORES ? SCRUB_MAX_TRABALHADORES : (int)processadores;
+    struct trabalhador_scrub trabalhadores[SCRUB_MAX_TRABALHADORES];
+    pthread_t threads[SCRUB_MAX_TRABALHADORES];
+    uint64_t proximo = 0;
+    uint32_t num_blocos = motor_atual->somas_blocos.cabecalho->num_blocos;
+    for (int i = 0; i < num_trabalhadores; ++i) {
+        trabalhadores[i] = (struct trabalhador_scrub){ motor_atual, fd, num_blocos, criar, &proximo, { NULL, 0, 0 }, 0, { 0, 0, 0, 0, 0 }, { 0 } };
+    }
+
+    uint64_t inicio = relogio_ns();
+    int criadas = 0;
+    if (num_trabalhadores > 1) {
+        for (; criadas < num_trabalhadores; ++criadas) {
+            if (pthread_create(&threads[criadas], NULL, scrub_trabalhador, &trabalhadores[criadas]) != 0) break;
+        }
+    }
+    if (criadas == 0) scrub_trabalhador(&trabalhadores[0]);
+    for (int i = 0; i < criadas; ++i) pthread_join(threads[i], NULL);
+    double ms = (relogio_ns() - inicio) / 1e6;
+
+    struct vetor_u32 divergentes = { NULL, 0, 0 };
+    int erro = 0;
+    for (int i = 0; i < num_trabalhadores; ++i) {
+        struct trabalhador_scrub *t = &trabalhadores[i];
+        contadores_es.leituras += t->es.leituras;
+        contadores_es.bytes_lidos += t->es.bytes_lidos;
+        ESTAT(estat_somar_blocos_lidos(t->blocos_lidos));
+        for (size_t k = 0; k < t->divergentes.tamanho && !erro; ++k) {
+            if (vetor_u32_adicionar(&divergentes, t->divergentes.itens[k]) != 0) erro = 1;
+        }
+        if (t->erro) erro = 1;
+        free(t->divergentes.itens);
+    }
+    if (erro) {
+        fprintf(erros_comando(), "scrub: erro ao ler a imagem\n");
+        if (criar) { // Somas incompletas não podem ficar valendo
+            somas_desativar();
+            unlink(motor_atual->somas_blocos.caminho);
+        }
+        free(divergentes.itens);
+        return 1;
+    }
+
+    double mib = (double)((uint64_t)num_blocos << motor_atual->geometria.log_bloco) / (1024.0 * 1024.0);
+    fprintf(saida_comando(), "scrub: %u blocos (%.1f MiB) %s em %.1f ms (%.0f MiB/s, threads: %d, crc32c %s)\n",
+            num_blocos, mib, criar ? "com somas calculadas" : "verificados", ms, ms > 0 ? mib / (ms / 1000.0) : 0.0,
+            criadas > 0 ? criadas : 1, crc32c_nome());
+    if (criar) return 0;
+
+    if (motor_atual->somas_blocos.desatualizado) {
+        fprintf(saida_comando(), "scrub: somas desatualizadas (sessão interrompida ou imagem alterada por outro "
+                                 "programa): as divergências podem ser alterações legítimas; recrie com 'scrub -c'\n");
+    }
+    qsort(divergentes.itens, divergentes.tamanho, sizeof(uint32_t), comparar_u32);
+    for (size_t i = 0; i < divergentes.tamanho && i < SCRUB_MAX_LISTADOS; ++i) {
+        uint32_t bloco = divergentes.itens[i];
+        fprintf(saida_comando(), "  bloco %u (grupo %u, %s): soma divergente\n", bloco,
+                grupo_do_bloco(bloco, NULL), scrub_tipo_bloco(fd, sb, bgdt, bloco));
+    }
+    if (divergentes.tamanho > SCRUB_MAX_LISTADOS) {
+        fprintf(saida_comando(), "  ... e mais %zu blocos\n", divergentes.tamanho - SCRUB_MAX_LISTADOS);
+    }
+    size_t total = divergentes.tamanho;
+    free(divergentes.itens);
+    if (total == 0) {
+        fprintf(saida_comando(), "scrub: nenhuma divergência\n");
+        return 0;
+    }
+    fprintf(saida_comando(), "scrub: %zu blocos com soma divergente\n", total);
+    return 1;
+}
+
+// ---------------------------------------------------------------------------
+// Dados duplicados (comando 'dupes'). Os arquivos regulares são listados em uma passada
+// pelas tabelas de inodes e divididos entre uma thread por processador; cada thread lê os
+// blocos de dados de cada arquivo em trechos contíguos e calcula um hash de 64 bits por
+// bloco (e um por arquivo, a partir dos hashes dos blocos). Cada thread conta os hashes
+// em uma tabela própria, com endereçamento aberto e 16 bytes por conteúdo distinto; as
+// tabelas são somadas no fim. A memória é proporcional aos blocos distintos (mais uma
+// entrada por arquivo). Conteúdos iguais são reconhecidos pelo hash, sem comparar bytes:
+// o resultado é uma estimativa (colisões de 64 bits são desprezíveis para esse uso).
+// ---------------------------------------------------------------------------
+
+#define DUPES_LOTE 256         // Blocos por leitura
+#define DUPES_MAX_TRABALHADORES 16
+#define DUPES_MAIORES 10       // Conjuntos listados
+#define DUPES_CAMINHOS_POR_CONJUNTO 3
+#define DUPES_PRIMO1 0x9E3779B185EBCA87ull
+#define DUPES_PRIMO2 0xC2B2AE3D27D4EB4Full
+#define DUPES_PRIMO3 0x165667B19E3779F9ull
+
+// Chaves de cada um dos 8 acumuladores (bytes de uma sequência pseudoaleatória fixa).
+static const uint64_t dupes_chaves[8] = {
+    0xBE4BA423396CFEB8ull, 0x1CAD21F72C81017Cull, 0xDB979083E96DD4DEull, 0x1F67B3B7A4A44072ull,
+    0x78E5C0CC4EE679CBull, 0x2172FFCC7DD05A82ull, 0x8E2443F7744608B8ull, 0x4C263A81E69035E0ull
+};
+
+static inline uint64_t dupes_misturar(uint64_t h) {
+    h ^= h >> 33;
+    h *= DUPES_PRIMO2;
+    h ^= h >> 29;
+    h *= DUPES_PRIMO3;
+    h ^= h >> 32;
+    return h;
+}
+
+// Hash de 64 bits de um bloco ('tamanho' múltiplo de 64), no estilo do XXH3: 8 acumuladores
+// independentes, cada um somando o produto 32x32->64 das metades da palavra (com a chave) e
+// a palavra vizinha, embaralhados a cada 1 KiB. O laço interno é vetorizável.
+static uint64_t dupes_hash(const unsigned char *p, size_t tamanho) {
+    uint64_t acc[8];
+    for (int l = 0; l < 8; ++l) acc[l] = dupes_chaves[l] ^ DUPES_PRIMO1;
+    for (size_t i = 0; i < tamanho; i += 64) {
+        for (int l = 0; l < 8; ++l) {
+            uint64_t v;
+            memcpy(&v, p + i + 8 * l, 8);
+            uint64_t k = v ^ dupes_chaves[l];
+            acc[l ^ 1] += v;
+            acc[l] += (k & 0xFFFFFFFFull) * (k >> 32);
+        }
+        if ((i & 1023) == 1023 - 63) {
+            for (int l = 0; l < 8; ++l) acc[l] = (acc[l] ^ (acc[l] >> 47) ^ dupes_chaves[7 - l]) * 0x9E3779B1ull;
+        }
+    }
+    uint64_t h = tamanho * DUPES_PRIMO1;
+    for (int l = 0; l < 8; ++l) h = (h ^ dupes_misturar(acc[l] ^ dupes_chaves[l])) * DUPES_PRIMO1;
+    h = dupes_misturar(h);
+    return h != 0 ? h : 1; // 0 marca posição vazia na tabela
+}
+
+// Conteúdo distinto de bloco: o hash, quantos blocos o têm e um arquivo que o contém.
+struct bloco_unico {
+    uint64_t hash;
+    uint32_t copias;
+    uint32_t inode;
+};
+
+struct tabela_blocos {
+    struct bloco_unico *itens;
+    size_t capacidade;               // Potência de 2
+    size_t usados;
+};
+
+static int tabela_blocos_inserir(struct tabela_blocos *t, uint64_t hash, uint32_t copias, uint32_t inode);
+
+// Dobra a capacidade (ou cria a tabela). Retorna 0 ou -1 sem memória.
+static int tabela_blocos_crescer(struct tabela_blocos *t) {
+    struct tabela_blocos nova = { NULL, t->capacidade ? t->capacidade * 2 : 4096, 0 };
+    nova.itens = (struct bloco_unico *)calloc(nova.capacidade, sizeof(struct bloco_unico));
+    if (!nova.itens) {
+        perror("dupes: Erro ao alocar a tabela de blocos");
+        return -1;
+    }
+    for (size_t i = 0; i < t->capacidade; ++i) {
+        if (t->itens[i].hash != 0) tabela_blocos_inserir(&nova, t->itens[i].hash, t->itens[i].copias, t->itens[i].inode);
+    }
+    free(t->itens);
+    *t = nova;
+    return 0;
+}
+
+// Soma 'copias' ao conteúdo 'hash' (criando-o com 'inode' como exemplo). Retorna 0 ou -1.
+static int tabela_blocos_inserir(struct tabela_blocos *t, uint64_t hash, uint32_t copias, uint32_t inode) {
+    if ((t->usados + 1) * 10 > t->capacidade * 7 && tabela_blocos_crescer(t) != 0) return -1; // Carga máxima de 70%
+    size_t mascara = t->capacidade - 1;
+    for (size_t pos = (size_t)(hash >> 7) & mascara; ; pos = (pos + 1) & mascara) {
+        struct bloco_unico *b = &t->itens[pos];
+        if (b->hash == hash) {
+            b->copias += copias;
+            return 0;
+        }
+        if (b->hash == 0) {
+            *b = (struct bloco_unico){ hash, copias, inode };
+            t->usados++;
+            return 0;
+        }
+    }
+}
+
+struct arquivo_dupes {
+    uint32_t inode;
+    uint32_t tamanho;
+    uint64_t hash;                   // Do conteúdo inteiro (0 = não lido)
+};
+
+struct analise_dupes {
+    int fd;
+    const struct ext2_super_block *sb;
+    const struct ext2_group_desc *bgdt;
+    struct arquivo_dupes *arquivos;
+    size_t num_arquivos, capacidade;
+    size_t proximo;                  // Próximo arquivo livre (incrementado atomicamente)
+    uint64_t hash_zeros;             // Hash de um bloco zerado
+};
+
+static int dupes_listar_arquivo(uint32_t inode_num, const struct ext2_inode *inode, void *contexto) {
+    struct analise_dupes *a = (struct analise_dupes *)contexto;
+    if (!S_ISREG(inode->i_mode) || inode->i_size == 0) return 0;
+    if (a->num_arquivos == a->capacidade) {
+        size_t capacidade = a->capacidade ? a->capacidade * 2 : 1024;
+        struct arquivo_dupes *arquivos = (struct arquivo_dupes *)realloc(a->arquivos, capacidade * sizeof(struct arquivo_dupes));
+        if (!arquivos) {
+            perror("dupes: Erro ao alocar a lista de arquivos");
+            return -1;
+        }
+        a->arquivos = arquivos;
+        a->capacidade = capacidade;
+    }
+    a->arquivos[a->num_arquivos++] = (struct arquivo_dupes){ inode_num, inode->i_size, 0 };
+    return 0;
+}
+
+struct trabalhador_dupes {
+    struct motor *motor;
+    struct analise_dupes *a;
+    struct tabela_blocos tabela;
+    uint64_t blocos, zerados;
+    int erro;
+    struct contadores_es es;         // E/S feita pela thread (só somada se for outra thread)
+    uint64_t blocos_lidos[NUM_TIPOS_BLOCO]; // Idem para as estatísticas
+};
+
+// Lê os blocos de um arquivo e registra os hashes. Retorna 0 ou -1 em erro.
+static int dupes_ler_arquivo(struct trabalhador_dupes *t, struct arquivo_dupes *arquivo,
+                             struct buffer_blocos *lista, char *buffer) {
+    struct analise_dupes *a = t->a;
+    struct ext2_inode inode;
+    uint32_t num_blocos = (arquivo->tamanho + BLOCK_SIZE - 1) >> motor_atual->geometria.log_bloco;
+    if (read_inode(a->fd, a->sb, a->bgdt, arquivo->inode, &inode) != 0 ||
+        buffer_blocos_reservar(lista, num_blocos) != 0 ||
+        listar_blocos_arquivo(a->fd, &inode, lista->fisicos, num_blocos, NULL, NULL, NULL) != 0) {
+        fprintf(erros_comando(), "dupes: erro ao ler os blocos do inode %u\n", arquivo->inode);
+        return -1;
+    }
+    uint32_t resto = arquivo->tamanho & (BLOCK_SIZE - 1); // Bytes usados do último bloco (0 = inteiro)
+    uint64_t hash_arquivo = dupes_misturar(arquivo->tamanho ^ DUPES_PRIMO3);
+    for (uint32_t i = 0; i < num_blocos; ) {
+        const uint32_t *fisicos = lista->fisicos;
+        if (fisicos[i] == 0) { // Buraco: entra no hash do arquivo, não é um bloco
+            hash_arquivo = (hash_arquivo ^ DUPES_PRIMO2) * DUPES_PRIMO1;
+            i++;
+            continue;
+        }
+        uint32_t n = 1;
+        while (n < DUPES_LOTE && i + n < num_blocos && fisicos[i + n] == fisicos[i] + n) n++;
+        size_t bytes = (size_t)n << motor_atual->geometria.log_bloco;
+        if (dev_pread(a->fd, buffer, bytes, offset_do_bloco(fisicos[i])) != (ssize_t)bytes) {
+            fprintf(erros_comando(), "dupes: erro ao ler o inode %u\n", arquivo->inode);
+            return -1;
+        }
+        for (uint32_t k = 0; k < n; ++k) {
+            unsigned char *bloco = (unsigned char *)buffer + ((size_t)k << motor_atual->geometria.log_bloco);
+            if (i + k == num_blocos - 1 && resto != 0) memset(bloco + resto, 0, BLOCK_SIZE - resto); // Após o fim do arquivo
+            uint64_t hash = dupes_hash(bloco, BLOCK_SIZE);
+            if (tabela_blocos_inserir(&t->tabela, hash, 1, arquivo->inode) != 0) return -1;
+            t->blocos++;
+            if (hash == a->hash_zeros) t->zerados++;
+            hash_arquivo = (hash_arquivo ^ hash) * DUPES_PRIMO1;
+            hash_arquivo ^= hash_arquivo >> 31;
+        }
+        i += n;
+    }
+    arquivo->hash = dupes_misturar(hash_arquivo) | 1;
+    return 0;
+}
+
+static void *dupes_trabalhador(void *argumento) {
+    struct trabalhador_dupes *t = (struct trabalhador_dupes *)argumento;
+    motor_atual = t->motor;
+    struct contadores_es antes = contadores_es;
+    ESTAT(memcpy(t->blocos_lidos, estatisticas.blocos_lidos, sizeof(t->blocos_lidos))); // Início; vira a diferença no fim
+    struct buffer_blocos lista = { NULL, NULL, 0 };
+    char *buffer = (char *)malloc((size_t)DUPES_LOTE << motor_atual->geometria.log_bloco);
+    if (!buffer) t->erro = 1;
+    size_t indice;
+    while (!t->erro && (indice = __atomic_fetch_add(&t->a->proximo, 1, __ATOMIC_RELAXED)) < t->a->num_arquivos) {
+        if (dupes_ler_arquivo(t, &t->a->arquivos[indice], &lista, buffer) != 0) t->erro = 1;
+    }
+    free(buffer);
+    free(lista.fisicos);
+    free(lista.ordem);
+    t->es.leituras = contadores_es.leituras - antes.leituras;
+    t->es.bytes_lidos = contadores_es.bytes_lidos - antes.bytes_lidos;
+    ESTAT(for (int k = 0; k < NUM_TIPOS_BLOCO; ++k) t->blocos_lidos[k] = estatisticas.blocos_lidos[k] - t->blocos_lidos[k]);
+    return NULL;
+}
+
+// Conteúdos de bloco repetidos agrupados por número de cópias e arquivo de exemplo.
+struct conjunto_blocos {
+    uint32_t copias;
+    uint32_t inode;
+    uint32_t conteudos;              // Conteúdos distintos no conjunto
+    uint32_t zerado;                 // 1 para o bloco zerado (sempre em um conjunto próprio)
+};
+
+static int comparar_conjuntos_blocos(const void *a, const void *b) {
+    const struct conjunto_blocos *x = (const struct conjunto_blocos *)a, *y = (const struct conjunto_blocos *)b;
+    if (x->copias != y->copias) return x->copias > y->copias ? -1 : 1;
+    return (x->inode > y->inode) - (x->inode < y->inode);
+}
+
+static int comparar_arquivos_dupes(const void *a, const void *b) {
+    const struct arquivo_dupes *x = (const struct arquivo_dupes *)a, *y = (const struct arquivo_dupes *)b;
+    if (x->hash != y->hash) return x->hash < y->hash ? -1 : 1;
+    if (x->tamanho != y->tamanho) return x->tamanho < y->tamanho ? -1 : 1;
+    return (x->inode > y->inode) - (x->inode < y->inode);
+}
+
+// Procura, a partir da raiz, um caminho para cada inode de 'procurados' (ordenado e sem
+// repetições); 'caminhos[i]' recebe uma cópia alocada ou fica NULL (inode sem nome).
+static void dupes_caminhos(int fd, const struct ext2_super_block *sb, const struct ext2_group_desc *bgdt,
+                           const uint32_t *procurados, size_t num_procurados, char **caminhos) {
+    struct pendente { uint32_t inode; char *caminho; };
+    struct pendente *fila = (struct pendente *)malloc(sizeof(struct pendente));
+    size_t inicio = 0, fim = 0, capacidade = 1, encontrados = 0;
+    struct buffer_blocos lista = { NULL, NULL, 0 };
+    char bloco[BLOCK_SIZE_MAX];
+    if (!fila) return;
+    fila[fim++] = (struct pendente){ EXT2_ROOT_INO, strdup("") };
+    while (inicio < fim && encontrados < num_procurados) {
+        struct pendente dir = fila[inicio++];
+        struct ext2_inode inode;
+        uint32_t num_blocos = 0;
+        if (dir.caminho && read_inode(fd, sb, bgdt, dir.inode, &inode) == 0) num_blocos = (inode.i_size + BLOCK_SIZE - 1) >> motor_atual->geometria.log_bloco;
+        if (num_blocos > 0 && (buffer_blocos_reservar(&lista, num_blocos) != 0 ||
+                               listar_blocos_arquivo(fd, &inode, lista.fisicos, num_blocos, NULL, NULL, NULL) != 0)) num_blocos = 0;
+        for (uint32_t logico = 0; logico < num_blocos; ++logico) {
+            if (lista.fisicos[logico] == 0 || ler_bloco(fd, lista.fisicos[logico], bloco, BLOCO_DIRETORIO) != 0) continue;
+            for (uint32_t offset = 0; offset + offsetof(struct ext2_dir_entry_2, name) <= BLOCK_SIZE; ) {
+                struct ext2_dir_entry_2 *entrada = (struct ext2_dir_entry_2 *)(bloco + offset);
+                if (entrada->rec_len == 0 || offset + entrada->rec_len > BLOCK_SIZE) break;
+                offset += entrada->rec_len;
+                if (entrada->inode == 0 || (entrada->name_len == 1 && entrada->name[0] == '.') ||
+                    (entrada->name_len == 2 && entrada->name[0] == '.' && entrada->name[1] == '.')) continue;
+                int eh_diretorio = entrada->file_type == EXT2_FT_DIR;
+                const uint32_t *achado = (const uint32_t *)bsearch(&entrada->inode, procurados, num_procurados, sizeof(uint32_t), comparar_u32);
+                if (!eh_diretorio && !achado) continue;
+                size_t tamanho = strlen(dir.caminho) + entrada->name_len + 2;
+                char *caminho = (char *)malloc(tamanho);
+                if (!caminho) continue;
+                snprintf(caminho, tamanho, "%s/%.*s", dir.caminho, entrada->name_len, entrada->name);
+                if (achado && caminhos[achado - procurados] == NULL) {
+                    caminhos[achado - procurados] = strdup(caminho);
+                    encontrados++;
+                }
+                if (!eh_diretorio) {
+                    free(caminho);
+                    continue;
+                }
+                if (fim == capacidade) {
+                    struct pendente *nova = (struct pendente *)realloc(fila, capacidade * 2 * sizeof(struct pendente));
+                    if (!nova) {
+                        free(caminho);
+                        continue;
+                    }
+                    fila = nova;
+                    capacidade *= 2;
+                }
+                fila[fim++] = (struct pendente){ entrada->inode, caminho };
+            }
+        }
+        free(dir.caminho);
+    }
+    for (size_t i = inicio; i < fim; ++i) free(fila[i].caminho);
+    free(fila);
+    free(lista.fisicos);
+    free(lista.ordem);
+}
+
+// Insere 'valor' (com a chave 'peso') entre os DUPES_MAIORES maiores de 'maiores'.
+static void dupes_classificar(uint64_t *pesos, size_t *maiores, size_t *num, uint64_t peso, size_t valor) {
+    if (*num == DUPES_MAIORES && peso <= pesos[*num - 1]) return;
+    size_t pos = *num < DUPES_MAIORES ? (*num)++ : *num - 1;
+    while (pos > 0 && pesos[pos - 1] < peso) {
+        pesos[pos] = pesos[pos - 1];
+        maiores[pos] = maiores[pos - 1];
+        pos--;
+    }
+    pesos[pos] = peso;
+    maiores[pos] = valor;
+}
+
+static const char *dupes_caminho(const uint32_t *procurados, size_t num, char **caminhos, uint32_t inode) {
+    const uint32_t *achado = (const uint32_t *)bsearch(&inode, procurados, num, sizeof(uint32_t), comparar_u32);
+    return achado && caminhos[achado - procurados] ? caminhos[achado - procurados] : NULL;
+}
+
+// Implementa 'dupes': blocos e arquivos com conteúdo repetido, o espaço que uma
+// deduplicação economizaria e os maiores conjuntos de cada tipo. Retorna 0 ou 1 em erro.
+int comando_dupes(int fd, const struct ext2_super_block *sb, const struct ext2_group_desc *bgdt) {
+    struct analise_dupes a = { fd, sb, bgdt, NULL, 0, 0, 0, 0 };
+    static const unsigned char zeros[BLOCK_SIZE_MAX];
+    a.hash_zeros = dupes_hash(zeros, BLOCK_SIZE);
+    uint64_t inicio = relogio_ns();
+    if (percorrer_inodes(fd, sb, bgdt, dupes_listar_arquivo, &a) != 0) {
+        fprintf(erros_comando(), "dupes: erro ao percorrer as tabelas de inodes\n");
+        free(a.arquivos);
+        return 1;
+    }
+
+    long processadores = sysconf(_SC_NPROCESSORS_ONLN);
+    int num_trabalhadores = processadores < 1 ? 1 : processadores > DUPES_MAX_TRABALHADORES ? DUPES_MAX_TRABALHADORES : (int)processadores;
+    struct trabalhador_dupes trabalhadores[DUPES_MAX_TRABALHADORES];
+    pthread_t threads[DUPES_MAX_TRABALHADORES];
+    memset(trabalhadores, 0, sizeof(trabalhadores));
+    for (int i = 0; i < num_trabalhadores; ++i) {
+        trabalhadores[i].motor = motor_atual;
+        trabalhadores[i].a = &a;
+    }
+    int criadas = 0;
+    if (num_trabalhadores > 1) {
+        for (; criadas < num_trabalhadores; ++criadas) {
+            if (pthread_create(&threads[criadas], NULL, dupes_trabalhador, &trabalhadores[criadas]) != 0) break;
+        }
+    }
+    if (criadas == 0) dupes_trabalhador(&trabalhadores[0]);
+    for (int i = 0; i < criadas; ++i) pthread_join(threads[i], NULL);
+
+    // Soma as tabelas das threads na primeira.
+    struct tabela_blocos *tabela = &trabalhadores[0].tabela;
+    uint64_t blocos = 0, zerados = 0;
+    int erro = 0;
+    for (int i = 0; i < num_trabalhadores; ++i) {
+        struct trabalhador_dupes *t = &trabalhadores[i];
+        blocos += t->blocos;
+        zerados += t->zerados;
+        if (t->erro) erro = 1;
+        if (criadas > 0) {
+            contadores_es.leituras += t->es.leituras;
+            contadores_es.bytes_lidos += t->es.bytes_lidos;
+            ESTAT(estat_somar_blocos_lidos(t->blocos_lidos));
+        }
+        if (i == 0) continue;
+        for (size_t k = 0; k < t->tabela.capacidade && !erro; ++k) {
+            const struct bloco_unico *b = &t->tabela.itens[k];
+            if (b->hash != 0 && tabela_blocos_inserir(tabela, b->hash, b->copias, b->inode) != 0) erro = 1;
+        }
+        free(t->tabela.itens);
+    }
+    double ms = (relogio_ns() - inicio) / 1e6;
+    if (erro) {
+        free(tabela->itens);
+        free(a.arquivos);
+        return 1;
+    }
+
+    // Maiores conjuntos de blocos (pelo número de cópias) e de arquivos (pelo espaço repetido).
+    uint64_t pesos_blocos[DUPES_MAIORES], pesos_arquivos[DUPES_MAIORES];
+    size_t maiores_blocos[DUPES_MAIORES], maiores_arquivos[DUPES_MAIORES];
+    size_t num_maiores_blocos = 0, num_maiores_arquivos = 0;
+    // Conteúdos repetidos com o mesmo número de cópias e o mesmo arquivo de exemplo (como os
+    // blocos de um arquivo copiado inteiro) formam um conjunto só.
+    struct conjunto_blocos *conjuntos = NULL;
+    size_t num_conjuntos = 0;
+    for (size_t k = 0; k < tabela->capacidade; ++k) num_conjuntos += tabela->itens[k].copias > 1;
+    if (num_conjuntos > 0 && !(conjuntos = (struct conjunto_blocos *)malloc(num_conjuntos * sizeof(struct conjunto_blocos)))) {
+        perror("dupes: Erro ao alocar os conjuntos de blocos");
+        num_conjuntos = 0;
+    }
+    num_conjuntos = 0;
+    for (size_t k = 0; conjuntos && k < tabela->capacidade; ++k) {
+        const struct bloco_unico *b = &tabela->itens[k];
+        if (b->copias > 1) conjuntos[num_conjuntos++] = (struct conjunto_blocos){ b->copias, b->inode, 1, b->hash == a.hash_zeros };
+    }
+    qsort(conjuntos, num_conjuntos, sizeof(struct conjunto_blocos), comparar_conjuntos_blocos);
+    size_t agrupados = 0;
+    for (size_t i = 0; i < num_conjuntos; ++i) {
+        struct conjunto_blocos *c = &conjuntos[i];
+        if (agrupados > 0 && !c->zerado && !conjuntos[agrupados - 1].zerado &&
+            c->copias == conjuntos[agrupados - 1].copias && c->inode == conjuntos[agrupados - 1].inode) {
+            conjuntos[agrupados - 1].conteudos++;
+        } else {
+            conjuntos[agrupados++] = *c;
+        }
+    }
+    for (size_t i = 0; i < agrupados; ++i) {
+        dupes_classificar(pesos_blocos, maiores_blocos, &num_maiores_blocos,
+                          (uint64_t)(conjuntos[i].copias - 1) * conjuntos[i].conteudos, i);
+    }
+    qsort(a.arquivos, a.num_arquivos, sizeof(struct arquivo_dupes), comparar_arquivos_dupes);
+    uint64_t arquivos_repetidos = 0, conjuntos_arquivos = 0, bytes_arquivos = 0;
+    for (size_t i = 0; i < a.num_arquivos; ) {
+        size_t n = 1;
+        while (i + n < a.num_arquivos && a.arquivos[i + n].hash == a.arquivos[i].hash &&
+               a.arquivos[i + n].tamanho == a.arquivos[i].tamanho) n++;
+        if (n > 1) {
+            conjuntos_arquivos++;
+            arquivos_repetidos += n - 1;
+            bytes_arquivos += (uint64_t)(n - 1) * a.arquivos[i].tamanho;
+            dupes_classificar(pesos_arquivos, maiores_arquivos, &num_maiores_arquivos, (uint64_t)(n - 1) * a.arquivos[i].tamanho, i);
+        }
+        i += n;
+    }
+
+    // Caminhos dos arquivos listados.
+    uint32_t procurados[DUPES_MAIORES * (DUPES_CAMINHOS_POR_CONJUNTO + 1)];
+    size_t num_procurados = 0;
+    for (size_t i = 0; i < num_maiores_blocos; ++i) procurados[num_procurados++] = conjuntos[maiores_blocos[i]].inode;
+    for (size_t i = 0; i < num_maiores_arquivos; ++i) {
+        for (size_t k = 0; k < DUPES_CAMINHOS_POR_CONJUNTO && maiores_arquivos[i] + k < a.num_arquivos; ++k) {
+            const struct arquivo_dupes *arquivo = &a.arquivos[maiores_arquivos[i] + k];
+            if (k > 0 && (arquivo->hash != arquivo[-1].hash || arquivo->tamanho != arquivo[-1].tamanho)) break;
+            procurados[num_procurados++] = arquivo->inode;
+        }
+    }
+    qsort(procurados, num_procurados, sizeof(uint32_t), comparar_u32);
+    size_t distintos = 0;
+    for (size_t i = 0; i < num_procurados; ++i) {
+        if (distintos == 0 || procurados[i] != procurados[distintos - 1]) procurados[distintos++] = procurados[i];
+    }
+    num_procurados = distintos;
+    char *caminhos[DUPES_MAIORES * (DUPES_CAMINHOS_POR_CONJUNTO + 1)] = { NULL };
+    dupes_caminhos(fd, sb, bgdt, procurados, num_procurados, caminhos);
+
+    FILE *saida = saida_comando();
+    double mib = 1024.0 * 1024.0;
+    uint64_t repetidos = blocos - tabela->usados;
+    fprintf(saida, "dupes: %zu arquivos, %llu blocos de dados (%.1f MiB) lidos em %.1f ms (%.0f MiB/s, threads: %d)\n",
+            a.num_arquivos, (unsigned long long)blocos, (double)(blocos << motor_atual->geometria.log_bloco) / mib, ms,
+            ms > 0 ? (double)(blocos << motor_atual->geometria.log_bloco) / mib / (ms / 1000.0) : 0.0, criadas > 0 ? criadas : 1);
+    fprintf(saida, "blocos: %zu distintos, %llu repetidos (%.1f%%), %llu zerados; economia possível: %.1f MiB\n",
+            tabela->usados, (unsigned long long)repetidos, blocos ? 100.0 * repetidos / blocos : 0.0,
+            (unsigned long long)zerados, (double)(repetidos << motor_atual->geometria.log_bloco) / mib);
+    fprintf(saida, "arquivos: %llu cópias em %llu conjuntos de arquivos iguais; economia possível: %.1f MiB\n",
+            (unsigned long long)arquivos_repetidos, (unsigned long long)conjuntos_arquivos, (double)bytes_arquivos / mib);
+
+    if (num_maiores_blocos > 0) fprintf(saida, "\nMaiores conjuntos de blocos repetidos:\n  cópias conteúdos   economia  exemplo\n");
+    for (size_t i = 0; i < num_maiores_blocos; ++i) {
+        const struct conjunto_blocos *c = &conjuntos[maiores_blocos[i]];
+        const char *caminho = dupes_caminho(procurados, num_procurados, caminhos, c->inode);
+        char kib[32];
+        snprintf(kib, sizeof(kib), "%llu KiB", (unsigned long long)((pesos_blocos[i] << motor_atual->geometria.log_bloco) >> 10));
+        fprintf(saida, "%8u %9u %10s  %s%s (inode %u)\n", c->copias, c->conteudos, kib, caminho ? caminho : "?",
+                c->zerado ? " [zerado]" : "", c->inode);
+    }
+    if (num_maiores_arquivos > 0) fprintf(saida, "\nMaiores conjuntos de arquivos iguais:\narquivos    tamanho   economia  caminhos\n");
+    for (size_t i = 0; i < num_maiores_arquivos; ++i) {
+        const struct arquivo_dupes *primeiro = &a.arquivos[maiores_arquivos[i]];
+        size_t n = 1;
+        while (maiores_arquivos[i] + n < a.num_arquivos && primeiro[n].hash == primeiro->hash && primeiro[n].tamanho == primeiro->tamanho) n++;
+        char kib[32];
+        snprintf(kib, sizeof(kib), "%llu KiB", (unsigned long long)(pesos_arquivos[i] >> 10));
+        fprintf(saida, "%8zu %10u %10s ", n, primeiro->tamanho, kib);
+        for (size_t k = 0; k < n && k < DUPES_CAMINHOS_POR_CONJUNTO; ++k) {
+            const char *caminho = dupes_caminho(procurados, num_procurados, caminhos, primeiro[k].inode);
+            if (caminho) fprintf(saida, " %s", caminho);
+            else fprintf(saida, " (inode %u)", primeiro[k].inode);
+        }
+        fprintf(saida, n > DUPES_CAMINHOS_POR_CONJUNTO ? " ...\n" : "\n");
+    }
+
+    for (size_t i = 0; i < num_procurados; ++i) free(caminhos[i]);
+    free(conjuntos);
+    free(tabela->itens);
+    free(a.arquivos);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Desfragmentação (comando 'defrag'). Cada arquivo fragmentado é copiado para sequências
+// contíguas alocadas perto do início do grupo do seu inode; os ponteiros (e os blocos
+// indiretos) são refeitos apontando para as cópias e só então os blocos antigos são
+// liberados. Tudo de um arquivo acontece em uma transação, e os blocos antigos não são
+// realocados (nem para o arquivo seguinte) antes que a liberação fique durável (ver
+// liberacao_registrar). Assim, com o journal, uma queda no meio deixa o arquivo inteiro na
+// posição antiga ou na nova; sem ele, vale o que a política de durabilidade garante. Entre
+// dois arquivos o comando cede a trava (comando_ceder), e com um limite de banda espera o
+// necessário para não passar dele, então pode rodar no modo servidor com os outros clientes.
+// ---------------------------------------------------------------------------
+
+#define DEFRAG_LOTE 256 // Blocos por leitura/escrita na cópia dos dados
+
+struct resultado_defrag {
+    uint32_t arquivos;           // Arquivos regulares examinados
+    uint32_t desfragmentados;
+    uint32_t sem_espaco;         // Fragmentados, mas sem espaço contíguo que melhorasse
+    uint64_t blocos_movidos;
+    uint64_t extensoes_antes;    // Somadas sobre os arquivos examinados
+    uint64_t extensoes_depois;
+};
+
+// Disposição nova de um arquivo: os blocos de 'destino' (na ordem) são distribuídos como o
+// ext2 faz, com cada bloco indireto logo antes dos blocos que ele aponta. Sem 'destino' só
+// conta quantos blocos a disposição usa.
+struct disposicao_arquivo {
+    const uint32_t *fisicos;  // Blocos atuais (0 = buraco, que continua buraco)
+    uint32_t num_blocos;
+    const uint32_t *destino;  // Blocos alocados, na ordem da disposição (NULL = só contar)
+    uint32_t usados;          // Blocos de 'destino' já usados
+    uint32_t *novos;          // Bloco novo de cada bloco lógico
+    uint64_t logico;
+};
+
+// Dispõe a subárvore do bloco indireto de nível 'nivel' que começa em d->logico e grava em
+// '*ponteiro' o bloco dela (0 se a subárvore só tiver buracos). Retorna 0 ou -1 em erro.
+static int dispor_indireto(int fd, struct disposicao_arquivo *d, int nivel, uint32_t *ponteiro) {
+    uint64_t cobertos = 1;
+    for (int i = 0; i < nivel; ++i) cobertos *= PONTEIROS_POR_BLOCO;
+    uint64_t fim = d->logico + cobertos < d->num_blocos ? d->logico + cobertos : d->num_blocos;
+    uint64_t l = d->logico;
+    while (l < fim && d->fisicos[l] == 0) l++;
+    if (l == fim) { // Nada nesta subárvore
+        *ponteiro = 0;
+        d->logico += cobertos;
+        return 0;
+    }
+
+    uint32_t bloco = d->destino ? d->destino[d->usados] : 0;
+    d->usados++;
+    uint32_t ponteiros[PONTEIROS_POR_BLOCO_MAX];
+    memset(ponteiros, 0, sizeof(ponteiros));
+    for (uint32_t i = 0; i < PONTEIROS_POR_BLOCO && d->logico < d->num_blocos; ++i) {
+        if (nivel > 1) {
+            if (dispor_indireto(fd, d, nivel - 1, &ponteiros[i]) != 0) return -1;
+        } else {
+            if (d->fisicos[d->logico] != 0) {
+                ponteiros[i] = d->destino ? d->destino[d->usados] : 0;
+                if (d->destino) d->novos[d->logico] = ponteiros[i];
+                d->usados++;
+            }
+            d->logico++;
+        }
+    }
+    *ponteiro = bloco;
+    if (d->destino && write_data_block(fd, bloco, (const char *)ponteiros) != 0) return -1;
+    return 0;
+}
+
+// Dispõe o arquivo inteiro, preenchendo os ponteiros de 'inode'. Retorna 0 ou -1 em erro.
+static int dispor_arquivo(int fd, struct disposicao_arquivo *d, struct ext2_inode *inode) {
+    d->usados = 0;
+    d->logico = 0;
+    for (int i = 0; i < EXT2_NDIR_BLOCKS; ++i, ++d->logico) {
+        uint32_t bloco = 0;
+        if (d->logico < d->num_blocos && d->fisicos[d->logico] != 0) {
+            bloco = d->destino ? d->destino[d->usados] : 0;
+            if (d->destino) d->novos[d->logico] = bloco;
+            d->usados++;
+        }
+        inode->i_block[i] = bloco;
+    }
+    for (int nivel = 1; nivel <= 3; ++nivel) {
+        inode->i_block[EXT2_NDIR_BLOCKS + nivel - 1] = 0;
+        if (d->logico >= d->num_blocos) continue;
+        if (dispor_indireto(fd, d, nivel, &inode->i_block[EXT2_NDIR_BLOCKS + nivel - 1]) != 0) return -1;
+    }
+    return 0;
+}
+
+// Desfragmenta o arquivo regular 'inode_num'. Não faz nada se os dados já forem contíguos
+// ou se não houver sequências livres que reduzam o número de extensões.
+// Retorna 0 em sucesso (inclusive quando nada muda), -1 em erro.
+static int defrag_arquivo(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt,
+                          uint32_t inode_num, struct resultado_defrag *r) {
+    struct ext2_inode inode;
+    if (read_inode(fd, sb, bgdt, inode_num, &inode) != 0) return -1;
+    if (!S_ISREG(inode.i_mode) || inode.i_links_count == 0) return 0; // Removido enquanto o comando cedia a trava
+    r->arquivos++;
+
+    uint32_t num_blocos = (inode.i_size + BLOCK_SIZE - 1) >> motor_atual->geometria.log_bloco;
+    if (num_blocos == 0) return 0;
+    uint32_t *fisicos = (uint32_t *)malloc((size_t)num_blocos * sizeof(uint32_t));
+    uint32_t *novos = (uint32_t *)calloc(num_blocos, sizeof(uint32_t));
+    uint32_t *destino = (uint32_t *)malloc((size_t)blocos_com_indiretos_max(num_blocos) * sizeof(uint32_t));
+    char *buffer = (char *)malloc((size_t)DEFRAG_LOTE * BLOCK_SIZE);
+    int resultado = 0;
+    if (!fisicos || !novos || !destino || !buffer) {
+        perror("defrag: Erro ao alocar memória");
+        resultado = -1;
+        goto fim;
+    }
+    // As extensões são contadas na ordem do ext2, com os blocos indiretos: um arquivo cujos
+    // indiretos ficam entre os dados que apontam, como o defrag os deixa, é contíguo.
+    uint32_t tamanho_ordem;
+    if (listar_blocos_arquivo(fd, &inode, fisicos, num_blocos, destino, &tamanho_ordem, NULL) != 0) {
+        fprintf(erros_comando(), "defrag: erro ao ler os blocos do inode %u\n", inode_num);
+        resultado = -1;
+        goto fim;
+    }
+    uint32_t extensoes = contar_extensoes(destino, tamanho_ordem);
+    r->extensoes_antes += extensoes;
+    if (extensoes <= 1) {
+        r->extensoes_depois += extensoes;
+        goto fim;
+    }
+
+    // 1. Quantos blocos (dados e indiretos) a disposição nova usa.
+    struct disposicao_arquivo d = { fisicos, num_blocos, NULL, 0, novos, 0 };
+    struct ext2_inode novo = inode;
+    dispor_arquivo(fd, &d, &novo);
+    uint32_t total = d.usados;
+
+    // 2. Destino: sequências contíguas (as maiores que houver, como em anexar_ao_arquivo)
+    // a partir do início do grupo do inode. Se não der menos extensões que hoje, desiste.
+    uint32_t alocados = 0, sequencias = 0;
+    uint32_t objetivo = grupo_do_inode(inode_num, NULL) * sb->s_blocks_per_group + sb->s_first_data_block;
+    while (alocados < total && sequencias < extensoes - 1) {
+        uint32_t pedido = total - alocados;
+        if (pedido > sb->s_blocks_per_group) pedido = sb->s_blocks_per_group;
+        uint32_t inicio = 0;
+        while (pedido > 0 && (inicio = allocate_data_blocks_near(fd, sb, bgdt, objetivo, pedido)) == 0) pedido /= 2;
+        if (inicio == 0) break;
+        for (uint32_t i = 0; i < pedido; ++i) destino[alocados++] = inicio + i;
+        sequencias++;
+        objetivo = inicio + pedido;
+    }
+    if (alocados < total) {
+        for (uint32_t i = 0; i < alocados; ++i) deallocate_data_block(fd, sb, bgdt, destino[i]);
+        r->sem_espaco++;
+        r->extensoes_depois += extensoes;
+        goto fim;
+    }
+
+    // 3. Grava os blocos indiretos novos e monta os ponteiros em uma cópia do inode.
+    d.destino = destino;
+    if (dispor_arquivo(fd, &d, &novo) != 0) resultado = -1;
+
+    // 4. Copia os dados, com uma leitura e uma escrita por trecho contíguo na origem e no destino.
+    for (uint32_t i = 0; i < num_blocos && resultado == 0; ) {
+        if (fisicos[i] == 0) { i++; continue; }
+        uint32_t n = 1;
+        while (n < DEFRAG_LOTE && i + n < num_blocos && fisicos[i + n] == fisicos[i] + n && novos[i + n] == novos[i] + n) n++;
+        size_t bytes = (size_t)n << motor_atual->geometria.log_bloco;
+        if (dev_pread(fd, buffer, bytes, offset_do_bloco(fisicos[i])) != (ssize_t)bytes ||
+            dev_pwrite_dados(fd, buffer, bytes, offset_do_bloco(novos[i])) != (ssize_t)bytes) {
+            fprintf(erros_comando(), "defrag: erro ao copiar os blocos %u-%u do inode %u\n", fisicos[i], fisicos[i] + n - 1, inode_num);
+            resultado = -1;
+        }
+        i += n;
+    }
+
+    // 5. Grava o inode com os ponteiros novos e libera os blocos antigos (dados e indiretos),
+    // que só voltam a ser alocáveis quando a troca do inode estiver durável.
+    novo.i_blocks = total * (BLOCK_SIZE / 512);
+    novo.i_ctime = time(NULL);
+    if (resultado == 0 && write_inode_table_entry(fd, sb, bgdt, inode_num, &novo) != 0) resultado = -1;
+    if (resultado != 0) { // O arquivo continua nos blocos antigos
+        for (uint32_t i = 0; i < total; ++i) deallocate_data_block(fd, sb, bgdt, destino[i]);
+        goto fim;
+    }
+    liberar_blocos_arquivo(fd, sb, bgdt, &inode);
+    r->extensoes_depois += contar_extensoes(destino, total);
+    r->desfragmentados++;
+    r->blocos_movidos += total;
+
+fim:
+    free(fisicos);
+    free(novos);
+    free(destino);
+    free(buffer);
+    return resultado;
+}
+
+// Acrescenta à lista os arquivos regulares da árvore do diretório 'raiz' (percorrida com
+// uma pilha de diretórios). Retorna 0 em sucesso, -1 em erro.
+static int defrag_listar_arvore(int fd, const struct ext2_super_block *sb, const struct ext2_group_desc *bgdt,
+                                uint32_t raiz, uint32_t **arquivos, uint32_t *num, uint32_t *cap) {
+    uint32_t *pilha = (uint32_t *)malloc(64 * sizeof(uint32_t));
+    uint32_t topo = 0, cap_pilha = 64;
+    if (!pilha) return -1;
+    pilha[topo++] = raiz;
+    char bloco[BLOCK_SIZE_MAX];
+    int resultado = 0;
+
+    while (topo > 0 && resultado == 0) {
+        uint32_t dir_num = pilha[--topo];
+        struct ext2_inode dir;
+        if (read_inode(fd, sb, bgdt, dir_num, &dir) != 0 || !S_ISDIR(dir.i_mode)) continue;
+        uint32_t num_blocos = (dir.i_size + BLOCK_SIZE - 1) >> motor_atual->geometria.log_bloco;
+        for (uint32_t logico = 0; logico < num_blocos && resultado == 0; ++logico) {
+            uint32_t fisico = bmap_ler(fd, &dir, logico);
+            if (fisico == 0 || ler_bloco(fd, fisico, bloco, BLOCO_DIRETORIO) != 0) continue;
+            for (uint32_t offset = 0; offset + offsetof(struct ext2_dir_entry_2, name) <= BLOCK_SIZE; ) {
+                struct ext2_dir_entry_2 *entrada = (struct ext2_dir_entry_2 *)(bloco + offset);
+                if (entrada->rec_len == 0 || offset + entrada->rec_len > BLOCK_SIZE) break;
+                offset += entrada->rec_len;
+                if (entrada->inode == 0) continue;
+                int ponto = (entrada->name_len == 1 && entrada->name[0] == '.') ||
+                            (entrada->name_len == 2 && entrada->name[0] == '.' && entrada->name[1] == '.');
+                uint32_t **lista = NULL;
+                uint32_t *tamanho = NULL, *capacidade = NULL;
+                if (entrada->file_type == EXT2_FT_REG_FILE) {
+                    lista = arquivos; tamanho = num; capacidade = cap;
+                } else if (entrada->file_type == EXT2_FT_DIR && !ponto) {
+                    lista = &pilha; tamanho = &topo; capacidade = &cap_pilha;
+                } else {
+                    continue;
+                }
+                if (*tamanho == *capacidade) {
+                    uint32_t nova_cap = *capacidade ? *capacidade * 2 : 64;
+                    uint32_t *nova = (uint32_t *)realloc(*lista, nova_cap * sizeof(uint32_t));
+                    if (!nova) {
+                        perror("defrag: Erro ao alocar memória");
+                        resultado = -1;
+                        break;
+                    }
+                    *lista = nova;
+                    *capacidade = nova_cap;
+                }
+                (*lista)[(*tamanho)++] = entrada->inode;
+            }
+        }
+    }
+    free(pilha);
+    return resultado;
+}
+
+// Implementa o comando 'defrag', que desfragmenta um arquivo ou, com 'recursivo', todos os
+// arquivos regulares da árvore de um diretório. 'limite_kib' (0 = sem limite) é a banda
+// máxima da cópia em KiB/s.
+int comando_defrag(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt,
+                   uint32_t diretorio_atual_inode_num, const char *path_alvo, int recursivo, uint32_t limite_kib) {
+    uint8_t tipo;
+    uint32_t inode_num = path_to_inode_number(fd, sb, bgdt, diretorio_atual_inode_num, path_alvo, &tipo);
+    if (inode_num == 0) {
+        fprintf(erros_comando(), "defrag: arquivo ou diretório não encontrado: %s\n", path_alvo);
+        return 1;
+    }
+    struct ext2_inode inode;
+    if (read_inode(fd, sb, bgdt, inode_num, &inode) != 0) {
+        fprintf(erros_comando(), "defrag: erro ao ler o inode %u\n", inode_num);
+        return 1;
+    }
+
+    uint32_t *arquivos = NULL, num = 0, cap = 0;
+    if (S_ISDIR(inode.i_mode)) {
+        if (!recursivo) {
+            fprintf(erros_comando(), "defrag: '%s' é um diretório (use -r)\n", path_alvo);
+            return 1;
+        }
+        if (defrag_listar_arvore(fd, sb, bgdt, inode_num, &arquivos, &num, &cap) != 0) {
+            free(arquivos);
+            return 1;
+        }
+    } else if (S_ISREG(inode.i_mode)) {
+        arquivos = (uint32_t *)malloc(sizeof(uint32_t));
+        if (!arquivos) {
+            perror("defrag: Erro ao alocar memória");
+            return 1;
+        }
+        arquivos[num++] = inode_num;
+    } else {
+        fprintf(erros_comando(), "defrag: '%s' não é um arquivo regular nem um diretório\n", path_alvo);
+        return 1;
+    }
+
+    struct resultado_defrag r;
+    memset(&r, 0, sizeof(r));
+    uint64_t inicio = relogio_ns();
+    int erros = 0;
+    for (uint32_t i = 0; i < num; ++i) {
+        if (defrag_arquivo(fd, sb, bgdt, arquivos[i], &r) != 0) erros++;
+        if (i + 1 == num) break;
+
+        // Cede a trava entre dois arquivos; com limite, espera até a média voltar a ele.
+        uint64_t pausa = 0;
+        if (limite_kib > 0) {
+            uint64_t previsto = r.blocos_movidos * BLOCK_SIZE * 1000000000ull / ((uint64_t)limite_kib * 1024);
+            uint64_t decorrido = relogio_ns() - inicio;
+            if (previsto > decorrido) pausa = previsto - decorrido;
+        }
+        if (comando_ceder(fd, pausa) != 0) erros++;
+    }
+    free(arquivos);
+
+    fprintf(saida_comando(), "defrag: %s: %u arquivos, %u desfragmentados, %u sem espaço contíguo, "
+            "%llu blocos movidos, extensões %llu -> %llu\n",
+            path_alvo, r.arquivos, r.desfragmentados, r.sem_espaco, (unsigned long long)r.blocos_movidos,
+            (unsigned long long)r.extensoes_antes, (unsigned long long)r.extensoes_depois);
+    return erros ? 1 : 0;
+}
+
+// ---------------------------------------------------------------------------
+// Órfãos: arquivos removidos cujos blocos ainda não foram liberados. O 'rm' de um arquivo
+// grande só remove a entrada e põe o inode (sem links) na lista de órfãos do superbloco,
+// como o ext3: s_last_orphan aponta para o primeiro e o i_dtime de cada órfão guarda o
+// número do seguinte. Uma thread recolhe os blocos do primeiro órfão em lotes de
+// ORFAOS_LOTE_BLOCOS, cada lote uma transação com a trava exclusiva, do fim do arquivo
+// para o início; quando o arquivo fica vazio, ele sai da lista e o inode é liberado. Os
+// órfãos que sobraram (a sessão terminou antes) são recolhidos ao abrir a imagem.
+// ---------------------------------------------------------------------------
+
+#define ORFAOS_LIMIAR_BLOCOS 256  // Arquivos com mais blocos do que isto viram órfãos no 'rm'
+#define ORFAOS_LOTE_BLOCOS  8192  // Blocos lógicos liberados por transação
+
+// Põe o inode 'inode_num' (já sem links e sem entrada em diretório) no início da lista de
+// órfãos e grava o inode e o superbloco. Retorna 0 em sucesso, -1 em erro.
+int orfao_adicionar(int fd, struct ext2_super_block *sb, const struct ext2_group_desc *bgdt,
+                    uint32_t inode_num, struct ext2_inode *inode) {
+    inode->i_links_count = 0;
+    inode->i_dtime = sb->s_last_orphan;
+    if (write_inode_table_entry(fd, sb, bgdt, inode_num, inode) != 0) return -1;
+    sb->s_last_orphan = inode_num;
+    return write_superblock(fd, sb);
+}
+
+// Recolhe até ORFAOS_LOTE_BLOCOS blocos lógicos do primeiro órfão; se ele ficar vazio, tira-o
+// da lista e libera o inode. Deve rodar dentro de uma transação, com a trava exclusiva.
+// Retorna 1 se ainda há órfãos, 0 se a lista ficou vazia, -1 em erro (a lista é descartada
+// se estiver corrompida).
+int orfaos_recolher_lote(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt) {
+    uint32_t inode_num = sb->s_last_orphan;
+    if (inode_num == 0) return 0;
+    uint32_t primeiro = sb->s_rev_level >= EXT2_DYNAMIC_REV ? sb->s_first_ino : 11;
+    struct ext2_inode inode;
+    if (inode_num < primeiro || inode_num > sb->s_inodes_count ||
+        read_inode(fd, sb, bgdt, inode_num, &inode) != 0 || inode.i_links_count != 0 ||
+        (inode.i_dtime != 0 && (inode.i_dtime < primeiro || inode.i_dtime > sb->s_inodes_count))) {
+        fprintf(erros_comando(), "órfãos: inode %u inválido na lista; a lista foi descartada\n", inode_num);
+        sb->s_last_orphan = 0;
+        write_superblock(fd, sb);
+        return -1;
+    }
+
+    uint32_t num_blocos = (inode.i_size + BLOCK_SIZE - 1) >> motor_atual->geometria.log_bloco;
+    uint32_t corte = num_blocos > ORFAOS_LOTE_BLOCOS ? num_blocos - ORFAOS_LOTE_BLOCOS : 0;
+    int resultado = truncar_arquivo(fd, sb, bgdt, &inode, corte);
+    if (corte > 0) {
+        if (write_inode_table_entry(fd, sb, bgdt, inode_num, &inode) != 0) resultado = -1;
+        return resultado == 0 ? 1 : -1;
+    }
+
+    // Sem blocos: o próximo órfão passa a ser o primeiro e o inode é liberado.
+    sb->s_last_orphan = inode.i_dtime;
+    inode.i_dtime = (uint32_t)time(NULL);
+    if (write_inode_table_entry(fd, sb, bgdt, inode_num, &inode) != 0) resultado = -1;
+    if (write_superblock(fd, sb) != 0) resultado = -1;
+    uint32_t lista[1] = { inode_num };
+    if (liberar_inodes_lote(fd, sb, bgdt, lista, 1) != 0) resultado = -1;
+    if (resultado != 0) return -1;
+    return sb->s_last_orphan != 0;
+}
+
+// Recolhe todos os órfãos (ao abrir a imagem, antes dos comandos), um lote por transação.
+// Retorna o número de arquivos recolhidos ou -1 em erro.
+int orfaos_concluir(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt) {
+    int arquivos = 0;
+    uint32_t anterior = sb->s_last_orphan;
+    while (sb->s_last_orphan != 0) {
+        transacao_iniciar();
+        int restam = orfaos_recolher_lote(fd, sb, bgdt);
+        if (transacao_confirmar(fd) != 0 || restam < 0) return -1;
+        if (sb->s_last_orphan != anterior) {
+            arquivos++;
+            anterior = sb->s_last_orphan;
+        }
+    }
+    return arquivos;
+}
+
+static void *recolhedor_thread(void *argumento) {
+    motor_atual = (struct motor *)argumento;
+    struct recolhedor *r = &motor_atual->recolhedor;
+    pthread_mutex_lock(&r->mutex);
+    while (!r->parar) {
+        if (!r->pendente) {
+            pthread_cond_wait(&r->cond, &r->mutex);
+            continue;
+        }
+        pthread_mutex_unlock(&r->mutex);
+
+        // Um lote por vez; entre dois lotes a trava fica livre para os comandos.
+        int restam = 1;
+        durabilidade_bloquear();
+        int em_lote = motor_atual->transacao_atual.aninhamento > 0; // Não entra em um lote aberto com 'begin'
+        if (!em_lote) {
+            transacao_iniciar();
+            restam = orfaos_recolher_lote(r->fd, r->sb, r->bgdt);
+            transacao_confirmar(r->fd);
+            durabilidade_apos_comando(r->fd);
+            if (restam < 0) restam = r->sb->s_last_orphan != 0;
+        }
+        durabilidade_desbloquear();
+
+        pthread_mutex_lock(&r->mutex);
+        if (!restam) {
+            r->pendente = 0;
+        } else if (em_lote) { // Espera o lote do usuário ser confirmado
+            struct timespec limite;
+            clock_gettime(CLOCK_REALTIME, &limite);
+            limite.tv_nsec += 10 * 1000000L;
+            if (limite.tv_nsec >= 1000000000L) {
+                limite.tv_sec++;
+                limite.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&r->cond, &r->mutex, &limite);
+        } else {
+            pthread_mutex_unlock(&r->mutex);
+            sched_yield(); // Dá a vez a quem espera pela trava
+            pthread_mutex_lock(&r->mutex);
+        }
+    }
+    pthread_mutex_unlock(&r->mutex);
+    return NULL;
+}
+
+// Inicia a thread que recolhe os órfãos da imagem. Retorna 0 em sucesso, -1 em erro
+// (o 'rm' então libera os blocos na hora).
+int recolhedor_iniciar(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt) {
+    struct recolhedor *r = &motor_atual->recolhedor;
+    r->fd = fd;
+    r->sb = sb;
+    r->bgdt = bgdt;
+    r->parar = 0;
+    r->pendente = sb->s_last_orphan != 0;
+    int erro = pthread_create(&r->thread, NULL, recolhedor_thread, motor_atual);
+    if (erro != 0) {
+        fprintf(stderr, "órfãos: Erro ao criar a thread de recolhimento: %s\n", strerror(erro));
+        return -1;
+    }
+    r->ativo = 1;
+    return 0;
+}
+
+// Avisa a thread de que há um órfão novo.
+static void recolhedor_acordar(void) {
+    pthread_mutex_lock(&motor_atual->recolhedor.mutex);
+    motor_atual->recolhedor.pendente = 1;
+    pthread_cond_signal(&motor_atual->recolhedor.cond);
+    pthread_mutex_unlock(&motor_atual->recolhedor.mutex);
+}
+
+// Encerra a thread depois do lote em andamento. Os órfãos restantes ficam na lista e são
+// recolhidos na próxima abertura da imagem.
+void recolhedor_encerrar(void) {
+    struct recolhedor *r = &motor_atual->recolhedor;
+    if (!r->ativo) return;
+    pthread_mutex_lock(&r->mutex);
+    r->parar = 1;
+    pthread_cond_signal(&r->cond);
+    pthread_mutex_unlock(&r->mutex);
+    pthread_join(r->thread, NULL);
+    r->ativo = 0;
+}
+
+// Implementa o comando 'rm' (remove arquivo), que deleta um arquivo regular.
+int comando_rm(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt,
+                uint32_t diretorio_atual_inode_num, const char* path_alvo) {
+
+    if (path_alvo == NULL || strlen(path_alvo) == 0) {
+        fprintf(saida_comando(), "rm: Operando faltando\n");
+        return 1;
+    }
+
+    char nome_arquivo[EXT2_NAME_LEN + 1];
+    char caminho_pai_str[1024];
+    uint32_t inode_pai_num;
+
+    // 1. Analisa o caminho alvo para separar o nome do arquivo do caminho do diretório pai.
+    const char *ultimo_slash = strrchr(path_alvo, '/');
+    if (ultimo_slash != NULL) {
+        size_t len_caminho_pai = ultimo_slash - path_alvo;
+        if (len_caminho_pai == 0) { strcpy(caminho_pai_str, "/"); }
+        else { strncpy(caminho_pai_str, path_alvo, len_caminho_pai); caminho_pai_str[len_caminho_pai] = '\0'; }
+        strncpy(nome_arquivo, ultimo_slash + 1, EXT2_NAME_LEN); nome_arquivo[EXT2_NAME_LEN] = '\0';
+    } else {
+        strcpy(caminho_pai_str, "."); 
+        strncpy(nome_arquivo, path_alvo, EXT2_NAME_LEN); nome_arquivo[EXT2_NAME_LEN] = '\0';
+    }
+    // Validações do nome do arquivo.
+    if (strlen(nome_arquivo) == 0 || strcmp(nome_arquivo, ".") == 0 || strcmp(nome_arquivo, "..") == 0) {
+        fprintf(saida_comando(), "rm: não é possível remover '%s': Nome de arquivo inválido\n", nome_arquivo);
+        return 1;
+    }
+
+    // 2. Resolve o inode do diretório pai.
+    uint8_t tipo_pai;
+    inode_pai_num = path_to_inode_number(fd, sb, bgdt, diretorio_atual_inode_num, caminho_pai_str, &tipo_pai);
+    if (inode_pai_num == 0) {
+        fprintf(saida_comando(), "rm: não foi possível remover '%s': Diretório pai '%s' não encontrado\n", path_alvo, caminho_pai_str);
+        return 1;
+    }
+    struct ext2_inode inode_pai_obj;
+    if (read_inode(fd, sb, bgdt, inode_pai_num, &inode_pai_obj) != 0 || !S_ISDIR(inode_pai_obj.i_mode)) {
+        fprintf(saida_comando(), "rm: não foi possível remover '%s': Caminho pai '%s' não é um diretório\n", path_alvo, caminho_pai_str);
+        return 1;
+    }
+
+    // 3. Resolve o inode do arquivo a ser removido.
+    uint32_t arquivo_inode_num = dir_lookup(fd, sb, bgdt, inode_pai_num, nome_arquivo, NULL);
+    if (arquivo_inode_num == 0) {
+        fprintf(saida_comando(), "rm: não foi possível remover '%s': Arquivo ou diretório não encontrado\n", path_alvo);
+        return 1;
+    }
+
+    // 4. Lê o inode do arquivo.
+    struct ext2_inode arquivo_inode_obj;
+    if (read_inode(fd, sb, bgdt, arquivo_inode_num, &arquivo_inode_obj) != 0) {
+        fprintf(saida_comando(), "rm: erro ao ler inode %u para '%s'\n", arquivo_inode_num, path_alvo);
+        return 1;
+    }
+
+    // 5. Verifica se é um arquivo regular (o 'rm' padrão não remove diretórios sem flag -r).
+    if (S_ISDIR(arquivo_inode_obj.i_mode)) {
+        fprintf(saida_comando(), "rm: não é possível remover '%s': É um diretório (use rm -r)\n", path_alvo);
+        return 1;
+    }
+    if (!S_ISREG(arquivo_inode_obj.i_mode)) {
+         fprintf(saida_comando(), "rm: não é possível remover '%s': Não é um arquivo regular\n", path_alvo);
+        return 1;
+    }
+
+    // 6. Remove a entrada do diretório pai (e grava o bloco e o inode do pai).
+    int removida = dir_remover_nome(fd, sb, bgdt, inode_pai_num, &inode_pai_obj, nome_arquivo, NULL);
+    if (removida != 0) {
+        fprintf(saida_comando(), "rm: erro ao remover a entrada '%s' do diretório pai.\n", nome_arquivo);
+        return 1;
+    }
+
+    // 7. Decrementa o link count do inode do arquivo.
+    arquivo_inode_obj.i_links_count--; 
+
+    // 8. Se o link count for 0, libera os blocos de dados do arquivo e o próprio inode.
+    if (arquivo_inode_obj.i_links_count == 0 && motor_atual->recolhedor.ativo &&
+        (arquivo_inode_obj.i_blocks >> (motor_atual->geometria.log_bloco - 9)) > ORFAOS_LIMIAR_BLOCOS) {
+        // Arquivo grande: os blocos são liberados em segundo plano (ver "Órfãos").
+        if (orfao_adicionar(fd, sb, bgdt, arquivo_inode_num, &arquivo_inode_obj) != 0) {
+            fprintf(saida_comando(), "rm: erro ao atualizar inode %u.\n", arquivo_inode_num);
+            return 1;
+        }
+        recolhedor_acordar();
+        fprintf(saida_comando(), "rm: '%s' removido\n", path_alvo);
+    } else if (arquivo_inode_obj.i_links_count == 0) {
+        // Libera os blocos de dados e os blocos indiretos (simples, duplo e triplo).
+        liberar_blocos_arquivo(fd, sb, bgdt, &arquivo_inode_obj);
+        arquivo_inode_obj.i_dtime = time(NULL); // Define o tempo de deleção
+        if (write_inode_table_entry(fd, sb, bgdt, arquivo_inode_num, &arquivo_inode_obj) != 0) {
+            fprintf(saida_comando(), "rm: erro ao atualizar inode %u.\n", arquivo_inode_num);
+        }
+
+        // 9. Libera o inode do arquivo.
+        deallocate_inode(fd, sb, bgdt, arquivo_inode_num);
+        fprintf(saida_comando(), "rm: '%s' removido\n", path_alvo);
+    } else {
+        if (write_inode_table_entry(fd, sb, bgdt, arquivo_inode_num, &arquivo_inode_obj) != 0) {
+            fprintf(saida_comando(), "rm: erro ao atualizar inode %u.\n", arquivo_inode_num);
+        }
+        fprintf(saida_comando(), "rm: '%s' (links restantes: %u) - apenas entrada de diretório removida\n", path_alvo, arquivo_inode_obj.i_links_count);
+    }
+    return 0;
+}
+
+// Implementa 'rm -r': remove 'path_alvo' e, se for um diretório, toda a sua subárvore.
+// Os diretórios são percorridos uma vez para coletar os inodes da subárvore; depois os
+// inodes são ordenados, cada bloco da tabela de inodes envolvido é lido e gravado uma vez,
+// e os blocos e inodes são liberados em lote, com uma escrita por bitmap afetado (os
+// arquivos grandes vão para a lista de órfãos, como no 'rm').
+int comando_rm_recursivo(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt,
+                         uint32_t diretorio_atual_inode_num, const char *path_alvo) {
+    if (path_alvo == NULL || path_alvo[0] == '\0') {
+        fprintf(erros_comando(), "rm: Operando faltando\n");
+        return 1;
+    }
+
+    // Separa o caminho do pai e o nome.
+    char caminho_pai[1024];
+    const char *nome = path_alvo;
+    const char *ultima_barra = strrchr(path_alvo, '/');
+    if (ultima_barra == NULL) {
+        strcpy(caminho_pai, ".");
+    } else {
+        size_t tamanho = (size_t)(ultima_barra - path_alvo);
+        if (tamanho >= sizeof(caminho_pai)) tamanho = sizeof(caminho_pai) - 1;
+        if (tamanho == 0) strcpy(caminho_pai, "/");
+        else { memcpy(caminho_pai, path_alvo, tamanho); caminho_pai[tamanho] = '\0'; }
+        nome = ultima_barra + 1;
+    }
+    if (nome[0] == '\0' || strcmp(nome, ".") == 0 || strcmp(nome, "..") == 0 || strlen(nome) > EXT2_NAME_LEN) {
+        fprintf(erros_comando(), "rm: não é possível remover '%s': Nome inválido\n", path_alvo);
+        return 1;
+    }
+
+    uint8_t tipo_pai;
+    uint32_t pai_num = path_to_inode_number(fd, sb, bgdt, diretorio_atual_inode_num, caminho_pai, &tipo_pai);
+    struct ext2_inode pai;
+    if (pai_num == 0 || read_inode(fd, sb, bgdt, pai_num, &pai) != 0 || !S_ISDIR(pai.i_mode)) {
+        fprintf(erros_comando(), "rm: não foi possível remover '%s': Diretório pai '%s' não encontrado\n", path_alvo, caminho_pai);
+        return 1;
+    }
+    uint32_t alvo_num = dir_lookup(fd, sb, bgdt, pai_num, nome, NULL);
+    struct ext2_inode alvo;
+    if (alvo_num == 0 || read_inode(fd, sb, bgdt, alvo_num, &alvo) != 0) {
+        fprintf(erros_comando(), "rm: não foi possível remover '%s': Arquivo ou diretório não encontrado\n", path_alvo);
+        return 1;
+    }
+    if (!S_ISDIR(alvo.i_mode)) return comando_rm(fd, sb, bgdt, diretorio_atual_inode_num, path_alvo);
+
+    // 1. Percorre a subárvore e coleta um número de inode por entrada (um inode com links
+    //    dentro da subárvore aparece uma vez por link).
+    struct vetor_u32 inodes = { NULL, 0, 0 }, pendentes = { NULL, 0, 0 };
+    struct vetor_u32 blocos = { NULL, 0, 0 }, liberados = { NULL, 0, 0 };
+    struct buffer_blocos lista = { NULL, NULL, 0 };
+    char bloco[BLOCK_SIZE_MAX];
+    int resultado = 0;
+    if (vetor_u32_adicionar(&inodes, alvo_num) != 0 || vetor_u32_adicionar(&pendentes, alvo_num) != 0) resultado = 1;
+    while (pendentes.tamanho > 0 && resultado == 0) {
+        uint32_t dir_num = pendentes.itens[--pendentes.tamanho];
+        if (dir_num == diretorio_atual_inode_num) {
+            fprintf(erros_comando(), "rm: não é possível remover '%s': contém o diretório atual\n", path_alvo);
+            resultado = 1;
+            break;
+        }
+        struct ext2_inode dir;
+        if (read_inode(fd, sb, bgdt, dir_num, &dir) != 0) {
+            fprintf(erros_comando(), "rm: erro ao ler o inode %u\n", dir_num);
+            resultado = 1;
+            break;
+        }
+        uint32_t num_blocos = (dir.i_size + BLOCK_SIZE - 1) >> motor_atual->geometria.log_bloco;
+        if (buffer_blocos_reservar(&lista, num_blocos) != 0 ||
+            listar_blocos_arquivo(fd, &dir, lista.fisicos, num_blocos, NULL, NULL, NULL) != 0) {
+            fprintf(erros_comando(), "rm: erro ao listar os blocos do diretório %u\n", dir_num);
+            resultado = 1;
+            break;
+        }
+        for (uint32_t logico = 0; logico < num_blocos && resultado == 0; ++logico) {
+            if (lista.fisicos[logico] == 0) continue;
+            if (ler_bloco(fd, lista.fisicos[logico], bloco, BLOCO_DIRETORIO) != 0) {
+                resultado = 1;
+                break;
+            }
+            for (uint32_t offset = 0; offset + offsetof(struct ext2_dir_entry_2, name) <= BLOCK_SIZE; ) {
+                struct ext2_dir_entry_2 *entrada = (struct ext2_dir_entry_2 *)(bloco + offset);
+                if (entrada->rec_len == 0) break;
+                offset += entrada->rec_len;
+                if (entrada->inode == 0) continue;
+                if ((entrada->name_len == 1 && entrada->name[0] == '.') ||
+                    (entrada->name_len == 2 && entrada->name[0] == '.' && entrada->name[1] == '.')) continue;
+                int diretorio = entrada->file_type == EXT2_FT_DIR;
+                if (entrada->file_type == EXT2_FT_UNKNOWN) { // Sem o tipo na entrada: consulta o inode
+                    struct ext2_inode filho;
+                    if (read_inode(fd, sb, bgdt, entrada->inode, &filho) != 0) {
+                        resultado = 1;
+                        break;
+                    }
+                    diretorio = S_ISDIR(filho.i_mode);
+                }
+                if (vetor_u32_adicionar(&inodes, entrada->inode) != 0 ||
+                    (diretorio && vetor_u32_adicionar(&pendentes, entrada->inode) != 0)) {
+                    resultado = 1;
+                    break;
+                }
+            }
+        }
+    }
+    free(pendentes.itens);
+    free(lista.fisicos);
+    free(lista.ordem);
+    if (resultado != 0) {
+        free(inodes.itens);
+        return 1;
+    }
+
+    // 2. Remove a entrada do pai, que perde o link do '..' do diretório removido. Vem antes
+    //    da passada pelas tabelas de inodes para que a gravação do pai não seja sobrescrita.
+    pai.i_links_count--;
+    if (dir_remover_nome(fd, sb, bgdt, pai_num, &pai, nome, NULL) != 0) {
+        fprintf(erros_comando(), "rm: erro ao remover a entrada '%s' do diretório pai\n", nome);
+        free(inodes.itens);
+        return 1;
+    }
+
+    // 3. Em ordem de número de inode, cada bloco da tabela de inodes é lido e gravado uma vez.
+    //    Arquivos com links fora da subárvore só perdem os links removidos.
+    qsort(inodes.itens, inodes.tamanho, sizeof(uint32_t), comparar_u32);
+    char tabela[BLOCK_SIZE_MAX];
+    uint32_t bloco_tabela = 0, arquivos = 0, diretorios = 0, orfaos = 0;
+    uint64_t blocos_adiados = 0; // Dos órfãos, liberados depois pelo recolhedor
+    uint32_t agora = (uint32_t)time(NULL);
+    for (size_t i = 0; i < inodes.tamanho && resultado == 0; ) {
+        uint32_t inode_num = inodes.itens[i];
+        uint32_t referencias = 0;
+        for (; i < inodes.tamanho && inodes.itens[i] == inode_num; ++i) referencias++;
+
+        off_t offset = offset_do_inode(bgdt, inode_num);
+        uint32_t bloco_inode = (uint32_t)(offset >> motor_atual->geometria.log_bloco);
+        if (bloco_inode != bloco_tabela) {
+            if (bloco_tabela != 0 && write_data_block(fd, bloco_tabela, tabela) != 0) resultado = 1;
+            if (ler_bloco(fd, bloco_inode, tabela, BLOCO_TABELA_INODES) != 0) {
+                resultado = 1;
+                bloco_tabela = 0;
+                break;
+            }
+            bloco_tabela = bloco_inode;
+        }
+        struct ext2_inode *inode = (struct ext2_inode *)(tabela + (offset & (BLOCK_SIZE - 1)));
+        if (!S_ISDIR(inode->i_mode) && inode->i_links_count > referencias) {
+            inode->i_links_count -= referencias;
+            inode->i_ctime = agora;
+            continue;
+        }
+        if (!S_ISDIR(inode->i_mode) && motor_atual->recolhedor.ativo &&
+            (inode->i_blocks >> (motor_atual->geometria.log_bloco - 9)) > ORFAOS_LIMIAR_BLOCOS) {
+            // Arquivo grande: vai para a lista de órfãos (ver orfao_adicionar).
+            blocos_adiados += inode->i_blocks >> (motor_atual->geometria.log_bloco - 9);
+            inode->i_links_count = 0;
+            inode->i_dtime = sb->s_last_orphan;
+            sb->s_last_orphan = inode_num;
+            arquivos++;
+            orfaos++;
+            continue;
+        }
+        if (coletar_blocos_inode(fd, inode, &blocos) != 0 || vetor_u32_adicionar(&liberados, inode_num) != 0) {
+            resultado = 1;
+            break;
+        }
+        if (S_ISDIR(inode->i_mode)) {
+            diretorios++;
+            descritor_grupo(bgdt, grupo_do_inode(inode_num, NULL))->bg_used_dirs_count--;
+        } else {
+            arquivos++;
+        }
+        memset(inode->i_block, 0, sizeof(inode->i_block));
+        inode->i_blocks = 0;
+        inode->i_size = 0;
+        inode->i_links_count = 0;
+        inode->i_dtime = agora;
+    }
+    if (bloco_tabela != 0 && write_data_block(fd, bloco_tabela, tabela) != 0) resultado = 1;
+    free(inodes.itens);
+
+    // 4. Libera os blocos e os inodes, com uma escrita por bitmap afetado.
+    size_t num_blocos_liberados = blocos.tamanho;
+    if (liberar_blocos_lote(fd, sb, bgdt, blocos.itens, blocos.tamanho) != 0) resultado = 1;
+    if (liberar_inodes_lote(fd, sb, bgdt, liberados.itens, liberados.tamanho) != 0) resultado = 1;
+    free(blocos.itens);
+    free(liberados.itens);
+    if (orfaos > 0) {
+        if (write_superblock(fd, sb) != 0) resultado = 1;
+        recolhedor_acordar();
+    }
+    if (resultado != 0) {
+        fprintf(erros_comando(), "rm: erro ao remover '%s'\n", path_alvo);
+        return 1;
+    }
+    fprintf(saida_comando(), "rm: '%s' removido (%u arquivos, %u diretórios, %zu blocos liberados",
+            path_alvo, arquivos, diretorios, num_blocos_liberados);
+    if (orfaos > 0) {
+        fprintf(saida_comando(), "; %u arquivos adiados, %llu blocos a liberar em segundo plano",
+                orfaos, (unsigned long long)blocos_adiados);
+    }
+    fprintf(saida_comando(), ")\n");
+    return 0;
+}
+
+// Implementa o comando 'rmdir', que remove um diretório vazio.
+int comando_rmdir(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt,
+                  uint32_t diretorio_atual_inode_num, const char* path_alvo) {
+    if (path_alvo == NULL || path_alvo[0] == '\0') {
+        fprintf(erros_comando(), "rmdir: caminho não especificado\n");
+        return 1;
+    }
+
+    // Não permite remover "." ou "..".
+    if (strcmp(path_alvo, ".") == 0 || strcmp(path_alvo, "..") == 0) {
+        fprintf(erros_comando(), "rmdir: não é possível remover '.' ou '..'\n");
+        return 1;
+    }
+
+    // Obtém o inode do diretório a ser removido.
+    uint8_t tipo_alvo;
+    uint32_t dir_inode_num = path_to_inode_number(fd, sb, bgdt, diretorio_atual_inode_num, 
+                                                 path_alvo, &tipo_alvo);
+    
+    if (dir_inode_num == 0) {
+        fprintf(erros_comando(), "rmdir: diretório não encontrado: %s\n", path_alvo);
+        return 1;
+    }
+
+    if (tipo_alvo != EXT2_FT_DIR) { // Verifica se é realmente um diretório
+        fprintf(erros_comando(), "rmdir: '%s' não é um diretório\n", path_alvo);
+        return 1;
+    }
+
+    // Lê o inode do diretório a ser removido.
+    struct ext2_inode dir_inode;
+    if (read_inode(fd, sb, bgdt, dir_inode_num, &dir_inode) != 0) {
+        fprintf(erros_comando(), "rmdir: erro ao ler inode do diretório\n");
+        return 1;
+    }
+
+    // Verifica se o diretório está vazio (contém apenas "." e ".." em todos os blocos).
+    char dir_data[BLOCK_SIZE_MAX];
+    int entry_count = 0;
+    uint32_t num_blocos = (dir_inode.i_size + BLOCK_SIZE - 1) >> motor_atual->geometria.log_bloco;
+    for (uint32_t logico = 0; logico < num_blocos; ++logico) {
+        uint32_t fisico = bmap_ler(fd, &dir_inode, logico);
+        if (fisico == 0) continue;
+        if (ler_bloco(fd, fisico, dir_data, BLOCO_DIRETORIO) != 0) {
+            fprintf(erros_comando(), "rmdir: erro ao ler bloco de dados do diretório\n");
+            return 1;
+        }
+        size_t offset = 0;
+        while (offset < BLOCK_SIZE) {
+            struct ext2_dir_entry_2 *entry = (struct ext2_dir_entry_2 *)(dir_data + offset);
+            if (entry->rec_len == 0) break;
+            if (entry->inode != 0) {
+                entry_count++;
+                if (entry_count > 2) { // Se mais de 2 entradas (., ..), não está vazio
+                    fprintf(erros_comando(), "rmdir: diretório não está vazio\n");
+                    return 1;
+                }
+            }
+            offset += entry->rec_len;
+        }
+    }
+
+    // Obtém o inode do diretório pai e o nome do diretório a ser removido.
+    char *last_slash = strrchr(path_alvo, '/');
+    const char *dir_name;
+    char parent_path[1024];
+    uint32_t parent_inode_num;
+
+    if (last_slash == NULL) { // Caminho sem '/', o pai é o diretório atual
+        parent_inode_num = diretorio_atual_inode_num;
+        dir_name = path_alvo;
+    } else {
+        if (last_slash == path_alvo) { // Caso especial: "/nome"
+            parent_inode_num = EXT2_ROOT_INO;
+            dir_name = last_slash + 1;
+        } else {
+            strncpy(parent_path, path_alvo, last_slash - path_alvo);
+            parent_path[last_slash - path_alvo] = '\0';
+            uint8_t parent_type;
+            parent_inode_num = path_to_inode_number(fd, sb, bgdt, diretorio_atual_inode_num,
+                                                  parent_path, &parent_type);
+            dir_name = last_slash + 1;
+        }
+    }
+
+    // Lê o inode do diretório pai.
+    struct ext2_inode parent_inode;
+    if (parent_inode_num == 0 || read_inode(fd, sb, bgdt, parent_inode_num, &parent_inode) != 0) {
+        fprintf(erros_comando(), "rmdir: erro ao ler inode do diretório pai\n");
+        return 1;
+    }
+
+    // Remove a entrada do diretório no pai. O '..' do diretório removido deixa de
+    // apontar para o pai, que perde um link (gravado junto com a entrada).
+    parent_inode.i_links_count--;
+    int removida = dir_remover_nome(fd, sb, bgdt, parent_inode_num, &parent_inode, dir_name, NULL);
+    if (removida != 0) {
+        fprintf(erros_comando(), removida > 0 ? "rmdir: erro interno - entrada do diretório não encontrada\n"
+                                              : "rmdir: erro ao atualizar o diretório pai\n");
+        return 1;
+    }
+
+    // Libera os blocos do diretório removido e grava o inode como apagado.
+    liberar_blocos_arquivo(fd, sb, bgdt, &dir_inode);
+    dir_inode.i_links_count = 0;
+    dir_inode.i_dtime = time(NULL);
+    if (write_inode_table_entry(fd, sb, bgdt, dir_inode_num, &dir_inode) != 0) {
+        fprintf(erros_comando(), "rmdir: erro ao atualizar inode %u\n", dir_inode_num);
+    }
+
+    // Desaloca o inode do diretório que foi removido.
+    deallocate_inode(fd, sb, bgdt, dir_inode_num);
+
+    // Decrementa o contador de diretórios usados no grupo de blocos.
+    uint32_t group_idx = grupo_do_inode(dir_inode_num, NULL);
+    descritor_grupo(bgdt, group_idx)->bg_used_dirs_count--;
+    if (write_group_descriptor(fd, sb, group_idx, &bgdt[group_idx]) != 0) {
+        fprintf(erros_comando(), "rmdir: erro ao atualizar descritor do grupo\n");
+    }
+    fprintf(saida_comando(), "rmdir: diretório removido com sucesso: %s\n", path_alvo);
+    return 0;
+}
+
+// Ordem das entradas vivas depois de 'compact'.
+enum ordem_compactacao {
+    COMPACTAR_ORIGINAL = 0, // Mantém a ordem atual (só remove os buracos)
+    COMPACTAR_HASH,         // Pelo CRC32C do nome
+    COMPACTAR_INODE         // Pelo número do inode (stat em sequência percorre a tabela de inodes em ordem)
+};
+
+// Entrada viva de um bloco durante a compactação.
+struct entrada_compactacao {
+    uint32_t chave;
+    uint16_t offset;   // Posição no bloco original (desempate: a ordem é estável)
+    uint16_t tamanho;  // Tamanho real (cabeçalho + nome, alinhado a 4 bytes)
+};
+
+static int comparar_entradas_compactacao(const void *a, const void *b) {
+    const struct entrada_compactacao *x = (const struct entrada_compactacao *)a;
+    const struct entrada_compactacao *y = (const struct entrada_compactacao *)b;
+    if (x->chave != y->chave) return x->chave < y->chave ? -1 : 1;
+    return (int)x->offset - (int)y->offset;
+}
+
+// Reescreve em 'novo' o bloco de diretório 'bloco' com as entradas vivas lado a lado, na
+// 'ordem' pedida, e o espaço livre todo no rec_len da última. No primeiro bloco ('primeiro'),
+// "." e ".." continuam no início. '*vivas' e '*mortas' recebem as contagens de entradas.
+// Retorna 1 se a disposição das entradas mudou, 0 se não, -1 se o bloco estiver corrompido
+// (os bytes da folga de uma entrada não contam: só as posições e os rec_len).
+static int compactar_bloco_diretorio(const char *bloco, char *novo, int primeiro, enum ordem_compactacao ordem,
+                                     uint32_t *vivas, uint32_t *mortas) {
+    struct entrada_compactacao entradas[BLOCK_SIZE_MAX / 12 + 1]; // Menor entrada: 12 bytes
+    uint32_t num = 0, fixas = 0;
+    *vivas = *mortas = 0;
+
+    uint32_t offset = 0;
+    while (offset < BLOCK_SIZE) {
+        const struct ext2_dir_entry_2 *entrada = (const struct ext2_dir_entry_2 *)(bloco + offset);
+        uint32_t tamanho_real = (offsetof(struct ext2_dir_entry_2, name) + entrada->name_len + 3) & ~3u;
+        if (entrada->rec_len < tamanho_real || (entrada->rec_len & 3) != 0 || offset + entrada->rec_len > BLOCK_SIZE) {
+            return -1;
+        }
+        if (entrada->inode == 0) {
+            if (entrada->rec_len != BLOCK_SIZE) (*mortas)++; // Um bloco vazio já é uma única entrada livre
+        } else {
+            int ponto = (entrada->name_len == 1 && entrada->name[0] == '.') ||
+                        (entrada->name_len == 2 && entrada->name[0] == '.' && entrada->name[1] == '.');
+            if (primeiro && ponto && num == fixas) fixas++;
+            entradas[num].chave = ordem == COMPACTAR_HASH ? crc32c(0, entrada->name, entrada->name_len)
+                                : ordem == COMPACTAR_INODE ? entrada->inode : 0;
+            entradas[num].offset = (uint16_t)offset;
+            entradas[num].tamanho = (uint16_t)tamanho_real;
+            num++;
+        }
+        offset += entrada->rec_len;
+    }
+    if (ordem != COMPACTAR_ORIGINAL) {
+        qsort(entradas + fixas, num - fixas, sizeof(entradas[0]), comparar_entradas_compactacao);
+    }
+
+    memset(novo, 0, BLOCK_SIZE);
+    if (num == 0) { // Bloco sem entradas vivas: uma única entrada vazia cobre o bloco
+        ((struct ext2_dir_entry_2 *)novo)->rec_len = (uint16_t)BLOCK_SIZE;
+        return *mortas > 0;
+    }
+    int mudou = *mortas > 0;
+    offset = 0;
+    for (uint32_t i = 0; i < num; ++i) {
+        struct ext2_dir_entry_2 *destino = (struct ext2_dir_entry_2 *)(novo + offset);
+        memcpy(destino, bloco + entradas[i].offset, entradas[i].tamanho);
+        destino->rec_len = (uint16_t)(i + 1 < num ? entradas[i].tamanho : BLOCK_SIZE - offset);
+        const struct ext2_dir_entry_2 *original = (const struct ext2_dir_entry_2 *)(bloco + entradas[i].offset);
+        if (entradas[i].offset != offset || original->rec_len != destino->rec_len) mudou = 1;
+        offset += entradas[i].tamanho;
+    }
+    *vivas = num;
+    return mudou;
+}
+
+// Implementa o comando 'compact', que reempacota os blocos de um diretório: as entradas
+// mortas e as folgas entre entradas somem, e as entradas vivas ficam contíguas no início
+// do bloco (opcionalmente ordenadas por hash do nome ou por inode), então as buscas e
+// listagens seguintes percorrem menos bytes. Cada bloco é compactado isoladamente; só os
+// blocos que mudaram são gravados.
+int comando_compact(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt,
+                    uint32_t diretorio_atual_inode_num, const char *path_alvo, const char *ordem_str) {
+    enum ordem_compactacao ordem = COMPACTAR_ORIGINAL;
+    if (ordem_str != NULL) {
+        if (strcmp(ordem_str, "hash") == 0) ordem = COMPACTAR_HASH;
+        else if (strcmp(ordem_str, "inode") == 0) ordem = COMPACTAR_INODE;
+        else {
+            fprintf(erros_comando(), "compact: ordem inválida '%s' (use hash ou inode)\n", ordem_str);
+            return 1;
+        }
+    }
+
+    uint8_t tipo;
+    uint32_t dir_inode_num = path_to_inode_number(fd, sb, bgdt, diretorio_atual_inode_num, path_alvo, &tipo);
+    if (dir_inode_num == 0) {
+        fprintf(erros_comando(), "compact: diretório não encontrado: %s\n", path_alvo);
+        return 1;
+    }
+    struct ext2_inode dir_inode;
+    if (read_inode(fd, sb, bgdt, dir_inode_num, &dir_inode) != 0 || !S_ISDIR(dir_inode.i_mode)) {
+        fprintf(erros_comando(), "compact: '%s' não é um diretório\n", path_alvo);
+        return 1;
+    }
+
+    char bloco[BLOCK_SIZE_MAX], novo[BLOCK_SIZE_MAX];
+    uint32_t num_blocos = (dir_inode.i_size + BLOCK_SIZE - 1) >> motor_atual->geometria.log_bloco;
+    uint32_t total_vivas = 0, total_mortas = 0, reescritos = 0;
+    for (uint32_t logico = 0; logico < num_blocos; ++logico) {
+        uint32_t fisico = bmap_ler(fd, &dir_inode, logico);
+        if (fisico == 0) continue;
+        if (ler_bloco(fd, fisico, bloco, BLOCO_DIRETORIO) != 0) {
+            fprintf(erros_comando(), "compact: erro ao ler o bloco %u do diretório\n", fisico);
+            return 1;
+        }
+        uint32_t vivas, mortas;
+        int mudou = compactar_bloco_diretorio(bloco, novo, logico == 0, ordem, &vivas, &mortas);
+        if (mudou < 0) {
+            fprintf(erros_comando(), "compact: bloco %u do diretório corrompido; nada foi alterado nele\n", fisico);
+            return 1;
+        }
+        total_vivas += vivas;
+        total_mortas += mortas;
+        if (!mudou) continue;
+        if (write_data_block(fd, fisico, novo) != 0) {
+            fprintf(erros_comando(), "compact: erro ao gravar o bloco %u do diretório\n", fisico);
+            return 1;
+        }
+        struct mapa_diretorio *m = &motor_atual->mapas_diretorios[dir_inode_num & (MAPAS_DIRETORIOS - 1)];
+        if (m->inode == dir_inode_num && logico < m->num_blocos) {
+            mapa_diretorio_atualizar(m, logico, dir_maior_buraco(novo));
+        }
+        reescritos++;
+    }
+
+    fprintf(saida_comando(), "compact: %s: %u entradas em %u blocos, %u entradas mortas removidas, %u blocos reescritos\n",
+            path_alvo, total_vivas, num_blocos, total_mortas, reescritos);
+    return 0;
+}
+
+// Implementa o comando 'rename', que renomeia um arquivo ou diretório.
+// Atualmente, suporta apenas renomear dentro do mesmo diretório.
+int comando_rename(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt,
+                   uint32_t diretorio_atual_inode_num, const char* path_origem, const char* path_destino) {
+    if (path_origem == NULL || path_origem[0] == '\0' || 
+        path_destino == NULL || path_destino[0] == '\0') {
+        fprintf(erros_comando(), "rename: origem e destino devem ser especificados\n");
+        return 1;
+    }
+
+    // Não permite renomear "." ou "..".
+    if (strcmp(path_origem, ".") == 0 || strcmp(path_origem, "..") == 0 ||
+        strcmp(path_destino, ".") == 0 || strcmp(path_destino, "..") == 0) {
+        fprintf(erros_comando(), "rename: não é possível renomear '.' ou '..'\n");
+        return 1;
+    }
+
+    // Obtém o inode do arquivo/diretório de origem.
+    uint8_t tipo_origem;
+    uint32_t origem_inode_num = path_to_inode_number(fd, sb, bgdt, diretorio_atual_inode_num, 
+                                                    path_origem, &tipo_origem);
+    
+    if (origem_inode_num == 0) {
+        fprintf(erros_comando(), "rename: arquivo/diretório de origem não encontrado: %s\n", path_origem);
+        return 1;
+    }
+
+    // Verifica se o destino já existe.
+    uint8_t tipo_destino;
+    uint32_t destino_inode_num = path_to_inode_number(fd, sb, bgdt, diretorio_atual_inode_num, 
+                                                     path_destino, &tipo_destino);
+    
+    if (destino_inode_num != 0) {
+        fprintf(erros_comando(), "rename: destino já existe: %s\n", path_destino);
+        return 1;
+    }
+
+    // Obtém o diretório pai e o nome base do arquivo de origem.
+    char *origem_last_slash = strrchr(path_origem, '/');
+    const char *origem_name;
+    char origem_parent_path[1024];
+    uint32_t origem_parent_inode_num;
+
+    if (origem_last_slash == NULL) {
+        origem_parent_inode_num = diretorio_atual_inode_num;
+        origem_name = path_origem;
+    } else {
+        if (origem_last_slash == path_origem) {
+            origem_parent_inode_num = EXT2_ROOT_INO;
+            origem_name = origem_last_slash + 1;
+        } else {
+            strncpy(origem_parent_path, path_origem, origem_last_slash - path_origem);
+            origem_parent_path[origem_last_slash - path_origem] = '\0';
+            uint8_t parent_type;
+            origem_parent_inode_num = path_to_inode_number(fd, sb, bgdt, diretorio_atual_inode_num,
+                                                         origem_parent_path, &parent_type);
+            origem_name = origem_last_slash + 1;
+        }
+    }
+
+    // Obtém o diretório pai e o nome base do arquivo de destino.
+    char *destino_last_slash = strrchr(path_destino, '/');
+    const char *destino_name;
+    char destino_parent_path[1024];
+    uint32_t destino_parent_inode_num;
+
+    if (destino_last_slash == NULL) {
+        destino_parent_inode_num = diretorio_atual_inode_num;
+        destino_name = path_destino;
+    } else {
+        if (destino_last_slash == path_destino) {
+            destino_parent_inode_num = EXT2_ROOT_INO;
+            destino_name = destino_last_slash + 1;
+        } else {
+            strncpy(destino_parent_path, path_destino, destino_last_slash - path_destino);
+            destino_parent_path[destino_last_slash - path_destino] = '\0';
+            uint8_t parent_type;
+            destino_parent_inode_num = path_to_inode_number(fd, sb, bgdt, diretorio_atual_inode_num,
+                                                          destino_parent_path, &parent_type);
+            destino_name = destino_last_slash + 1;
+        }
+    }
+
+    // Verifica se o diretório pai do destino existe.
+    if (destino_parent_inode_num == 0) {
+        fprintf(erros_comando(), "rename: diretório pai do destino não existe\n");
+        return 1;
+    }
+
+    // Se origem e destino estão no mesmo diretório, a operação é mais simples (apenas renomear a entrada).
+    if (origem_parent_inode_num == destino_parent_inode_num) {
+        // Lê o inode do diretório pai.
+        struct ext2_inode parent_inode;
+        if (read_inode(fd, sb, bgdt, origem_parent_inode_num, &parent_inode) != 0) {
+            fprintf(erros_comando(), "rename: erro ao ler inode do diretório pai\n");
+            return 1;
+        }
+
+        // Adiciona a entrada com o nome novo e remove a antiga (o nome novo pode não
+        // caber no lugar do antigo).
+        if (dir_adicionar_entrada(fd, sb, bgdt, origem_parent_inode_num, &parent_inode, destino_name,
+                                  origem_inode_num, tipo_origem) != 0) {
+            fprintf(erros_comando(), "rename: erro ao adicionar a entrada '%s' no diretório\n", destino_name);
+            return 1;
+        }
+        if (dir_remover_nome(fd, sb, bgdt, origem_parent_inode_num, &parent_inode, origem_name, NULL) != 0) {
+            fprintf(erros_comando(), "rename: erro interno - entrada não encontrada\n");
+            return 1;
+        }
+        fprintf(saida_comando(), "rename: arquivo renomeado com sucesso: %s -> %s\n", path_origem, path_destino);
+        return 0;
+    }
+
+    // Se origem e destino estão em diretórios diferentes, a funcionalidade de mover não está implementada.
+    fprintf(erros_comando(), "rename: não é possível mover entre diretórios diferentes ainda\n");
+    return 1;
+}
+
+// Implementa o comando 'mv' (move/rename), que move ou renomeia arquivos/diretórios.
+// Atualmente, suporta renomear dentro do mesmo diretório e mover para um diretório existente.
+int comando_mv(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt,
+                uint32_t diretorio_atual_inode_num, const char* path_origem, const char* path_destino) {
+    if (path_origem == NULL || path_origem[0] == '\0' || 
+        path_destino == NULL || path_destino[0] == '\0') {
+        fprintf(erros_comando(), "mv: origem e destino devem ser especificados\n");
+        return 1;
+    }
+
+    // Não permite mover "." ou "..".
+    if (strcmp(path_origem, ".") == 0 || strcmp(path_origem, "..") == 0 ||
+        strcmp(path_destino, ".") == 0 || strcmp(path_destino, "..") == 0) {
+        fprintf(erros_comando(), "mv: não é possível mover '.' ou '..'\n");
+        return 1;
+    }
+
+    // Obtém o inode do arquivo/diretório de origem.
+    uint8_t tipo_origem;
+    uint32_t origem_inode_num = path_to_inode_number(fd, sb, bgdt, diretorio_atual_inode_num, 
+                                                    path_origem, &tipo_origem);
+    
+    if (origem_inode_num == 0) {
+        fprintf(erros_comando(), "mv: arquivo/diretório de origem não encontrado: %s\n", path_origem);
+        return 1;
+    }
+
+    // Verifica se o destino existe e, se sim, se é um diretório.
+    uint8_t tipo_destino;
+    uint32_t destino_inode_num = path_to_inode_number(fd, sb, bgdt, diretorio_atual_inode_num, 
+                                                     path_destino, &tipo_destino);
+    
+    // Obtém o nome base do arquivo de origem.
+    const char *origem_name = strrchr(path_origem, '/');
+    if (origem_name == NULL) {
+        origem_name = path_origem;
+    } else {
+        origem_name++; // Pula a barra
+    }
+
+    // Determina o caminho de destino efetivo (se mover para dentro de um diretório).
+    char novo_path_destino[1024];
+    const char *destino_efetivo;
+    
+    if (destino_inode_num != 0) {
+        if (tipo_destino == EXT2_FT_DIR) {
+            // Destino é um diretório, move para dentro dele.
+            snprintf(novo_path_destino, sizeof(novo_path_destino), "%s/%s", 
+                    path_destino, origem_name);
+            destino_efetivo = novo_path_destino;
+
+            // Verifica se já existe um arquivo com o mesmo nome no diretório de destino.
+            uint8_t tipo_temp;
+            uint32_t temp_inode = path_to_inode_number(fd, sb, bgdt, diretorio_atual_inode_num, 
+                                                     destino_efetivo, &tipo_temp);
+            if (temp_inode != 0) {
+                fprintf(erros_comando(), "mv: já existe um arquivo '%s' no diretório de destino\n", origem_name);
+                return 1;
+            }
+        } else {
+            fprintf(erros_comando(), "mv: destino já existe e não é um diretório: %s\n", path_destino);
+            return 1;
+        }
+    } else { // Destino não existe, é um novo nome no diretório pai do destino.
+        destino_efetivo = path_destino;
+    }
+
+    // Obtém o diretório pai e o nome base do arquivo de origem.
+    char *origem_last_slash = strrchr(path_origem, '/');
+    char origem_parent_path[1024];
+    uint32_t origem_parent_inode_num;
+
+    if (origem_last_slash == NULL) {
+        origem_parent_inode_num = diretorio_atual_inode_num;
+    } else {
+        if (origem_last_slash == path_origem) {
+            origem_parent_inode_num = EXT2_ROOT_INO;
+        } else {
+            strncpy(origem_parent_path, path_origem, origem_last_slash - path_origem);
+            origem_parent_path[origem_last_slash - path_origem] = '\0';
+            uint8_t parent_type;
+            origem_parent_inode_num = path_to_inode_number(fd, sb, bgdt, diretorio_atual_inode_num,
+                                                         origem_parent_path, &parent_type);
+        }
+    }
+
+    // Obtém o diretório pai e o nome base do arquivo de destino.
+    char *destino_last_slash = strrchr(destino_efetivo, '/');
+    const char *destino_name;
+    char destino_parent_path[1024];
+    uint32_t destino_parent_inode_num;
+
+    if (destino_last_slash == NULL) {
+        destino_parent_inode_num = diretorio_atual_inode_num;
+        destino_name = destino_efetivo;
+    } else {
+        if (destino_last_slash == destino_efetivo) {
+            destino_parent_inode_num = EXT2_ROOT_INO;
+            destino_name = destino_last_slash + 1;
+        } else {
+            strncpy(destino_parent_path, destino_efetivo, destino_last_slash - destino_efetivo);
+            destino_parent_path[destino_last_slash - destino_efetivo] = '\0';
+            uint8_t parent_type;
+            destino_parent_inode_num = path_to_inode_number(fd, sb, bgdt, diretorio_atual_inode_num,
+                                                          destino_parent_path, &parent_type);
+            destino_name = destino_last_slash + 1;
+        }
+    }
+
+    // Verifica se o diretório pai do destino existe.
+    if (destino_parent_inode_num == 0) {
+        fprintf(erros_comando(), "mv: diretório pai do destino não existe\n");
+        return 1;
+    }
+
+    // Primeiro, lê os inodes dos diretórios pai.
+    struct ext2_inode origem_parent_inode;
+    if (read_inode(fd, sb, bgdt, origem_parent_inode_num, &origem_parent_inode) != 0) {
+        fprintf(erros_comando(), "mv: erro ao ler inode do diretório pai de origem\n");
+        return 1;
+    }
+
+    struct ext2_inode destino_parent_inode;
+    if (read_inode(fd, sb, bgdt, destino_parent_inode_num, &destino_parent_inode) != 0) {
+        fprintf(erros_comando(), "mv: erro ao ler inode do diretório pai de destino\n");
+        return 1;
+    }
+
+    // Adiciona a entrada no destino antes de remover a da origem: uma falha no meio deixa
+    // o arquivo com dois nomes, nunca sem nenhum. Um diretório que muda de pai leva o
+    // link do seu '..' junto (gravado com a entrada em cada pai).
+    int muda_pai = origem_parent_inode_num != destino_parent_inode_num;
+    if (tipo_origem == EXT2_FT_DIR && muda_pai) destino_parent_inode.i_links_count++;
+    if (dir_adicionar_entrada(fd, sb, bgdt, destino_parent_inode_num, &destino_parent_inode, destino_name,
+                              origem_inode_num, tipo_origem) != 0) {
+        fprintf(erros_comando(), "mv: não foi possível adicionar '%s' no diretório de destino\n", destino_name);
+        return 1;
+    }
+    if (!muda_pai) origem_parent_inode = destino_parent_inode; // Mesmo diretório: já alterado acima
+    if (tipo_origem == EXT2_FT_DIR && muda_pai) origem_parent_inode.i_links_count--;
+    if (dir_remover_nome(fd, sb, bgdt, origem_parent_inode_num, &origem_parent_inode, origem_name, NULL) != 0) {
+        fprintf(erros_comando(), "mv: erro interno - entrada de origem não encontrada\n");
+        return 1;
+    }
+
+    // Se o que foi movido é um diretório, atualiza sua entrada ".." para apontar para o novo pai.
+    if (tipo_origem == EXT2_FT_DIR && muda_pai) {
+        struct ext2_inode dir_inode;
+        if (read_inode(fd, sb, bgdt, origem_inode_num, &dir_inode) != 0) {
+            fprintf(erros_comando(), "mv: erro ao ler inode do diretório movido\n");
+            return 1;
+        }
+
+        char dir_content[BLOCK_SIZE_MAX];
+        if (ler_bloco(fd, dir_inode.i_block[0], dir_content, BLOCO_DIRETORIO) != 0) {
+            fprintf(erros_comando(), "mv: erro ao ler conteúdo do diretório movido\n");
+            return 1;
+        }
+
+        struct ext2_dir_entry_2 *dotdot = (struct ext2_dir_entry_2 *)(dir_content + 
+            ((struct ext2_dir_entry_2 *)dir_content)->rec_len);
+        if (dotdot->name_len == 2 && strncmp(dotdot->name, "..", 2) == 0) { // Encontra a entrada ".."
+            dotdot->inode = destino_parent_inode_num; // Atualiza o inode do pai
+            
+            if (write_data_block(fd, dir_inode.i_block[0], dir_content) != 0) { // Escreve o bloco de dados do diretório movido
+                fprintf(erros_comando(), "mv: erro ao atualizar entrada '..' do diretório\n");
+                return 1;
+            }
+        }
+    }
+
+    fprintf(saida_comando(), "mv: arquivo movido com sucesso: %s -> %s\n", path_origem, destino_efetivo);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Cópia recursiva (comando 'cp -r'). A árvore de origem é percorrida em largura; para cada
+// diretório, os inodes dos filhos, os blocos dos arquivos (sequências contíguas do alocador,
+// com os indiretos dispostos como no ext2) e o diretório de destino inteiro (todas as
+// entradas, empacotadas) são criados de uma vez, dentro da transação do comando. Os dados
+// não passam pela transação: cada arquivo vira tarefas de cópia de trechos contíguos na
+// origem e no destino, executadas no fim por um conjunto de threads com leituras e escritas
+// grandes direto na imagem. Os blocos de destino são novos e só passam a ser apontados
+// quando a transação é confirmada, como no modo 'ordered' do ext3. Trechos com blocos
+// pendentes na transação ou no journal são copiados pela thread do comando, pelo caminho
+// normal.
+// ---------------------------------------------------------------------------
+
+#define CP_TRABALHADORES 4   // Threads de cópia de dados
+#define CP_LOTE 256          // Blocos por tarefa (uma leitura e uma escrita)
+#define CP_MINIMO_PARALELO 1024 // Abaixo disto (em blocos) a cópia não usa as threads
+
+struct entrada_cp {
+    uint32_t inode;
+    uint8_t tipo;
+    uint8_t tamanho_nome;
+    char nome[EXT2_NAME_LEN + 1];
+};
+
+struct entradas_cp {
+    struct entrada_cp *itens;
+    uint32_t tamanho;
+    uint32_t capacidade;
+};
+
+// Um trecho contíguo a copiar.
+struct tarefa_copia {
+    uint32_t origem;
+    uint32_t destino;
+    uint32_t blocos;
+};
+
+struct tarefas_copia {
+    struct tarefa_copia *itens;
+    size_t tamanho;
+    size_t capacidade;
+    uint64_t blocos;
+};
+
+// Diretório de destino a preencher: criado vazio ao processar o pai.
+struct diretorio_cp {
+    uint32_t origem;
+    uint32_t destino;
+};
+
+struct copia_recursiva {
+    int fd;
+    struct ext2_super_block *sb;
+    struct ext2_group_desc *bgdt;
+    uint32_t objetivo;         // Próximo bloco a tentar alocar (mantém a cópia em sequência)
+    struct tarefas_copia tarefas;
+    struct tarefas_copia tarefas_locais; // Trechos com blocos pendentes: copiados pela thread do comando
+    struct diretorio_cp *fila;
+    size_t inicio_fila, fim_fila, capacidade_fila;
+    struct buffer_blocos lista;
+    uint32_t *novos;
+    uint32_t *destino;
+    uint32_t capacidade_novos;
+    uint32_t arquivos, diretorios;
+};
+
+// Lê as entradas do diretório 'dir_num' (sem '.' e '..'). Retorna 0 em sucesso, -1 em erro.
+static int cp_ler_entradas(struct copia_recursiva *c, uint32_t dir_num, struct entradas_cp *e) {
+    struct ext2_inode dir;
+    char bloco[BLOCK_SIZE_MAX];
+    e->tamanho = 0;
+    if (read_inode(c->fd, c->sb, c->bgdt, dir_num, &dir) != 0) return -1;
+    uint32_t num_blocos = (dir.i_size + BLOCK_SIZE - 1) >> motor_atual->geometria.log_bloco;
+    if (buffer_blocos_reservar(&c->lista, num_blocos) != 0 ||
+        listar_blocos_arquivo(c->fd, &dir, c->lista.fisicos, num_blocos, NULL, NULL, NULL) != 0) return -1;
+    for (uint32_t logico = 0; logico < num_blocos; ++logico) {
+        if (c->lista.fisicos[logico] == 0) continue;
+        if (ler_bloco(c->fd, c->lista.fisicos[logico], bloco, BLOCO_DIRETORIO) != 0) return -1;
+        for (uint32_t offset = 0; offset + offsetof(struct ext2_dir_entry_2, name) <= BLOCK_SIZE; ) {
+            struct ext2_dir_entry_2 *entrada = (struct ext2_dir_entry_2 *)(bloco + offset);
+            if (entrada->rec_len == 0 || offset + entrada->rec_len > BLOCK_SIZE) break;
+            offset += entrada->rec_len;
+            if (entrada->inode == 0) continue;
+            if ((entrada->name_len == 1 && entrada->name[0] == '.') ||
+                (entrada->name_len == 2 && entrada->name[0] == '.' && entrada->name[1] == '.')) continue;
+            if (e->tamanho == e->capacidade) {
+                uint32_t capacidade = e->capacidade ? e->capacidade * 2 : 64;
+                struct entrada_cp *itens = (struct entrada_cp *)realloc(e->itens, capacidade * sizeof(struct entrada_cp));
+                if (!itens) {
+                    perror("cp: Erro ao alocar memória");
+                    return -1;
+                }
+                e->itens = itens;
+                e->capacidade = capacidade;
+            }
+            struct entrada_cp *nova = &e->itens[e->tamanho++];
+            nova->inode = entrada->inode;
+            nova->tipo = entrada->file_type;
+            nova->tamanho_nome = entrada->name_len;
+            memcpy(nova->nome, entrada->name, entrada->name_len);
+            nova->nome[entrada->name_len] = '\0';
+        }
+    }
+    return 0;
+}
+
+// Empacota '.', '..' e as 'quantidade' primeiras entradas em blocos de diretório: cada
+// entrada ocupa o tamanho mínimo e a última de cada bloco se estende até o fim dele.
+// Com 'blocos' NULL só conta. Retorna o número de blocos usados.
+static uint32_t cp_empacotar_entradas(uint32_t dir_num, uint32_t pai_num, const struct entrada_cp *entradas,
+                                      uint32_t quantidade, char *blocos) {
+    uint32_t bloco = 0, offset = 0;
+    struct ext2_dir_entry_2 *anterior = NULL;
+    for (uint32_t i = 0; i < quantidade + 2; ++i) {
+        const char *nome = i == 0 ? "." : i == 1 ? ".." : entradas[i - 2].nome;
+        uint8_t tamanho_nome = i == 0 ? 1 : i == 1 ? 2 : entradas[i - 2].tamanho_nome;
+        uint16_t tamanho = (uint16_t)dir_tamanho_entrada(tamanho_nome);
+        if (offset + tamanho > BLOCK_SIZE) { // Não cabe: fecha o bloco e começa outro
+            if (anterior) anterior->rec_len = (uint16_t)(BLOCK_SIZE - ((char *)anterior - (blocos + ((size_t)bloco << motor_atual->geometria.log_bloco))));
+            bloco++;
+            offset = 0;
+        }
+        if (blocos) {
+            struct ext2_dir_entry_2 *entrada = (struct ext2_dir_entry_2 *)(blocos + ((size_t)bloco << motor_atual->geometria.log_bloco) + offset);
+            entrada->inode = i == 0 ? dir_num : i == 1 ? pai_num : entradas[i - 2].inode;
+            entrada->rec_len = tamanho;
+            entrada->name_len = tamanho_nome;
+            entrada->file_type = i < 2 ? EXT2_FT_DIR : entradas[i - 2].tipo;
+            memcpy(entrada->name, nome, tamanho_nome);
+            anterior = entrada;
+        }
+        offset += tamanho;
+    }
+    if (anterior) anterior->rec_len = (uint16_t)(BLOCK_SIZE - ((char *)anterior - (blocos + ((size_t)bloco << motor_atual->geometria.log_bloco))));
+    return bloco + 1;
+}
+
+// Garante espaço para a disposição de um arquivo com 'num_blocos' blocos lógicos.
+static int cp_reservar(struct copia_recursiva *c, uint32_t num_blocos) {
+    if (buffer_blocos_reservar(&c->lista, num_blocos) != 0) return -1;
+    if (num_blocos <= c->capacidade_novos) return 0;
+    uint32_t *novos = (uint32_t *)realloc(c->novos, (size_t)num_blocos * sizeof(uint32_t));
+    if (novos) c->novos = novos;
+    uint32_t *destino = (uint32_t *)realloc(c->destino, (size_t)blocos_com_indiretos_max(num_blocos) * sizeof(uint32_t));
+    if (destino) c->destino = destino;
+    if (!novos || !destino) {
+        perror("cp: Erro ao alocar memória");
+        return -1;
+    }
+    c->capacidade_novos = num_blocos;
+    return 0;
+}
+
+// Aloca, em sequências contíguas a partir de c->objetivo, os blocos da disposição dos
+// 'num_blocos' blocos lógicos de 'fisicos' (0 = buraco), grava os blocos indiretos e
+// preenche os ponteiros e i_blocks de 'inode'; c->novos recebe o bloco novo de cada bloco
+// lógico. Retorna 0 em sucesso, -1 sem espaço ou em erro (nada fica alocado).
+static int cp_alocar_blocos(struct copia_recursiva *c, const uint32_t *fisicos, uint32_t num_blocos,
+                            struct ext2_inode *inode) {
+    struct disposicao_arquivo d = { fisicos, num_blocos, NULL, 0, c->novos, 0 };
+    dispor_arquivo(c->fd, &d, inode);
+    uint32_t total = d.usados, alocados = 0;
+    while (alocados < total) {
+        uint32_t pedido = total - alocados;
+        if (pedido > c->sb->s_blocks_per_group) pedido = c->sb->s_blocks_per_group;
+        uint32_t inicio = 0;
+        while (pedido > 0 && (inicio = allocate_data_blocks_near(c->fd, c->sb, c->bgdt, c->objetivo, pedido)) == 0) pedido /= 2;
+        if (inicio == 0) break;
+        for (uint32_t i = 0; i < pedido; ++i) c->destino[alocados++] = inicio + i;
+        c->objetivo = inicio + pedido;
+    }
+    d.destino = c->destino;
+    if (alocados < total || dispor_arquivo(c->fd, &d, inode) != 0) {
+        liberar_blocos_lote(c->fd, c->sb, c->bgdt, c->destino, alocados);
+        return -1;
+    }
+    inode->i_blocks = total << (motor_atual->geometria.log_bloco - 9);
+    return 0;
+}
+
+static int cp_adicionar_tarefa(struct tarefas_copia *t, uint32_t origem, uint32_t destino, uint32_t blocos) {
+    if (t->tamanho == t->capacidade) {
+        size_t capacidade = t->capacidade ? t->capacidade * 2 : 256;
+        struct tarefa_copia *itens = (struct tarefa_copia *)realloc(t->itens, capacidade * sizeof(struct tarefa_copia));
+        if (!itens) {
+            perror("cp: Erro ao alocar memória");
+            return -1;
+        }
+        t->itens = itens;
+        t->capacidade = capacidade;
+    }
+    t->itens[t->tamanho++] = (struct tarefa_copia){ origem, destino, blocos };
+    t->blocos += blocos;
+    return 0;
+}
+
+// Copia o arquivo (ou link simbólico) 'origem_num': aloca o inode e os blocos e registra as
+// tarefas de cópia dos dados. Retorna o inode novo ou 0 em erro.
+static uint32_t cp_copiar_arquivo(struct copia_recursiva *c, uint32_t origem_num) {
+    struct ext2_inode origem;
+    if (read_inode(c->fd, c->sb, c->bgdt, origem_num, &origem) != 0) return 0;
+    uint32_t novo_num = allocate_inode(c->fd, c->sb, c->bgdt);
+    if (novo_num == 0) return 0;
+
+    struct ext2_inode novo = origem;
+    uint32_t agora = (uint32_t)time(NULL);
+    novo.i_atime = novo.i_ctime = novo.i_mtime = agora;
+    novo.i_dtime = 0;
+    novo.i_links_count = 1;
+    // Dispositivos, FIFOs e links simbólicos rápidos guardam tudo em i_block: o inode basta.
+    int com_dados = S_ISREG(origem.i_mode) || (S_ISLNK(origem.i_mode) && origem.i_blocks != 0);
+    if (com_dados) {
+        uint32_t num_blocos = (origem.i_size + BLOCK_SIZE - 1) >> motor_atual->geometria.log_bloco;
+        memset(novo.i_block, 0, sizeof(novo.i_block));
+        novo.i_blocks = 0;
+        if (num_blocos > 0) {
+            if (cp_reservar(c, num_blocos) != 0 ||
+                listar_blocos_arquivo(c->fd, &origem, c->lista.fisicos, num_blocos, NULL, NULL, NULL) != 0 ||
+                cp_alocar_blocos(c, c->lista.fisicos, num_blocos, &novo) != 0) {
+                deallocate_inode(c->fd, c->sb, c->bgdt, novo_num);
+                return 0;
+            }
+            // Uma tarefa por trecho contíguo na origem e no destino (até CP_LOTE blocos).
+            const uint32_t *fisicos = c->lista.fisicos;
+            struct tarefas_copia tarefas = c->tarefas, tarefas_locais = c->tarefas_locais;
+            for (uint32_t i = 0; i < num_blocos; ) {
+                if (fisicos[i] == 0) { i++; continue; }
+                uint32_t n = 1, pendente = bloco_pendente(fisicos[i]) || bloco_pendente(c->novos[i]);
+                while (n < CP_LOTE && i + n < num_blocos && fisicos[i + n] == fisicos[i] + n && c->novos[i + n] == c->novos[i] + n) {
+                    pendente |= bloco_pendente(fisicos[i + n]) || bloco_pendente(c->novos[i + n]);
+                    n++;
+                }
+                if (cp_adicionar_tarefa(pendente ? &c->tarefas_locais : &c->tarefas, fisicos[i], c->novos[i], n) != 0) {
+                    // Sem memória: desfaz as tarefas deste arquivo e devolve os blocos e o inode.
+                    c->tarefas.tamanho = tarefas.tamanho;
+                    c->tarefas.blocos = tarefas.blocos;
+                    c->tarefas_locais.tamanho = tarefas_locais.tamanho;
+                    c->tarefas_locais.blocos = tarefas_locais.blocos;
+                    liberar_blocos_lote(c->fd, c->sb, c->bgdt, c->destino, novo.i_blocks >> (motor_atual->geometria.log_bloco - 9));
+                    deallocate_inode(c->fd, c->sb, c->bgdt, novo_num);
+                    return 0;
+                }
+                i += n;
+            }
+        }
+    }
+    if (write_inode_table_entry(c->fd, c->sb, c->bgdt, novo_num, &novo) != 0) return 0;
+    c->arquivos++;
+    return novo_num;
+}
+
+// Cria o diretório de destino de 'origem_num' (filho de 'pai_num'), já com os blocos para
+// todas as entradas da origem, mas só com '.' e '..'. Retorna o inode novo ou 0 em erro.
+static uint32_t cp_criar_diretorio(struct copia_recursiva *c, uint32_t origem_num, uint32_t pai_num,
+                                   struct entradas_cp *entradas) {
+    struct ext2_inode origem;
+    if (read_inode(c->fd, c->sb, c->bgdt, origem_num, &origem) != 0 || cp_ler_entradas(c, origem_num, entradas) != 0) return 0;
+    uint32_t num_blocos = cp_empacotar_entradas(0, 0, entradas->itens, entradas->tamanho, NULL);
+    uint32_t novo_num = allocate_inode(c->fd, c->sb, c->bgdt);
+    if (novo_num == 0) return 0;
+
+    struct ext2_inode novo;
+    memset(&novo, 0, sizeof(novo));
+    novo.i_mode = origem.i_mode;
+    novo.i_uid = origem.i_uid;
+    novo.i_gid = origem.i_gid;
+    novo.i_atime = novo.i_ctime = novo.i_mtime = (uint32_t)time(NULL);
+    novo.i_links_count = 2;
+    novo.i_size = num_blocos << motor_atual->geometria.log_bloco;
+    // Todos os blocos lógicos existem (nenhum buraco em diretório).
+    if (cp_reservar(c, num_blocos) != 0) {
+        deallocate_inode(c->fd, c->sb, c->bgdt, novo_num);
+        return 0;
+    }
+    for (uint32_t i = 0; i < num_blocos; ++i) c->lista.ordem[i] = 1;
+    if (cp_alocar_blocos(c, c->lista.ordem, num_blocos, &novo) != 0) {
+        deallocate_inode(c->fd, c->sb, c->bgdt, novo_num);
+        return 0;
+    }
+
+    // Bloco 0 com '.' e '..'; os demais com uma entrada vazia do tamanho do bloco.
+    char bloco[BLOCK_SIZE_MAX];
+    int resultado = 0;
+    for (uint32_t i = 0; i < num_blocos && resultado == 0; ++i) {
+        memset(bloco, 0, BLOCK_SIZE);
+        if (i == 0) cp_empacotar_entradas(novo_num, pai_num, NULL, 0, bloco);
+        else ((struct ext2_dir_entry_2 *)bloco)->rec_len = (uint16_t)BLOCK_SIZE;
+        if (write_data_block(c->fd, c->novos[i], bloco) != 0) resultado = -1;
+    }
+    if (resultado != 0 || write_inode_table_entry(c->fd, c->sb, c->bgdt, novo_num, &novo) != 0) return 0;
+
+    uint32_t grupo = grupo_do_inode(novo_num, NULL);
+    descritor_grupo(c->bgdt, grupo)->bg_used_dirs_count++;
+    write_group_descriptor(c->fd, c->sb, grupo, &c->bgdt[grupo]);
+    c->diretorios++;
+
+    if (c->fim_fila == c->capacidade_fila) {
+        size_t capacidade = c->capacidade_fila ? c->capacidade_fila * 2 : 64;
+        struct diretorio_cp *fila = (struct diretorio_cp *)realloc(c->fila, capacidade * sizeof(struct diretorio_cp));
+        if (!fila) {
+            perror("cp: Erro ao alocar memória");
+            return novo_num; // Fica vazio, mas consistente
+        }
+        c->fila = fila;
+        c->capacidade_fila = capacidade;
+    }
+    c->fila[c->fim_fila++] = (struct diretorio_cp){ origem_num, novo_num };
+    return novo_num;
+}
+
+// Preenche o diretório de destino 'd': cria cada filho e grava as entradas empacotadas nos
+// blocos já alocados. Os filhos que não puderem ser criados ficam de fora. Retorna 0 em
+// sucesso, -1 se algum filho falhou.
+static int cp_preencher_diretorio(struct copia_recursiva *c, const struct diretorio_cp *d,
+                                  struct entradas_cp *entradas, struct entradas_cp *auxiliar) {
+    struct ext2_inode dir;
+    if (cp_ler_entradas(c, d->origem, entradas) != 0 || read_inode(c->fd, c->sb, c->bgdt, d->destino, &dir) != 0) return -1;
+    uint32_t pai_num = dir_lookup(c->fd, c->sb, c->bgdt, d->destino, "..", NULL);
+
+    int resultado = 0;
+    uint32_t criados = 0, subdiretorios = 0;
+    for (uint32_t i = 0; i < entradas->tamanho; ++i) {
+        struct entrada_cp *e = &entradas->itens[i];
+        int diretorio = e->tipo == EXT2_FT_DIR;
+        if (e->tipo == EXT2_FT_UNKNOWN) {
+            struct ext2_inode filho;
+            if (read_inode(c->fd, c->sb, c->bgdt, e->inode, &filho) != 0) { resultado = -1; continue; }
+            diretorio = S_ISDIR(filho.i_mode);
+        }
+        uint32_t novo = diretorio ? cp_criar_diretorio(c, e->inode, d->destino, auxiliar) : cp_copiar_arquivo(c, e->inode);
+        if (novo == 0) {
+            fprintf(erros_comando(), "cp: não foi possível copiar '%s'\n", e->nome);
+            resultado = -1;
+            continue;
+        }
+        subdiretorios += diretorio;
+        entradas->itens[criados] = *e;
+        entradas->itens[criados].inode = novo;
+        criados++;
+    }
+
+    // Grava todas as entradas do diretório de uma vez, nos blocos alocados na criação.
+    uint32_t num_blocos = (dir.i_size + BLOCK_SIZE - 1) >> motor_atual->geometria.log_bloco;
+    char *blocos = (char *)calloc(num_blocos, BLOCK_SIZE);
+    if (!blocos || cp_reservar(c, num_blocos) != 0 ||
+        listar_blocos_arquivo(c->fd, &dir, c->lista.fisicos, num_blocos, NULL, NULL, NULL) != 0) {
+        free(blocos);
+        return -1;
+    }
+    uint32_t usados = cp_empacotar_entradas(d->destino, pai_num, entradas->itens, criados, blocos);
+    for (uint32_t i = usados; i < num_blocos; ++i) {
+        ((struct ext2_dir_entry_2 *)(blocos + ((size_t)i << motor_atual->geometria.log_bloco)))->rec_len = (uint16_t)BLOCK_SIZE;
+    }
+    for (uint32_t i = 0; i < num_blocos; ++i) {
+        if (write_data_block(c->fd, c->lista.fisicos[i], blocos + ((size_t)i << motor_atual->geometria.log_bloco)) != 0) resultado = -1;
+    }
+    free(blocos);
+    dir.i_links_count = (uint16_t)(2 + subdiretorios);
+    if (write_inode_table_entry(c->fd, c->sb, c->bgdt, d->destino, &dir) != 0) resultado = -1;
+    return resultado;
+}
+
+struct trabalhador_cp {
+    struct motor *motor;
+    int fd;
+    const struct tarefas_copia *tarefas;
+    size_t *proxima;            // Próxima tarefa livre (incrementada atomicamente)
+    int erro;
+    struct contadores_es es;    // E/S feita pela thread, somada à do comando no fim
+    uint64_t blocos_lidos[NUM_TIPOS_BLOCO]; // Idem para as estatísticas
+};
+
+// Copia as tarefas com pread/pwrite direto na imagem. Os destinos foram alocados agora e
+// nenhum tem liberação pendente (um bloco liberado só é realocado quando a liberação fica
+// durável, ver liberacao_registrar), então a escrita não atinge dados que um inode ainda
+// no disco aponta; os trechos com versão pendente na transação ou no journal
+// (bloco_pendente) ficam em tarefas_locais e passam pela transação.
+static void *cp_trabalhador(void *argumento) {
+    struct trabalhador_cp *t = (struct trabalhador_cp *)argumento;
+    motor_atual = t->motor;
+    char *buffer = (char *)malloc((size_t)CP_LOTE << motor_atual->geometria.log_bloco);
+    if (!buffer) {
+        t->erro = 1;
+        return NULL;
+    }
+    size_t indice;
+    while ((indice = __atomic_fetch_add(t->proxima, 1, __ATOMIC_RELAXED)) < t->tarefas->tamanho) {
+        const struct tarefa_copia *tarefa = &t->tarefas->itens[indice];
+        size_t bytes = (size_t)tarefa->blocos << motor_atual->geometria.log_bloco;
+        ssize_t lidos = pread(t->fd, buffer, bytes, offset_do_bloco(tarefa->origem));
+        ssize_t escritos = lidos == (ssize_t)bytes ? pwrite(t->fd, buffer, bytes, offset_do_bloco(tarefa->destino)) : -1;
+        t->es.leituras++;
+        if (lidos > 0) t->es.bytes_lidos += (uint64_t)lidos;
+        ESTAT(t->blocos_lidos[BLOCO_DADOS] += tarefa->blocos);
+        if (escritos >= 0) {
+            t->es.escritas++;
+            t->es.bytes_escritos += (uint64_t)escritos;
+        }
+        if (escritos != (ssize_t)bytes) t->erro = 1;
+        else somas_atualizar(tarefa->destino, buffer, tarefa->blocos); // Blocos distintos por tarefa: sem disputa
+    }
+    free(buffer);
+    return NULL;
+}
+
+// Executa as tarefas de cópia: com poucos blocos, na própria thread; senão, com
+// CP_TRABALHADORES threads. Retorna 0 em sucesso, -1 em erro.
+static int cp_executar_tarefas(int fd, const struct tarefas_copia *tarefas) {
+    size_t proxima = 0;
+    struct trabalhador_cp trabalhadores[CP_TRABALHADORES];
+    pthread_t threads[CP_TRABALHADORES];
+    int num_threads = 0;
+    for (int i = 0; i < CP_TRABALHADORES; ++i) {
+        trabalhadores[i] = (struct trabalhador_cp){ motor_atual, fd, tarefas, &proxima, 0, { 0, 0, 0, 0, 0 }, { 0 } };
+    }
+    if (tarefas->blocos >= CP_MINIMO_PARALELO) {
+        for (; num_threads < CP_TRABALHADORES; ++num_threads) {
+            if (pthread_create(&threads[num_threads], NULL, cp_trabalhador, &trabalhadores[num_threads]) != 0) break;
+        }
+    }
+    if (num_threads == 0) cp_trabalhador(&trabalhadores[0]);
+    for (int i = 0; i < num_threads; ++i) pthread_join(threads[i], NULL);
+
+    int resultado = 0;
+    for (int i = 0; i < CP_TRABALHADORES; ++i) {
+        contadores_es.leituras += trabalhadores[i].es.leituras;
+        contadores_es.bytes_lidos += trabalhadores[i].es.bytes_lidos;
+        contadores_es.escritas += trabalhadores[i].es.escritas;
+        contadores_es.bytes_escritos += trabalhadores[i].es.bytes_escritos;
+        ESTAT(estat_somar_blocos_lidos(trabalhadores[i].blocos_lidos));
+        if (trabalhadores[i].erro) resultado = -1;
+    }
+    if (tarefas->tamanho > 0) motor_atual->escritas_nao_sincronizadas = 1;
+    return resultado;
+}
+
+// Copia os dados registrados em c->tarefas (pelas threads, direto na imagem) e em
+// c->tarefas_locais (trechos com blocos pendentes, pela transação). Retorna 0 em sucesso,
+// -1 em erro.
+static int cp_copiar_dados(struct copia_recursiva *c) {
+    int resultado = cp_executar_tarefas(c->fd, &c->tarefas);
+    char *buffer = c->tarefas_locais.tamanho > 0 ? (char *)malloc((size_t)CP_LOTE << motor_atual->geometria.log_bloco) : NULL;
+    for (size_t i = 0; i < c->tarefas_locais.tamanho; ++i) {
+        const struct tarefa_copia *t = &c->tarefas_locais.itens[i];
+        size_t bytes = (size_t)t->blocos << motor_atual->geometria.log_bloco;
+        if (!buffer || dev_pread(c->fd, buffer, bytes, offset_do_bloco(t->origem)) != (ssize_t)bytes ||
+            dev_pwrite(c->fd, buffer, bytes, offset_do_bloco(t->destino)) != (ssize_t)bytes) resultado = -1;
+    }
+    free(buffer);
+    return resultado;
+}
+
+// Libera a memória de trabalho de uma cópia.
+static void cp_liberar(struct copia_recursiva *c) {
+    free(c->tarefas.itens);
+    free(c->tarefas_locais.itens);
+    free(c->fila);
+    free(c->lista.fisicos);
+    free(c->lista.ordem);
+    free(c->novos);
+    free(c->destino);
+}
+
+// Desfaz uma cópia incompleta: libera os blocos e o inode do arquivo de destino.
+static void cp_desfazer(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt,
+                        uint32_t inode_num, struct ext2_inode *inode) {
+    liberar_blocos_arquivo(fd, sb, bgdt, inode);
+    inode->i_links_count = 0;
+    inode->i_dtime = time(NULL);
+    write_inode_table_entry(fd, sb, bgdt, inode_num, inode);
+    deallocate_inode(fd, sb, bgdt, inode_num);
+}
+
+// Implementa o comando 'cp' (copy), que copia um arquivo (diretórios vão por 'cp -r').
+int comando_cp(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt,
+              uint32_t diretorio_atual_inode_num, const char* path_origem, const char* path_destino) {
+    // Verifica se o arquivo de origem existe.
+    uint8_t tipo_origem;
+    uint32_t origem_inode_num = path_to_inode_number(fd, sb, bgdt, diretorio_atual_inode_num, 
+                                                   path_origem, &tipo_origem);
+    
+    if (origem_inode_num == 0) {
+        fprintf(erros_comando(), "cp: arquivo de origem não encontrado: %s\n", path_origem);
+        return 1;
+    }
+
+    // Diretórios são copiados por comando_cp_recursivo (cp -r).
+    if (tipo_origem == EXT2_FT_DIR) {
+        fprintf(erros_comando(), "cp: não é possível copiar diretórios (use cp -r)\n");
+        return 1;
+    }
+
+    // Obtém o nome base do arquivo de origem.
+    const char *origem_name = strrchr(path_origem, '/');
+    if (origem_name == NULL) {
+        origem_name = path_origem;
+    } else {
+        origem_name++;
+    }
+
+    // Verifica se o destino existe e, se sim, se é um diretório.
+    uint8_t tipo_destino;
+    uint32_t destino_inode_num = path_to_inode_number(fd, sb, bgdt, diretorio_atual_inode_num, 
+                                                    path_destino, &tipo_destino);
+
+    char caminho_final[1024];
+    const char *nome_final;
+
+    // Se o destino existe e é um diretório, o arquivo será copiado para dentro dele com o mesmo nome.
+    if (destino_inode_num != 0 && tipo_destino == EXT2_FT_DIR) {
+        snprintf(caminho_final, sizeof(caminho_final), "%s/%s", path_destino, origem_name);
+        nome_final = origem_name;
+    } else { // Caso contrário, o destino é o novo nome do arquivo.
+        strncpy(caminho_final, path_destino, sizeof(caminho_final) - 1);
+        nome_final = strrchr(path_destino, '/');
+        if (nome_final == NULL) {
+            nome_final = path_destino;
+        } else {
+            nome_final++;
+        }
+    }
+
+    // Verifica se já existe um arquivo com o mesmo nome no destino.
+    uint8_t tipo_temp;
+    if (path_to_inode_number(fd, sb, bgdt, diretorio_atual_inode_num, caminho_final, &tipo_temp) != 0) {
+        fprintf(erros_comando(), "cp: arquivo de destino já existe: %s\n", caminho_final);
+        return 1;
+    }
+
+    // Obtém o diretório pai do destino.
+    char destino_parent_path[1024];
+    uint32_t destino_parent_inode_num;
+
+    if (strrchr(caminho_final, '/') != NULL) {
+        strncpy(destino_parent_path, caminho_final, strrchr(caminho_final, '/') - caminho_final);
+        destino_parent_path[strrchr(caminho_final, '/') - caminho_final] = '\0';
+        
+        uint8_t parent_type;
+        destino_parent_inode_num = path_to_inode_number(fd, sb, bgdt, diretorio_atual_inode_num,
+                                                     destino_parent_path, &parent_type);
+    } else {
+        destino_parent_inode_num = diretorio_atual_inode_num;
+    }
+    if (destino_parent_inode_num == 0) {
+        fprintf(erros_comando(), "cp: diretório de destino não encontrado: %s\n", destino_parent_path);
+        return 1;
+    }
+
+    // Aloca o inode e os blocos como o 'cp -r' (sequências contíguas, indiretos gravados de
+    // uma vez) e copia os dados em trechos de até CP_LOTE blocos direto na imagem: a memória
+    // usada não depende do tamanho do arquivo, e só os metadados passam pela transação.
+    struct copia_recursiva c;
+    memset(&c, 0, sizeof(c));
+    c.fd = fd;
+    c.sb = sb;
+    c.bgdt = bgdt;
+    c.objetivo = grupo_do_inode(destino_parent_inode_num, NULL) * sb->s_blocks_per_group + sb->s_first_data_block;
+    uint32_t novo_inode_num = cp_copiar_arquivo(&c, origem_inode_num);
+    int erro_copia = novo_inode_num == 0 || cp_copiar_dados(&c) != 0;
+    cp_liberar(&c);
+    if (novo_inode_num == 0) {
+        fprintf(erros_comando(), "cp: não foi possível alocar o inode ou os blocos do arquivo de destino\n");
+        return 1;
+    }
+    struct ext2_inode novo_inode;
+    if (read_inode(fd, sb, bgdt, novo_inode_num, &novo_inode) != 0) {
+        fprintf(erros_comando(), "cp: erro ao ler inode do arquivo de destino\n");
+        return 1;
+    }
+    if (erro_copia) {
+        fprintf(erros_comando(), "cp: erro ao copiar os dados do arquivo de origem\n");
+        cp_desfazer(fd, sb, bgdt, novo_inode_num, &novo_inode);
+        return 1;
+    }
+
+    // Lê o inode do diretório pai do destino.
+    struct ext2_inode destino_parent_inode;
+    if (read_inode(fd, sb, bgdt, destino_parent_inode_num, &destino_parent_inode) != 0) {
+        fprintf(erros_comando(), "cp: erro ao ler inode do diretório pai de destino\n");
+        cp_desfazer(fd, sb, bgdt, novo_inode_num, &novo_inode);
+        return 1;
+    }
+
+    // Adiciona a nova entrada no diretório pai do destino.
+    if (dir_adicionar_entrada(fd, sb, bgdt, destino_parent_inode_num, &destino_parent_inode, nome_final,
+                              novo_inode_num, tipo_origem) != 0) {
+        fprintf(erros_comando(), "cp: não foi possível adicionar '%s' no diretório de destino\n", nome_final);
+        cp_desfazer(fd, sb, bgdt, novo_inode_num, &novo_inode);
+        return 1;
+    }
+    fprintf(saida_comando(), "cp: arquivo copiado com sucesso: %s -> %s\n", path_origem, caminho_final);
+    return 0;
+}
+
+// Implementa 'cp -r': copia a árvore do diretório 'path_origem' para 'path_destino' (ou
+// para dentro dele, se for um diretório existente). Arquivos que não são diretórios vão
+// para comando_cp.
+int comando_cp_recursivo(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt,
+                         uint32_t diretorio_atual_inode_num, const char *path_origem, const char *path_destino) {
+    uint8_t tipo_origem;
+    uint32_t origem_num = path_to_inode_number(fd, sb, bgdt, diretorio_atual_inode_num, path_origem, &tipo_origem);
+    if (origem_num == 0) {
+        fprintf(erros_comando(), "cp: arquivo de origem não encontrado: %s\n", path_origem);
+        return 1;
+    }
+    if (tipo_origem != EXT2_FT_DIR) return comando_cp(fd, sb, bgdt, diretorio_atual_inode_num, path_origem, path_destino);
+
+    // Destino: dentro de 'path_destino' se ele for um diretório; senão, o próprio caminho.
+    char caminho_pai[1024];
+    const char *nome;
+    uint8_t tipo_destino;
+    uint32_t destino_num = path_to_inode_number(fd, sb, bgdt, diretorio_atual_inode_num, path_destino, &tipo_destino);
+    if (destino_num != 0 && tipo_destino == EXT2_FT_DIR) {
+        snprintf(caminho_pai, sizeof(caminho_pai), "%s", path_destino);
+        nome = strrchr(path_origem, '/') ? strrchr(path_origem, '/') + 1 : path_origem;
+    } else {
+        const char *barra = strrchr(path_destino, '/');
+        if (barra == NULL) snprintf(caminho_pai, sizeof(caminho_pai), ".");
+        else if (barra == path_destino) snprintf(caminho_pai, sizeof(caminho_pai), "/");
+        else snprintf(caminho_pai, sizeof(caminho_pai), "%.*s", (int)(barra - path_destino), path_destino);
+        nome = barra ? barra + 1 : path_destino;
+    }
+    if (nome[0] == '\0' || strcmp(nome, ".") == 0 || strcmp(nome, "..") == 0 || strlen(nome) > EXT2_NAME_LEN) {
+        fprintf(erros_comando(), "cp: nome de destino inválido: %s\n", path_destino);
+        return 1;
+    }
+    uint8_t tipo_pai;
+    uint32_t pai_num = path_to_inode_number(fd, sb, bgdt, diretorio_atual_inode_num, caminho_pai, &tipo_pai);
+    struct ext2_inode pai;
+    if (pai_num == 0 || read_inode(fd, sb, bgdt, pai_num, &pai) != 0 || !S_ISDIR(pai.i_mode)) {
+        fprintf(erros_comando(), "cp: diretório de destino não encontrado: %s\n", caminho_pai);
+        return 1;
+    }
+    if (dir_lookup(fd, sb, bgdt, pai_num, nome, NULL) != 0) {
+        fprintf(erros_comando(), "cp: arquivo de destino já existe: %s/%s\n", caminho_pai, nome);
+        return 1;
+    }
+    // O destino não pode ficar dentro da árvore copiada.
+    for (uint32_t ancestral = pai_num, passos = 0; ancestral != 0 && passos < 4096; ++passos) {
+        if (ancestral == origem_num) {
+            fprintf(erros_comando(), "cp: não é possível copiar '%s' para dentro dele mesmo\n", path_origem);
+            return 1;
+        }
+        if (ancestral == EXT2_ROOT_INO) break;
+        ancestral = dir_lookup(fd, sb, bgdt, ancestral, "..", NULL);
+    }
+
+    struct copia_recursiva c;
+    memset(&c, 0, sizeof(c));
+    c.fd = fd;
+    c.sb = sb;
+    c.bgdt = bgdt;
+    c.objetivo = grupo_do_inode(pai_num, NULL) * sb->s_blocks_per_group + sb->s_first_data_block;
+    struct entradas_cp entradas = { NULL, 0, 0 }, auxiliar = { NULL, 0, 0 };
+    int resultado = 0;
+
+    // 1. Metadados: a raiz da cópia entra no pai; depois cada diretório da fila é preenchido.
+    uint32_t raiz = cp_criar_diretorio(&c, origem_num, pai_num, &auxiliar);
+    if (raiz == 0) {
+        fprintf(erros_comando(), "cp: não foi possível criar o diretório de destino\n");
+        resultado = 1;
+    } else {
+        pai.i_links_count++;
+        if (dir_adicionar_entrada(fd, sb, bgdt, pai_num, &pai, nome, raiz, EXT2_FT_DIR) != 0) {
+            // Sem entrada, a cópia vazia é desfeita.
+            struct ext2_inode vazio;
+            if (read_inode(fd, sb, bgdt, raiz, &vazio) == 0) liberar_blocos_arquivo(fd, sb, bgdt, &vazio);
+            descritor_grupo(bgdt, grupo_do_inode(raiz, NULL))->bg_used_dirs_count--;
+            deallocate_inode(fd, sb, bgdt, raiz);
+            fprintf(erros_comando(), "cp: não foi possível adicionar '%s' no diretório de destino\n", nome);
+            resultado = 1;
+            c.fim_fila = 0;
+        }
+    }
+    while (c.inicio_fila < c.fim_fila) {
+        struct diretorio_cp d = c.fila[c.inicio_fila++];
+        if (cp_preencher_diretorio(&c, &d, &entradas, &auxiliar) != 0) resultado = 1;
+    }
+
+    // 2. Dados: as threads copiam direto na imagem; os trechos pendentes vão pela transação.
+    if (cp_copiar_dados(&c) != 0) resultado = 1;
+
+    uint64_t blocos = c.tarefas.blocos + c.tarefas_locais.blocos;
+    cp_liberar(&c);
+    free(entradas.itens);
+    free(auxiliar.itens);
+    if (resultado != 0) {
+        fprintf(erros_comando(), "cp: erro ao copiar '%s'\n", path_origem);
+        return 1;
+    }
+    if (destino_num != 0) {
+        fprintf(saida_comando(), "cp: %s -> %s/%s: ", path_origem, path_destino, nome);
+    } else {
+        fprintf(saida_comando(), "cp: %s -> %s: ", path_origem, path_destino);
+    }
+    fprintf(saida_comando(), "%u arquivos, %u diretórios, %llu blocos copiados\n",
+            c.arquivos, c.diretorios, (unsigned long long)blocos);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Criação de imagens (modo mkfs).
+// Gera uma imagem Ext2 revisão 1 (sparse_super, filetype) com blocos de 1, 2 ou 4 KiB:
+// superbloco e cópias, descritores, bitmaps, diretório raiz e lost+found.
+// A imagem é um arquivo esparso: as tabelas de inodes não são escritas (os buracos
+// são lidos como zeros, que é um inode livre), e os metadados de cada grupo
+// (superbloco, descritores e bitmaps) são gravados com uma única escrita.
+// ---------------------------------------------------------------------------
+
+#define EXT2_FEATURE_INCOMPAT_FILETYPE     0x0002
+#define EXT2_PRIMEIRO_INODE_LIVRE 11 // Inodes 1-10 são reservados; 11 é o lost+found
+#define MKFS_MIN_BLOCOS_DADOS 50 // Último grupo menor que isto (além dos metadados) é descartado
+
+static void mkfs_marcar_bits(unsigned char *bitmap, uint32_t de, uint32_t ate) {
+    for (uint32_t bit = de; bit < ate; ++bit) set_bit(bitmap, (int)bit);
+}
+
+// Cria a imagem em 'caminho' (substituindo o arquivo se existir).
+// Retorna 0 em sucesso, -1 em erro.
+int criar_sistema_de_arquivos(const char *caminho, const struct parametros_mkfs *parametros) {
+    uint32_t tamanho_bloco = parametros->tamanho_bloco ? parametros->tamanho_bloco : 1024;
+    if (tamanho_bloco < (1u << EXT2_MIN_LOG_BLOCO) || tamanho_bloco > BLOCK_SIZE_MAX ||
+        (tamanho_bloco & (tamanho_bloco - 1)) != 0) {
+        fprintf(erros_comando(), "mkfs: tamanho de bloco inválido: %u (use 1024, 2048 ou 4096)\n", tamanho_bloco);
+        return -1;
+    }
+    uint32_t log_bloco = (uint32_t)__builtin_ctz(tamanho_bloco);
+    uint32_t blocos_por_grupo = tamanho_bloco * 8; // Um bloco de bitmap por grupo
+    // Com blocos de 1 KiB o superbloco ocupa o bloco 1; com blocos maiores fica dentro do bloco 0.
+    uint32_t primeiro_bloco = (tamanho_bloco == 1024) ? 1 : 0;
+
+    uint16_t tamanho_inode = parametros->tamanho_inode ? parametros->tamanho_inode : EXT2_GOOD_OLD_INODE_SIZE;
+    if (tamanho_inode < EXT2_GOOD_OLD_INODE_SIZE || tamanho_inode > tamanho_bloco ||
+        (tamanho_inode & (tamanho_inode - 1)) != 0) {
+        fprintf(erros_comando(), "mkfs: tamanho de inode inválido: %u\n", tamanho_inode);
+        return -1;
+    }
+    uint32_t inodes_por_bloco = tamanho_bloco / tamanho_inode;
+
+    // Geometria: quantidade de blocos e de grupos.
+    uint64_t total_blocos;
+    if (parametros->num_grupos > 0) {
+        total_blocos = primeiro_bloco + (uint64_t)parametros->num_grupos * blocos_por_grupo;
+    } else {
+        total_blocos = parametros->tamanho_bytes >> log_bloco;
+    }
+    if (total_blocos > UINT32_MAX) {
+        fprintf(erros_comando(), "mkfs: imagem grande demais para blocos de %u bytes\n", tamanho_bloco);
+        return -1;
+    }
+
+    uint32_t inodes_por_grupo = parametros->inodes_por_grupo;
+    if (inodes_por_grupo == 0) inodes_por_grupo = blocos_por_grupo * (tamanho_bloco / 1024) / 4;
+    inodes_por_grupo = (inodes_por_grupo + inodes_por_bloco - 1) / inodes_por_bloco * inodes_por_bloco;
+    if (inodes_por_grupo % 8 != 0) inodes_por_grupo = (inodes_por_grupo + 7) / 8 * 8;
+    if (inodes_por_grupo > blocos_por_grupo) {
+        fprintf(erros_comando(), "mkfs: no máximo %u inodes por grupo\n", blocos_por_grupo);
+        return -1;
+    }
+    uint32_t blocos_tabela_inodes = inodes_por_grupo / inodes_por_bloco;
+
+    uint32_t num_grupos = (uint32_t)((total_blocos - primeiro_bloco + blocos_por_grupo - 1) / blocos_por_grupo);
+    uint32_t blocos_descritores = 0;
+    for (int tentativa = 0; tentativa < 2 && num_grupos > 0; ++tentativa) {
+        blocos_descritores = (num_grupos * sizeof(struct ext2_group_desc) + tamanho_bloco - 1) / tamanho_bloco;
+        uint32_t ultimo = num_grupos - 1;
+        uint32_t tamanho_ultimo = (uint32_t)(total_blocos - primeiro_bloco - (uint64_t)ultimo * blocos_por_grupo);
+        uint32_t metadados_ultimo = (grupo_tem_superbloco(ultimo) ? 1 + blocos_descritores : 0) + 2 + blocos_tabela_inodes;
+        if (ultimo == 0 || tamanho_ultimo >= metadados_ultimo + MKFS_MIN_BLOCOS_DADOS) break;
+        total_blocos -= tamanho_ultimo; // Último grupo pequeno demais: fica fora da imagem
+        num_grupos--;
+    }
+    uint32_t metadados_grupo0 = 1 + blocos_descritores + 2 + blocos_tabela_inodes;
+    if (num_grupos == 0 || total_blocos - primeiro_bloco < metadados_grupo0 + MKFS_MIN_BLOCOS_DADOS) {
+        fprintf(erros_comando(), "mkfs: imagem pequena demais\n");
+        return -1;
+    }
+
+    struct ext2_group_desc *descritores = (struct ext2_group_desc *)calloc(blocos_descritores, tamanho_bloco);
+    char *buffer = (char *)calloc(1 + blocos_descritores + 2, tamanho_bloco); // Superbloco, descritores e bitmaps
+    if (!descritores || !buffer) {
+        perror("mkfs: Erro ao alocar memória");
+        free(descritores);
+        free(buffer);
+        return -1;
+    }
+
+    // Primeiro passo: posição dos metadados e contagens de cada grupo.
+    uint32_t bloco_raiz = 0;
+    uint64_t blocos_livres = 0;
+    for (uint32_t g = 0; g < num_grupos; ++g) {
+        uint32_t inicio = primeiro_bloco + g * blocos_por_grupo;
+        uint32_t tamanho = (g == num_grupos - 1) ? (uint32_t)(total_blocos - inicio) : blocos_por_grupo;
+        uint32_t posicao = inicio + (grupo_tem_superbloco(g) ? 1 + blocos_descritores : 0);
+        descritores[g].bg_block_bitmap = posicao;
+        descritores[g].bg_inode_bitmap = posicao + 1;
+        descritores[g].bg_inode_table = posicao + 2;
+        uint32_t usados = posicao + 2 + blocos_tabela_inodes - inicio;
+        if (g == 0) {
+            bloco_raiz = inicio + usados;
+            usados += 2; // Blocos do diretório raiz e do lost+found
+        }
+        descritores[g].bg_free_blocks_count = (uint16_t)(tamanho - usados);
+        descritores[g].bg_free_inodes_count = (uint16_t)(inodes_por_grupo - (g == 0 ? EXT2_PRIMEIRO_INODE_LIVRE : 0));
+        descritores[g].bg_used_dirs_count = (g == 0) ? 2 : 0;
+        blocos_livres += tamanho - usados;
+    }
+
+    uint32_t agora = (uint32_t)time(NULL);
+    struct ext2_super_block sb;
+    memset(&sb, 0, sizeof(sb));
+    sb.s_inodes_count = inodes_por_grupo * num_grupos;
+    sb.s_blocks_count = (uint32_t)total_blocos;
+    sb.s_r_blocks_count = (uint32_t)(total_blocos / 20); // 5% reservados, como o mke2fs
+    sb.s_free_blocks_count = (uint32_t)blocos_livres;
+    sb.s_free_inodes_count = sb.s_inodes_count - EXT2_PRIMEIRO_INODE_LIVRE;
+    sb.s_first_data_block = primeiro_bloco;
+    sb.s_log_block_size = log_bloco - EXT2_MIN_LOG_BLOCO;
+    sb.s_log_frag_size = log_bloco - EXT2_MIN_LOG_BLOCO;
+    sb.s_blocks_per_group = blocos_por_grupo;
+    sb.s_frags_per_group = blocos_por_grupo;
+    sb.s_inodes_per_group = inodes_por_grupo;
+    sb.s_wtime = agora;
+    sb.s_max_mnt_count = 0xFFFF; // Sem checagem forçada por contagem de montagens
+    sb.s_magic = EXT2_SUPER_MAGIC;
+    sb.s_state = 1;  // Limpo
+    sb.s_errors = 1; // Continuar
+    sb.s_lastcheck = agora;
+    sb.s_rev_level = EXT2_DYNAMIC_REV;
+    sb.s_first_ino = EXT2_PRIMEIRO_INODE_LIVRE;
+    sb.s_inode_size = tamanho_inode;
+    sb.s_feature_incompat = EXT2_FEATURE_INCOMPAT_FILETYPE;
+    sb.s_feature_ro_compat = EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER;
+    srand(agora ^ (uint32_t)getpid());
+    for (int i = 0; i < 16; ++i) sb.s_uuid[i] = (uint8_t)rand();
+    sb.s_uuid[6] = (sb.s_uuid[6] & 0x0F) | 0x40; // UUID versão 4
+    sb.s_uuid[8] = (sb.s_uuid[8] & 0x3F) | 0x80;
+
+    int fd = open(caminho, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("mkfs: Erro ao criar a imagem");
+        free(descritores);
+        free(buffer);
+        return -1;
+    }
+    // Arquivo esparso do tamanho final: tudo que não for escrito é lido como zero.
+    if (ftruncate(fd, (off_t)total_blocos << log_bloco) != 0) {
+        perror("mkfs: Erro ao definir o tamanho da imagem");
+        close(fd);
+        free(descritores);
+        free(buffer);
+        return -1;
+    }
+
+    // Segundo passo: uma escrita por grupo com superbloco, descritores e bitmaps.
+    int resultado = 0;
+    for (uint32_t g = 0; g < num_grupos && resultado == 0; ++g) {
+        uint32_t inicio = primeiro_bloco + g * blocos_por_grupo;
+        uint32_t tamanho = (g == num_grupos - 1) ? (uint32_t)(total_blocos - inicio) : blocos_por_grupo;
+        uint32_t blocos_buffer = descritores[g].bg_inode_table - inicio;
+        memset(buffer, 0, (size_t)blocos_buffer * tamanho_bloco);
+
+        char *cursor = buffer;
+        if (grupo_tem_superbloco(g)) {
+            sb.s_block_group_nr = (uint16_t)g;
+            // O superbloco principal fica no byte 1024 (dentro do bloco 0 com blocos maiores
+            // que 1 KiB); as cópias ficam no início do primeiro bloco do grupo.
+            memcpy(cursor + (g == 0 && primeiro_bloco == 0 ? SUPERBLOCK_OFFSET : 0), &sb, sizeof(sb));
+            memcpy(cursor + tamanho_bloco, descritores, (size_t)blocos_descritores * tamanho_bloco);
+            cursor += (size_t)(1 + blocos_descritores) * tamanho_bloco;
+        }
+
+        unsigned char *bitmap_blocos = (unsigned char *)cursor;
+        unsigned char *bitmap_inodes = (unsigned char *)cursor + tamanho_bloco;
+        uint32_t usados = tamanho - descritores[g].bg_free_blocks_count;
+        mkfs_marcar_bits(bitmap_blocos, 0, usados);
+        mkfs_marcar_bits(bitmap_blocos, tamanho, blocos_por_grupo); // Além do fim da imagem
+        mkfs_marcar_bits(bitmap_inodes, 0, g == 0 ? EXT2_PRIMEIRO_INODE_LIVRE : 0);
+        mkfs_marcar_bits(bitmap_inodes, inodes_por_grupo, tamanho_bloco * 8); // Preenchimento
+
+        size_t bytes = (size_t)blocos_buffer * tamanho_bloco;
+        if (pwrite(fd, buffer, bytes, (off_t)inicio << log_bloco) != (ssize_t)bytes) {
+            perror("mkfs: Erro ao gravar metadados do grupo");
+            resultado = -1;
+        }
+    }
+
+    // Diretório raiz e lost+found: inodes e um bloco de entradas cada.
+    if (resultado == 0) {
+        uint32_t inodes[2] = { EXT2_ROOT_INO, EXT2_PRIMEIRO_INODE_LIVRE };
+        uint16_t modos[2] = { S_IFDIR | 0755, S_IFDIR | 0700 };
+        uint16_t links[2] = { 3, 2 }; // A raiz é o '..' do lost+found
+        char bloco[BLOCK_SIZE_MAX];
+
+        for (int i = 0; i < 2 && resultado == 0; ++i) {
+            struct ext2_inode inode;
+            memset(&inode, 0, sizeof(inode));
+            inode.i_mode = modos[i];
+            inode.i_size = tamanho_bloco;
+            inode.i_atime = inode.i_ctime = inode.i_mtime = agora;
+            inode.i_links_count = links[i];
+            inode.i_blocks = tamanho_bloco / 512;
+            inode.i_block[0] = bloco_raiz + i;
+
+            memset(bloco, 0, sizeof(bloco));
+            struct ext2_dir_entry_2 *ponto = (struct ext2_dir_entry_2 *)bloco;
+            ponto->inode = inodes[i];
+            ponto->rec_len = 12;
+            ponto->name_len = 1;
+            ponto->file_type = EXT2_FT_DIR;
+            ponto->name[0] = '.';
+            struct ext2_dir_entry_2 *pai = (struct ext2_dir_entry_2 *)(bloco + 12);
+            pai->inode = EXT2_ROOT_INO;
+            pai->rec_len = (uint16_t)((i == 0) ? 12 : tamanho_bloco - 12);
+            pai->name_len = 2;
+            pai->file_type = EXT2_FT_DIR;
+            memcpy(pai->name, "..", 2);
+            if (i == 0) {
+                struct ext2_dir_entry_2 *achados = (struct ext2_dir_entry_2 *)(bloco + 24);
+                achados->inode = EXT2_PRIMEIRO_INODE_LIVRE;
+                achados->rec_len = (uint16_t)(tamanho_bloco - 24);
+                achados->name_len = 10;
+                achados->file_type = EXT2_FT_DIR;
+                memcpy(achados->name, "lost+found", 10);
+            }
+
+            off_t offset_inode = ((off_t)descritores[0].bg_inode_table << log_bloco) + (off_t)(inodes[i] - 1) * tamanho_inode;
+            if (pwrite(fd, &inode, sizeof(inode), offset_inode) != sizeof(inode) ||
+                pwrite(fd, bloco, tamanho_bloco, (off_t)(bloco_raiz + i) << log_bloco) != (ssize_t)tamanho_bloco) {
+                perror("mkfs: Erro ao gravar diretórios iniciais");
+                resultado = -1;
+            }
+        }
+    }
+
+    if (resultado == 0 && modo_verboso) {
+        fprintf(saida_comando(), "mkfs: %s: %u blocos de %u bytes, %u grupos, %u inodes (%u por grupo, %u bytes cada)\n",
+               caminho, sb.s_blocks_count, tamanho_bloco, num_grupos, sb.s_inodes_count,
+               inodes_por_grupo, tamanho_inode);
+    }
+    close(fd);
+    free(descritores);
+    free(buffer);
+    return resultado;
+}
+
+// Copia a imagem 'origem' para 'destino' preservando os buracos (blocos de zeros não
+// são escritos, como nas imagens do mkfs). Retorna 0 em sucesso, -1 em erro.
+int copiar_imagem(const char *origem, const char *destino) {
+    int entrada = open(origem, O_RDONLY);
+    int saida = open(destino, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    struct stat info;
+    if (entrada < 0 || saida < 0 || fstat(entrada, &info) != 0 || ftruncate(saida, info.st_size) != 0) {
+        perror("Erro ao copiar a imagem");
+        if (entrada >= 0) close(entrada);
+        if (saida >= 0) close(saida);
+        return -1;
+    }
+    static char buffer[1 << 20];
+    static const char zeros[BLOCK_SIZE_MAX];
+    int resultado = 0;
+    for (off_t offset = 0; offset < info.st_size && resultado == 0; ) {
+        ssize_t lidos = pread(entrada, buffer, sizeof(buffer), offset);
+        if (lidos <= 0) { resultado = lidos < 0 ? -1 : 0; break; }
+        for (ssize_t i = 0; i < lidos; i += BLOCK_SIZE) {
+            size_t parte = (size_t)(lidos - i) < BLOCK_SIZE ? (size_t)(lidos - i) : BLOCK_SIZE;
+            if (memcmp(buffer + i, zeros, parte) == 0) continue;
+            if (pwrite(saida, buffer + i, parte, offset + i) != (ssize_t)parte) { resultado = -1; break; }
+        }
+        offset += lidos;
+    }
+    if (resultado != 0) perror("Erro ao copiar a imagem");
+    close(entrada);
+    close(saida);
+    return resultado;
+}
+
+#define TRACE_MAX_LINHA 1024 // Maior linha de comando gravada no trace
+
+static int despachar_comando(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt,
+                             struct sessao_shell *sessao, const char *primeiro_token, char **restante,
+                             int *sair);
+static int trace_gravando(void);
+static void trace_registrar(const char *linha, uint64_t inicio, int status, const struct contadores_es *antes);
+
+int modo_servidor = 0; // 1 quando os comandos vêm de clientes do socket (ver servidor_executar)
+
+// Comandos que só leem a imagem (e a sessão): rodam com a trava compartilhada, sem
+// transação, ao mesmo tempo que outros comandos de leitura.
+const char *comandos_leitura[] = { "info", "ls", "cat", "attr", "pwd", "cd", "frag", "dupes", NULL };
+
+// Retorna 1 se o comando da 'linha' (ainda não tokenizada) só lê a imagem.
+static int comando_somente_leitura(const char *linha) {
+    linha += strspn(linha, " \t\r\n");
+    size_t tamanho = strcspn(linha, " \t\r\n");
+    for (int i = 0; comandos_leitura[i] != NULL; ++i) {
+        if (strlen(comandos_leitura[i]) == tamanho && strncmp(linha, comandos_leitura[i], tamanho) == 0) return 1;
+    }
+    // 'scrub' só lê a imagem e as somas; 'scrub -c' recria o arquivo de somas.
+    if (tamanho == 5 && strncmp(linha, "scrub", 5) == 0) return linha[5 + strspn(linha + 5, " \t\r\n")] == '\0';
+    return 0;
+}
+
+// Executa uma linha de comando do shell. Chamada com a trava do sistema de arquivos:
+// compartilhada se 'somente_leitura' (ver comando_somente_leitura), senão exclusiva.
+// A linha é modificada (tokenizada com strtok_r). '*sair' recebe 1 se o comando for 'quit'/'exit'.
+// Retorna o código de saída do comando (STATUS_*).
+static int executar_comando_travado(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt,
+                                   struct sessao_shell *sessao, char *linha, int somente_leitura, int *sair) {
+    *sair = 0;
+
+    // Extrai o primeiro token (o comando).
+    char *restante;
+    char *primeiro_token = strtok_r(linha, " \t\r\n", &restante);
+    if (primeiro_token == NULL) {
+        return STATUS_OK; // Linha vazia
+    }
+    if (somente_leitura) {
+        return despachar_comando(fd, sb, bgdt, sessao, primeiro_token, &restante, sair);
+    }
+
+    // 'begin' e 'commit' delimitam um lote: as escritas dos comandos entre eles
+    // são gravadas juntas na confirmação.
+    if (modo_servidor && (strcmp(primeiro_token, "begin") == 0 || strcmp(primeiro_token, "commit") == 0)) {
+        fprintf(erros_comando(), "%s: lotes não são suportados no modo servidor\n", primeiro_token);
+        return STATUS_ERRO; // O lote seria compartilhado por todos os clientes
+    } else if (strcmp(primeiro_token, "begin") == 0) {
+        transacao_iniciar();
+        return STATUS_OK;
+    } else if (strcmp(primeiro_token, "commit") == 0) {
+        if (motor_atual->transacao_atual.aninhamento == 0) {
+            fprintf(erros_comando(), "commit: nenhuma transação aberta\n");
+            return STATUS_ERRO;
+        }
+        return transacao_confirmar(fd) == 0 ? STATUS_OK : STATUS_ERRO;
+    }
+
+    // Cada comando roda dentro de uma transação: os blocos de metadados que ele
+    // altera são gravados de uma vez, ordenados, quando ele termina.
+    transacao_iniciar();
+    int status = despachar_comando(fd, sb, bgdt, sessao, primeiro_token, &restante, sair);
+    if (transacao_confirmar(fd) != 0 && status == STATUS_OK) {
+        status = STATUS_ERRO;
+    }
+    return status;
+}
+
+// Grava o span do comando (chamado "comando_<nome>", como as funções) com a linha,
+// o status e a E/S feita desde 'antes'.
+static void evento_comando(const char *nome, const char *linha, uint64_t inicio, int status,
+                           const struct contadores_es *antes) {
+    char nome_json[64], nome_evento[80], linha_json[2 * TRACE_MAX_LINHA];
+    evento_texto_json(nome_json, sizeof(nome_json), nome);
+    snprintf(nome_evento, sizeof(nome_evento), "comando_%s", nome_json);
+    linha += strspn(linha, " \t");
+    char linha_sem_quebra[TRACE_MAX_LINHA];
+    snprintf(linha_sem_quebra, sizeof(linha_sem_quebra), "%.*s", (int)strcspn(linha, "\r\n"), linha);
+    evento_texto_json(linha_json, sizeof(linha_json), linha_sem_quebra);
+    evento("comando", nome_evento, inicio,
+           "\"linha\":\"%s\",\"status\":%d,\"leituras\":%llu,\"bytes_lidos\":%llu,\"escritas\":%llu,"
+           "\"bytes_escritos\":%llu,\"sincronizacoes\":%llu",
+           linha_json, status, (unsigned long long)(contadores_es.leituras - antes->leituras),
+           (unsigned long long)(contadores_es.bytes_lidos - antes->bytes_lidos),
+           (unsigned long long)(contadores_es.escritas - antes->escritas),
+           (unsigned long long)(contadores_es.bytes_escritos - antes->bytes_escritos),
+           (unsigned long long)(contadores_es.sincronizacoes - antes->sincronizacoes));
+}
+
+// Executa uma linha de comando do shell (ver executar_comando_travado) com o
+// sistema de arquivos travado (para leitura ou com exclusividade) contra os outros
+// clientes e a thread de sincronização, aplicando a política de durabilidade ao final.
+// Retorna o código de saída do comando (STATUS_*); '*sair' recebe 1 para 'quit'/'exit'.
+int executar_comando(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt,
+                     struct sessao_shell *sessao, char *linha, int *sair) {
+    // Com o trace ou os eventos ativos, guarda a linha antes da tokenização; com as
+    // estatísticas ou os eventos, guarda o nome do comando. Todos medem a duração.
+    char copia_trace[TRACE_MAX_LINHA];
+    char nome_comando[16] = "";
+    struct contadores_es antes = contadores_es;
+    uint64_t inicio = 0;
+    if (trace_gravando() || EVENTOS_ATIVOS) snprintf(copia_trace, sizeof(copia_trace), "%s", linha);
+    if (ESTATISTICAS_ATIVAS) {
+        size_t espacos = strspn(linha, " \t\r\n");
+        snprintf(nome_comando, sizeof(nome_comando), "%.*s", (int)strcspn(linha + espacos, " \t\r\n"), linha + espacos);
+    }
+    if (ESTATISTICAS_ATIVAS || trace_gravando()) inicio = relogio_ns();
+
+    int somente_leitura = comando_somente_leitura(linha);
+    if (somente_leitura) durabilidade_bloquear_leitura(); else durabilidade_bloquear();
+    trava_exclusiva_do_comando = !somente_leitura;
+    int status = executar_comando_travado(fd, sb, bgdt, sessao, linha, somente_leitura, sair);
+    trava_exclusiva_do_comando = 0;
+    if (!somente_leitura && durabilidade_apos_comando(fd) != 0 && status == STATUS_OK) {
+        status = STATUS_ERRO;
+    }
+    durabilidade_desbloquear();
+
+    pthread_mutex_lock(&registro_mutex);
+    if (nome_comando[0] != '\0') ESTAT(estat_comando(nome_comando, relogio_ns() - inicio, status != STATUS_OK));
+    estatisticas_recolher();
+    if (EVENTOS_ATIVOS && nome_comando[0] != '\0') evento_comando(nome_comando, copia_trace, inicio, status, &antes);
+    if (trace_gravando()) trace_registrar(copia_trace, inicio, status, &antes);
+    pthread_mutex_unlock(&registro_mutex);
+    return status;
+}
+
+// Despacha o comando 'primeiro_token' (os argumentos são lidos com strtok_r(NULL, ..., restante)).
+// Retorna o código de saída do comando (STATUS_*).
+static int despachar_comando(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt,
+                             struct sessao_shell *sessao, const char *primeiro_token, char **restante,
+                             int *sair) {
+    // Processa os comandos.
+    if (strcmp(primeiro_token, "info") == 0) {
+        return comando_info(sb);
+    } else if (strcmp(primeiro_token, "ls") == 0) {
+        char *arg_path = strtok_r(NULL, " \t\r\n", restante);
+        return comando_ls(fd, sb, bgdt, sessao->diretorio_atual_inode, arg_path);
+    } else if (strcmp(primeiro_token, "cat") == 0) {
+        char *arg_path_cat = strtok_r(NULL, " \t\r\n", restante);
+        return comando_cat(fd, sb, bgdt, sessao->diretorio_atual_inode, arg_path_cat);
+    } else if (strcmp(primeiro_token, "attr") == 0) {
+        char *arg_path_attr = strtok_r(NULL, " \t\r\n", restante);
+        return comando_attr(fd, sb, bgdt, sessao->diretorio_atual_inode, arg_path_attr);
+    } else if (strcmp(primeiro_token, "pwd") == 0) {
+        return comando_pwd(sessao->diretorio_atual);
+    } else if (strcmp(primeiro_token, "cd") == 0) {
+        char *arg_path_cd = strtok_r(NULL, " \t\r\n", restante);
+        return comando_cd(fd, sb, bgdt, &sessao->diretorio_atual_inode, sessao->diretorio_atual,
+                          sizeof(sessao->diretorio_atual), arg_path_cd);
+    } else if (strcmp(primeiro_token, "touch") == 0) {
+        char *arg_path_touch = strtok_r(NULL, " \t\r\n", restante);
+        return comando_touch(fd, sb, bgdt, sessao->diretorio_atual_inode, sessao->diretorio_atual, arg_path_touch);
+    } else if (strcmp(primeiro_token, "mkdir") == 0) {
+        char *arg_path_mkdir = strtok_r(NULL, " \t\r\n", restante);
+        return comando_mkdir(fd, sb, bgdt, sessao->diretorio_atual_inode, sessao->diretorio_atual, arg_path_mkdir);
+    } else if (strcmp(primeiro_token, "rm") == 0) {
+        char *arg_path_rm = strtok_r(NULL, " \t\r\n", restante);
+        if (arg_path_rm != NULL && strcmp(arg_path_rm, "-r") == 0) {
+            arg_path_rm = strtok_r(NULL, " \t\r\n", restante);
+            if (arg_path_rm == NULL) {
+                fprintf(erros_comando(), "Uso: rm [-r] <caminho>\n");
+                return STATUS_USO;
+            }
+            return comando_rm_recursivo(fd, sb, bgdt, sessao->diretorio_atual_inode, arg_path_rm);
+        }
+        return comando_rm(fd, sb, bgdt, sessao->diretorio_atual_inode, arg_path_rm);
+    } else if (strcmp(primeiro_token, "rmdir") == 0) {
+        char *arg_path_rmdir = strtok_r(NULL, " \t\r\n", restante);
+        return comando_rmdir(fd, sb, bgdt, sessao->diretorio_atual_inode, arg_path_rmdir);
+    } else if (strcmp(primeiro_token, "compact") == 0) {
+        char *arg_path_compact = strtok_r(NULL, " \t\r\n", restante);
+        char *arg_ordem = strtok_r(NULL, " \t\r\n", restante);
+        if (arg_path_compact == NULL || arg_path_compact[0] == '-' || strtok_r(NULL, " \t\r\n", restante) != NULL ||
+            (arg_ordem != NULL && strcmp(arg_ordem, "hash") != 0 && strcmp(arg_ordem, "inode") != 0)) {
+            fprintf(erros_comando(), "Uso: compact <diretório> [hash|inode]\n");
+            return STATUS_USO;
+        }
+        return comando_compact(fd, sb, bgdt, sessao->diretorio_atual_inode, arg_path_compact, arg_ordem);
+    } else if (strcmp(primeiro_token, "defrag") == 0) {
+        int recursivo = 0;
+        uint32_t limite_kib = 0;
+        char *arg_path_defrag = NULL;
+        char *arg;
+        while ((arg = strtok_r(NULL, " \t\r\n", restante)) != NULL) {
+            if (strcmp(arg, "-r") == 0) {
+                recursivo = 1;
+            } else if (strcmp(arg, "-l") == 0) {
+                char *valor = strtok_r(NULL, " \t\r\n", restante);
+                char *fim;
+                unsigned long limite = valor ? strtoul(valor, &fim, 10) : 0;
+                if (valor == NULL || *fim != '\0' || limite == 0 || limite > UINT32_MAX) {
+                    arg_path_defrag = NULL;
+                    break;
+                }
+                limite_kib = (uint32_t)limite;
+            } else if (arg_path_defrag == NULL) {
+                arg_path_defrag = arg;
+            } else {
+                arg_path_defrag = NULL;
+                break;
+            }
+        }
+        if (arg_path_defrag == NULL) {
+            fprintf(erros_comando(), "Uso: defrag [-r] [-l KiB/s] <caminho>\n");
+            return STATUS_USO;
+        }
+        return comando_defrag(fd, sb, bgdt, sessao->diretorio_atual_inode, arg_path_defrag, recursivo, limite_kib);
+    } else if (strcmp(primeiro_token, "frag") == 0) {
+        char *arg = strtok_r(NULL, " \t\r\n", restante);
+        int todos = arg != NULL && strcmp(arg, "-a") == 0;
+        if ((arg != NULL && !todos) || strtok_r(NULL, " \t\r\n", restante) != NULL) {
+            fprintf(erros_comando(), "Uso: frag [-a]\n");
+            return STATUS_USO;
+        }
+        return comando_frag(fd, sb, bgdt, todos);
+    } else if (strcmp(primeiro_token, "scrub") == 0) {
+        char *arg = strtok_r(NULL, " \t\r\n", restante);
+        int criar = arg != NULL && strcmp(arg, "-c") == 0;
+        if ((arg != NULL && !criar) || strtok_r(NULL, " \t\r\n", restante) != NULL) {
+            fprintf(erros_comando(), "Uso: scrub [-c]\n");
+            return STATUS_USO;
+        }
+        return comando_scrub(fd, sb, bgdt, criar);
+    } else if (strcmp(primeiro_token, "dupes") == 0) {
+        if (strtok_r(NULL, " \t\r\n", restante) != NULL) {
+            fprintf(erros_comando(), "Uso: dupes\n");
+            return STATUS_USO;
+        }
+        return comando_dupes(fd, sb, bgdt);
+    } else if (strcmp(primeiro_token, "rename") == 0) {
+        char *arg_path_origem = strtok_r(NULL, " \t\r\n", restante);
+        char *arg_path_destino = strtok_r(NULL, " \t\r\n", restante);
+        return comando_rename(fd, sb, bgdt, sessao->diretorio_atual_inode, arg_path_origem, arg_path_destino);
+    } else if (strcmp(primeiro_token, "mv") == 0) {
+        char *arg_path_origem = strtok_r(NULL, " \t\r\n", restante);
+        char *arg_path_destino = strtok_r(NULL, " \t\r\n", restante);
+        return comando_mv(fd, sb, bgdt, sessao->diretorio_atual_inode, arg_path_origem, arg_path_destino);
+    } else if (strcmp(primeiro_token, "cp") == 0) {
+        char *arg_path_origem = strtok_r(NULL, " \t\r\n", restante);
+        int recursivo = arg_path_origem != NULL && strcmp(arg_path_origem, "-r") == 0;
+        if (recursivo) arg_path_origem = strtok_r(NULL, " \t\r\n", restante);
+        char *arg_path_destino = strtok_r(NULL, " \t\r\n", restante);
+        if (arg_path_origem == NULL || arg_path_destino == NULL) {
+            fprintf(erros_comando(), "Uso: cp [-r] <origem> <destino>\n");
+            return STATUS_USO;
+        }
+        if (recursivo) {
+            return comando_cp_recursivo(fd, sb, bgdt, sessao->diretorio_atual_inode, arg_path_origem, arg_path_destino);
+        }
+        return comando_cp(fd, sb, bgdt, sessao->diretorio_atual_inode, arg_path_origem, arg_path_destino);
+    } else if (strcmp(primeiro_token, "stats") == 0) {
+        char *arg_stats = strtok_r(NULL, " \t\r\n", restante);
+        if (arg_stats == NULL) {
+            estatisticas_imprimir(saida_comando());
+        } else if (strcmp(arg_stats, "reset") == 0) {
+            estatisticas_zerar();
+        } else {
+            fprintf(erros_comando(), "Uso: stats [reset]\n");
+            return STATUS_USO;
+        }
+        return STATUS_OK;
+    } else if (strcmp(primeiro_token, "quit") == 0 || strcmp(primeiro_token, "exit") == 0) {
+        *sair = 1;
+        return STATUS_OK;
+    }
+
+    fprintf(saida_comando(), "Comando desconhecido: '%s'\n", primeiro_token);
+    return STATUS_DESCONHECIDO;
+}
+
+// ---------------------------------------------------------------------------
+// Gravação e reprodução de traces de sessão.
+// Com o trace ativo, cada comando executado por executar_comando é gravado em um
+// arquivo binário compacto: um cabeçalho (magic "EX2T", versão e o instante de início
+// da sessão em ns desde a época) seguido de um registro por comando. Os campos do
+// registro são inteiros sem sinal em varint (LEB128): intervalo desde o início do
+// comando anterior, duração, status, as chamadas de E/S (leituras, bytes lidos,
+// escritas, bytes escritos, sincronizações) e o tamanho da linha, seguido da linha.
+// A reprodução reexecuta os comandos em ordem, na velocidade gravada (multiplicada
+// por um fator) ou o mais rápido possível, e compara latência e E/S por comando.
+// Um registro incompleto no fim do arquivo (sessão interrompida) é ignorado.
+// ---------------------------------------------------------------------------
+
+#define TRACE_MAGIC "EX2T"
+#define TRACE_VERSAO 1
+#define TRACE_MAX_TIPOS 32 // Comandos distintos acompanhados na reprodução
+
+struct trace_cabecalho {
+    char magic[4];
+    uint32_t versao;
+    uint64_t inicio_unix_ns;  // Início da sessão gravada (CLOCK_REALTIME)
+};
+
+// Registro de um comando, já decodificado.
+struct registro_trace {
+    uint64_t inicio_ns;       // Início do comando em relação ao início da sessão
+    uint64_t duracao_ns;
+    uint64_t status;
+    struct contadores_es es;  // E/S feita pelo comando
+    char linha[TRACE_MAX_LINHA];
+};
+
+// Estado da gravação.
+static struct {
+    FILE *arquivo;            // NULL quando o trace está desativado
+    uint64_t inicio_ns;       // relogio_ns() no início da sessão
+    uint64_t ultimo_ns;       // Início do último comando gravado
+} trace = { NULL, 0, 0 };
+
+static int trace_gravando(void) {
+    return trace.arquivo != NULL;
+}
+
+// Inicia a gravação do trace em 'caminho'. Retorna 0 em sucesso, -1 em erro.
+int trace_abrir(const char *caminho) {
+    FILE *arquivo = fopen(caminho, "wb");
+    if (!arquivo) {
+        perror("trace: Erro ao criar o arquivo de trace");
+        return -1;
+    }
+    struct timespec agora;
+    clock_gettime(CLOCK_REALTIME, &agora);
+    struct trace_cabecalho cabecalho = { TRACE_MAGIC, TRACE_VERSAO,
+                                         (uint64_t)agora.tv_sec * 1000000000ull + (uint64_t)agora.tv_nsec };
+    if (fwrite(&cabecalho, sizeof(cabecalho), 1, arquivo) != 1) {
+        perror("trace: Erro ao gravar o cabeçalho");
+        fclose(arquivo);
+        return -1;
+    }
+    trace.arquivo = arquivo;
+    trace.inicio_ns = trace.ultimo_ns = relogio_ns();
+    return 0;
+}
+
+// Encerra a gravação. Retorna 0 em sucesso, -1 em erro.
+int trace_fechar(void) {
+    if (!trace.arquivo) return 0;
+    int resultado = (fclose(trace.arquivo) == 0) ? 0 : -1;
+    if (resultado != 0) perror("trace: Erro ao fechar o arquivo de trace");
+    trace.arquivo = NULL;
+    return resultado;
+}
+
+static void trace_escrever_varint(uint8_t **cursor, uint64_t valor) {
+    while (valor >= 0x80) {
+        *(*cursor)++ = (uint8_t)(valor | 0x80);
+        valor >>= 7;
+    }
+    *(*cursor)++ = (uint8_t)valor;
+}
+
+// Grava o registro de um comando. 'inicio' é o relogio_ns() do início do comando e
+// 'antes' os contadores de E/S naquele momento.
+static void trace_registrar(const char *linha, uint64_t inicio, int status, const struct contadores_es *antes) {
+    uint8_t registro[TRACE_MAX_LINHA + 10 * 9];
+    uint8_t *cursor = registro;
+    size_t tamanho_linha = strcspn(linha, "\r\n");
+
+    trace_escrever_varint(&cursor, inicio - trace.ultimo_ns);
+    trace_escrever_varint(&cursor, relogio_ns() - inicio);
+    trace_escrever_varint(&cursor, (uint64_t)status);
+    trace_escrever_varint(&cursor, contadores_es.leituras - antes->leituras);
+    trace_escrever_varint(&cursor, contadores_es.bytes_lidos - antes->bytes_lidos);
+    trace_escrever_varint(&cursor, contadores_es.escritas - antes->escritas);
+    trace_escrever_varint(&cursor, contadores_es.bytes_escritos - antes->bytes_escritos);
+    trace_escrever_varint(&cursor, contadores_es.sincronizacoes - antes->sincronizacoes);
+    trace_escrever_varint(&cursor, tamanho_linha);
+    memcpy(cursor, linha, tamanho_linha);
+    cursor += tamanho_linha;
+    trace.ultimo_ns = inicio;
+
+    if (fwrite(registro, 1, (size_t)(cursor - registro), trace.arquivo) != (size_t)(cursor - registro)) {
+        perror("trace: Erro ao gravar registro; gravação interrompida");
+        fclose(trace.arquivo);
+        trace.arquivo = NULL;
+    }
+}
+
+// Lê um varint. Retorna 0 em sucesso, -1 no fim do arquivo ou em valor inválido.
+static int trace_ler_varint(FILE *arquivo, uint64_t *valor) {
+    *valor = 0;
+    for (int deslocamento = 0; deslocamento < 64; deslocamento += 7) {
+        int byte = fgetc(arquivo);
+        if (byte == EOF) return -1;
+        *valor |= (uint64_t)(byte & 0x7F) << deslocamento;
+        if (!(byte & 0x80)) return 0;
+    }
+    return -1;
+}
+
+// Lê o próximo registro. 'anterior_ns' é o início do registro anterior (atualizado).
+// Retorna 1 se leu um registro, 0 no fim do trace.
+static int trace_ler_registro(FILE *arquivo, struct registro_trace *r, uint64_t *anterior_ns) {
+    uint64_t campos[9];
+    for (int i = 0; i < 9; ++i) {
+        if (trace_ler_varint(arquivo, &campos[i]) != 0) return 0;
+    }
+    if (campos[8] >= TRACE_MAX_LINHA || fread(r->linha, 1, campos[8], arquivo) != campos[8]) return 0;
+    r->linha[campos[8]] = '\0';
+    *anterior_ns += campos[0];
+    r->inicio_ns = *anterior_ns;
+    r->duracao_ns = campos[1];
+    r->status = campos[2];
+    r->es.leituras = campos[3];
+    r->es.bytes_lidos = campos[4];
+    r->es.escritas = campos[5];
+    r->es.bytes_escritos = campos[6];
+    r->es.sincronizacoes = campos[7];
+    return 1;
+}
+
+// Estatísticas da reprodução de um tipo de comando.
+struct estatisticas_reproducao {
+    char nome[16];
+    uint64_t *amostras;           // Latência de cada execução na reprodução (ns)
+    uint64_t num_amostras;
+    uint64_t capacidade;
+    uint64_t falhas;              // Status diferente de 0 na reprodução
+    uint64_t divergencias;        // Status diferente do gravado
+    uint64_t gravado_total_ns;    // Soma das durações gravadas
+    struct contadores_es es_gravado;
+    struct contadores_es es_reproducao;
+};
+
+static int comparar_latencias(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static struct estatisticas_reproducao* reproducao_tipo(struct estatisticas_reproducao *tipos, int *num_tipos,
+                                                       const char *linha) {
+    char nome[16];
+    size_t inicio = strspn(linha, " \t");
+    size_t tamanho = strcspn(linha + inicio, " \t");
+    if (tamanho == 0) return NULL;
+    snprintf(nome, sizeof(nome), "%.*s", (int)tamanho, linha + inicio);
+    for (int i = 0; i < *num_tipos; ++i) {
+        if (strcmp(tipos[i].nome, nome) == 0) return &tipos[i];
+    }
+    if (*num_tipos == TRACE_MAX_TIPOS) return NULL;
+    struct estatisticas_reproducao *t = &tipos[(*num_tipos)++];
+    memset(t, 0, sizeof(*t));
+    snprintf(t->nome, sizeof(t->nome), "%s", nome);
+    return t;
+}
+
+static void somar_es(struct contadores_es *total, const struct contadores_es *parcela) {
+    total->leituras += parcela->leituras;
+    total->bytes_lidos += parcela->bytes_lidos;
+    total->escritas += parcela->escritas;
+    total->bytes_escritos += parcela->bytes_escritos;
+    total->sincronizacoes += parcela->sincronizacoes;
+}
+
+// Imprime o relatório da reprodução: vazão e latência por tipo de comando, comparadas
+// com as durações e a E/S gravadas.
+static void reproducao_imprimir(FILE *saida, struct estatisticas_reproducao *tipos, int num_tipos,
+                                uint64_t comandos, double segundos) {
+    fprintf(saida, "reprodução: %llu comandos em %.3f s (%.1f comandos/s)\n", (unsigned long long)comandos,
+            segundos, segundos > 0 ? comandos / segundos : 0.0);
+    fprintf(saida, "%-10s %8s %7s %7s %11s %11s %10s %10s %10s %9s %9s\n", "comando", "n", "falhas", "diverg",
+            "gravado_us", "media_us", "p50_us", "p99_us", "max_us", "leit/op", "escr/op");
+    for (int i = 0; i < num_tipos; ++i) {
+        struct estatisticas_reproducao *t = &tipos[i];
+        uint64_t total = 0;
+        for (uint64_t k = 0; k < t->num_amostras; ++k) total += t->amostras[k];
+        qsort(t->amostras, t->num_amostras, sizeof(uint64_t), comparar_latencias);
+        double n = t->num_amostras ? (double)t->num_amostras : 1.0;
+        uint64_t p50 = t->num_amostras ? t->amostras[(t->num_amostras - 1) / 2] : 0;
+        uint64_t p99 = t->num_amostras ? t->amostras[(uint64_t)((t->num_amostras - 1) * 0.99)] : 0;
+        uint64_t max = t->num_amostras ? t->amostras[t->num_amostras - 1] : 0;
+        fprintf(saida, "%-10s %8llu %7llu %7llu %11.1f %11.1f %10.1f %10.1f %10.1f %4.1f/%-4.1f %4.1f/%-4.1f\n",
+                t->nome, (unsigned long long)t->num_amostras, (unsigned long long)t->falhas,
+                (unsigned long long)t->divergencias, t->gravado_total_ns / n / 1e3, total / n / 1e3,
+                p50 / 1e3, p99 / 1e3, max / 1e3,
+                t->es_gravado.leituras / n, t->es_reproducao.leituras / n,
+                t->es_gravado.escritas / n, t->es_reproducao.escritas / n);
+    }
+    fprintf(saida, "(leit/op e escr/op: gravado/reproduzido)\n");
+}
+
+// Reproduz o trace 'caminho' na sessão dada. 'velocidade' multiplica o ritmo gravado
+// (1 = mesmo ritmo, 2 = duas vezes mais rápido); 0 executa sem esperas.
+// O relatório é impresso em 'relatorio'. Retorna 0 se o trace foi reproduzido até o
+// fim (mesmo que comandos tenham falhado), -1 em erro.
+int reproduzir_trace(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt,
+                     struct sessao_shell *sessao, const char *caminho, double velocidade, FILE *relatorio) {
+    FILE *arquivo = fopen(caminho, "rb");
+    if (!arquivo) {
+        perror("trace: Erro ao abrir o trace");
+        return -1;
+    }
+    struct trace_cabecalho cabecalho;
+    if (fread(&cabecalho, sizeof(cabecalho), 1, arquivo) != 1 ||
+        memcmp(cabecalho.magic, TRACE_MAGIC, 4) != 0 || cabecalho.versao != TRACE_VERSAO) {
+        fprintf(erros_comando(), "trace: '%s' não é um trace válido (versão %d)\n", caminho, TRACE_VERSAO);
+        fclose(arquivo);
+        return -1;
+    }
+
+    struct estatisticas_reproducao tipos[TRACE_MAX_TIPOS];
+    int num_tipos = 0;
+    struct registro_trace *r = (struct registro_trace *)malloc(sizeof(struct registro_trace));
+    if (!r) {
+        perror("trace: Erro ao alocar registro");
+        fclose(arquivo);
+        return -1;
+    }
+    uint64_t anterior_ns = 0;
+    uint64_t comandos = 0;
+    int resultado = 0;
+    int sair = 0;
+    uint64_t inicio_reproducao = relogio_ns();
+
+    while (!sair && trace_ler_registro(arquivo, r, &anterior_ns)) {
+        if (velocidade > 0) { // Espera o instante gravado do comando
+            uint64_t alvo = inicio_reproducao + (uint64_t)(r->inicio_ns / velocidade);
+            uint64_t agora = relogio_ns();
+            if (alvo > agora) {
+                struct timespec espera = { (time_t)((alvo - agora) / 1000000000ull), (long)((alvo - agora) % 1000000000ull) };
+                nanosleep(&espera, NULL);
+            }
+        }
+
+        struct estatisticas_reproducao *t = reproducao_tipo(tipos, &num_tipos, r->linha);
+        char linha[TRACE_MAX_LINHA];
+        snprintf(linha, sizeof(linha), "%s", r->linha);
+        struct contadores_es antes = contadores_es;
+        uint64_t inicio = relogio_ns();
+        int status = executar_comando(fd, sb, bgdt, sessao, linha, &sair);
+        uint64_t duracao = relogio_ns() - inicio;
+        comandos++;
+        if (!t) continue; // Linha vazia ou tipos demais: executada, mas não contabilizada
+
+        if (t->num_amostras == t->capacidade) {
+            uint64_t nova = t->capacidade ? t->capacidade * 2 : 256;
+            uint64_t *amostras = (uint64_t *)realloc(t->amostras, nova * sizeof(uint64_t));
+            if (!amostras) {
+                perror("trace: Erro ao alocar amostras");
+                resultado = -1;
+                break;
+            }
+            t->amostras = amostras;
+            t->capacidade = nova;
+        }
+        t->amostras[t->num_amostras++] = duracao;
+        if (status != STATUS_OK) t->falhas++;
+        if ((uint64_t)status != r->status) t->divergencias++;
+        t->gravado_total_ns += r->duracao_ns;
+        somar_es(&t->es_gravado, &r->es);
+        struct contadores_es feito = { contadores_es.leituras - antes.leituras, contadores_es.bytes_lidos - antes.bytes_lidos,
+                                       contadores_es.escritas - antes.escritas, contadores_es.bytes_escritos - antes.bytes_escritos,
+                                       contadores_es.sincronizacoes - antes.sincronizacoes };
+        somar_es(&t->es_reproducao, &feito);
+    }
+    double segundos = (relogio_ns() - inicio_reproducao) / 1e9;
+    fclose(arquivo);
+    free(r);
+
+    if (resultado == 0) reproducao_imprimir(relatorio, tipos, num_tipos, comandos, segundos);
+    for (int i = 0; i < num_tipos; ++i) free(tipos[i].amostras);
+    return resultado;
+}
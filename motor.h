@@ -0,0 +1,640 @@
+/*
+    Motor do ext2shell: estruturas do Ext2 no disco, estado da imagem aberta e funções
+    do sistema de arquivos (E/S, transações, journal, alocadores e comandos), usados pelo
+    shell (main.c), pela biblioteca (ext2lib.c) e pelas ferramentas (bench.c, age.c, mark.c).
+
+    O estado de uma imagem aberta fica em um 'struct motor'. As funções trabalham sobre o
+    motor da thread ('motor_atual'), que é por padrão o único motor do shell e das
+    ferramentas; a biblioteca cria um por ext2_fs e o escolhe a cada chamada.
+*/
+
+#ifndef MOTOR_H
+#define MOTOR_H
+
+#define _POSIX_C_SOURCE 200809L // Para expor S_IFREG e outras macros POSIX
+#define _DEFAULT_SOURCE // Para pwritev
+#define _GNU_SOURCE // Para a trava leitura/escrita com preferência para escritores (modo servidor)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h> // For uint32_t, uint16_t
+#include <string.h> // Para strcmp, strrchr, etc.
+#include <sys/stat.h> // Para S_ISDIR, S_ISREG, etc. (usado na impressão do i_mode)
+#include <time.h>     // Para ctime_r() na formatação de datas
+#include <stddef.h> // Para offsetof
+#include <sys/uio.h> // Para pwritev e struct iovec
+#include <pthread.h> // Para a thread de sincronização periódica
+#include <stdarg.h> // Para os argumentos dos eventos do Perfetto
+#include <sys/socket.h> // Para o modo servidor (socket Unix)
+#include <sys/un.h>
+#include <signal.h>
+#include <poll.h>
+#include <errno.h>
+#include <sched.h> // Para sched_yield (comando_ceder)
+#include <sys/mman.h> // Para o arquivo de somas mapeado em memória
+
+// Estrutura do Superbloco Ext2. Contém informações globais sobre o sistema de arquivos.
+// Todos os valores são armazenados em little-endian no disco.
+struct ext2_super_block {
+    uint32_t s_inodes_count;      // Contagem total de inodes
+    uint32_t s_blocks_count;      // Contagem total de blocos
+    uint32_t s_r_blocks_count;    // Contagem de blocos reservados (para o superusuário)
+    uint32_t s_free_blocks_count; // Contagem de blocos livres
+    uint32_t s_free_inodes_count; // Contagem de inodes livres
+    uint32_t s_first_data_block;  // Primeiro bloco de dados (0 ou 1, dependendo do tamanho do bloco)
+    uint32_t s_log_block_size;    // Tamanho do bloco (log2(tamanho_do_bloco) - 10). Ex: 0 para 1KB.
+    uint32_t s_log_frag_size;     // Tamanho do fragmento (log2(tamanho_do_fragmento) - 10)
+    uint32_t s_blocks_per_group;  // Blocos por grupo
+    uint32_t s_frags_per_group;   // Fragmentos por grupo
+    uint32_t s_inodes_per_group;  // Inodes por grupo
+    uint32_t s_mtime;             // Tempo da última montagem
+    uint32_t s_wtime;             // Tempo da última escrita
+    uint16_t s_mnt_count;         // Contagem de montagens desde a última checagem
+    uint16_t s_max_mnt_count;     // Contagem máxima de montagens antes de forçar checagem
+    uint16_t s_magic;             // Número mágico (0xEF53 para Ext2)
+    uint16_t s_state;             // Estado do sistema de arquivos
+    uint16_t s_errors;            // Comportamento ao detectar erros
+    uint16_t s_minor_rev_level;   // Nível de revisão menor
+    uint32_t s_lastcheck;         // Tempo da última checagem (fsck)
+    uint32_t s_checkinterval;     // Intervalo máximo entre checagens
+    uint32_t s_creator_os;        // SO que criou o sistema de arquivos
+    uint32_t s_rev_level;         // Nível de revisão (0 = antiga, 1 = dinâmica)
+    uint16_t s_def_resuid;        // UID padrão para blocos reservados
+    uint16_t s_def_resgid;        // GID padrão para blocos reservados
+    // Campos estendidos do Superbloco (se s_rev_level >= 1)
+    uint32_t s_first_ino;         // Primeiro inode não reservado
+    uint16_t s_inode_size;        // Tamanho da estrutura do inode
+    uint16_t s_block_group_nr;    // Número do grupo de blocos desta cópia do superbloco
+    uint32_t s_feature_compat;    // Conjunto de funcionalidades compatíveis
+    uint32_t s_feature_incompat;  // Conjunto de funcionalidades incompatíveis
+    uint32_t s_feature_ro_compat; // Conjunto de funcionalidades somente leitura
+    uint8_t  s_uuid[16];          // UUID (identificador único universal) do volume
+    char     s_volume_name[16];   // Nome do volume
+    char     s_last_mounted[64];  // Diretório onde foi montado pela última vez
+    uint32_t s_algo_bitmap;       // Bitmap de algoritmos de compressão (uso varia)
+    uint8_t  s_prealloc_blocks;      // Blocos a pré-alocar para arquivos
+    uint8_t  s_prealloc_dir_blocks;  // Blocos a pré-alocar para diretórios
+    uint16_t s_reserved_gdt_blocks;  // Blocos reservados para o crescimento da BGDT
+    uint8_t  s_journal_uuid[16];     // UUID do journal (ext3)
+    uint32_t s_journal_inum;         // Inode do journal (ext3)
+    uint32_t s_journal_dev;          // Dispositivo do journal externo (ext3)
+    uint32_t s_last_orphan;          // Primeiro inode da lista de órfãos (ver "Órfãos")
+};
+
+// Estrutura do Descritor de Grupo de Blocos (Block Group Descriptor).
+// Descreve as características de cada grupo de blocos.
+struct ext2_group_desc {
+    uint32_t bg_block_bitmap;        // Bloco do bitmap de blocos (indica blocos livres/usados)
+    uint32_t bg_inode_bitmap;        // Bloco do bitmap de inodes (indica inodes livres/usados)
+    uint32_t bg_inode_table;         // Bloco do início da tabela de inodes
+    uint16_t bg_free_blocks_count;   // Contagem de blocos livres neste grupo
+    uint16_t bg_free_inodes_count;   // Contagem de inodes livres neste grupo
+    uint16_t bg_used_dirs_count;     // Contagem de diretórios neste grupo
+    uint16_t bg_pad;                 // Alinhamento (não usado, para preenchimento)
+    uint32_t bg_reserved[3];         // Reservado
+};
+
+// Estrutura do Inode (índice de nó). Contém metadados sobre um arquivo ou diretório.
+struct ext2_inode {
+    uint16_t i_mode;        // Tipo de arquivo e permissões
+    uint16_t i_uid;         // ID do usuário (UID) proprietário
+    uint32_t i_size;        // Tamanho do arquivo em bytes
+    uint32_t i_atime;       // Tempo do último acesso (access time)
+    uint32_t i_ctime;       // Tempo de criação do inode (creation time)
+    uint32_t i_mtime;       // Tempo da última modificação do arquivo (modification time)
+    uint32_t i_dtime;       // Tempo de deleção (deletion time)
+    uint16_t i_gid;         // ID do grupo (GID) proprietário
+    uint16_t i_links_count; // Contagem de links (hard links) para este inode
+    uint32_t i_blocks;      // Número de blocos de 512 bytes alocados (não blocos do FS!)
+    uint32_t i_flags;       // Flags do inode (ex: imutável, somente append)
+    uint32_t i_osd1;        // Dependente do OS 1 (geralmente para Linux, salva geração de arquivo ou ACL)
+    uint32_t i_block[15];   // Ponteiros para os blocos de dados:
+                            // 12 diretos, 1 indireto, 1 duplo indireto, 1 triplo indireto
+    uint32_t i_generation;  // Número de geração do arquivo (para NFS)
+    uint32_t i_file_acl;    // ACL do arquivo (obsoleto ou usado para ACLs estendidas)
+    uint32_t i_dir_acl;     // ACL do diretório (ou 32 bits superiores do tamanho do arquivo se i_mode for arquivo regular)
+    uint32_t i_faddr;       // Endereço do fragmento (obsoleto)
+    uint8_t  i_osd2[12];    // Dependente do OS 2
+};
+
+// Estrutura de uma Entrada de Diretório. Linka um nome a um inode.
+// Inclui o tipo do arquivo para evitar leitura do inode para `ls -F`.
+struct ext2_dir_entry_2 {
+    uint32_t inode;         // Número do Inode (0 se a entrada não for usada ou for vazia)
+    uint16_t rec_len;       // Comprimento total desta entrada (incluindo todos os campos e o nome)
+    uint8_t  name_len;      // Comprimento do nome em bytes
+    uint8_t  file_type;     // Tipo do arquivo (ver EXT2_FT_* abaixo)
+    char name[255 + 1];     // Nome do arquivo (255 é EXT2_NAME_LEN, +1 para terminador null)
+};
+
+// Constantes para 'file_type' em 'ext2_dir_entry_2' (baseadas em include/linux/ext2_fs.h)
+#define EXT2_FT_UNKNOWN  0 // Tipo desconhecido
+#define EXT2_FT_REG_FILE 1 // Arquivo regular
+#define EXT2_FT_DIR      2 // Diretório
+#define EXT2_FT_CHRDEV   3 // Dispositivo de caractere
+#define EXT2_FT_BLKDEV   4 // Dispositivo de bloco
+#define EXT2_FT_FIFO     5 // FIFO (pipe nomeado)
+#define EXT2_FT_SOCK     6 // Socket
+#define EXT2_FT_SYMLINK  7 // Link simbólico
+#define EXT2_FT_MAX      8 // Usado para validação de tipo
+
+#define EXT2_NAME_LEN 255 // Comprimento máximo do nome de arquivo em uma entrada de diretório
+
+#define EXT2_ROOT_INO 2 // O Inode do diretório raiz é sempre 2
+
+#define SUPERBLOCK_OFFSET 1024 // O superbloco começa em 1024 bytes do início da imagem
+#define EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER 0x0001
+#define EXT2_SUPER_MAGIC 0xEF53
+
+// Tamanhos de bloco suportados: 1, 2 e 4 KiB (s_log_block_size de 0 a 2).
+#define EXT2_MIN_LOG_BLOCO 10
+#define EXT2_MAX_LOG_BLOCO 12
+#define BLOCK_SIZE_MAX (1 << EXT2_MAX_LOG_BLOCO) // Tamanho dos buffers de bloco
+
+// Constantes para 's_rev_level' e tamanho do inode (para clareza e compatibilidade)
+#define EXT2_GOOD_OLD_REV 0      // Nível de revisão original (inode_size = 128)
+#define EXT2_DYNAMIC_REV  1      // Nível de revisão dinâmico (inode_size variável, >128)
+#define EXT2_GOOD_OLD_INODE_SIZE 128 // Tamanho padrão do inode para EXT2_GOOD_OLD_REV
+
+#define EXT2_N_BLOCKS 15  // Número total de ponteiros de bloco em um inode (12 diretos + 3 indiretos)
+
+// Geometria da imagem aberta, calculada do superbloco por geometria_configurar.
+// Tudo que os caminhos quentes precisam (offsets de blocos e inodes, grupo de um
+// inode ou bloco, caminho no bmap) é deslocamento, máscara ou multiplicação pelo
+// inverso: nenhuma divisão.
+struct geometria {
+    uint32_t tamanho_bloco;            // 1024, 2048 ou 4096 bytes
+    uint32_t log_bloco;                // log2(tamanho_bloco)
+    uint32_t log_ponteiros;            // log2(ponteiros em um bloco indireto)
+    uint32_t log_inode;                // log2(tamanho do inode no disco)
+    uint32_t primeiro_bloco_dados;     // s_first_data_block (1 com blocos de 1 KiB, senão 0)
+    uint32_t inodes_por_grupo;
+    uint32_t blocos_por_grupo;
+    uint64_t inverso_inodes_por_grupo; // ceil(2^64 / inodes_por_grupo), ver dividir_por_inverso
+    uint64_t inverso_blocos_por_grupo;
+    off_t offset_descritores;          // Início da tabela de descritores (bloco após o superbloco)
+};
+
+// Tabela de descritores de grupo (BGDT), carregada sob demanda em pedaços de um bloco
+// (ver read_block_group_descriptor_table). As contagens de livres de cada grupo ficam
+// também em vetores separados (struct-of-arrays), para que a procura por um grupo com
+// espaço livre percorra 2 bytes por grupo em vez do descritor inteiro.
+#define RESUMO_DESCONHECIDO UINT16_MAX // Grupo de um pedaço ainda não carregado
+#define PEDACO_CARREGADO 1
+#define PEDACO_ALTERADO 2              // Alterado desde a abertura: as cópias de segurança estão atrasadas
+
+struct descritores {
+    int fd;
+    struct ext2_group_desc *tabela;  // Um descritor por grupo; só os pedaços carregados têm conteúdo
+    uint32_t num_grupos;
+    uint32_t num_pedacos;
+    uint32_t log_por_pedaco;         // log2(descritores por bloco)
+    uint32_t num_blocos;             // s_blocks_count, para validar os descritores lidos
+    int sparse_super;                // Cópias de segurança só nos grupos 0, 1 e potências de 3, 5 e 7
+    uint8_t *pedaco_carregado;       // PEDACO_CARREGADO ou PEDACO_ALTERADO (a gravar nas cópias)
+    uint16_t *blocos_livres;         // bg_free_blocks_count de cada grupo (ou RESUMO_DESCONHECIDO)
+    uint16_t *inodes_livres;         // bg_free_inodes_count de cada grupo (ou RESUMO_DESCONHECIDO)
+    pthread_mutex_t mutex;           // Serializa o carregamento dos pedaços
+};
+
+// Bloco sujo mantido por uma transação. O conteúdo fica na área 'dados' da transação,
+// no espaço 'slot' (de BLOCK_SIZE bytes), que acompanha o bloco quando o vetor é ordenado.
+struct bloco_transacao {
+    uint32_t numero;                 // Número do bloco na imagem
+    uint32_t slot;                   // Posição do conteúdo em 'dados'
+};
+
+// Conjunto de blocos sujos indexado pelo número do bloco.
+struct transacao {
+    int aninhamento;                 // >0 enquanto a transação está aberta (begin/commit aninhados)
+    struct bloco_transacao *blocos;  // Blocos sujos, na ordem em que foram tocados
+    char *dados;                     // 'capacidade' espaços de BLOCK_SIZE bytes (tamanho da imagem aberta)
+    uint32_t num_blocos;
+    uint32_t capacidade;
+    uint32_t *tabela;                // Tabela hash (endereçamento aberto): índice em 'blocos' + 1, 0 = vazio
+    uint32_t tabela_cap;             // Potência de 2
+};
+
+// Estado do journal de metadados (arquivo auxiliar "<imagem>.journal").
+struct journal {
+    int fd;                          // -1 quando o journal está desativado
+    uint64_t sequencia;              // Número da próxima transação registrada
+    off_t tamanho;                   // Bytes atualmente no arquivo do journal
+    uint32_t transacoes_pendentes;   // Transações registradas desde o último commit de grupo
+    uint32_t grupo_max;              // Transações por commit de grupo (um fdatasync por grupo)
+    uint8_t uuid[16];                // s_uuid da imagem, gravado em cada registro
+    uint32_t blocos_imagem;          // s_blocks_count da imagem, idem
+};
+
+// Somas (CRC32C) dos blocos da imagem, no arquivo "<imagem>.crc" (ver somas_abrir).
+struct somas_blocos {
+    int fd;                          // -1 quando a imagem não tem somas
+    struct somas_cabecalho *cabecalho; // Arquivo inteiro, mapeado
+    uint32_t *somas;                 // Logo após o cabeçalho
+    size_t tamanho;                  // Bytes mapeados
+    int desatualizado;               // 1 = sessão anterior interrompida ou imagem alterada por fora
+    int invalido;                    // 1 = o arquivo existe, mas não corresponde à imagem (não aberto)
+    char caminho[4096];
+};
+
+// Política de durabilidade (ver durabilidade_iniciar).
+enum modo_durabilidade {
+    DURABILIDADE_NENHUMA = 0,
+    DURABILIDADE_COMANDO,
+    DURABILIDADE_PERIODICA
+};
+
+struct durabilidade {
+    enum modo_durabilidade modo;
+    unsigned long intervalo_ms;      // Intervalo da política periódica
+    int fd;                          // Imagem sincronizada pela thread
+    pthread_rwlock_t trava;          // Compartilhada pelos comandos de leitura; exclusiva para os demais e as sincronizações
+    pthread_mutex_t mutex;           // Protege 'parar' (espera da thread)
+    pthread_cond_t cond;             // Acorda a thread para encerrar
+    pthread_t thread;
+    int thread_ativa;
+    int parar;
+    // Estatísticas de latência das sincronizações (nanossegundos).
+    uint64_t num_sincronizacoes;
+    uint64_t latencia_total_ns;
+    uint64_t latencia_min_ns;
+    uint64_t latencia_max_ns;
+};
+
+// Índice de extensões livres (ver construir_indice_livre). Os nós ficam em motor.c.
+struct extensao_livre;
+struct indice_extensoes_livres {
+    struct extensao_livre *raiz[2];    // Raízes das árvores (ARVORE_OFFSET e ARVORE_TAMANHO)
+    uint32_t num_extensoes;            // Quantidade de extensões no índice
+    uint32_t blocos_livres;            // Soma dos tamanhos das extensões
+    int construido;                    // 1 se o índice foi construído a partir dos bitmaps
+};
+
+// Blocos liberados que ainda não voltaram ao índice de extensões livres, porque a
+// liberação ainda não é durável (ver liberacao_registrar).
+struct liberacao_pendente {
+    uint32_t inicio;
+    uint32_t quantidade;
+};
+
+struct liberacoes_pendentes {
+    struct liberacao_pendente *itens;
+    size_t tamanho;
+    size_t capacidade;
+    size_t confirmadas;                // itens[0, confirmadas): de transações já confirmadas
+};
+
+#define MAPAS_DIRETORIOS 256 // Entradas da tabela de mapas (potência de 2)
+
+struct mapa_diretorio {
+    uint32_t inode;          // 0 = entrada vazia
+    uint32_t num_blocos;     // Blocos lógicos do diretório (i_size / tamanho do bloco)
+    uint32_t capacidade;
+    uint32_t melhor;         // Bloco lógico com o maior buraco
+    uint16_t *maior_buraco;  // Maior buraco (bytes) de cada bloco lógico
+};
+
+// Thread que recolhe os blocos dos órfãos (ver recolhedor_iniciar).
+struct recolhedor {
+    int fd;
+    struct ext2_super_block *sb;
+    struct ext2_group_desc *bgdt;
+    pthread_mutex_t mutex;  // Protege 'pendente' e 'parar'
+    pthread_cond_t cond;    // Acorda a thread (novo órfão ou encerramento)
+    pthread_t thread;
+    int ativo;
+    int pendente;           // Há órfãos a recolher
+    int parar;
+};
+
+// Estado de uma imagem aberta. O shell e as ferramentas usam um só motor; a biblioteca
+// cria um por ext2_fs, de modo que várias imagens podem estar abertas ao mesmo tempo.
+struct motor {
+    struct geometria geometria;
+    struct descritores descritores;
+
+    // Escrita adiada de metadados. Quando ativa, write_superblock e write_group_descriptor
+    // apenas marcam o superbloco/descritores como sujos; gravar_metadados_adiados() grava
+    // tudo uma única vez (por exemplo, ao final de um script). A cópia em memória do
+    // superbloco e da BGDT é a referência durante a sessão, então adiar é seguro.
+    int metadados_adiados;
+    int superbloco_sujo;
+    int descritores_sujos;                   // 1 se há descritores pendentes
+    uint32_t descritor_sujo_min, descritor_sujo_max; // Faixa de grupos pendentes
+
+    struct transacao transacao_atual;   // Transação do comando (ou lote) em andamento
+    struct transacao journal_pendentes; // Blocos já no journal, ainda não gravados na imagem
+    int escritas_nao_sincronizadas;     // 1 se houve gravação na imagem desde o último fdatasync
+    struct journal journal;
+    struct somas_blocos somas_blocos;
+    struct durabilidade durabilidade;
+
+    struct indice_extensoes_livres indice_livre;
+    struct liberacoes_pendentes liberacoes;
+    struct mapa_diretorio mapas_diretorios[MAPAS_DIRETORIOS];
+    struct recolhedor recolhedor;
+};
+
+// Motor usado pelas funções chamadas nesta thread. As threads criadas pelo motor
+// (durabilidade, recolhedor e trabalhadores) recebem o motor de quem as criou.
+extern __thread struct motor *motor_atual;
+
+struct motor *motor_criar(void);
+void motor_destruir(struct motor *motor);
+
+#define BLOCK_SIZE (motor_atual->geometria.tamanho_bloco)
+#define PONTEIROS_POR_BLOCO_MAX (BLOCK_SIZE_MAX / sizeof(uint32_t)) // Tamanho dos buffers de ponteiros
+
+// Quociente n / d para n e d de 32 bits (d >= 2), com inverso = ceil(2^64 / d):
+// a parte alta do produto de 128 bits é exata (Lemire, "Faster remainder by direct
+// computation", 2019).
+static inline uint32_t dividir_por_inverso(uint32_t n, uint64_t inverso) {
+    return (uint32_t)(((unsigned __int128)inverso * n) >> 64);
+}
+
+// Grupo de blocos do inode 'inode_num' e sua posição dentro do grupo.
+static inline uint32_t grupo_do_inode(uint32_t inode_num, uint32_t *indice_no_grupo) {
+    uint32_t grupo = dividir_por_inverso(inode_num - 1, motor_atual->geometria.inverso_inodes_por_grupo);
+    if (indice_no_grupo) *indice_no_grupo = inode_num - 1 - grupo * motor_atual->geometria.inodes_por_grupo;
+    return grupo;
+}
+
+// Grupo de blocos do bloco 'bloco' e sua posição (bit) dentro do grupo.
+static inline uint32_t grupo_do_bloco(uint32_t bloco, uint32_t *indice_no_grupo) {
+    uint32_t relativo = bloco - motor_atual->geometria.primeiro_bloco_dados;
+    uint32_t grupo = dividir_por_inverso(relativo, motor_atual->geometria.inverso_blocos_por_grupo);
+    if (indice_no_grupo) *indice_no_grupo = relativo - grupo * motor_atual->geometria.blocos_por_grupo;
+    return grupo;
+}
+
+static inline off_t offset_do_bloco(uint32_t bloco) {
+    return (off_t)bloco << motor_atual->geometria.log_bloco;
+}
+
+// Número de grupos de blocos: os blocos a partir de s_first_data_block divididos em grupos
+// de s_blocks_per_group (o último pode ser menor).
+static inline uint32_t numero_de_grupos(const struct ext2_super_block *sb) {
+    return (sb->s_blocks_count - sb->s_first_data_block + sb->s_blocks_per_group - 1) / sb->s_blocks_per_group;
+}
+
+int descritores_carregar_pedaco(uint32_t pedaco);
+
+// Descritor do grupo 'grupo', lendo do disco o pedaço da BGDT que o contém se preciso.
+static inline struct ext2_group_desc *descritor_grupo(const struct ext2_group_desc *bgdt, uint32_t grupo) {
+    if (bgdt == motor_atual->descritores.tabela && grupo < motor_atual->descritores.num_grupos) {
+        uint32_t pedaco = grupo >> motor_atual->descritores.log_por_pedaco;
+        if (!__atomic_load_n(&motor_atual->descritores.pedaco_carregado[pedaco], __ATOMIC_ACQUIRE)) {
+            descritores_carregar_pedaco(pedaco);
+        }
+    }
+    return (struct ext2_group_desc *)&bgdt[grupo];
+}
+
+// Atualiza o resumo de livres do grupo 'grupo' a partir do seu descritor.
+static inline void descritores_resumir(uint32_t grupo, const struct ext2_group_desc *desc) {
+    if (grupo >= motor_atual->descritores.num_grupos) return;
+    motor_atual->descritores.blocos_livres[grupo] = desc->bg_free_blocks_count;
+    motor_atual->descritores.inodes_livres[grupo] = desc->bg_free_inodes_count;
+}
+
+// Offset do inode 'inode_num' (a partir de 1) na tabela de inodes do seu grupo.
+static inline off_t offset_do_inode(const struct ext2_group_desc *bgdt, uint32_t inode_num) {
+    uint32_t indice;
+    uint32_t grupo = grupo_do_inode(inode_num, &indice);
+    return offset_do_bloco(descritor_grupo(bgdt, grupo)->bg_inode_table) + ((off_t)indice << motor_atual->geometria.log_inode);
+}
+
+// Conteúdo do bloco de índice 'indice' em 'blocos'.
+static inline char *transacao_dados(const struct transacao *t, int64_t indice) {
+    return t->dados + ((size_t)t->blocos[indice].slot << motor_atual->geometria.log_bloco);
+}
+
+// Quando 0 (modo batch/script), suprime mensagens de diagnóstico que não fazem parte
+// da saída dos comandos (leitura do superbloco/BGDT, inode raiz ao sair, etc.).
+extern int modo_verboso;
+
+// Saída dos comandos. No modo servidor cada thread de cliente aponta 'saida_cliente' para
+// a sua conexão, e tanto a saída normal quanto as mensagens de erro dos comandos que ela
+// executa vão para o cliente; nos demais modos são stdout e stderr.
+extern __thread FILE *saida_cliente;
+
+static inline FILE *saida_comando(void) {
+    return saida_cliente ? saida_cliente : stdout;
+}
+
+static inline FILE *erros_comando(void) {
+    return saida_cliente ? saida_cliente : stderr;
+}
+
+// Contadores das chamadas de sistema de E/S feitas na imagem e no journal (usados pelos
+// benchmarks, pelo trace e pelo comando 'stats' para medir quantas chamadas e quantos
+// bytes cada operação custa). São por thread: as sincronizações da thread periódica
+// não entram na conta dos comandos.
+struct contadores_es {
+    uint64_t leituras;        // Chamadas pread
+    uint64_t bytes_lidos;
+    uint64_t escritas;        // Chamadas pwrite/pwritev
+    uint64_t bytes_escritos;
+    uint64_t sincronizacoes;  // Chamadas fdatasync
+};
+
+extern __thread struct contadores_es contadores_es;
+
+#ifndef EXT2_SEM_ESTATISTICAS
+#define ESTATISTICAS_ATIVAS 1
+#define ESTAT(expr) do { expr; } while (0)
+#else
+#define ESTATISTICAS_ATIVAS 0
+#define ESTAT(expr) do { } while (0)
+#endif
+
+#define ESTAT_MAX_COMANDOS 32 // Comandos distintos com histograma próprio
+#define ESTAT_FAIXAS 40       // Faixas [2^i, 2^(i+1)) ns do histograma de tempo
+
+// Tipos de bloco lidos pelo sistema de arquivos (ver ler_bloco).
+enum tipo_bloco {
+    BLOCO_METADADOS = 0,      // Superbloco e tabela de descritores
+    BLOCO_BITMAP,
+    BLOCO_TABELA_INODES,
+    BLOCO_DIRETORIO,
+    BLOCO_INDIRETO,
+    BLOCO_DADOS,
+    NUM_TIPOS_BLOCO
+};
+
+struct estatisticas_alocador {
+    uint64_t alocacoes;
+    uint64_t passos;          // Bits ou extensões examinados, somados
+    uint64_t max_passos;      // Maior número de passos de uma única alocação
+    uint64_t passos_atual;    // Passos da procura em andamento (índice de extensões)
+};
+
+struct estatisticas_comando {
+    char nome[16];
+    uint64_t execucoes;
+    uint64_t falhas;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t histograma[ESTAT_FAIXAS];
+};
+
+// 'estatisticas' guarda o que a thread contou e ainda não passou para o total do
+// processo (ver estatisticas_recolher em motor.c).
+struct estatisticas {
+    struct contadores_es es;        // E/S somada (só no total do processo)
+    uint64_t blocos_lidos[NUM_TIPOS_BLOCO];
+    struct estatisticas_alocador alocador_inodes;
+    struct estatisticas_alocador alocador_blocos;
+    struct estatisticas_comando comandos[ESTAT_MAX_COMANDOS];
+    int num_comandos;
+};
+
+extern __thread struct estatisticas estatisticas;
+
+// Métricas de fragmentação (ver medir_fragmentacao).
+struct metricas_fragmentacao {
+    uint64_t arquivos;               // Arquivos regulares com pelo menos um bloco
+    uint64_t arquivos_vazios;        // Arquivos regulares sem blocos
+    uint64_t arquivos_fragmentados;  // Arquivos com mais de uma extensão
+    uint64_t blocos_arquivos;        // Blocos de dados de arquivos (sem os indiretos)
+    uint64_t extensoes;              // Sequências de blocos fisicamente contíguos
+    uint64_t max_extensoes;          // Maior número de extensões em um arquivo
+    uint64_t pares_contiguos;        // Pares de blocos lógicos vizinhos também vizinhos no disco
+    uint64_t pares_total;            // Pares de blocos lógicos vizinhos
+    uint64_t diretorios;
+    uint64_t bytes_diretorios;       // Bytes nos blocos de diretório
+    uint64_t bytes_entradas_vivas;   // Bytes efetivamente usados por entradas em uso
+    uint64_t entradas_vivas;
+    uint64_t entradas_mortas;        // Entradas com inode 0 (buracos deixados por remoções)
+    uint64_t bytes_entradas_mortas;
+    uint64_t blocos_livres;
+    uint64_t extensoes_livres;       // Sequências de blocos livres (dentro de cada grupo)
+    uint64_t maior_extensao_livre;
+};
+
+// Parâmetros do mkfs. Campos com 0 usam o valor padrão.
+struct parametros_mkfs {
+    uint64_t tamanho_bytes;       // Tamanho da imagem (ignorado se num_grupos != 0)
+    uint32_t num_grupos;          // Quantidade de grupos de blocos
+    uint32_t inodes_por_grupo;    // Padrão: um inode a cada 4 KiB
+    uint16_t tamanho_inode;       // 128 (padrão) ou potência de 2 até o tamanho do bloco
+    uint32_t tamanho_bloco;       // 1024 (padrão), 2048 ou 4096
+};
+
+// Estado de uma sessão do shell: diretório de trabalho atual.
+struct sessao_shell {
+    uint32_t diretorio_atual_inode;  // Inode do diretório atual
+    char diretorio_atual[1024];      // Caminho do diretório atual (para o prompt e 'pwd')
+};
+
+// Códigos de saída dos comandos (seguem a convenção dos shells).
+#define STATUS_OK               0
+#define STATUS_ERRO             1   // O comando falhou
+#define STATUS_USO              2   // Argumentos inválidos
+#define STATUS_DESCONHECIDO     127 // Comando inexistente
+
+extern const char *nomes_durabilidade[];
+extern int modo_servidor; // 1 quando os comandos vêm de clientes do socket (ver servidor_executar)
+extern const char *comandos_leitura[]; // Comandos que só leem a imagem (ver executar_comando)
+
+// ---------------------------------------------------------------------------
+// Funções do motor usadas pelo shell, pela biblioteca e pelas ferramentas (a
+// documentação de cada uma está na definição, em motor.c).
+// ---------------------------------------------------------------------------
+
+// Instrumentação.
+int estatisticas_gravar_json(const char *caminho);
+uint64_t relogio_ns(void);
+int eventos_abrir(const char *caminho);
+int eventos_fechar(void);
+
+// E/S e transações.
+ssize_t dev_pread(int fd, void *buffer, size_t tamanho, off_t offset);
+int64_t transacao_procurar(const struct transacao *t, uint32_t numero);
+void transacao_iniciar(void);
+int transacao_confirmar(int fd);
+void liberar_transacoes(void);
+
+// Journal e somas dos blocos.
+int journal_recuperar(int fd, const char *caminho_imagem, const struct ext2_super_block *sb);
+int journal_abrir(const char *caminho_imagem, uint32_t grupo_max, const struct ext2_super_block *sb);
+int journal_fechar(int fd);
+int somas_abrir(int fd, const char *caminho_imagem, const struct ext2_super_block *sb);
+int somas_fechar(int fd);
+
+// Durabilidade e trava do sistema de arquivos.
+int durabilidade_modo_por_nome(const char *nome, enum modo_durabilidade *modo);
+void durabilidade_bloquear(void);
+void durabilidade_bloquear_leitura(void);
+void durabilidade_desbloquear(void);
+int durabilidade_sincronizar(int fd);
+int durabilidade_iniciar(int fd, enum modo_durabilidade modo, unsigned long intervalo_ms);
+int durabilidade_apos_comando(int fd);
+int durabilidade_encerrar(int fd);
+void durabilidade_imprimir_estatisticas(FILE *saida);
+
+// Superbloco, descritores, inodes e blocos.
+int read_superblock(const char *device_path, struct ext2_super_block *sb);
+struct ext2_group_desc *read_block_group_descriptor_table(int fd, const struct ext2_super_block *sb,
+                                                          unsigned int *num_block_groups_out);
+void liberar_descritores(void);
+int gravar_metadados_adiados(int fd, const struct ext2_super_block *sb, const struct ext2_group_desc *bgdt);
+int descritores_gravar_copias(int fd);
+int read_inode(int fd, const struct ext2_super_block *sb, const struct ext2_group_desc *bgdt,
+               uint32_t inode_num, struct ext2_inode *inode_out);
+int ler_bloco(int fd, uint32_t block_num, char *buffer, enum tipo_bloco tipo);
+uint32_t bmap_ler(int fd, const struct ext2_inode *inode, uint32_t logico);
+
+// Diretórios e caminhos.
+uint32_t dir_lookup(int fd, const struct ext2_super_block *sb, const struct ext2_group_desc *bgdt,
+                    uint32_t dir_inode_num, const char *name_to_find, uint8_t *found_file_type);
+uint32_t path_to_inode_number(int fd, const struct ext2_super_block *sb, const struct ext2_group_desc *bgdt,
+                              uint32_t base_inode_num, const char *path_str, uint8_t *resolved_final_type);
+char *read_file_data(int fd, const struct ext2_super_block *sb, const struct ext2_group_desc *bgdt,
+                     const struct ext2_inode *file_inode, uint32_t *file_size_out);
+
+// Alocação e índices em memória.
+int construir_indice_livre(int fd, const struct ext2_super_block *sb, const struct ext2_group_desc *bgdt);
+void liberar_indice_livre(void);
+void liberar_mapas_diretorios(void);
+uint32_t allocate_data_block(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt);
+void deallocate_data_block(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt, uint32_t block_num);
+
+// Comandos e alterações.
+int comando_touch(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt,
+                  uint32_t diretorio_atual_inode_num, char *diretorio_atual_str, const char *path_alvo);
+int comando_mkdir(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt,
+                  uint32_t diretorio_atual_inode_num, char *diretorio_atual_str, const char *path_alvo);
+int comando_rm(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt,
+               uint32_t diretorio_atual_inode_num, const char *path_alvo);
+int comando_rmdir(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt,
+                  uint32_t diretorio_atual_inode_num, const char *path_alvo);
+int comando_mv(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt,
+               uint32_t diretorio_atual_inode_num, const char *path_origem, const char *path_destino);
+int comando_cp(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt,
+               uint32_t diretorio_atual_inode_num, const char *path_origem, const char *path_destino);
+int anexar_ao_arquivo(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt,
+                      uint32_t inode_num, struct ext2_inode *inode, const char *dados, uint32_t tamanho);
+int medir_fragmentacao(int fd, const struct ext2_super_block *sb, const struct ext2_group_desc *bgdt,
+                       struct metricas_fragmentacao *m);
+
+// Órfãos.
+int orfaos_concluir(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt);
+int recolhedor_iniciar(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt);
+void recolhedor_encerrar(void);
+
+// Criação e cópia de imagens.
+int criar_sistema_de_arquivos(const char *caminho, const struct parametros_mkfs *parametros);
+int copiar_imagem(const char *origem, const char *destino);
+
+// Shell: comandos, trace e reprodução.
+int executar_comando(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt,
+                     struct sessao_shell *sessao, char *linha, int *sair);
+int trace_abrir(const char *caminho);
+int trace_fechar(void);
+int reproduzir_trace(int fd, struct ext2_super_block *sb, struct ext2_group_desc *bgdt,
+                     struct sessao_shell *sessao, const char *caminho, double velocidade, FILE *relatorio);
+
+#endif // MOTOR_H